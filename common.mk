@@ -47,3 +47,7 @@ include $(MKFILES_ROOT)/qtargets.mk
 # Make optimized binary
 optimized: CCFLAGS += $(OPTIMIZATION)
 optimized: all
+
+# Make optimized binary with tracepoints on the hot path (see src/trace.h)
+traced: CCFLAGS += $(OPTIMIZATION) -DPACKAGER_TRACE
+traced: all
@@ -0,0 +1,82 @@
+/**
+ * @file arena.c
+ * @brief Contains the definitions for allocating subsystem buffers from the startup arena.
+ */
+#include "arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * Initializes an empty arena over memory owned by the caller.
+ * @param a The arena to initialize.
+ * @param memory The memory to allocate from, aligned to ARENA_ALIGN.
+ * @param size The size of the memory in bytes.
+ */
+void arena_init(Arena *a, void *memory, const size_t size) {
+    memset(a, 0, sizeof(*a));
+    a->base = memory;
+    a->size = size;
+}
+
+/**
+ * Maps anonymous memory for an empty arena.
+ * @param a The arena to open.
+ * @param size The size of the arena in bytes.
+ * @return True if the memory was mapped, false otherwise, in which case the arena is empty and refuses allocations.
+ */
+bool arena_open(Arena *a, const size_t size) {
+    arena_init(a, NULL, 0);
+    if (size == 0) return true;
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) return false;
+    arena_init(a, map, size);
+    a->mapped = true;
+    return true;
+}
+
+/**
+ * Allocates zeroed memory from an arena and counts it towards a subsystem.
+ * @param a The arena.
+ * @param bytes The size of the allocation in bytes.
+ * @param owner The name of the subsystem allocating. Must outlive the arena.
+ * @return The memory, aligned to ARENA_ALIGN, or NULL if the arena is sealed or has no room left.
+ */
+void *arena_alloc(Arena *a, const size_t bytes, const char *owner) {
+    const size_t room = arena_round(bytes);
+    if (a->sealed || room > a->size - a->used) {
+        a->refused++;
+        return NULL;
+    }
+
+    uint8_t i = 0;
+    while (i < a->n_owners && strcmp(a->owners[i].name, owner)) i++;
+    if (i == a->n_owners && a->n_owners < ARENA_OWNERS) a->owners[a->n_owners++].name = owner;
+    if (i < a->n_owners) {
+        a->owners[i].bytes += room;
+        a->owners[i].allocations++;
+    }
+
+    void *p = a->base + a->used;
+    a->used += room;
+    memset(p, 0, room); // Also faults the pages in now rather than on first use
+    return p;
+}
+
+/**
+ * Ends startup, after which every allocation from the arena is refused.
+ * @param a The arena.
+ */
+void arena_seal(Arena *a) { a->sealed = true; }
+
+/**
+ * Releases the memory of an arena mapped by arena_open. Everything allocated from it becomes invalid.
+ * @param a The arena.
+ */
+void arena_close(Arena *a) {
+    if (a->mapped) munmap(a->base, a->size);
+    arena_init(a, NULL, 0);
+}
@@ -0,0 +1,66 @@
+/**
+ * @file arena.h
+ * @brief Bump allocator that the buffers of every packager subsystem are carved from at startup.
+ *
+ * The arena is sized once from the configuration, before any input is read, so the memory footprint of packager is
+ * known up front and never grows. Buffers are only allocated while starting up; the arena is then sealed, after which
+ * any allocation is refused and counted, so steady-state operation cannot allocate.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The alignment of every allocation in bytes. */
+#define ARENA_ALIGN 16
+
+/** The most subsystems that usage is reported for. */
+#define ARENA_OWNERS 8
+
+/** The memory a subsystem allocated from the arena. */
+typedef struct {
+    /** The name of the subsystem. */
+    const char *name;
+    /** The number of bytes allocated, including alignment padding. */
+    size_t bytes;
+    /** The number of allocations. */
+    uint32_t allocations;
+} ArenaOwner;
+
+/** An arena. */
+typedef struct {
+    /** The memory of the arena. */
+    uint8_t *base;
+    /** The size of the arena in bytes. */
+    size_t size;
+    /** The number of bytes allocated. */
+    size_t used;
+    /** Whether the memory was mapped by arena_open, and must be unmapped by arena_close. */
+    bool mapped;
+    /** Whether startup has finished and allocations are refused. */
+    bool sealed;
+    /** The number of allocations refused for lack of room or because the arena was sealed. */
+    uint32_t refused;
+    /** The memory allocated by each subsystem, in the order they first allocated. */
+    ArenaOwner owners[ARENA_OWNERS];
+    /** The number of subsystems that allocated. */
+    uint8_t n_owners;
+} Arena;
+
+/**
+ * Gets the room an allocation takes up in an arena.
+ * @param bytes The size of the allocation in bytes.
+ * @return The size rounded up to the alignment of allocations.
+ */
+static inline size_t arena_round(const size_t bytes) { return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); }
+
+void arena_init(Arena *a, void *memory, const size_t size);
+bool arena_open(Arena *a, const size_t size);
+void *arena_alloc(Arena *a, const size_t bytes, const char *owner);
+void arena_seal(Arena *a);
+void arena_close(Arena *a);
+
+#endif // _ARENA_H_
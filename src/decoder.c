@@ -0,0 +1,138 @@
+/**
+ * @file decoder.c
+ * @brief Contains the definitions for validating received packets, iterating over their blocks and decoding blocks
+ * back into input messages.
+ */
+#include "decoder.h"
+#include "encoder.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/** The input message tag of each data block sub-type, or 0xFF if the sub-type is not a sensor reading. */
+static const uint8_t subtype_tags[] = {
+    [DATA_DBG_MSG] = 0xFF,
+    [DATA_ALT_SEA] = TAG_ALTITUDE_SEA,
+    [DATA_ALT_LAUNCH] = TAG_ALTITUDE_REL,
+    [DATA_TEMP] = TAG_TEMPERATURE,
+    [DATA_PRESSURE] = TAG_PRESSURE,
+    [DATA_ACCEL_REL] = TAG_LINEAR_ACCEL_REL,
+    [DATA_ACCEL_ABS] = TAG_LINEAR_ACCEL_ABS,
+    [DATA_ANGULAR_VEL] = TAG_ANGULAR_VEL,
+    [DATA_HUMIDITY] = TAG_HUMIDITY,
+    [DATA_LAT_LONG] = TAG_COORDS,
+    [DATA_VOLTAGE] = TAG_VOLTAGE,
+    [DATA_VELOCITY] = TAG_VERTICAL_VEL,
+    [DATA_ALT_FUSED] = TAG_ALTITUDE_FUSED,
+};
+
+/**
+ * Validates the header of a received packet and prepares to iterate over its blocks.
+ * @param it The block iterator to initialize.
+ * @param packet The received packet.
+ * @param received_len The number of bytes received.
+ * @return True if the packet header is valid and its length matches the number of bytes received, false otherwise.
+ */
+bool block_iter_init(BlockIterator *it, const uint8_t *packet, const size_t received_len) {
+    if (received_len < sizeof(CompactPacketHeader) || received_len > PACKET_LIMIT_SIZE || received_len % 4 != 0) {
+        return false;
+    }
+    if (received_len < packet_header_size(packet)) return false;
+    if (packet_get_length(packet) != received_len) return false;
+
+    it->packet = packet;
+    it->len = received_len;
+    it->offset = packet_header_size(packet);
+    return true;
+}
+
+/**
+ * Gets the next block of a packet.
+ * @param it The block iterator.
+ * @param h Where to store a pointer to the header of the block.
+ * @param payload Where to store a pointer to the contents of the block following its header.
+ * @return 1 if a block was found, 0 if there are no more blocks and -1 if the block extends past the end of the packet.
+ */
+int block_iter_next(BlockIterator *it, const BlockHeader **h, const uint8_t **payload) {
+    if (it->offset == it->len) return 0;
+    if ((size_t)(it->len - it->offset) < sizeof(BlockHeader)) return -1;
+
+    const BlockHeader *header = (const BlockHeader *)(it->packet + it->offset);
+    const uint16_t block_len = block_header_get_length(header);
+    if (block_len > it->len - it->offset) return -1;
+
+    *h = header;
+    *payload = it->packet + it->offset + sizeof(BlockHeader);
+    it->offset += block_len;
+    return 1;
+}
+
+/**
+ * Decodes a data block back into the input message it was encoded from. Readings are restored at the resolution of
+ * the block, so they may differ from the original by up to one fixed point unit.
+ * @param h The header of the block.
+ * @param payload The block contents following the header.
+ * @param msg Where to store the decoded message.
+ * @param mission_time Where to store the mission time of the block.
+ * @return True if the block was decoded, false if it is not a sensor data block or its length is wrong.
+ */
+bool decode_block(const BlockHeader *h, const uint8_t *payload, common_t *msg, uint32_t *mission_time) {
+
+    if (block_header_get_type(h) != TYPE_DATA || h->subtype >= sizeof(subtype_tags) || subtype_tags[h->subtype] == 0xFF) {
+        return false;
+    }
+    memset(msg, 0, sizeof(*msg));
+    msg->type = subtype_tags[h->subtype];
+
+    // Check the length before reading anything from the payload
+    if (block_header_get_length(h) != encoded_block_size(msg->type)) return false;
+
+    switch (h->subtype) {
+    case DATA_TEMP:
+        msg->data.FLOAT = ((const TemperatureDB *)payload)->temperature / 1000.0f;
+        break;
+    case DATA_PRESSURE:
+        msg->data.FLOAT = (int32_t)((const PressureDB *)payload)->pressure / 1000.0f;
+        break;
+    case DATA_HUMIDITY:
+        msg->data.FLOAT = ((const HumidityDB *)payload)->humidity / 100.0f;
+        break;
+    case DATA_ALT_SEA:
+    case DATA_ALT_LAUNCH:
+    case DATA_ALT_FUSED:
+        msg->data.FLOAT = ((const AltitudeDB *)payload)->altitude / 1000.0f;
+        break;
+    case DATA_VELOCITY:
+        msg->data.FLOAT = ((const VelocityDB *)payload)->velocity / 1000.0f;
+        break;
+    case DATA_ACCEL_REL:
+    case DATA_ACCEL_ABS: {
+        const AccelerationDB *b = (const AccelerationDB *)payload;
+        msg->data.VEC3D = (vec3d_t){.x = b->x / 100.0f, .y = b->y / 100.0f, .z = b->z / 100.0f};
+        break;
+    }
+    case DATA_ANGULAR_VEL: {
+        const AngularVelocityDB *b = (const AngularVelocityDB *)payload;
+        msg->data.VEC3D = (vec3d_t){.x = b->x / 10.0f, .y = b->y / 10.0f, .z = b->z / 10.0f};
+        break;
+    }
+    case DATA_LAT_LONG: {
+        const CoordinateDB *b = (const CoordinateDB *)payload;
+        msg->data.VEC2D_I32 = (vec2d_i32_t){.x = b->latitude, .y = b->longitude};
+        break;
+    }
+    case DATA_VOLTAGE: {
+        const VoltageDB *b = (const VoltageDB *)payload;
+        msg->id = b->id;
+        msg->data.I16 = b->voltage;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    *mission_time = *(const uint32_t *)payload;
+    return true;
+}
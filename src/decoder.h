@@ -0,0 +1,31 @@
+/**
+ * @file decoder.h
+ * @brief Validation and decoding of received packets.
+ *
+ * The decoder never trusts the length fields of a packet: every block is checked to lie entirely within the received
+ * bytes before it is handed out.
+ */
+
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#include "intypes.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Iterates over the blocks of a received packet. */
+typedef struct {
+    /** The received packet. */
+    const uint8_t *packet;
+    /** The length of the packet in bytes. */
+    uint16_t len;
+    /** The offset of the next block in the packet. */
+    uint16_t offset;
+} BlockIterator;
+
+bool block_iter_init(BlockIterator *it, const uint8_t *packet, const size_t received_len);
+int block_iter_next(BlockIterator *it, const BlockHeader **h, const uint8_t **payload);
+bool decode_block(const BlockHeader *h, const uint8_t *payload, common_t *msg, uint32_t *mission_time);
+
+#endif // _DECODER_H_
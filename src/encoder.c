@@ -0,0 +1,237 @@
+/**
+ * @file encoder.c
+ * @brief Contains the definitions for encoding input messages as blocks and building packets.
+ *
+ * Floating point readings are converted to fixed point with saturation, so that out of range or NaN readings produce
+ * the nearest representable value instead of undefined behaviour.
+ */
+#include "encoder.h"
+#include "header.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// The packet length fields count multiples of 4 bytes, so every block must be a multiple of 4 bytes
+_Static_assert(sizeof(BlockHeader) % 4 == 0, "BlockHeader must be a multiple of 4 bytes");
+_Static_assert(sizeof(PacketHeader) % 4 == 0, "PacketHeader must be a multiple of 4 bytes");
+_Static_assert(sizeof(CompactPacketHeader) % 4 == 0, "CompactPacketHeader must be a multiple of 4 bytes");
+_Static_assert(sizeof(AltitudeDB) % 4 == 0, "AltitudeDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(TemperatureDB) % 4 == 0, "TemperatureDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(HumidityDB) % 4 == 0, "HumidityDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(PressureDB) % 4 == 0, "PressureDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(AngularVelocityDB) % 4 == 0, "AngularVelocityDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(AccelerationDB) % 4 == 0, "AccelerationDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(CoordinateDB) % 4 == 0, "CoordinateDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(VoltageDB) % 4 == 0, "VoltageDB must be a multiple of 4 bytes");
+_Static_assert(sizeof(EventDB) % 4 == 0, "EventDB must be a multiple of 4 bytes");
+
+// The length fields are a single byte
+_Static_assert(PACKET_LIMIT_SIZE <= 256 * 4, "PACKET_LIMIT_SIZE does not fit in the packet length field");
+_Static_assert(BLOCK_MAX_SIZE <= 256 * 4, "BLOCK_MAX_SIZE does not fit in the block length field");
+
+/**
+ * Converts a reading to a 32 bit fixed point value, saturating at the limits of the type.
+ * @param value The reading.
+ * @param scale The number of fixed point units per unit of the reading.
+ * @return The fixed point value, or 0 if the reading is NaN.
+ */
+static int32_t fixed32(const float value, const float scale) {
+    const float scaled = value * scale;
+    if (isnan(scaled)) return 0;
+    if (scaled >= 2147483648.0f) return INT32_MAX;
+    if (scaled <= -2147483648.0f) return INT32_MIN;
+    return (int32_t)scaled;
+}
+
+/**
+ * Converts a reading to a 16 bit fixed point value, saturating at the limits of the type.
+ * @param value The reading.
+ * @param scale The number of fixed point units per unit of the reading.
+ * @return The fixed point value, or 0 if the reading is NaN.
+ */
+static int16_t fixed16(const float value, const float scale) {
+    const float scaled = value * scale;
+    if (isnan(scaled)) return 0;
+    if (scaled >= 32767.0f) return INT16_MAX;
+    if (scaled <= -32768.0f) return INT16_MIN;
+    return (int16_t)scaled;
+}
+
+/**
+ * Gets the size of the block that an input message with the given tag is encoded as.
+ * @param tag The sensor tag of the input message.
+ * @return The size of the block in bytes including its header, 0 if messages with this tag are not encoded as blocks
+ * (time and GPS fix) or -1 if the tag is unknown.
+ */
+int16_t encoded_block_size(const uint8_t tag) {
+    switch (tag) {
+    case TAG_TEMPERATURE:
+        return sizeof(BlockHeader) + sizeof(TemperatureDB);
+    case TAG_PRESSURE:
+        return sizeof(BlockHeader) + sizeof(PressureDB);
+    case TAG_HUMIDITY:
+        return sizeof(BlockHeader) + sizeof(HumidityDB);
+    case TAG_ALTITUDE_REL:
+    case TAG_ALTITUDE_SEA:
+    case TAG_ALTITUDE_FUSED:
+        return sizeof(BlockHeader) + sizeof(AltitudeDB);
+    case TAG_LINEAR_ACCEL_ABS:
+    case TAG_LINEAR_ACCEL_REL:
+        return sizeof(BlockHeader) + sizeof(AccelerationDB);
+    case TAG_ANGULAR_VEL:
+        return sizeof(BlockHeader) + sizeof(AngularVelocityDB);
+    case TAG_COORDS:
+        return sizeof(BlockHeader) + sizeof(CoordinateDB);
+    case TAG_VOLTAGE:
+        return sizeof(BlockHeader) + sizeof(VoltageDB);
+    case TAG_VERTICAL_VEL:
+        return sizeof(BlockHeader) + sizeof(VelocityDB);
+    case TAG_TIME:
+    case TAG_FIX:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Encodes an input message as a data block, including its block header.
+ * @param buf The buffer to write the block to. Must have room for at least encoded_block_size(msg->type) bytes.
+ * @param msg The input message to encode.
+ * @param mission_time The mission time of the measurement in milliseconds.
+ * @return The number of bytes written, or 0 if the message is not encoded as a block.
+ */
+uint16_t encode_block(uint8_t *buf, const common_t *msg, const uint32_t mission_time) {
+
+    BlockHeader *h = (BlockHeader *)buf;
+    uint8_t *payload = buf + sizeof(BlockHeader);
+    const int16_t size = encoded_block_size(msg->type);
+    if (size <= 0) return 0;
+    const uint16_t payload_size = size - sizeof(BlockHeader);
+
+    switch (msg->type) {
+    case TAG_TEMPERATURE:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_TEMP, GROUNDSTATION);
+        temperature_db_init((TemperatureDB *)payload, mission_time, fixed32(msg->data.FLOAT, 1000));
+        break;
+
+    case TAG_PRESSURE:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_PRESSURE, GROUNDSTATION);
+        pressure_db_init((PressureDB *)payload, mission_time, fixed32(msg->data.FLOAT, 1000));
+        break;
+
+    case TAG_HUMIDITY: {
+        const int32_t humidity = fixed32(msg->data.FLOAT, 100);
+        block_header_init(h, payload_size, TYPE_DATA, DATA_HUMIDITY, GROUNDSTATION);
+        humidity_db_init((HumidityDB *)payload, mission_time, humidity < 0 ? 0 : humidity);
+        break;
+    }
+
+    case TAG_ALTITUDE_REL:
+    case TAG_ALTITUDE_SEA:
+        block_header_init(h, payload_size, TYPE_DATA, msg->type == TAG_ALTITUDE_SEA ? DATA_ALT_SEA : DATA_ALT_LAUNCH,
+                          GROUNDSTATION);
+        altitude_db_init((AltitudeDB *)payload, mission_time, fixed32(msg->data.FLOAT, 1000));
+        break;
+
+    case TAG_LINEAR_ACCEL_ABS:
+    case TAG_LINEAR_ACCEL_REL:
+        block_header_init(h, payload_size, TYPE_DATA,
+                          msg->type == TAG_LINEAR_ACCEL_REL ? DATA_ACCEL_REL : DATA_ACCEL_ABS, GROUNDSTATION);
+        acceleration_db_init((AccelerationDB *)payload, mission_time, fixed16(msg->data.VEC3D.x, 100),
+                             fixed16(msg->data.VEC3D.y, 100), fixed16(msg->data.VEC3D.z, 100));
+        ((AccelerationDB *)payload)->_padding = 0;
+        break;
+
+    case TAG_ANGULAR_VEL:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_ANGULAR_VEL, GROUNDSTATION);
+        angular_velocity_db_init((AngularVelocityDB *)payload, mission_time, fixed16(msg->data.VEC3D.x, 10),
+                                 fixed16(msg->data.VEC3D.y, 10), fixed16(msg->data.VEC3D.z, 10));
+        ((AngularVelocityDB *)payload)->_padding = 0;
+        break;
+
+    case TAG_COORDS:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_LAT_LONG, GROUNDSTATION);
+        coordinate_db_init((CoordinateDB *)payload, mission_time, msg->data.VEC2D_I32.x, msg->data.VEC2D_I32.y);
+        break;
+
+    case TAG_VOLTAGE:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_VOLTAGE, GROUNDSTATION);
+        voltage_db_init((VoltageDB *)payload, mission_time, msg->id, msg->data.I16);
+        break;
+
+    case TAG_VERTICAL_VEL:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_VELOCITY, GROUNDSTATION);
+        velocity_db_init((VelocityDB *)payload, mission_time, fixed32(msg->data.FLOAT, 1000));
+        break;
+
+    case TAG_ALTITUDE_FUSED:
+        block_header_init(h, payload_size, TYPE_DATA, DATA_ALT_FUSED, GROUNDSTATION);
+        altitude_db_init((AltitudeDB *)payload, mission_time, fixed32(msg->data.FLOAT, 1000));
+        break;
+    }
+
+    return size;
+}
+
+/**
+ * Initializes a packet builder.
+ * @param b The packet builder to initialize.
+ * @param buf The packet buffer to build packets in. Must be at least max_size bytes.
+ * @param max_size The maximum size of a packet in bytes. Rounded down to a multiple of 4 and capped at
+ * PACKET_LIMIT_SIZE.
+ */
+void packet_builder_init(PacketBuilder *b, uint8_t *buf, const uint16_t max_size) {
+    b->buf = buf;
+    b->max_size = max_size & ~3u;
+    if (b->max_size > PACKET_LIMIT_SIZE) b->max_size = PACKET_LIMIT_SIZE;
+    b->limit = b->max_size;
+    b->len = 0;
+    b->blocks = 0;
+}
+
+/**
+ * Starts a new, empty packet, discarding any packet that was being built.
+ * @param b The packet builder.
+ * @param t The header template of the packet stream.
+ * @param compact True to use a compact packet header.
+ * @param packet_number The number of the new packet.
+ */
+void packet_builder_start(PacketBuilder *b, const PacketHeaderTemplate *t, const bool compact,
+                          const uint32_t packet_number) {
+    b->len = packet_header_write(b->buf, t, compact, packet_number);
+    b->limit = compact && b->max_size > COMPACT_PACKET_LIMIT_SIZE ? COMPACT_PACKET_LIMIT_SIZE : b->max_size;
+    b->blocks = 0;
+}
+
+/**
+ * Encodes an input message as a block at the end of the packet.
+ * @param b The packet builder.
+ * @param msg The input message.
+ * @param mission_time The mission time of the measurement in milliseconds.
+ * @return True if the message was added or does not produce a block, false if there is no room for its block.
+ */
+bool packet_builder_add(PacketBuilder *b, const common_t *msg, const uint32_t mission_time) {
+    const int16_t size = encoded_block_size(msg->type);
+    if (size <= 0) return true;
+    if (!packet_builder_fits(b, size)) return false;
+    packet_builder_commit(b, encode_block(packet_builder_tail(b), msg, mission_time));
+    return true;
+}
+
+/**
+ * Appends an already encoded block to the end of the packet.
+ * @param b The packet builder.
+ * @param block The block, including its header.
+ * @param size The size of the block in bytes. Must be a multiple of 4.
+ * @return True if the block was appended, false if there is no room for it.
+ */
+bool packet_builder_append(PacketBuilder *b, const uint8_t *block, const uint16_t size) {
+    if (!packet_builder_fits(b, size)) return false;
+    memcpy(packet_builder_tail(b), block, size);
+    packet_builder_commit(b, size);
+    return true;
+}
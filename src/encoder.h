@@ -0,0 +1,139 @@
+/**
+ * @file encoder.h
+ * @brief Encoding of input messages into data blocks and assembly of blocks into packets.
+ *
+ * A packet builder owns a packet buffer and tracks the write position, so that the length in the packet header always
+ * matches the number of bytes written and nothing is ever written past the maximum packet size.
+ */
+
+#ifndef _ENCODER_H_
+#define _ENCODER_H_
+
+#include "header.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/** The size of the largest block that can be encoded from an input message, including its header. */
+#define ENCODED_BLOCK_MAX_SIZE (sizeof(BlockHeader) + sizeof(CoordinateDB))
+
+/** The size of the smallest block that can be encoded from an input message, including its header. */
+#define ENCODED_BLOCK_MIN_SIZE (sizeof(BlockHeader) + sizeof(AltitudeDB))
+
+/** Builds a packet in a buffer. */
+typedef struct {
+    /** The packet buffer. */
+    uint8_t *buf;
+    /** The maximum size of the packet in bytes. */
+    uint16_t max_size;
+    /** The maximum size of the packet being built, which is less than max_size for the largest compact packets. */
+    uint16_t limit;
+    /** The number of bytes written to the packet, including its header. */
+    uint16_t len;
+    /** The number of blocks in the packet. */
+    uint16_t blocks;
+} PacketBuilder;
+
+__attribute__((const)) int16_t encoded_block_size(const uint8_t tag);
+uint16_t encode_block(uint8_t *buf, const common_t *msg, const uint32_t mission_time);
+
+void packet_builder_init(PacketBuilder *b, uint8_t *buf, const uint16_t max_size);
+void packet_builder_start(PacketBuilder *b, const PacketHeaderTemplate *t, const bool compact,
+                          const uint32_t packet_number);
+bool packet_builder_add(PacketBuilder *b, const common_t *msg, const uint32_t mission_time);
+bool packet_builder_append(PacketBuilder *b, const uint8_t *block, const uint16_t size);
+
+/**
+ * Gets the position in the packet buffer where the next block will be written.
+ * @param b The packet builder.
+ * @return A pointer to the end of the packet being built.
+ */
+static inline uint8_t *packet_builder_tail(const PacketBuilder *b) { return b->buf + b->len; }
+
+/**
+ * Gets the number of bytes left in the packet being built.
+ * @param b The packet builder.
+ * @return The number of bytes that can still be added to the packet.
+ */
+static inline uint16_t packet_builder_room(const PacketBuilder *b) { return b->limit - b->len; }
+
+/**
+ * Checks whether a block fits in the packet being built.
+ * @param b The packet builder.
+ * @param size The size of the block in bytes, including its header.
+ * @return True if the block fits, false otherwise.
+ */
+static inline bool packet_builder_fits(const PacketBuilder *b, const uint16_t size) {
+    return size <= packet_builder_room(b);
+}
+
+/**
+ * Records that a block has been written at the tail of the packet.
+ * @param b The packet builder.
+ * @param size The size of the block in bytes, including its header. Must be a multiple of 4.
+ */
+static inline void packet_builder_commit(PacketBuilder *b, const uint16_t size) {
+    if (size == 0) return;
+    b->len += size;
+    b->blocks++;
+    packet_inc_length(b->buf, size);
+}
+
+/**
+ * Checks whether the packet being built has no blocks.
+ * @param b The packet builder.
+ * @return True if only the packet header has been written.
+ */
+static inline bool packet_builder_empty(const PacketBuilder *b) { return b->blocks == 0; }
+
+/**
+ * Defines packet_builder<size>_fits and packet_builder<size>_append, which behave like packet_builder_fits and
+ * packet_builder_append for a builder whose maximum size is the compile time constant `size`. The size check folds
+ * into a comparison with a constant, and blocks, which are always a multiple of 4 bytes, are copied a word at a time
+ * inline instead of through a call to memcpy. Only use them with builders initialized with that maximum size.
+ */
+#define PACKET_BUILDER_SPECIALIZE(size)                                                                                \
+    static inline bool packet_builder##size##_fits(const PacketBuilder *b, const uint16_t n) {                         \
+        if ((size) > COMPACT_PACKET_LIMIT_SIZE && b->len + n > b->limit) return false;                                 \
+        return b->len + n <= (size);                                                                                   \
+    }                                                                                                                  \
+    static inline bool packet_builder##size##_append(PacketBuilder *b, const uint8_t *block, const uint16_t n) {       \
+        if (!packet_builder##size##_fits(b, n)) return false;                                                          \
+        for (uint16_t i = 0; i < n; i += 4) memcpy(b->buf + b->len + i, block + i, 4);                                 \
+        packet_builder_commit(b, n);                                                                                   \
+        return true;                                                                                                   \
+    }
+
+// Builders specialized for the common packet sizes, from small LoRa frames to wired links
+PACKET_BUILDER_SPECIALIZE(64)
+PACKET_BUILDER_SPECIALIZE(128)
+PACKET_BUILDER_SPECIALIZE(256)
+PACKET_BUILDER_SPECIALIZE(1024)
+
+/**
+ * Appends an already encoded block to the end of the packet with the builder specialized for the builder's maximum
+ * size, or the generic one if there is none. The switch is inlined into the caller, so unlike a call through a function
+ * pointer the specialized append is inlined too.
+ * @param b The packet builder.
+ * @param block The block, including its header.
+ * @param n The size of the block in bytes. Must be a multiple of 4.
+ * @return True if the block was appended, false if there is no room for it.
+ */
+static inline bool packet_builder_append_sized(PacketBuilder *b, const uint8_t *block, const uint16_t n) {
+    switch (b->max_size) {
+    case 64:
+        return packet_builder64_append(b, block, n);
+    case 128:
+        return packet_builder128_append(b, block, n);
+    case 256:
+        return packet_builder256_append(b, block, n);
+    case 1024:
+        return packet_builder1024_append(b, block, n);
+    default:
+        return packet_builder_append(b, block, n);
+    }
+}
+
+#endif // _ENCODER_H_
@@ -0,0 +1,207 @@
+/**
+ * @file events.c
+ * @brief Contains the definitions for interning event strings, queuing events and encoding them as debug blocks.
+ */
+#include "events.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initializes an event channel with no interned strings or queued events.
+ * @param c The event channel to initialize.
+ * @param rate The maximum number of events per second. Must be greater than 0.
+ * @param max_per_packet The maximum number of event and dictionary blocks in a single packet.
+ * @param dict_refresh_ms How often in milliseconds to send the whole dictionary again, or 0 to only send new strings.
+ */
+void event_channel_init(EventChannel *c, const uint16_t rate, const uint8_t max_per_packet,
+                        const uint32_t dict_refresh_ms) {
+    memset(c, 0, sizeof(*c));
+    c->rate = rate;
+    c->tokens = rate * 1000u;
+    c->max_per_packet = max_per_packet;
+    c->dict_refresh_ms = dict_refresh_ms;
+}
+
+/**
+ * Finds the ID of an interned string, interning it if it has not been seen before.
+ * @param c The event channel.
+ * @param str The string to intern.
+ * @return The ID of the string, or EVENT_STRING_NONE if the string table is full.
+ */
+static uint8_t intern(EventChannel *c, const char *str) {
+    size_t len = strlen(str);
+    if (len > EVENT_STRING_MAX_LEN) len = EVENT_STRING_MAX_LEN;
+
+    for (uint8_t id = 0; id < c->n_strings; id++) {
+        if (c->strings[id].len == len && !memcmp(c->strings[id].str, str, len)) return id;
+    }
+
+    if (c->n_strings == EVENT_STRINGS_MAX) {
+        c->intern_overflows++;
+        return EVENT_STRING_NONE;
+    }
+
+    InternedString *s = &c->strings[c->n_strings];
+    memcpy(s->str, str, len);
+    s->str[len] = '\0';
+    s->len = len;
+    s->dirty = true;
+    return c->n_strings++;
+}
+
+/**
+ * Queues an event to be sent.
+ * @param c The event channel.
+ * @param category The category of the event.
+ * @param str A short description of the event, which will be interned. Prefer constant strings (such as format
+ * strings) over formatted ones, since every distinct string takes up a slot in the string table.
+ * @param arg The argument of the event.
+ * @param mission_time The mission time in milliseconds at which the event happened.
+ * @return True if the event was queued, false if it was dropped because the queue is full.
+ */
+bool event_post(EventChannel *c, const EventCategory category, const char *str, const int32_t arg,
+                const uint32_t mission_time) {
+    if (c->queued == EVENT_QUEUE_LEN) {
+        c->dropped++;
+        return false;
+    }
+
+    Event *e = &c->queue[(c->head + c->queued) % EVENT_QUEUE_LEN];
+    e->mission_time = mission_time;
+    e->category = category;
+    e->string_id = intern(c, str);
+    e->arg = arg;
+    c->queued++;
+    return true;
+}
+
+/**
+ * Resets the per-packet block limit. Call this when a new packet is started.
+ * @param c The event channel.
+ */
+void event_channel_new_packet(EventChannel *c) { c->in_packet = 0; }
+
+/** The size of a dictionary block's fields before its entries, which start before the end of the padded struct. */
+#define DICTIONARY_HEADER_SIZE offsetof(DictionaryDB, entries)
+
+/**
+ * Writes a dictionary block with as many unsent strings as fit.
+ * @param c The event channel.
+ * @param buf Where to write the block, including its header.
+ * @param room The space available in bytes.
+ * @param mission_time The current mission time in milliseconds.
+ * @return The number of bytes written, 0 if not even one entry fits.
+ */
+static uint16_t emit_dictionary(EventChannel *c, uint8_t *buf, uint16_t room, const uint32_t mission_time) {
+    if (room > BLOCK_MAX_SIZE) room = BLOCK_MAX_SIZE;
+    if (room < sizeof(BlockHeader) + DICTIONARY_HEADER_SIZE) return 0;
+
+    DictionaryDB *d = (DictionaryDB *)(buf + sizeof(BlockHeader));
+    const uint16_t capacity = room - sizeof(BlockHeader);
+    uint16_t used = 0;
+    uint8_t count = 0;
+
+    for (uint8_t id = 0; id < c->n_strings; id++) {
+        InternedString *s = &c->strings[id];
+        if (!s->dirty) continue;
+        // The block including this entry, padded to a multiple of 4, must fit
+        if (((DICTIONARY_HEADER_SIZE + used + 2 + s->len + 3) & ~3u) > capacity) break;
+
+        d->entries[used] = id;
+        d->entries[used + 1] = s->len;
+        memcpy(&d->entries[used + 2], s->str, s->len);
+        used += 2 + s->len;
+        s->dirty = false;
+        count++;
+    }
+    if (count == 0) return 0;
+
+    const uint16_t padded = (DICTIONARY_HEADER_SIZE + used + 3) & ~3u;
+    memset(&d->entries[used], 0, padded - DICTIONARY_HEADER_SIZE - used);
+    d->mission_time = mission_time;
+    d->record = DBG_RECORD_DICTIONARY;
+    d->count = count;
+
+    block_header_init((BlockHeader *)buf, padded, TYPE_DATA, DATA_DBG_MSG, GROUNDSTATION);
+    return sizeof(BlockHeader) + padded;
+}
+
+/**
+ * Writes the next due debug block of the event channel, if any. Dictionary blocks with new strings are written before
+ * events. Call this repeatedly until it returns 0 to fill a packet with as many blocks as the limits allow.
+ * @param c The event channel.
+ * @param buf Where to write the block, including its header.
+ * @param room The space available in bytes.
+ * @param mission_time The current mission time in milliseconds.
+ * @param now_ms The current time in milliseconds, used for rate limiting and dictionary refreshes.
+ * @return The number of bytes written, or 0 if no block was written.
+ */
+uint16_t event_channel_emit(EventChannel *c, uint8_t *buf, const uint16_t room, const uint32_t mission_time,
+                            const uint32_t now_ms) {
+    if (c->in_packet >= c->max_per_packet) return 0;
+
+    // Periodically send the whole dictionary again
+    if (c->dict_refresh_ms != 0 && now_ms - c->last_dict_refresh >= c->dict_refresh_ms) {
+        for (uint8_t id = 0; id < c->n_strings; id++) {
+            c->strings[id].dirty = true;
+        }
+        c->last_dict_refresh = now_ms;
+    }
+
+    uint16_t written = emit_dictionary(c, buf, room, mission_time);
+    if (written != 0) {
+        c->in_packet++;
+        return written;
+    }
+
+    if (c->queued == 0) return 0;
+
+    // Refill the token bucket, allowing at most one second's worth of events in a burst
+    uint32_t elapsed = now_ms - c->last_refill;
+    if (elapsed > 1000) elapsed = 1000;
+    c->last_refill = now_ms;
+    c->tokens += c->rate * elapsed;
+    if (c->tokens > c->rate * 1000u) c->tokens = c->rate * 1000u;
+
+    if (c->tokens < 1000 || room < sizeof(BlockHeader) + sizeof(EventDB)) return 0;
+    c->tokens -= 1000;
+
+    const Event *e = &c->queue[c->head];
+    block_header_init((BlockHeader *)buf, sizeof(EventDB), TYPE_DATA, DATA_DBG_MSG, GROUNDSTATION);
+    event_db_init((EventDB *)(buf + sizeof(BlockHeader)), e->mission_time, e->category, e->string_id, e->arg);
+    c->head = (c->head + 1) % EVENT_QUEUE_LEN;
+    c->queued--;
+    c->in_packet++;
+    return sizeof(BlockHeader) + sizeof(EventDB);
+}
+
+/**
+ * Reports that no sink accepted a block written by event_channel_emit. The strings of a dictionary block are sent again
+ * in a later one, since the ground station cannot decode events without them. Dropped event blocks are not resent.
+ * @param c The event channel.
+ * @param buf The block, including its header.
+ */
+void event_channel_unsent(EventChannel *c, const uint8_t *buf) {
+    const DictionaryDB *d = (const DictionaryDB *)(buf + sizeof(BlockHeader));
+    if (d->record != DBG_RECORD_DICTIONARY) return;
+
+    uint16_t pos = 0;
+    for (uint8_t i = 0; i < d->count; i++) {
+        if (d->entries[pos] < c->n_strings) c->strings[d->entries[pos]].dirty = true;
+        pos += 2 + d->entries[pos + 1];
+    }
+}
+
+/**
+ * Gets an interned string by its ID.
+ * @param c The event channel.
+ * @param id The string ID.
+ * @return The interned string, or NULL if there is no string with that ID.
+ */
+const char *event_string(const EventChannel *c, const uint8_t id) {
+    if (id >= c->n_strings) return NULL;
+    return c->strings[id].str;
+}
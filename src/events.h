@@ -0,0 +1,103 @@
+/**
+ * @file events.h
+ * @brief An event channel which encodes operational events (GPS fix changes, errors, flight phase transitions) as
+ * compact debug blocks.
+ *
+ * Event descriptions are interned into one byte string IDs, so an event costs a fixed 16 bytes in a packet regardless
+ * of how long its description is. The strings themselves are sent in dictionary blocks whenever a new one is interned
+ * and periodically after that, so a ground station which joins late can still decode events. Events are rate limited
+ * so that they cannot starve sensor data of packet space.
+ */
+
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The maximum number of strings that can be interned. */
+#define EVENT_STRINGS_MAX 32
+
+/** The maximum length of an interned string. Longer strings are truncated. */
+#define EVENT_STRING_MAX_LEN 32
+
+/** The string ID used for events whose string could not be interned because the table is full. */
+#define EVENT_STRING_NONE 0xFF
+
+/** The maximum number of events waiting to be sent. */
+#define EVENT_QUEUE_LEN 16
+
+/** The categories of events. */
+typedef enum {
+    EVENT_PHASE = 0x1,   /**< Flight phase transition, argument is the new FlightPhase */
+    EVENT_GPS_FIX = 0x2, /**< GPS fix type changed, argument is the new fix type */
+    EVENT_ERROR = 0x3,   /**< Error, argument is the error number or offending value */
+    EVENT_RESTART = 0x4, /**< Packager restarted, argument is how long it was down in milliseconds */
+} EventCategory;
+
+/** An event waiting to be sent. */
+typedef struct {
+    /** Mission time in milliseconds at which the event happened. */
+    uint32_t mission_time;
+    /** The category of the event. */
+    uint8_t category;
+    /** The ID of the interned string describing the event. */
+    uint8_t string_id;
+    /** The argument of the event. */
+    int32_t arg;
+} Event;
+
+/** An interned string. */
+typedef struct {
+    /** The null terminated string. */
+    char str[EVENT_STRING_MAX_LEN + 1];
+    /** The length of the string. */
+    uint8_t len;
+    /** Whether the string still needs to be sent in a dictionary block. */
+    bool dirty;
+} InternedString;
+
+/** The event channel state. */
+typedef struct {
+    /** The interned strings, indexed by string ID. */
+    InternedString strings[EVENT_STRINGS_MAX];
+    /** The number of interned strings. */
+    uint8_t n_strings;
+    /** Events waiting to be sent, as a ring buffer. */
+    Event queue[EVENT_QUEUE_LEN];
+    /** The index of the oldest queued event. */
+    uint8_t head;
+    /** The number of queued events. */
+    uint8_t queued;
+    /** Maximum events per second. */
+    uint16_t rate;
+    /** Available tokens, in thousandths of an event. */
+    uint32_t tokens;
+    /** Time in milliseconds of the last token refill. */
+    uint32_t last_refill;
+    /** Maximum number of event and dictionary blocks in a single packet. */
+    uint8_t max_per_packet;
+    /** Number of event and dictionary blocks in the current packet. */
+    uint8_t in_packet;
+    /** How often in milliseconds the whole dictionary is sent again. */
+    uint32_t dict_refresh_ms;
+    /** Time in milliseconds that the whole dictionary was last queued for sending. */
+    uint32_t last_dict_refresh;
+    /** Number of events dropped because the queue was full. */
+    uint32_t dropped;
+    /** Number of events whose string could not be interned. */
+    uint32_t intern_overflows;
+} EventChannel;
+
+void event_channel_init(EventChannel *c, const uint16_t rate, const uint8_t max_per_packet,
+                        const uint32_t dict_refresh_ms);
+bool event_post(EventChannel *c, const EventCategory category, const char *str, const int32_t arg,
+                const uint32_t mission_time);
+void event_channel_new_packet(EventChannel *c);
+uint16_t event_channel_emit(EventChannel *c, uint8_t *buf, const uint16_t room, const uint32_t mission_time,
+                            const uint32_t now_ms);
+void event_channel_unsent(EventChannel *c, const uint8_t *buf);
+const char *event_string(const EventChannel *c, const uint8_t id);
+
+#endif // _EVENTS_H_
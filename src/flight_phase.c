@@ -0,0 +1,239 @@
+/**
+ * @file flight_phase.c
+ * @brief Contains the flight phase detector and the per-phase bandwidth budget tables.
+ *
+ * Every transition has to be confirmed by several consecutive samples so that a single noisy reading cannot change the
+ * phase.
+ */
+#include "flight_phase.h"
+#include "intypes.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of consecutive samples required to confirm a phase transition. */
+#define CONFIRM_SAMPLES 3
+
+/** Acceleration magnitude (m/s^2) above which the motor is considered to be burning. */
+#define BOOST_ACCEL 30.0f
+
+/** Acceleration magnitude (m/s^2) below which the motor is considered to be burnt out. */
+#define COAST_ACCEL 20.0f
+
+/** Relative altitude (m) above which the rocket has definitely left the pad. */
+#define LIFTOFF_ALTITUDE 30.0f
+
+/** Drop below the maximum altitude (m) that indicates apogee has passed. */
+#define APOGEE_DROP 5.0f
+
+/** Rise above the minimum pressure (kPa) that indicates apogee has passed. */
+#define APOGEE_PRESSURE_RISE 0.1f
+
+/** Altitude change (m) within which the rocket is considered to be at rest. */
+#define LANDED_TOLERANCE 2.0f
+
+/** How long (ms) the altitude must stay within tolerance before the rocket is considered landed. */
+#define LANDED_STABLE_MS 10000
+
+/** Shorthand for the unlimited budget in the table below. */
+#define UNL PHASE_BUDGET_UNLIMITED
+
+/**
+ * Bandwidth budgets in blocks per second, indexed by flight phase and then sensor tag. Tags which never produce a
+ * block (time and GPS fix) are unlimited.
+ */
+static const uint16_t budgets[PHASE_COUNT][SENSOR_TAG_COUNT] = {
+    /*             TEMP PRES HUM TIME ALT_SEA ALT_REL ANG_VEL ACC_REL ACC_ABS COORDS VOLT FIX */
+    [PHASE_PAD] = {1, 1, 1, UNL, 1, 1, 1, 1, 1, 2, 10, UNL},
+    [PHASE_BOOST] = {0, 20, 0, UNL, 2, 20, 40, 50, 10, 0, 1, UNL},
+    [PHASE_COAST] = {0, 20, 0, UNL, 2, 20, 20, 20, 5, 1, 1, UNL},
+    [PHASE_DESCENT] = {1, 5, 1, UNL, 5, 10, 2, 2, 2, 10, 1, UNL},
+    [PHASE_LANDED] = {1, 1, 1, UNL, 1, 1, 0, 0, 0, 5, 5, UNL},
+};
+
+/** Names of the flight phases, for logging. */
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_PAD] = "PAD",         [PHASE_BOOST] = "BOOST",   [PHASE_COAST] = "COAST",
+    [PHASE_DESCENT] = "DESCENT", [PHASE_LANDED] = "LANDED",
+};
+
+/**
+ * Calculates the absolute difference between two floats.
+ * @param a The first value.
+ * @param b The second value.
+ * @return |a - b|
+ */
+static float abs_diff(const float a, const float b) { return a > b ? a - b : b - a; }
+
+/**
+ * Moves the detector into a new phase.
+ * @param d The flight phase detector.
+ * @param phase The phase to transition to.
+ * @param mission_time The mission time of the transition in milliseconds.
+ */
+static void enter_phase(FlightPhaseDetector *d, const FlightPhase phase, const uint32_t mission_time) {
+    d->phase = phase;
+    d->altitude_confirm = 0;
+    d->accel_confirm = 0;
+    d->pressure_confirm = 0;
+    d->rest_altitude = d->altitude;
+    d->rest_since = mission_time;
+}
+
+/**
+ * Counts a sample towards confirming a transition, or resets the count if the sample contradicts it.
+ * @param count The confirmation count of the kind of sample being counted.
+ * @param evidence True if the sample supports the transition.
+ * @return True if the transition has been confirmed by enough consecutive samples.
+ */
+static bool confirm(uint8_t *count, const bool evidence) {
+    *count = evidence ? *count + 1 : 0;
+    return *count >= CONFIRM_SAMPLES;
+}
+
+/**
+ * Initializes the flight phase detector in the pad phase.
+ * @param d The flight phase detector to initialize.
+ */
+void flight_phase_init(FlightPhaseDetector *d) {
+    *d = (FlightPhaseDetector){
+        .phase = PHASE_PAD,
+    };
+}
+
+/**
+ * Feeds an input message to the flight phase detector. Messages other than relative altitude, linear acceleration and
+ * pressure are ignored.
+ * @param d The flight phase detector.
+ * @param msg The input message.
+ * @param mission_time The most recent mission time in milliseconds.
+ * @return True if the flight phase changed as a result of this message, false otherwise.
+ */
+bool flight_phase_update(FlightPhaseDetector *d, const common_t *msg, const uint32_t mission_time) {
+
+    const FlightPhase previous = d->phase;
+
+    switch (msg->type) {
+    case TAG_ALTITUDE_REL: {
+        d->altitude = msg->data.FLOAT;
+        if (!d->have_altitude || d->altitude > d->max_altitude) d->max_altitude = d->altitude;
+        d->have_altitude = true;
+
+        if (d->phase == PHASE_PAD) {
+            if (confirm(&d->altitude_confirm, d->altitude > LIFTOFF_ALTITUDE)) {
+                enter_phase(d, PHASE_BOOST, mission_time);
+            }
+        } else if (d->phase == PHASE_BOOST || d->phase == PHASE_COAST) {
+            if (confirm(&d->altitude_confirm, d->altitude < d->max_altitude - APOGEE_DROP)) {
+                enter_phase(d, PHASE_DESCENT, mission_time);
+            }
+        } else if (d->phase == PHASE_DESCENT) {
+            if (abs_diff(d->altitude, d->rest_altitude) > LANDED_TOLERANCE) {
+                d->rest_altitude = d->altitude;
+                d->rest_since = mission_time;
+            } else if (mission_time - d->rest_since >= LANDED_STABLE_MS) {
+                enter_phase(d, PHASE_LANDED, mission_time);
+            }
+        }
+        break;
+    }
+
+    case TAG_LINEAR_ACCEL_REL:
+    case TAG_LINEAR_ACCEL_ABS: {
+        // Compare squared magnitudes to avoid a square root
+        const vec3d_t *a = &msg->data.VEC3D;
+        const float mag2 = a->x * a->x + a->y * a->y + a->z * a->z;
+
+        if (d->phase == PHASE_PAD) {
+            if (confirm(&d->accel_confirm, mag2 > BOOST_ACCEL * BOOST_ACCEL)) enter_phase(d, PHASE_BOOST, mission_time);
+        } else if (d->phase == PHASE_BOOST) {
+            if (confirm(&d->accel_confirm, mag2 < COAST_ACCEL * COAST_ACCEL)) enter_phase(d, PHASE_COAST, mission_time);
+        }
+        break;
+    }
+
+    case TAG_PRESSURE: {
+        const float pressure = msg->data.FLOAT;
+        if (!d->have_pressure || pressure < d->min_pressure) d->min_pressure = pressure;
+        d->have_pressure = true;
+
+        // Only use pressure for apogee detection if there is no altitude source
+        if (!d->have_altitude && (d->phase == PHASE_BOOST || d->phase == PHASE_COAST)) {
+            if (confirm(&d->pressure_confirm, pressure > d->min_pressure + APOGEE_PRESSURE_RISE)) {
+                enter_phase(d, PHASE_DESCENT, mission_time);
+            }
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return d->phase != previous;
+}
+
+/**
+ * Gets the name of a flight phase.
+ * @param phase The flight phase.
+ * @return The name of the flight phase as a string.
+ */
+const char *flight_phase_name(const FlightPhase phase) {
+    if (phase >= PHASE_COUNT) return "UNKNOWN";
+    return phase_names[phase];
+}
+
+/**
+ * Gets the bandwidth budget of a sensor tag in the given flight phase.
+ * @param phase The flight phase.
+ * @param tag The sensor tag.
+ * @return The budget in blocks per second, or PHASE_BUDGET_UNLIMITED if the tag is not limited.
+ */
+uint16_t flight_phase_budget(const FlightPhase phase, const uint8_t tag) {
+    if (phase >= PHASE_COUNT || tag >= SENSOR_TAG_COUNT) return PHASE_BUDGET_UNLIMITED;
+    return budgets[phase][tag];
+}
+
+/**
+ * Initializes the budget token buckets so that every tag starts with one second's worth of blocks.
+ * @param b The budget to initialize.
+ * @param phase The current flight phase.
+ * @param mission_time The current mission time in milliseconds.
+ */
+void phase_budget_init(PhaseBudget *b, const FlightPhase phase, const uint32_t mission_time) {
+    for (uint8_t tag = 0; tag < SENSOR_TAG_COUNT; tag++) {
+        const uint16_t rate = flight_phase_budget(phase, tag);
+        b->tokens[tag] = rate == PHASE_BUDGET_UNLIMITED ? 0 : rate * 1000u;
+    }
+    b->last_refill = mission_time;
+}
+
+/**
+ * Decides whether a reading of a sensor tag fits in the bandwidth budget of the current phase, consuming budget if it
+ * does.
+ * @param b The budget token buckets.
+ * @param phase The current flight phase.
+ * @param tag The sensor tag of the reading.
+ * @param mission_time The current mission time in milliseconds.
+ * @return True if the reading should be encoded, false if it should be dropped.
+ */
+bool phase_budget_admit(PhaseBudget *b, const FlightPhase phase, const uint8_t tag, const uint32_t mission_time) {
+
+    const uint16_t rate = flight_phase_budget(phase, tag);
+    if (rate == PHASE_BUDGET_UNLIMITED) return true;
+
+    // Refill every bucket for the elapsed time, capped at one second's worth of blocks
+    uint32_t elapsed = mission_time > b->last_refill ? mission_time - b->last_refill : 0;
+    if (elapsed > 1000) elapsed = 1000;
+    b->last_refill = mission_time;
+    for (uint8_t t = 0; t < SENSOR_TAG_COUNT; t++) {
+        const uint16_t r = flight_phase_budget(phase, t);
+        if (r == PHASE_BUDGET_UNLIMITED) continue;
+        const uint32_t cap = r * 1000u;
+        const uint32_t refilled = b->tokens[t] + r * elapsed;
+        b->tokens[t] = refilled > cap ? cap : refilled;
+    }
+
+    if (b->tokens[tag] < 1000) return false;
+    b->tokens[tag] -= 1000;
+    return true;
+}
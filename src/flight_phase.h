@@ -0,0 +1,75 @@
+/**
+ * @file flight_phase.h
+ * @brief Flight phase detection and the per-phase bandwidth budgets used to compose packets.
+ *
+ * The detector is fed the same input messages that are encoded into packets and infers what the rocket is currently
+ * doing from relative altitude, linear acceleration and pressure. Each phase has a budget (in blocks per second) for
+ * every sensor tag, which is used to decide which readings make it into a packet.
+ */
+
+#ifndef _FLIGHT_PHASE_H_
+#define _FLIGHT_PHASE_H_
+
+#include "intypes.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The number of sensor tags that budgets are kept for. */
+#define SENSOR_TAG_COUNT (TAG_FIX + 1)
+
+/** Budget value indicating that a tag is never limited. */
+#define PHASE_BUDGET_UNLIMITED 0xFFFF
+
+/** The phases of flight that can be detected. */
+typedef enum {
+    PHASE_PAD = 0,     /**< Sitting on the launch pad */
+    PHASE_BOOST = 1,   /**< Motor burning */
+    PHASE_COAST = 2,   /**< Motor burnt out, still ascending */
+    PHASE_DESCENT = 3, /**< Past apogee and descending */
+    PHASE_LANDED = 4,  /**< Back on the ground */
+    PHASE_COUNT,       /**< Number of flight phases */
+} FlightPhase;
+
+/** State of the flight phase detector. */
+typedef struct {
+    /** The currently detected flight phase. */
+    FlightPhase phase;
+    /** Number of consecutive altitude samples confirming the next phase transition. */
+    uint8_t altitude_confirm;
+    /** Number of consecutive acceleration samples confirming the next phase transition. */
+    uint8_t accel_confirm;
+    /** Number of consecutive pressure samples confirming the next phase transition. */
+    uint8_t pressure_confirm;
+    /** Whether an altitude measurement has been received yet. */
+    bool have_altitude;
+    /** Whether a pressure measurement has been received yet. */
+    bool have_pressure;
+    /** The most recent relative altitude in metres. */
+    float altitude;
+    /** The highest relative altitude seen in metres. */
+    float max_altitude;
+    /** The lowest pressure seen in kilo Pascals. */
+    float min_pressure;
+    /** The altitude in metres that landing stability is measured against. */
+    float rest_altitude;
+    /** Mission time in milliseconds at which the altitude last moved outside of the landing tolerance. */
+    uint32_t rest_since;
+} FlightPhaseDetector;
+
+/** Per-tag token buckets enforcing the bandwidth budgets of the current phase. */
+typedef struct {
+    /** Available tokens per tag, in thousandths of a block. */
+    uint32_t tokens[SENSOR_TAG_COUNT];
+    /** Mission time in milliseconds of the last refill. */
+    uint32_t last_refill;
+} PhaseBudget;
+
+void flight_phase_init(FlightPhaseDetector *d);
+bool flight_phase_update(FlightPhaseDetector *d, const common_t *msg, const uint32_t mission_time);
+__attribute__((const)) const char *flight_phase_name(const FlightPhase phase);
+
+__attribute__((const)) uint16_t flight_phase_budget(const FlightPhase phase, const uint8_t tag);
+void phase_budget_init(PhaseBudget *b, const FlightPhase phase, const uint32_t mission_time);
+bool phase_budget_admit(PhaseBudget *b, const FlightPhase phase, const uint8_t tag, const uint32_t mission_time);
+
+#endif // _FLIGHT_PHASE_H_
@@ -0,0 +1,186 @@
+/**
+ * @file fusion.c
+ * @brief Contains the definitions for the fixed point complementary filter estimating altitude and vertical velocity.
+ *
+ * Between altitude readings the estimate is integrated from the held acceleration. Each altitude reading then pulls
+ * the estimate towards it with gains 2 / tau and 1 / tau^2 per millisecond since the previous reading, which makes the
+ * correction critically damped with time constant tau.
+ */
+#include "fusion.h"
+#include "encoder.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The largest altitude reading accepted, in micrometres (1000 km). */
+#define MAX_ALTITUDE 1000000000000LL
+
+/** The largest acceleration reading accepted, in millimetres per second squared (about 100 g). */
+#define MAX_ACCEL 1000000
+
+/** The largest altitude error corrected by one reading, in micrometres (10 km). */
+#define MAX_ERROR 10000000000LL
+
+/** The largest velocity estimate, in micrometres per second (1000 km/s). */
+#define MAX_VELOCITY 1000000000000LL
+
+/**
+ * Converts a reading to fixed point, saturating at the given limit.
+ * @param value The reading.
+ * @param scale The number of fixed point units per unit of the reading.
+ * @param limit The largest magnitude of the fixed point value.
+ * @param out Where to store the fixed point value.
+ * @return False if the reading is NaN, true otherwise.
+ */
+static bool to_fixed(const float value, const float scale, const int64_t limit, int64_t *out) {
+    const float scaled = value * scale;
+    if (isnan(scaled)) return false;
+    if (scaled >= (float)limit) {
+        *out = limit;
+    } else if (scaled <= -(float)limit) {
+        *out = -limit;
+    } else {
+        *out = (int64_t)scaled;
+    }
+    return true;
+}
+
+/**
+ * Limits a value to between -limit and limit.
+ * @param value The value.
+ * @param limit The largest allowed magnitude.
+ * @return The limited value.
+ */
+static inline int64_t clamp(const int64_t value, const int64_t limit) {
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+/**
+ * Integrates the estimate up to the given time with the held acceleration. Time going backwards or gaps longer than
+ * FUSION_MAX_GAP_MS only move the clock.
+ * @param f The estimator.
+ * @param mission_time The mission time in milliseconds.
+ */
+static void predict(Fusion *f, const uint32_t mission_time) {
+    const uint32_t dt = mission_time - f->last_predict;
+    f->last_predict = mission_time;
+    if (dt > FUSION_MAX_GAP_MS) return;
+
+    // um/s * ms = 1e-3 um and mm/s^2 * ms^2 = 1e-3 um
+    f->altitude = clamp(f->altitude + (f->velocity * dt + (int64_t)f->accel * dt * dt / 2) / 1000, MAX_ALTITUDE);
+    f->velocity = clamp(f->velocity + (int64_t)f->accel * dt, MAX_VELOCITY); // mm/s^2 * ms = um/s
+}
+
+/**
+ * Initializes the estimator. It produces no estimates until the first altitude reading.
+ * @param f The estimator to initialize.
+ * @param rate The number of estimates per second, clamped to between 1 and FUSION_MAX_RATE.
+ * @param tau_ms The crossover time constant in milliseconds, clamped to between FUSION_MIN_TAU_MS and
+ * FUSION_MAX_TAU_MS. Longer time constants smooth the altitude more but follow accelerometer bias for longer.
+ */
+void fusion_init(Fusion *f, const uint32_t rate, const uint32_t tau_ms) {
+    uint32_t tau = tau_ms;
+    if (tau < FUSION_MIN_TAU_MS) tau = FUSION_MIN_TAU_MS;
+    if (tau > FUSION_MAX_TAU_MS) tau = FUSION_MAX_TAU_MS;
+    uint32_t r = rate;
+    if (r < 1) r = 1;
+    if (r > FUSION_MAX_RATE) r = FUSION_MAX_RATE;
+
+    *f = (Fusion){
+        .k_alt = (2LL << FUSION_GAIN_SHIFT) / tau,
+        .k_vel = (1000LL << FUSION_GAIN_SHIFT) / ((int64_t)tau * tau), // Per second for the velocity in um/s
+        .half_tau = tau / 2,
+        .period = 1000 / r,
+    };
+}
+
+/**
+ * Feeds an input message to the estimator. Relative altitude readings correct the estimate and the vertical component
+ * of absolute linear acceleration readings drives it. NaN readings are consumed without effect.
+ * @param f The estimator.
+ * @param msg The input message.
+ * @param mission_time The mission time of the message in milliseconds.
+ * @return True if the message was consumed by the estimator, false if it is not one of its inputs.
+ */
+bool fusion_update(Fusion *f, const common_t *msg, const uint32_t mission_time) {
+    int64_t value;
+
+    switch (msg->type) {
+    case TAG_LINEAR_ACCEL_ABS:
+        if (!to_fixed(msg->data.VEC3D.z, 1000.0f, MAX_ACCEL, &value)) break;
+        if (f->ready) predict(f, mission_time);
+        f->accel = (int32_t)value;
+        break;
+
+    case TAG_ALTITUDE_REL: {
+        if (!to_fixed(msg->data.FLOAT, 1000000.0f, MAX_ALTITUDE, &value)) break;
+        if (!f->ready || mission_time - f->last_correct > FUSION_MAX_GAP_MS) {
+            // Start at rest at the first reading, and start over after a gap in the altitude readings
+            f->altitude = value;
+            f->velocity = 0;
+            f->last_predict = f->last_correct = mission_time;
+            if (!f->ready) f->next_output = mission_time;
+            f->ready = true;
+            break;
+        }
+
+        predict(f, mission_time);
+        uint32_t dt = mission_time - f->last_correct;
+        f->last_correct = mission_time;
+        if (dt > f->half_tau) dt = f->half_tau; // Sparse readings replace the altitude
+
+        const int64_t error = clamp(value - f->altitude, MAX_ERROR);
+        f->altitude += (error * dt * f->k_alt) >> FUSION_GAIN_SHIFT;
+        f->velocity = clamp(f->velocity + ((error * dt * f->k_vel) >> FUSION_GAIN_SHIFT), MAX_VELOCITY);
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    f->samples++;
+    return true;
+}
+
+/**
+ * Checks whether the next estimate is due, and if so schedules the one after it. Estimates that were missed during a
+ * gap in the input are skipped rather than sent in a burst.
+ * @param f The estimator.
+ * @param mission_time The current mission time in milliseconds.
+ * @return True if an estimate should be sent now, false otherwise.
+ */
+bool fusion_due(Fusion *f, const uint32_t mission_time) {
+    if (!f->ready || (int32_t)(mission_time - f->next_output) < 0) return false;
+    f->next_output += f->period;
+    if ((int32_t)(mission_time - f->next_output) >= 0) f->next_output = mission_time + f->period;
+    return true;
+}
+
+/**
+ * Encodes the current estimate as a data block, including its block header.
+ * @param f The estimator.
+ * @param buf The buffer to write the block to. Must have room for at least encoded_block_size(tag) bytes.
+ * @param tag TAG_ALTITUDE_FUSED for a filtered altitude block or TAG_VERTICAL_VEL for a vertical velocity block.
+ * @param mission_time The mission time of the estimate in milliseconds.
+ * @return The number of bytes written, or 0 if the tag is not an output of the estimator.
+ */
+uint16_t fusion_encode(const Fusion *f, uint8_t *buf, const uint8_t tag, const uint32_t mission_time) {
+    if (tag != TAG_ALTITUDE_FUSED && tag != TAG_VERTICAL_VEL) return 0;
+
+    const int64_t value = clamp((tag == TAG_ALTITUDE_FUSED ? f->altitude : f->velocity) / 1000, INT32_MAX);
+
+    const uint16_t size = encoded_block_size(tag);
+    BlockHeader *h = (BlockHeader *)buf;
+    uint8_t *payload = buf + sizeof(BlockHeader);
+    if (tag == TAG_ALTITUDE_FUSED) {
+        block_header_init(h, size - sizeof(BlockHeader), TYPE_DATA, DATA_ALT_FUSED, GROUNDSTATION);
+        altitude_db_init((AltitudeDB *)payload, mission_time, (int32_t)value);
+    } else {
+        block_header_init(h, size - sizeof(BlockHeader), TYPE_DATA, DATA_VELOCITY, GROUNDSTATION);
+        velocity_db_init((VelocityDB *)payload, mission_time, (int32_t)value);
+    }
+    return size;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file fusion.h
+ * @brief Streaming estimation of altitude and vertical velocity from relative altitude and acceleration readings.
+ *
+ * A second order complementary filter integrates the vertical component of the absolute linear acceleration (ground
+ * frame, gravity removed) and corrects the result with the relative altitude readings. Acceleration is trusted over
+ * short time spans and altitude over long ones, with the crossover set by a time constant. The filter runs entirely in
+ * fixed point so that every sample costs a handful of integer operations, and its estimates are sent as filtered
+ * altitude and vertical velocity blocks at a configurable rate instead of every raw altitude reading. The filtered
+ * altitude has a tag and subtype of its own, and acceleration readings are still sent as they are.
+ */
+
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+#include "intypes.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The default crossover time constant of the filter in milliseconds. */
+#define FUSION_DEFAULT_TAU_MS 500
+
+/** The shortest allowed time constant, which keeps the fixed point correction from overflowing. */
+#define FUSION_MIN_TAU_MS 50
+
+/** The longest allowed time constant. */
+#define FUSION_MAX_TAU_MS 60000
+
+/** The highest output rate in estimates per second. */
+#define FUSION_MAX_RATE 1000
+
+/** Gaps between readings longer than this many milliseconds are not integrated over. */
+#define FUSION_MAX_GAP_MS 1000
+
+/** The number of fractional bits of the correction gains. */
+#define FUSION_GAIN_SHIFT 24
+
+/** State of the altitude and vertical velocity estimator. */
+typedef struct {
+    /** The estimated altitude above launch height in micrometres. */
+    int64_t altitude;
+    /** The estimated vertical velocity in micrometres per second, positive upwards. */
+    int64_t velocity;
+    /** The most recent vertical acceleration in millimetres per second squared, held until the next reading. */
+    int32_t accel;
+    /** The altitude correction gain per millisecond between altitude readings, 2 / tau in fixed point. */
+    int64_t k_alt;
+    /** The velocity correction gain per millisecond between altitude readings, 1 / tau^2 in fixed point. */
+    int64_t k_vel;
+    /** Half the time constant in milliseconds, the interval at which the altitude correction is complete. */
+    uint32_t half_tau;
+    /** The mission time in milliseconds up to which the estimate has been integrated. */
+    uint32_t last_predict;
+    /** The mission time in milliseconds of the last altitude reading. */
+    uint32_t last_correct;
+    /** The interval between estimates in milliseconds. */
+    uint32_t period;
+    /** The mission time in milliseconds at which the next estimate is due. */
+    uint32_t next_output;
+    /** Whether an altitude reading has been received, which the estimate starts from. */
+    bool ready;
+    /** The number of readings consumed by the filter. */
+    uint32_t samples;
+} Fusion;
+
+void fusion_init(Fusion *f, const uint32_t rate, const uint32_t tau_ms);
+bool fusion_update(Fusion *f, const common_t *msg, const uint32_t mission_time);
+bool fusion_due(Fusion *f, const uint32_t mission_time);
+uint16_t fusion_encode(const Fusion *f, uint8_t *buf, const uint8_t tag, const uint32_t mission_time);
+
+#endif // _FUSION_H_
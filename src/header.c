@@ -0,0 +1,136 @@
+/**
+ * @file header.c
+ * @brief Contains the definitions for building packet headers from templates, scheduling compact headers and
+ * reconstructing full headers from compact ones.
+ */
+#include "header.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initializes a packet header template. The call sign is copied and padded once here rather than for every packet.
+ * @param t The template to initialize.
+ * @param callsign The HAM radio call sign to include in full packet headers.
+ * @param version The version of the packet encoding format being used.
+ * @param source The source address of the packets.
+ * @return True if the template was initialized, false if the call sign is empty or too long to fit in the header.
+ */
+bool packet_header_template_init(PacketHeaderTemplate *t, const char *callsign, const uint8_t version,
+                                 const DeviceAddress source) {
+    size_t len = strlen(callsign);
+    if (len == 0 || len > sizeof(t->call_sign)) return false;
+
+    memset(t->call_sign, 0, sizeof(t->call_sign));
+    memcpy(t->call_sign, callsign, len);
+    t->version = version;
+    t->src_addr = source;
+    return true;
+}
+
+/**
+ * Writes the header of a new, empty packet.
+ * @param packet The packet buffer to write the header to.
+ * @param t The header template of the packet stream.
+ * @param compact True to write a CompactPacketHeader, false to write a full PacketHeader.
+ * @param packet_number The number of this packet (how many were sent before it).
+ * @return The size of the written header in bytes.
+ */
+uint16_t packet_header_write(uint8_t *packet, const PacketHeaderTemplate *t, const bool compact,
+                             const uint32_t packet_number) {
+    if (compact) {
+        CompactPacketHeader *c = (CompactPacketHeader *)packet;
+        c->marker = COMPACT_HEADER_MARKER;
+        c->len = (sizeof(CompactPacketHeader) / 4) - 1;
+        c->station_id = t->src_addr;
+        c->packet_num = packet_number & 0xFF;
+        return sizeof(CompactPacketHeader);
+    }
+
+    PacketHeader *p = (PacketHeader *)packet;
+    memcpy(p->call_sign, t->call_sign, sizeof(p->call_sign));
+    packet_header_set_length(p, 0);
+    p->version = t->version;
+    p->src_addr = t->src_addr;
+    p->packet_num = packet_number;
+    return sizeof(PacketHeader);
+}
+
+/**
+ * Initializes a compact header schedule.
+ * @param s The schedule to initialize.
+ * @param every_packets Send the full header at least once every this many packets, or 0 to always send it.
+ * @param every_ms Send the full header at least once every this many milliseconds, or 0 for no time limit.
+ */
+void header_schedule_init(HeaderSchedule *s, const uint32_t every_packets, const uint32_t every_ms) {
+    *s = (HeaderSchedule){
+        .every_packets = every_packets,
+        .every_ms = every_ms,
+    };
+}
+
+/**
+ * Decides whether the next packet gets a full header, and records it if it does.
+ * @param s The compact header schedule.
+ * @param packet_number The number of the next packet.
+ * @param now_ms The current time in milliseconds.
+ * @return True if the packet must have a full header, false if it can have a compact header.
+ */
+bool header_schedule_full(HeaderSchedule *s, const uint32_t packet_number, const uint32_t now_ms) {
+    bool full = s->every_packets == 0 || !s->sent_full || packet_number - s->last_full_num >= s->every_packets ||
+                (s->every_ms != 0 && now_ms - s->last_full_ms >= s->every_ms);
+
+    // The decoder can only recover 8 bits of packet number from a compact header
+    if (packet_number - s->last_full_num > 0xFF) full = true;
+
+    if (full) {
+        s->sent_full = true;
+        s->last_full_num = packet_number;
+        s->last_full_ms = now_ms;
+    }
+    return full;
+}
+
+/**
+ * Initializes a header decoder with no known stations.
+ * @param d The header decoder to initialize.
+ */
+void header_decoder_init(HeaderDecoder *d) { memset(d, 0, sizeof(*d)); }
+
+/**
+ * Decodes the header of a received packet, reconstructing the full header if it is compact.
+ * @param d The header decoder.
+ * @param packet The received packet.
+ * @param out Where to store the full packet header.
+ * @return The size of the header in the packet in bytes, or 0 if the packet has a compact header from a station that no
+ * full header has been received from yet.
+ */
+uint16_t header_decode(HeaderDecoder *d, const uint8_t *packet, PacketHeader *out) {
+
+    if (!packet_is_compact(packet)) {
+        memcpy(out, packet, sizeof(PacketHeader));
+        HeaderStation *s = &d->stations[out->src_addr];
+        s->known = true;
+        memcpy(s->call_sign, out->call_sign, sizeof(s->call_sign));
+        s->version = out->version;
+        s->last_num = out->packet_num;
+        return sizeof(PacketHeader);
+    }
+
+    const CompactPacketHeader *c = (const CompactPacketHeader *)packet;
+    HeaderStation *s = &d->stations[c->station_id];
+    if (!s->known) return 0;
+
+    // The packet number is the closest one at or after the last one with matching low bits
+    uint32_t num = (s->last_num & ~(uint32_t)0xFF) | c->packet_num;
+    if (num < s->last_num) num += 0x100;
+    s->last_num = num;
+
+    memcpy(out->call_sign, s->call_sign, sizeof(out->call_sign));
+    out->len = ((c->len + 1) * 4 - sizeof(CompactPacketHeader) + sizeof(PacketHeader)) / 4 - 1;
+    out->version = s->version;
+    out->src_addr = c->station_id;
+    out->packet_num = num;
+    return sizeof(CompactPacketHeader);
+}
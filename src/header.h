@@ -0,0 +1,77 @@
+/**
+ * @file header.h
+ * @brief Packet header construction for a stream of packets, including compact headers and their reconstruction.
+ *
+ * The fields of the packet header which are the same for every packet in a stream are computed once into a template.
+ * In compact mode the full header, with the call sign, is only sent every so many packets or seconds and every other
+ * packet gets a CompactPacketHeader. The decoder reconstructs full headers from compact ones using the last full header
+ * received from the same station.
+ */
+
+#ifndef _HEADER_H_
+#define _HEADER_H_
+
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The largest size in bytes of a packet with a compact header. The full header reconstructed from the compact one is
+ * larger, and must still fit in the packet length field.
+ */
+#define COMPACT_PACKET_LIMIT_SIZE (PACKET_LIMIT_SIZE - sizeof(PacketHeader) + sizeof(CompactPacketHeader))
+
+/** The header fields which are the same for every packet in a stream. */
+typedef struct {
+    /** The HAM radio call sign padded with trailing null characters. */
+    char call_sign[sizeof(((PacketHeader *)0)->call_sign)];
+    /** The version of InSpace radio packet encoding being used. */
+    uint8_t version;
+    /** The source address of the packets. */
+    uint8_t src_addr;
+} PacketHeaderTemplate;
+
+/** Decides which packets of a stream get a full header in compact mode. */
+typedef struct {
+    /** Send a full header at least once every this many packets. 0 means compact headers are disabled. */
+    uint32_t every_packets;
+    /** Send a full header at least once every this many milliseconds. 0 means no time limit. */
+    uint32_t every_ms;
+    /** Whether a full header has been sent yet. */
+    bool sent_full;
+    /** The packet number of the last full header. */
+    uint32_t last_full_num;
+    /** The time in milliseconds of the last full header. */
+    uint32_t last_full_ms;
+} HeaderSchedule;
+
+/** What the decoder knows about a single station. */
+typedef struct {
+    /** Whether a full header has been received from this station. */
+    bool known;
+    /** The call sign of the station. */
+    char call_sign[sizeof(((PacketHeader *)0)->call_sign)];
+    /** The encoding version of the station. */
+    uint8_t version;
+    /** The packet number of the last packet received from the station. */
+    uint32_t last_num;
+} HeaderStation;
+
+/** Reconstructs full packet headers from a stream of full and compact headers. */
+typedef struct {
+    /** The known stations, indexed by station ID. */
+    HeaderStation stations[256];
+} HeaderDecoder;
+
+bool packet_header_template_init(PacketHeaderTemplate *t, const char *callsign, const uint8_t version,
+                                 const DeviceAddress source);
+uint16_t packet_header_write(uint8_t *packet, const PacketHeaderTemplate *t, const bool compact,
+                             const uint32_t packet_number);
+
+void header_schedule_init(HeaderSchedule *s, const uint32_t every_packets, const uint32_t every_ms);
+bool header_schedule_full(HeaderSchedule *s, const uint32_t packet_number, const uint32_t now_ms);
+
+void header_decoder_init(HeaderDecoder *d);
+uint16_t header_decode(HeaderDecoder *d, const uint8_t *packet, PacketHeader *out);
+
+#endif // _HEADER_H_
@@ -0,0 +1,152 @@
+/**
+ * @file history.c
+ * @brief Contains the definitions for keeping the history of sent packets and resending blocks from it.
+ */
+#include "history.h"
+#include "encoder.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initializes an empty history, allocating its packet slots from an arena.
+ * @param h The history to initialize.
+ * @param depth The number of packets to keep, capped at HISTORY_MAX_PACKETS. 0 for no history.
+ * @param slot_size The maximum size of the packets of the sink in bytes.
+ * @param arena The arena to allocate from.
+ * @return True if the history was initialized, false if the arena had no room, in which case no packets are kept.
+ */
+bool history_init(PacketHistory *h, const uint8_t depth, const uint16_t slot_size, Arena *arena) {
+    memset(h, 0, sizeof(*h));
+    h->slot_size = slot_size;
+    if (history_footprint(depth, slot_size) == 0) return true;
+
+    h->packets = arena_alloc(arena, history_footprint(depth, slot_size), "history");
+    if (h->packets == NULL) return false;
+    h->depth = depth > HISTORY_MAX_PACKETS ? HISTORY_MAX_PACKETS : depth;
+    return true;
+}
+
+/**
+ * Keeps a copy of a sent packet, replacing the oldest packet once the history is full.
+ * @param h The history.
+ * @param packet_num The number of the packet.
+ * @param packet The packet.
+ * @param len The length of the packet in bytes, at most the slot size.
+ */
+void history_store(PacketHistory *h, const uint32_t packet_num, const uint8_t *packet, const uint16_t len) {
+    if (h->depth == 0 || len > h->slot_size) return;
+    const uint8_t slot = packet_num % h->depth;
+    memcpy(h->packets + slot * h->slot_size, packet, len);
+    h->numbers[slot] = packet_num;
+    h->lengths[slot] = len;
+    h->last = packet_num;
+    h->stored = true;
+}
+
+/**
+ * Finds a packet in the history.
+ * @param h The history.
+ * @param packet_num The number of the packet.
+ * @param len Where to store the length of the packet in bytes.
+ * @return The packet, or NULL if it is not in the history.
+ */
+const uint8_t *history_find(const PacketHistory *h, const uint32_t packet_num, uint16_t *len) {
+    if (h->depth == 0) return NULL;
+    const uint8_t slot = packet_num % h->depth;
+    if (h->lengths[slot] == 0 || h->numbers[slot] != packet_num) return NULL;
+    *len = h->lengths[slot];
+    return h->packets + slot * h->slot_size;
+}
+
+/**
+ * Queues the blocks of a packet in the history that have one of the requested subtypes to be resent.
+ * @param h The history.
+ * @param packet_num The number of the packet.
+ * @param subtypes Bit mask of the subtypes of the blocks to resend.
+ * @return The number of blocks queued, or -1 if the packet is not in the history.
+ */
+static int queue_packet(PacketHistory *h, const uint32_t packet_num, const uint32_t subtypes) {
+    uint16_t len;
+    const uint8_t *packet = history_find(h, packet_num, &len);
+    if (packet == NULL) return -1;
+
+    int queued = 0;
+    for (uint16_t offset = packet_header_size(packet); offset + sizeof(BlockHeader) <= len;) {
+        const BlockHeader *b = (const BlockHeader *)(packet + offset);
+        const uint16_t size = block_header_get_length(b);
+        if (b->subtype < 32 && (subtypes & (1u << b->subtype))) {
+            if (h->n_pending == HISTORY_MAX_PENDING) {
+                h->dropped++;
+            } else {
+                h->pending[h->n_pending++] = (PendingBlock){.packet_num = packet_num, .offset = offset, .size = size};
+                queued++;
+            }
+        }
+        offset += size;
+    }
+    return queued;
+}
+
+/**
+ * Queues the requested blocks to be resent.
+ * @param h The history.
+ * @param r The request.
+ * @return The number of blocks queued.
+ */
+uint16_t history_request(PacketHistory *h, const ResendRequest *r) {
+    if (h->depth == 0 || !h->stored) {
+        h->missing += r->count;
+        return 0;
+    }
+
+    // Only the packets still in the history need to be looked at
+    const uint32_t oldest = h->last >= h->depth - 1u ? h->last - (h->depth - 1u) : 0;
+    const uint32_t first = r->count == 0 ? oldest : r->first;
+    uint32_t last = h->last;
+    if (r->count != 0 && r->count - 1 < h->last - first) last = first + r->count - 1;
+
+    uint16_t queued = 0;
+    uint32_t found = 0;
+    for (uint32_t n = first < oldest ? oldest : first; n <= last && n <= h->last; n++) {
+        const int q = queue_packet(h, n, r->subtypes);
+        if (q < 0) continue;
+        queued += q;
+        found++;
+    }
+    if (r->count != 0) h->missing += r->count - found;
+    return queued;
+}
+
+/**
+ * Appends as many queued blocks as fit to the end of a packet, in the order they were requested, marked as resent.
+ * Blocks that do not fit stay queued for a later packet, and blocks of packets that have left the history are dropped.
+ * @param h The history.
+ * @param b The packet builder of the packet being sent.
+ * @param budget The most bytes to append.
+ * @return The number of bytes appended.
+ */
+uint16_t history_fill(PacketHistory *h, PacketBuilder *b, uint16_t budget) {
+    uint16_t appended = 0;
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < h->n_pending; i++) {
+        const PendingBlock *p = &h->pending[i];
+        uint16_t len;
+        const uint8_t *packet = history_find(h, p->packet_num, &len);
+        if (packet == NULL) {
+            h->dropped++;
+            continue;
+        }
+        if (p->size <= budget && packet_builder_append(b, packet + p->offset, p->size)) {
+            ((BlockHeader *)(packet_builder_tail(b) - p->size))->type |= BLOCK_TYPE_RESENT;
+            budget -= p->size;
+            appended += p->size;
+            h->resent++;
+            continue;
+        }
+        h->pending[kept++] = *p;
+    }
+    h->n_pending = kept;
+    return appended;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file history.h
+ * @brief History of recently sent packets, from which blocks are resent on request of the ground station.
+ *
+ * Each sink with a history keeps copies of its most recently sent packets, indexed by packet number. The ground station
+ * asks for lost packets by number over the uplink, or for only the blocks of some subtypes, such as events, from a
+ * range of packets. The requested blocks are queued and resent in packets that are being sent anyway: when a packet is
+ * started, up to 1 / HISTORY_RESERVE_SHARE of it is reserved for them, so that they still go out while fresh data fills
+ * every packet, and the room left over when the packet is sent takes more. Resent blocks have BLOCK_TYPE_RESENT set in
+ * their type, so the ground station can tell them from fresh ones.
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include "arena.h"
+#include "encoder.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The most packets kept per sink. */
+#define HISTORY_MAX_PACKETS 128
+
+/** The most blocks waiting to be resent per sink. */
+#define HISTORY_MAX_PENDING 64
+
+/** Resends may take up to one in this many bytes of a packet as soon as it is started, before fresh data fills it. */
+#define HISTORY_RESERVE_SHARE 4
+
+/** Subtype mask of a resend request that resends every block of the packets. */
+#define RESEND_ALL_SUBTYPES 0xFFFFFFFF
+
+/** A request to resend blocks, as received on the uplink request queue. */
+typedef struct {
+    /** The index of the sink whose packets to resend, by position on the command line. */
+    uint8_t sink;
+    /** Unused. */
+    uint8_t _padding[3];
+    /** The number of the first packet to resend blocks of. */
+    uint32_t first;
+    /** The number of packets to resend blocks of, or 0 for every packet in the history. */
+    uint32_t count;
+    /** Bit mask of the subtypes of the blocks to resend, bit n for subtype n. */
+    uint32_t subtypes;
+} ResendRequest;
+
+/** A block waiting to be resent. */
+typedef struct {
+    /** The number of the packet the block was sent in. */
+    uint32_t packet_num;
+    /** The offset of the block in the packet. */
+    uint16_t offset;
+    /** The size of the block in bytes. */
+    uint16_t size;
+} PendingBlock;
+
+/** The history of a sink. */
+typedef struct {
+    /** The copies of the packets, in slots of the maximum packet size of the sink. */
+    uint8_t *packets;
+    /** The number of each packet in a slot. */
+    uint32_t numbers[HISTORY_MAX_PACKETS];
+    /** The length of the packet in each slot, or 0 if the slot is empty. */
+    uint16_t lengths[HISTORY_MAX_PACKETS];
+    /** The size of the slots in bytes. */
+    uint16_t slot_size;
+    /** The number of packets kept, 0 if the sink has no history. */
+    uint8_t depth;
+    /** Whether any packet has been stored. */
+    bool stored;
+    /** The number of the most recently stored packet. */
+    uint32_t last;
+    /** The blocks waiting to be resent, oldest first. */
+    PendingBlock pending[HISTORY_MAX_PENDING];
+    /** The number of blocks waiting to be resent. */
+    uint8_t n_pending;
+    /** The number of requested packets that were no longer in the history. */
+    uint32_t missing;
+    /** The number of blocks resent. */
+    uint32_t resent;
+    /** The number of requested blocks that were not resent because too many were waiting or they left the history. */
+    uint32_t dropped;
+} PacketHistory;
+
+/**
+ * Gets the arena memory a history needs.
+ * @param depth The number of packets to keep.
+ * @param slot_size The maximum size of the packets in bytes.
+ * @return The size of the history's arena allocation in bytes.
+ */
+static inline size_t history_footprint(const uint8_t depth, const uint16_t slot_size) {
+    const size_t packets = depth > HISTORY_MAX_PACKETS ? HISTORY_MAX_PACKETS : depth;
+    return packets == 0 ? 0 : arena_round(packets * slot_size);
+}
+
+bool history_init(PacketHistory *h, const uint8_t depth, const uint16_t slot_size, Arena *arena);
+void history_store(PacketHistory *h, const uint32_t packet_num, const uint8_t *packet, const uint16_t len);
+const uint8_t *history_find(const PacketHistory *h, const uint32_t packet_num, uint16_t *len);
+uint16_t history_request(PacketHistory *h, const ResendRequest *r);
+uint16_t history_fill(PacketHistory *h, PacketBuilder *b, uint16_t budget);
+
+#endif // _HISTORY_H_
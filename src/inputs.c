@@ -0,0 +1,183 @@
+/**
+ * @file inputs.c
+ * @brief Contains the definitions for opening the input queues and draining them in weighted rounds.
+ */
+#include "inputs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Gets the current time from the monotonic clock.
+ * @return The current monotonic time in microseconds.
+ */
+static uint64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + now.tv_nsec / 1000;
+}
+
+/**
+ * Initializes an empty set of input queues.
+ * @param set The set to initialize.
+ */
+void input_set_init(InputSet *set) { memset(set, 0, sizeof(*set)); }
+
+/**
+ * Opens an input queue and adds it to the set.
+ * @param set The set.
+ * @param spec The name of the message queue, optionally followed by ':' and its weight, from 1 to INPUT_MAX_WEIGHT
+ * messages per round (1 by default).
+ * @return True if the queue was added, false if there are too many queues, the specification is invalid or the queue
+ * could not be opened (with errno set).
+ */
+bool input_set_add(InputSet *set, const char *spec) {
+    if (set->count == INPUTS_MAX) {
+        errno = ENOSPC;
+        return false;
+    }
+
+    InputQueue *in = &set->queues[set->count];
+    memset(in, 0, sizeof(*in));
+    in->weight = 1;
+    const char *colon = strrchr(spec, ':');
+    const size_t len = colon == NULL ? strlen(spec) : (size_t)(colon - spec);
+    if (colon != NULL) {
+        char *end;
+        const unsigned long weight = strtoul(colon + 1, &end, 10);
+        if (*end != '\0' || weight == 0 || weight > INPUT_MAX_WEIGHT) {
+            errno = EINVAL;
+            return false;
+        }
+        in->weight = weight;
+    }
+    if (len == 0 || len > INPUT_NAME_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+    memcpy(in->name, spec, len);
+
+    in->q = mq_open(in->name, O_RDONLY | O_NONBLOCK);
+    if (in->q == (mqd_t)-1) return false;
+    set->fds[set->count] = (struct pollfd){.fd = in->q, .events = POLLIN};
+    set->count++;
+    return true;
+}
+
+/**
+ * Starts a new round with one poll of every queue, crediting each readable queue with its weight.
+ * @param set The set.
+ * @param wait_ms The longest time to wait for a message in milliseconds, 0 to not wait or -1 to wait until one arrives.
+ * @return True if any queue was credited, false on error, with errno set to EAGAIN if there was no message and not
+ * waiting, ETIMEDOUT if none arrived in time, EINTR if a signal interrupted the wait or EIO if poll reported the
+ * queues without any of them being readable.
+ */
+static bool start_round(InputSet *set, const int32_t wait_ms) {
+    const int ready = poll(set->fds, set->count, wait_ms < 0 ? -1 : wait_ms);
+    if (ready == 0) errno = wait_ms == 0 ? EAGAIN : ETIMEDOUT;
+    if (ready <= 0) return false;
+
+    const uint64_t now_us = monotonic_us();
+    bool any = false;
+    for (uint8_t i = 0; i < set->count; i++) {
+        InputQueue *in = &set->queues[i];
+        in->deficit = 0;
+        if (!(set->fds[i].revents & POLLIN)) continue;
+        in->deficit = in->weight;
+        in->round_us = now_us;
+        in->busy_rounds++;
+        any = true;
+    }
+    set->current = 0;
+    if (!any) errno = EIO;
+    return any;
+}
+
+/**
+ * Receives the next message of a set with a single queue, which needs no turns: the queue is received from directly
+ * and only polled once it is empty.
+ * @param set The set.
+ * @param buf Where to store the message.
+ * @param size The size of the buffer, at least the message size of the queue.
+ * @param priority Where to store the priority of the message.
+ * @param wait_ms The longest time to wait for a message in milliseconds, 0 to not wait or -1 to wait until one arrives.
+ * @return The size of the message, or -1 on error, with errno set like input_set_receive does.
+ */
+static ssize_t receive_single(InputSet *set, char *buf, const size_t size, unsigned int *priority,
+                              const int32_t wait_ms) {
+    InputQueue *in = &set->queues[0];
+    for (;;) {
+        const ssize_t n = mq_receive(in->q, buf, size, priority);
+        if (n != -1) {
+            in->received++;
+            return n;
+        }
+        if (errno != EAGAIN || wait_ms == 0) return -1;
+
+        const int ready = poll(set->fds, 1, wait_ms < 0 ? -1 : wait_ms);
+        if (ready == 0) errno = ETIMEDOUT;
+        if (ready <= 0) return -1;
+    }
+}
+
+/**
+ * Receives the next input message, taking turns between the queues by their weights. Within a queue, messages are
+ * received by priority.
+ * @param set The set.
+ * @param buf Where to store the message.
+ * @param size The size of the buffer, at least the message size of every queue.
+ * @param priority Where to store the priority of the message.
+ * @param source Where to store the index of the queue the message or error came from.
+ * @param wait_ms The longest time to wait for a message in milliseconds, 0 to not wait or -1 to wait until one arrives.
+ * @return The size of the message, or -1 on error, with errno set to EAGAIN if there was no message and not waiting,
+ * ETIMEDOUT if none arrived in time or EINTR if a signal interrupted the wait.
+ */
+ssize_t input_set_receive(InputSet *set, char *buf, const size_t size, unsigned int *priority, uint8_t *source,
+                          const int32_t wait_ms) {
+    *source = 0;
+    if (set->count == 1) return receive_single(set, buf, size, priority, wait_ms);
+
+    for (;;) {
+        for (; set->current < set->count; set->current++) {
+            InputQueue *in = &set->queues[set->current];
+            if (in->deficit == 0) continue;
+
+            const ssize_t n = mq_receive(in->q, buf, size, priority);
+            if (n == -1 && errno == EAGAIN) {
+                in->deficit = 0; // Emptied before its credit ran out, its turn is over
+                continue;
+            }
+            *source = set->current;
+            if (n == -1) {
+                in->deficit = 0;
+                return -1;
+            }
+
+            if (--in->deficit == 0) in->full_turns++;
+            in->received++;
+            const uint64_t wait_us = monotonic_us() - in->round_us;
+            in->turn_wait_sum_us += wait_us;
+            if (wait_us > in->max_turn_wait_us) in->max_turn_wait_us = wait_us > UINT32_MAX ? UINT32_MAX : wait_us;
+            return n;
+        }
+
+        if (!start_round(set, wait_ms)) return -1;
+    }
+}
+
+/**
+ * Closes every input queue of the set.
+ * @param set The set.
+ */
+void input_set_close(InputSet *set) {
+    for (uint8_t i = 0; i < set->count; i++) {
+        mq_close(set->queues[i].q);
+    }
+    set->count = 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file inputs.h
+ * @brief Set of input message queues, one per producer, drained fairly from a single poll loop.
+ *
+ * Each producer (avionics bay, payload, GPS) gets its own input queue so that a noisy one cannot fill the queue of the
+ * others. The queues are drained in rounds of deficit round robin: each round starts with one poll, every queue that
+ * poll finds readable is credited its weight in messages, and each queue in turn is drained of its credit or until it
+ * is empty. Input messages all have the same size, so the credit is counted in messages. When every queue is empty the
+ * poll sleeps until one of them receives a message.
+ *
+ * A single queue needs no turns, so it is received from directly, with one system call per message, and only polled
+ * once it is empty.
+ */
+
+#ifndef _INPUTS_H_
+#define _INPUTS_H_
+
+#include <mqueue.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** The most input queues. */
+#define INPUTS_MAX 4
+
+/** The most characters in the name of an input queue. */
+#define INPUT_NAME_MAX 63
+
+/** The most messages a queue may be credited per round. */
+#define INPUT_MAX_WEIGHT 64
+
+/** An input queue. */
+typedef struct {
+    /** The name of the message queue. */
+    char name[INPUT_NAME_MAX + 1];
+    /** The message queue, opened without blocking. */
+    mqd_t q;
+    /** The number of messages the queue is credited per round. */
+    uint8_t weight;
+    /** The number of messages the queue may still give this round. */
+    uint8_t deficit;
+    /** The time in microseconds at which the poll that started the current round returned. */
+    uint64_t round_us;
+    /** The number of messages received. */
+    uint32_t received;
+    /** The number of rounds the queue had messages in. Not counted for a single queue, which has no rounds. */
+    uint32_t busy_rounds;
+    /** The number of rounds the queue gave its whole weight in, and so may have had messages left over. */
+    uint32_t full_turns;
+    /** The sum of the times in microseconds messages waited for the turn of their queue, from the poll that started
+     * their round to being received. This is the skew that sharing a round adds, not the time spent in the queue. */
+    uint64_t turn_wait_sum_us;
+    /** The longest time in microseconds a message waited for the turn of its queue. */
+    uint32_t max_turn_wait_us;
+} InputQueue;
+
+/** A set of input queues. */
+typedef struct {
+    /** The queues, in the order they were added. */
+    InputQueue queues[INPUTS_MAX];
+    /** The descriptors of the queues, for poll. */
+    struct pollfd fds[INPUTS_MAX];
+    /** The number of queues. */
+    uint8_t count;
+    /** The index of the queue being drained in the current round. */
+    uint8_t current;
+} InputSet;
+
+void input_set_init(InputSet *set);
+bool input_set_add(InputSet *set, const char *spec);
+ssize_t input_set_receive(InputSet *set, char *buf, const size_t size, unsigned int *priority, uint8_t *source,
+                          const int32_t wait_ms);
+void input_set_close(InputSet *set);
+
+#endif // _INPUTS_H_
@@ -48,12 +48,20 @@ typedef enum {
     TAG_COORDS = 0x9,           /**< Latitude and longitude in degrees */
     TAG_VOLTAGE = 0xa,          /**< Voltage in volts with a unique ID. */
     TAG_FIX = 0xb,              /**< Fix type representing the type of fix a gps has */
+    TAG_VERTICAL_VEL = 0xc,     /**< Vertical velocity in meters per second, estimated by packager itself */
+    TAG_ALTITUDE_FUSED = 0xd,   /**< Altitude above launch height in meters, estimated by packager itself */
 } SensorTag;
 
 /** Describes a message that can be sent on a message queue and recognized by both fetcher and packager */
 typedef struct {
     uint8_t type; /**< Measurement type */
     uint8_t id;   /**< Sensor ID */
+    /**
+     * Source sequence number, one higher for every message sent. It takes the padding bytes after the sensor ID, so the
+     * layout is unchanged, but fetcher does not fill it in yet: it is only read with -r, which needs a fetcher that
+     * stamps it (like tests/load/loadgen.c does). Unstamped messages would all look like duplicates and be dropped.
+     */
+    uint16_t seq;
     union {
         float FLOAT;
         uint32_t U32;
@@ -1,13 +1,33 @@
 #include "../logging-utils/logging.h"
+#include "arena.h"
+#include "encoder.h"
+#include "events.h"
+#include "fusion.h"
+#include "header.h"
+#include "inputs.h"
 #include "intypes.h"
 #include "packet_types.h"
+#include "quant.h"
+#include "reorder.h"
+#include "rt.h"
+#include "schema.h"
+#include "seqstate.h"
+#include "sink.h"
+#include "snapshot.h"
+#include "source.h"
+#include "trace.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <mqueue.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 /** Macro for easily de-referencing a pointer into a specific type. */
@@ -17,46 +37,249 @@
 #define BLOCK_LIMIT 4
 /** The version of the packet encoding being used. */
 #define VERSION 1
-/** The name of the message queue for outputting encoded packets. */
+/** The name of the message queue for outputting encoded packets when no sinks are configured. */
 #define OUTPUT_QUEUE "packager-out"
 /** The name of the message queue for input sensor data. */
 #define INPUT_QUEUE "fetcher/sensors"
+/** The default file that packet sequence numbers are persisted in across restarts. */
+#define SEQSTATE_FILE "/tmp/packager.seq"
+/** How long to wait for room in each output queue for the packets flushed during shutdown, in seconds. */
+#define SHUTDOWN_SEND_TIMEOUT 1
 
 /** Static variable to store the user HAM radio call sign. */
 static char *callsign = NULL;
 /** Static variable to store the file name to read input from instead of stdin. */
 static char *infile = NULL;
+/** The message queues to read input sensor data from, each optionally followed by ':' and its weight. */
+static const char *input_specs[INPUTS_MAX];
+/** The number of input queues given on the command line. */
+static uint8_t n_inputs = 0;
+/** The name of the message queue that resend requests are received on, or NULL to not take requests. */
+static const char *uplink_queue = NULL;
+/** The name of the shared memory object that the latest readings are published in, or NULL to not publish them. */
+static const char *snapshot_name = NULL;
+/** The schema file describing additional sensors, or NULL if there are none. */
+static const char *schemafile = NULL;
+/** The file of quantization profiles that blocks are packed by, or NULL to send every block at full precision. */
+static const char *profilefile = NULL;
+/** The file that the trace of the hot path is written to, or NULL to not write one. */
+static const char *tracefile = NULL;
+/** Static variable to store the file name that packet sequence numbers are persisted in. */
+static const char *seqfile = SEQSTATE_FILE;
 /** Whether or not to print the encoded packets to stdout (false by default). */
 static bool print_output = false;
+/** Whether or not packet composition follows the bandwidth budgets of the flight phase (false by default). */
+static bool adaptive = false;
+/** Send the full header with the call sign every this many packets, 0 to always send it (0 by default). */
+static uint32_t full_header_packets = 0;
+/** Send the full header with the call sign at least every this many seconds in compact header mode. */
+static uint32_t full_header_secs = 600;
+/** Number of input messages held to restore their send order, 0 to process them in arrival order (0 by default). */
+static uint8_t reorder_window = 0;
+/** Longest time in milliseconds an input message is held to restore the send order. */
+static uint32_t reorder_latency = REORDER_DEFAULT_LATENCY_MS;
+/** Number of altitude and vertical velocity estimates per second, 0 to forward raw altitude instead (0 by default). */
+static uint32_t fusion_rate = 0;
+/** Most bytes of memory the buffers of all subsystems may take up, or 0 to size them from the configuration alone. */
+static size_t memory_budget = 0;
+/** SCHED_FIFO priority of the main loop in real-time mode, or 0 to run with default scheduling (0 by default). */
+static int rt_priority = 0;
+/** CPU that the main loop is pinned to, or -1 to run on any CPU (-1 by default). */
+static int rt_cpu = -1;
 /** Static message to act as an input buffer */
 static common_t recv_msg = {0};
 
+/* --- MEMORY --- */
+
+/** The memory that the buffers of every subsystem are allocated from at startup. */
+static Arena arena;
+
+/* --- INPUT --- */
+
+/** The input queues, drained in turns by their weights. */
+static InputSet inputs;
+
+/** Restore the send order of the input messages of each input queue, which higher priority messages overtook. */
+static ReorderBuffer reorders[INPUTS_MAX];
+
+/* --- INPUT STATE --- */
+
+/** The mission time, GPS fix, flight phase, budget, estimator and latest readings of each input queue. */
+static Source sources[INPUTS_MAX];
+
 /* --- CONSTRUCTING PACKETS --- */
 
-/** Packet count tracker for encoding packets number. */
-static uint16_t pkt_count = 0;
+/** The configurations of the output sinks given on the command line. */
+static SinkConfig sink_configs[SINKS_MAX];
+
+/** The number of output sinks given on the command line. */
+static uint8_t n_sinks = 0;
+
+/** Packet sequence numbers of every sink, persisted so that numbering continues across restarts. */
+static SeqState seqstate;
+
+/** Header fields shared by every packet, computed once at startup. */
+static PacketHeaderTemplate header_template;
+
+/** The output sinks, which every block is fanned out to. */
+static Fanout fanout;
+
+/** Encodings of the sensors described by the schema file, which have no built-in encoding. */
+static Schema schema;
+
+/** Quantization profiles that blocks are packed by before they are fanned out. */
+static QuantProfile profile;
+
+/** A buffer that each block is encoded into once before it is fanned out to the sinks. */
+static uint8_t block[BLOCK_MAX_SIZE];
+
+/* --- EVENTS --- */
+
+/** Maximum number of events per second. */
+#define EVENT_RATE 5
+/** Maximum number of event and dictionary blocks per packet, so that events cannot crowd out sensor data. */
+#define EVENT_MAX_PER_PACKET 2
+/** How often the event string dictionary is sent again, in milliseconds. */
+#define EVENT_DICT_REFRESH_MS 30000
+
+/** Event channel for reporting GPS fix changes, errors and flight phase transitions over the radio. */
+static EventChannel events;
+
+/** The most recent mission time of any input queue in milliseconds, the measurement time of events that no input
+ * message caused. */
+static uint32_t latest_time = 0;
+
+/** Latencies from receiving an input message to having encoded and fanned it out. */
+static LatencyStats latency;
+
+/* --- SHUTDOWN --- */
 
-/** A buffer for constructing the current packet. */
-static uint8_t packet[PACKET_MAX_SIZE];
+/** Set by the signal handler when the packager has been asked to stop. */
+static volatile sig_atomic_t shutdown_requested = 0;
 
-/** The current position within the packet buffer. */
-static uint8_t *packet_pos = packet;
+/** Whether the input queues are being drained without blocking because of a shutdown request. */
+static bool draining = false;
 
-void add_block_header(DataBlockType t, size_t size);
-bool room_for_block(size_t b_len);
+/** Set by the signal handler when the trace has been asked for. */
+static volatile sig_atomic_t trace_requested = 0;
+
+/**
+ * Logs an error and reports it over the radio as an event. The format string is used as the description of the event,
+ * so that all occurrences of the same error share one interned string.
+ */
+#define report_error(arg, fmt, ...)                                                                                    \
+    do {                                                                                                               \
+        int32_t _arg = (arg);                                                                                          \
+        log_print(stderr, LOG_ERROR, fmt, __VA_ARGS__);                                                                \
+        event_post(&events, EVENT_ERROR, fmt, _arg, latest_time);                                                      \
+    } while (0)
+
+void process_input(unsigned int priority, uint8_t source);
+void emit_events(void);
+int read_input(FILE *input, unsigned int *priority, uint8_t *source, int32_t wait_ms);
+int32_t reorder_wait(const uint8_t n_sources);
+uint32_t monotonic_ms(void);
+void request_shutdown(int sig);
+#ifdef PACKAGER_TRACE
+void request_trace(int sig);
+void write_trace(void);
+#endif
+void report_memory(void);
+void enter_real_time(void);
 
 int main(int argc, char **argv) {
 
     /* Fetch command line arguments. */
     int c;
-    while ((c = getopt(argc, argv, ":i:p")) != -1) {
+    while ((c = getopt(argc, argv, ":aC:f:i:k:K:m:M:o:pP:q:Q:r:R:s:t:T:u:")) != -1) {
         switch (c) {
+        case 'a':
+            adaptive = true;
+            break;
+        case 'C':
+            rt_cpu = strtol(optarg, NULL, 10);
+            break;
+        case 'f':
+            fusion_rate = strtoul(optarg, NULL, 10);
+            if (fusion_rate > FUSION_MAX_RATE) {
+                fprintf(stderr, "At most %d estimates per second can be sent.\n", FUSION_MAX_RATE);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'i':
             infile = optarg;
             break;
+        case 'k':
+            full_header_packets = strtoul(optarg, NULL, 10);
+            break;
+        case 'K':
+            full_header_secs = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            snapshot_name = optarg;
+            break;
+        case 'M':
+            memory_budget = strtoul(optarg, NULL, 10);
+            if (memory_budget == 0) {
+                fprintf(stderr, "Memory budget must be a positive number of bytes.\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            if (n_sinks == SINKS_MAX) {
+                fprintf(stderr, "At most %d output sinks can be given.\n", SINKS_MAX);
+                exit(EXIT_FAILURE);
+            }
+            if (!sink_config_parse(&sink_configs[n_sinks++], optarg)) {
+                fprintf(stderr, "Invalid output sink '%s'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'p':
             print_output = true;
             break;
+        case 'P':
+            rt_priority = strtol(optarg, NULL, 10);
+            if (rt_priority < sched_get_priority_min(SCHED_FIFO) || rt_priority > sched_get_priority_max(SCHED_FIFO)) {
+                fprintf(stderr, "Real-time priority must be from %d to %d.\n", sched_get_priority_min(SCHED_FIFO),
+                        sched_get_priority_max(SCHED_FIFO));
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+            profilefile = optarg;
+            break;
+        case 'Q':
+            if (n_inputs == INPUTS_MAX) {
+                fprintf(stderr, "At most %d input queues can be given.\n", INPUTS_MAX);
+                exit(EXIT_FAILURE);
+            }
+            input_specs[n_inputs++] = optarg;
+            break;
+        case 'r': {
+            const unsigned long window = strtoul(optarg, NULL, 10);
+            if (window > REORDER_MAX) {
+                fprintf(stderr, "At most %d input messages can be held for reordering.\n", REORDER_MAX);
+                exit(EXIT_FAILURE);
+            }
+            reorder_window = window;
+            break;
+        }
+        case 'R':
+            reorder_latency = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seqfile = optarg;
+            break;
+        case 't':
+            schemafile = optarg;
+            break;
+        case 'T':
+            tracefile = optarg;
+            break;
+        case 'u':
+            uplink_queue = optarg;
+            break;
         case ':':
             fprintf(stderr, "Option -%c requires an argument.\n", optopt);
             exit(EXIT_FAILURE);
@@ -75,177 +298,484 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
     callsign = argv[optind];
+    if (!packet_header_template_init(&header_template, callsign, VERSION, ROCKET)) {
+        fprintf(stderr, "Call sign must be between 1 and %zu characters.\n", sizeof(header_template.call_sign));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Load the encodings of sensors that are not built in. */
+    unsigned int schema_line;
+    if (schemafile != NULL && !schema_load(&schema, schemafile, &schema_line)) {
+        if (schema_line == 0) {
+            fprintf(stderr, "Could not read sensor schema '%s'.\n", schemafile);
+        } else {
+            fprintf(stderr, "Invalid sensor schema '%s' at line %u.\n", schemafile, schema_line);
+        }
+        exit(EXIT_FAILURE);
+    }
+    unsigned int profile_line;
+    if (profilefile != NULL && !quant_load(&profile, profilefile, &profile_line)) {
+        if (profile_line == 0) {
+            fprintf(stderr, "Could not read quantization profiles '%s'.\n", profilefile);
+        } else {
+            fprintf(stderr, "Invalid quantization profiles '%s' at line %u.\n", profilefile, profile_line);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    /* Without any sinks, send everything to the output queue like a single radio. */
+    if (n_sinks == 0) {
+        sink_config_parse(&sink_configs[n_sinks++], "mq=" OUTPUT_QUEUE);
+    }
+    sink_configs[0].print = print_output;
 
-    /* Open input stream. */
-    FILE *input = stdin;
+    /* Open input stream. When a file is provided, recorded input messages are replayed from it instead of reading from
+     * the input message queues. */
+    FILE *input = NULL;
+    input_set_init(&inputs);
     if (infile != NULL) {
-        input = fopen(infile, "r");
+        input = fopen(infile, "rb");
         if (input == NULL) {
             log_print(stderr, LOG_ERROR, "File '%s' could not be opened for reading.\n", infile);
             exit(EXIT_FAILURE);
         }
+    } else {
+        if (n_inputs == 0) input_specs[n_inputs++] = INPUT_QUEUE;
+        for (uint8_t i = 0; i < n_inputs; i++) {
+            if (!input_set_add(&inputs, input_specs[i])) {
+                log_print(stderr, LOG_ERROR, "Could not open input message queue %s with error %s\n", input_specs[i],
+                          strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
     }
-    struct mq_attr in_q_attr = {
-        .mq_flags = 0,
-        .mq_maxmsg = 30,
-        .mq_msgsize = sizeof(recv_msg),
-    };
-    /* Open input message queue. */
-    mqd_t in_q = mq_open(INPUT_QUEUE, O_RDONLY, &in_q_attr);
-    if (in_q == -1) {
-        log_print(stderr, LOG_ERROR, "Could not open input message queue %s with error %s\n", INPUT_QUEUE,
-                  strerror(errno));
-        exit(EXIT_FAILURE);
+    const uint8_t n_sources = input != NULL ? 1 : inputs.count;
+
+    /* Open the queue that resend requests from the ground station are received on, without ever waiting for one. */
+    mqd_t up_q = -1;
+    if (uplink_queue != NULL) {
+        struct mq_attr up_q_attr = {
+            .mq_flags = 0,
+            .mq_maxmsg = 10,
+            .mq_msgsize = sizeof(ResendRequest),
+        };
+        up_q = mq_open(uplink_queue, O_RDONLY | O_NONBLOCK | O_CREAT, S_IRUSR | S_IWUSR | S_IWGRP | S_IWOTH,
+                       &up_q_attr);
+        if (up_q == -1) {
+            log_print(stderr, LOG_WARN, "Could not open resend request queue %s with error %s\n", uplink_queue,
+                      strerror(errno));
+        }
+    }
+
+    /* Resume packet numbering from the previous instance. Each sink numbers its packets with the counter at its
+     * position on the command line. */
+    if (!seqstate_open(&seqstate, seqfile, seqstate_clock_ms())) {
+        log_print(stderr, LOG_WARN, "Could not map sequence state file '%s', packet numbers start from 0\n", seqfile);
     }
 
-    /* Open output message queue. */
-    struct mq_attr q_attributes = {
-        .mq_flags = 0,
-        .mq_maxmsg = 15, // 15 packets is probably enough
-        .mq_msgsize = PACKET_MAX_SIZE,
-    };
-    mqd_t out_q = mq_open(OUTPUT_QUEUE, O_CREAT | O_WRONLY, S_IWOTH, &q_attributes);
-    if (out_q == -1) {
-        log_print(stderr, LOG_ERROR, "Could not open output queue %s with error %s\n", OUTPUT_QUEUE, strerror(errno));
+    /* Publish the latest readings of each input for local consumers, those of the first input under the given name
+     * and those of input i under the name suffixed with -i. */
+    for (uint8_t i = 0; i < n_sources; i++) {
+        source_init(&sources[i], i, fusion_rate);
+        if (snapshot_name == NULL) continue;
+        char name[NAME_MAX];
+        if (i == 0) {
+            snprintf(name, sizeof(name), "%s", snapshot_name);
+        } else {
+            snprintf(name, sizeof(name), "%s-%u", snapshot_name, i);
+        }
+        if (!snapshot_open(&sources[i].snapshot, name)) {
+            log_print(stderr, LOG_WARN, "Could not map latest readings table '%s' with error %s\n", name,
+                      strerror(errno));
+        }
+    }
+
+    /* Size the arena that every buffer is allocated from for the configuration, refusing to start if that is over the
+     * memory budget. Only what the configuration needs is mapped, whatever the budget. Nothing is allocated once
+     * startup is over. */
+    size_t footprint = n_sources * reorder_footprint(reorder_window);
+    for (uint8_t i = 0; i < n_sinks; i++) {
+        footprint += sink_footprint(&sink_configs[i]);
+    }
+    if (memory_budget != 0 && footprint > memory_budget) {
+        log_print(stderr, LOG_ERROR, "Configuration needs %zu bytes of buffers, over the memory budget of %zu bytes\n",
+                  footprint, memory_budget);
+        exit(EXIT_FAILURE);
+    }
+    if (!arena_open(&arena, footprint)) {
+        log_print(stderr, LOG_ERROR, "Could not map %zu bytes of buffers with error %s\n", footprint, strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    uint32_t last_time = 0;
-    size_t just_added_block_size = 0;
-    unsigned int highest_priority = 0;
-    unsigned int last_priority;
-    while (1) {
-        highest_priority = 0; // Reset priority to 0 for each packet
-        packet_header_init((PacketHeader *)packet, callsign, 0, VERSION, ROCKET, pkt_count);
-        packet_pos += sizeof(PacketHeader); // We just added a packet header
+    /* Open output sinks. */
+    fanout_init(&fanout, &header_template, &seqstate, &arena);
+    for (uint8_t i = 0; i < n_sinks; i++) {
+        if (!fanout_add(&fanout, &sink_configs[i], full_header_packets, full_header_secs * 1000)) {
+            log_print(stderr, LOG_ERROR, "Could not open output %s with error %s\n", sink_configs[i].target,
+                      strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Stop gracefully on termination, flushing the packets being built and whatever input is still queued. The handler
+     * is reset after the first signal so that a second one stops the packager immediately. Interrupted calls are not
+     * restarted, so a blocked mq_receive returns as soon as the signal arrives. */
+    struct sigaction sa = {.sa_handler = request_shutdown, .sa_flags = SA_RESETHAND};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    /* Write the trace of the hot path whenever it is asked for, as well as on exit. */
+#ifdef PACKAGER_TRACE
+    if (tracefile != NULL) {
+        trace_init();
+        struct sigaction trace_sa = {.sa_handler = request_trace};
+        sigemptyset(&trace_sa.sa_mask);
+        sigaction(SIGUSR1, &trace_sa, NULL);
+    }
+#else
+    if (tracefile != NULL) {
+        log_print(stderr, LOG_WARN, "Built without tracepoints, define PACKAGER_TRACE to write a trace\n");
+    }
+#endif
 
-        // TODO: need a better condition for ending packet construction that still maximizes buffer use
-        // WARNING: Assumes AngularVelocityDB as largest possible block size
-        while (room_for_block(sizeof(AngularVelocityDB))) {
+    event_channel_init(&events, EVENT_RATE, EVENT_MAX_PER_PACKET, EVENT_DICT_REFRESH_MS);
+    for (uint8_t i = 0; i < n_sources; i++) {
+        reorder_init(&reorders[i], reorder_window, reorder_latency, &arena);
+    }
+    if (reorder_window > 0) {
+        log_print(stderr, LOG_WARN,
+                  "Reordering input by sequence number; messages from producers that do not stamp it are dropped\n");
+    }
+    arena_seal(&arena);
+    report_memory();
+    enter_real_time();
+
+    /* Report how long the previous instance was down. */
+    if (seqstate.resumed) {
+        int32_t downtime = seqstate.downtime_ms > INT32_MAX ? INT32_MAX : (int32_t)seqstate.downtime_ms;
+        log_print(stderr, LOG_INFO, "Resuming at packet #%u after %s, down for %d ms\n",
+                  *seqstate_counter(&seqstate, 0), seqstate.was_clean ? "clean shutdown" : "crash", downtime);
+        event_post(&events, EVENT_RESTART, seqstate.was_clean ? "restart" : "restart after crash", downtime,
+                   latest_time);
+    }
 
-            /* Read input data. */
-            if (mq_receive(in_q, (char *)&recv_msg, sizeof(recv_msg), &last_priority) == -1) {
-                log_print(stderr, LOG_ERROR, "Could not read message from queue %s with error %s\n", INPUT_QUEUE,
-                          strerror(errno));
-                continue;
+    uint32_t reported_errors = 0;
+    unsigned int priority;
+    uint8_t source;
+    int status;
+    latency_init(&latency);
+    while ((status = read_input(input, &priority, &source, reorder_wait(n_sources))) != 0) {
+        const uint64_t received_ns = latency_now_ns();
+        if (status == 1 && reorder_window == 0) {
+            process_input(priority, source);
+        } else if (status == 1) {
+            reorder_push(&reorders[source], &recv_msg, priority, monotonic_ms());
+        }
+        for (uint8_t i = 0; i < n_sources; i++) {
+            while (reorder_pop(&reorders[i], &recv_msg, &priority, monotonic_ms(), false)) {
+                process_input(priority, i);
             }
+        }
+        emit_events();
+        if (status == 1) latency_record(&latency, latency_now_ns() - received_ns);
+
+        // Resent blocks go out in the next packets, so taking requests never waits
+        ResendRequest request;
+        while (up_q != -1 && mq_receive(up_q, (char *)&request, sizeof(request), NULL) == sizeof(request)) {
+            fanout_resend(&fanout, &request);
+        }
+
+#ifdef PACKAGER_TRACE
+        if (trace_requested) {
+            trace_requested = 0;
+            write_trace();
+        }
+#endif
 
-            // Take record the highest priority packet received so far
-            highest_priority = last_priority > highest_priority ? last_priority : highest_priority;
-
-            just_added_block_size = 0;
-            switch (recv_msg.type) {
-            case TAG_TIME:
-                // Update with most recent time measurement to use as measurement time for other packets
-                last_time = recv_msg.data.U32;
-                break;
-
-            case TAG_TEMPERATURE:
-                just_added_block_size = sizeof(TemperatureDB);
-                add_block_header(DATA_TEMP, just_added_block_size);
-                temperature_db_init((TemperatureDB *)packet_pos, last_time, 1000 * recv_msg.data.FLOAT);
-                break;
-
-            case TAG_PRESSURE:
-                just_added_block_size = sizeof(PressureDB);
-                add_block_header(DATA_PRESSURE, just_added_block_size);
-                pressure_db_init((PressureDB *)packet_pos, last_time, 1000 * recv_msg.data.FLOAT);
-                break;
-
-            case TAG_HUMIDITY:
-                just_added_block_size = sizeof(HumidityDB);
-                add_block_header(DATA_HUMIDITY, just_added_block_size);
-                humidity_db_init((HumidityDB *)packet_pos, last_time, 100 * recv_msg.data.FLOAT);
-                break;
-
-            case TAG_ALTITUDE_REL:
-            case TAG_ALTITUDE_SEA:
-                just_added_block_size = sizeof(AltitudeDB);
-                add_block_header(recv_msg.type == TAG_ALTITUDE_SEA ? DATA_ALT_SEA : DATA_ALT_LAUNCH,
-                                 just_added_block_size);
-                altitude_db_init((AltitudeDB *)packet_pos, last_time, 1000 * recv_msg.data.FLOAT);
-                break;
-
-            case TAG_LINEAR_ACCEL_ABS:
-            case TAG_LINEAR_ACCEL_REL:
-                just_added_block_size = sizeof(AccelerationDB);
-                add_block_header(recv_msg.type == TAG_LINEAR_ACCEL_REL ? DATA_ACCEL_REL : DATA_ACCEL_ABS,
-                                 just_added_block_size);
-                acceleration_db_init((AccelerationDB *)packet_pos, last_time, recv_msg.data.VEC3D.x * 100,
-                                     recv_msg.data.VEC3D.y * 100, recv_msg.data.VEC3D.z * 100);
-                break;
-
-            case TAG_ANGULAR_VEL:
-                just_added_block_size = sizeof(AngularVelocityDB);
-                add_block_header(DATA_ANGULAR_VEL, just_added_block_size);
-                angular_velocity_db_init((AngularVelocityDB *)packet_pos, last_time, recv_msg.data.VEC3D.x * 10,
-                                         recv_msg.data.VEC3D.y * 10, recv_msg.data.VEC3D.z * 10);
-                break;
-
-            case TAG_COORDS:
-                just_added_block_size = sizeof(CoordinateDB);
-                add_block_header(DATA_LAT_LONG, just_added_block_size);
-                coordinate_db_init((CoordinateDB *)packet_pos, last_time, recv_msg.data.VEC2D_I32.x,
-                                   recv_msg.data.VEC2D_I32.y);
-                break;
-
-            case TAG_VOLTAGE:
-                just_added_block_size = sizeof(VoltageDB);
-                add_block_header(DATA_VOLTAGE, just_added_block_size);
-                voltage_db_init((VoltageDB *)packet_pos, last_time, recv_msg.id, recv_msg.data.I16);
-                break;
-
-            case TAG_FIX:
-                // Ignore this data for now, currently useful as debug output
-                break;
-            default:
-                log_print(stderr, LOG_ERROR, "Unknown input data type: %u\n", recv_msg.type);
-                continue; // Skip to next iteration without storing block
+        // Sinks cannot report their own errors, so report them here
+        if (fanout.errors != reported_errors) {
+            reported_errors = fanout.errors;
+            report_error(fanout.last_errno, "Failed to output encoded packet to %s with error: %s\n",
+                         fanout.sinks[fanout.last_error_sink].cfg.target, strerror(fanout.last_errno));
+        }
+    }
+
+    /* Process the input messages still held for reordering, no longer waiting for missing ones. */
+    for (uint8_t i = 0; i < n_sources; i++) {
+        while (reorder_pop(&reorders[i], &recv_msg, &priority, monotonic_ms(), true)) {
+            process_input(priority, i);
+        }
+    }
+    emit_events();
+
+    /* Report how each input was drained and ordered. */
+    for (uint8_t i = 0; i < inputs.count; i++) {
+        const InputQueue *in = &inputs.queues[i];
+        if (inputs.count == 1) {
+            log_print(stderr, LOG_INFO, "Input %s: %u messages\n", in->name, in->received);
+            continue;
+        }
+        log_print(stderr, LOG_INFO,
+                  "Input %s: %u messages in %u rounds, %u taking the whole weight, waited for turns %u us on average "
+                  "and up to %u us\n",
+                  in->name, in->received, in->busy_rounds, in->full_turns,
+                  in->received == 0 ? 0 : (uint32_t)(in->turn_wait_sum_us / in->received), in->max_turn_wait_us);
+    }
+    for (uint8_t i = 0; i < n_sources && reorder_window > 0; i++) {
+        const ReorderBuffer *r = &reorders[i];
+        log_print(stderr, LOG_INFO,
+                  "Input order %s: %u reordered, %u duplicates and %u late dropped, %u missing, up to %u held\n",
+                  input != NULL ? infile : inputs.queues[i].name, r->reordered, r->duplicates, r->late, r->skipped,
+                  r->max_count);
+    }
+
+    log_print(stderr, LOG_INFO,
+              "Latency (%s): %u messages, %u us on average, 99%% under %u us, 99.9%% under %u us, worst %u us\n",
+              rt_priority > 0 ? "real-time" : "default scheduling", latency.count,
+              latency.count == 0 ? 0 : (uint32_t)(latency.sum_ns / latency.count / 1000),
+              (uint32_t)(latency_percentile_ns(&latency, 990) / 1000),
+              (uint32_t)(latency_percentile_ns(&latency, 999) / 1000), (uint32_t)(latency.max_ns / 1000));
+
+    /* Send the packets still being built and report what each sink did. */
+    const uint8_t count = fanout.count;
+    fanout_close(&fanout, SHUTDOWN_SEND_TIMEOUT);
+    for (uint8_t i = 0; i < count; i++) {
+        const Sink *s = &fanout.sinks[i];
+        log_print(stderr, LOG_INFO,
+                  "Output %s: %u packets sent, %u dropped by full queue, %u blocks over rate, %u blocks too large\n",
+                  s->cfg.target, s->sent, s->dropped_full, s->dropped_rate, s->dropped_size);
+        if (s->history.depth > 0) {
+            log_print(stderr, LOG_INFO, "Output %s: %u blocks resent, %u dropped, %u requested packets missing\n",
+                      s->cfg.target, s->history.resent, s->history.dropped, s->history.missing);
+        }
+    }
+
+#ifdef PACKAGER_TRACE
+    if (tracefile != NULL) write_trace();
+#endif
+    if (shutdown_requested) log_print(stderr, LOG_INFO, "Shut down at packet #%u\n", *seqstate_counter(&seqstate, 0));
+    seqstate_close(&seqstate, seqstate_clock_ms());
+    for (uint8_t i = 0; i < n_sources; i++) {
+        snapshot_close(&sources[i].snapshot);
+    }
+    if (input != NULL) fclose(input);
+    input_set_close(&inputs);
+    if (up_q != -1) mq_close(up_q);
+    arena_close(&arena);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Processes the message in the input buffer: updates the state of the input queue it came from and encodes the
+ * message, the estimates it completes or both, once for all output sinks.
+ * @param priority The priority the message was received with.
+ * @param source The index of the input queue the message came from, which decides the sinks that may send it.
+ */
+void process_input(unsigned int priority, uint8_t source) {
+    TRACE_START(process_start);
+    const uint32_t now = monotonic_ms();
+    Source *src = &sources[source];
+
+    const SourceAction action = source_update(src, &recv_msg, &events, adaptive);
+
+    if (action & SOURCE_ENCODE) {
+        TRACE_START(encode_start);
+        uint16_t size = encode_block(block, &recv_msg, src->mission_time);
+        if (size == 0) size = schema_encode(&schema, block, &recv_msg, src->mission_time);
+        size = quant_pack(&profile, block, size);
+        TRACE_SPAN(TRACE_ENCODE, encode_start, recv_msg.type);
+        if (size == 0) {
+            report_error(recv_msg.type, "Unknown input data type: %u\n", recv_msg.type);
+        } else {
+            TRACE_START(fanout_start);
+            if (fanout_offer(&fanout, block, size, recv_msg.type, source, priority, now)) {
+                event_channel_new_packet(&events);
             }
+            TRACE_SPAN(TRACE_FANOUT, fanout_start, size);
+        }
+    }
 
-            // Increment position in packet buffer to match most recently added block type
-            packet_pos += just_added_block_size;
-            packet_header_inc_length((PacketHeader *)packet, just_added_block_size);
+    if (action & SOURCE_ESTIMATES) {
+        static const uint8_t estimates[] = {TAG_ALTITUDE_FUSED, TAG_VERTICAL_VEL};
+        for (size_t i = 0; i < sizeof(estimates); i++) {
+            const uint16_t encoded = fusion_encode(&src->fusion, block, estimates[i], src->mission_time);
+            const uint16_t size = quant_pack(&profile, block, encoded);
+            if (fanout_offer(&fanout, block, size, estimates[i], source, priority, now)) {
+                event_channel_new_packet(&events);
+            }
         }
+    }
+    if (src->mission_time > latest_time) latest_time = src->mission_time;
+    TRACE_SPAN(TRACE_PROCESS, process_start, recv_msg.type);
+}
 
-        pkt_count++; // One more packet constructed
+/**
+ * Fans out as many due event and dictionary blocks as the event channel limits allow. A block is limited to the size
+ * that fits in an empty packet of every sink that sends events.
+ */
+void emit_events(void) {
+    const uint32_t now = monotonic_ms();
+    uint16_t written;
+    while ((written = event_channel_emit(&events, block, fanout_event_room(&fanout), latest_time, now)) != 0) {
+        // An event block that opens a packet does not crowd out any sensor data, so it is not counted against the
+        // limit of the new packet
+        if (fanout_offer(&fanout, block, written, SINK_TAG_EVENT, 0, 0, now)) event_channel_new_packet(&events);
+        // Strings that no sink took, because of its rate budget, are defined again in a later dictionary block
+        if (fanout.accepted == 0) event_channel_unsent(&events, block);
+    }
+}
 
-        // Send packet with the priority matching the highest priority data received
-        if (mq_send(out_q, (char *)packet, packet_header_get_length((PacketHeader *)packet), highest_priority) == -1) {
-            log_print(stderr, LOG_ERROR, "Failed to output encoded packet #%u with error: %s\n", pkt_count - 1,
-                      strerror(errno));
+/**
+ * Reads the next input message into the input buffer, either from the replay file or the input message queues.
+ * @param input The replay file of recorded input messages, or NULL to read from the input message queues.
+ * @param priority Where to store the priority of the received message. Replayed messages have priority 0.
+ * @param source Where to store the index of the input queue the message came from. Replayed messages come from 0.
+ * @param wait_ms The longest time to wait for a message from the input message queues in milliseconds, or -1 to wait
+ * until one arrives.
+ * @return 1 if a message was read, 0 if the input has ended and -1 if there was an error reading the message or none
+ * arrived in time.
+ */
+int read_input(FILE *input, unsigned int *priority, uint8_t *source, int32_t wait_ms) {
+    if (shutdown_requested) {
+        if (input != NULL) return 0; // Stop replaying
+        draining = true;             // Receive whatever is left in the queues without waiting for more
+    }
+
+    if (input != NULL) {
+        *priority = 0;
+        *source = 0;
+        if (fread(&recv_msg, sizeof(recv_msg), 1, input) != 1) {
+            if (ferror(input)) log_print(stderr, LOG_ERROR, "Could not read from replay file '%s'\n", infile);
+            return 0;
         }
+        return 1;
+    }
 
-        if (print_output) packet_print_hex(stdout, packet);
+    TRACE_START(receive_start);
+    const ssize_t received =
+        input_set_receive(&inputs, (char *)&recv_msg, sizeof(recv_msg), priority, source, draining ? 0 : wait_ms);
+    TRACE_SPAN(TRACE_RECEIVE, receive_start, received == -1 ? 0 : recv_msg.type);
+
+    if (received == -1) {
+        if (draining && errno == EAGAIN) return 0; // Input queues are drained
+        if (errno == EINTR && (shutdown_requested || trace_requested)) return -1;
+        if (errno == ETIMEDOUT) return -1; // Held input messages are due
+        report_error(errno, "Could not read message from queue %s with error %s\n", inputs.queues[*source].name,
+                     strerror(errno));
+        return -1;
+    }
+    return 1;
+}
 
-        packet_pos = packet; // Reset position to overwrite with next packet
+/**
+ * Gets how long to wait for input before a message held for reordering by any input is due.
+ * @param n_sources The number of inputs.
+ * @return The wait in milliseconds, or -1 if no message is held.
+ */
+int32_t reorder_wait(const uint8_t n_sources) {
+    const uint32_t now = monotonic_ms();
+    int32_t wait_ms = -1;
+    for (uint8_t i = 0; i < n_sources; i++) {
+        const int32_t w = reorder_wait_ms(&reorders[i], now);
+        if (w >= 0 && (wait_ms < 0 || w < wait_ms)) wait_ms = w;
     }
+    return wait_ms;
+}
 
-    return EXIT_SUCCESS;
+/**
+ * Gets the current time from the monotonic clock.
+ * @return The current monotonic time in milliseconds.
+ */
+uint32_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Signal handler which asks the main loop to shut down gracefully.
+ * @param sig The signal received.
+ */
+void request_shutdown(int sig) {
+    (void)sig;
+    shutdown_requested = 1;
 }
 
+#ifdef PACKAGER_TRACE
 /**
- * Adds a block header to the global packet buffer.
- * @param t The type of the data block.
- * @param size The size of the data block (in bytes) that will be stored in this block, not including its header.
+ * Signal handler which asks the main loop to write the trace.
+ * @param sig The signal received.
  */
-void add_block_header(DataBlockType t, size_t size) {
-    block_header_init((BlockHeader *)packet_pos, size, TYPE_DATA, t, GROUNDSTATION);
-    packet_pos += sizeof(BlockHeader); // We just added a block header
+void request_trace(int sig) {
+    (void)sig;
+    trace_requested = 1;
+}
 
-    // Update packet header length to include just added block header
-    packet_header_inc_length((PacketHeader *)packet, sizeof(BlockHeader));
+/**
+ * Writes the spans recorded at the tracepoints to the trace file.
+ */
+void write_trace(void) {
+    if (trace_export(tracefile)) {
+        log_print(stderr, LOG_INFO, "Wrote trace to '%s'\n", tracefile);
+    } else {
+        log_print(stderr, LOG_WARN, "Could not write trace to '%s' with error %s\n", tracefile, strerror(errno));
+    }
 }
+#endif
 
 /**
- * Checks if there is room for a block in the global packet buffer.
- * @param b_len The size of the block (not including its header) to append to the packet buffer.
- * @return True if the append succeeded, false if there was no space to append the block.
+ * Logs the memory taken up by the statically allocated state and by the buffers of each subsystem in the arena.
  */
-bool room_for_block(size_t b_len) {
-    const uint16_t p_len = packet_header_get_length((PacketHeader *)packet);
+void report_memory(void) {
+    size_t fixed = sizeof(recv_msg) + sizeof(inputs) + sizeof(reorders) + sizeof(sources) + sizeof(sink_configs) +
+                   sizeof(seqstate) + sizeof(header_template) + sizeof(fanout) + sizeof(schema) + sizeof(profile) +
+                   sizeof(block) + sizeof(events) + sizeof(latency) + sizeof(arena);
+#ifdef PACKAGER_TRACE
+    fixed += TRACE_MAX_THREADS * sizeof(TraceRing);
+#endif
+    log_print(stderr, LOG_INFO, "Memory: %zu bytes static, %zu of %zu bytes of buffers used\n", fixed, arena.used,
+              arena.size);
+    for (uint8_t i = 0; i < arena.n_owners; i++) {
+        log_print(stderr, LOG_INFO, "Memory: %s %zu bytes in %u buffers\n", arena.owners[i].name, arena.owners[i].bytes,
+                  arena.owners[i].allocations);
+    }
+}
 
-    // Ensure that there is enough space for the block to be added to the packet
-    if (p_len + b_len + sizeof(BlockHeader) > PACKET_MAX_SIZE) return false;
-    return true;
+/**
+ * Pins the main loop to its CPU and, in real-time mode, raises it to its real-time priority, locks the memory of the
+ * process and faults in every buffer and enough stack for the main loop, so that it never waits for a page fault.
+ * Exits if any of it cannot be done, rather than run without the guarantees that were asked for.
+ */
+void enter_real_time(void) {
+    if (rt_cpu >= 0 && !rt_set_cpu(rt_cpu)) {
+        log_print(stderr, LOG_ERROR, "Could not pin to CPU %d with error %s\n", rt_cpu, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (rt_priority == 0) return;
+
+    if (!rt_set_priority(rt_priority)) {
+        log_print(stderr, LOG_ERROR, "Could not run at real-time priority %d with error %s\n", rt_priority,
+                  strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (!rt_lock_memory()) {
+        log_print(stderr, LOG_ERROR, "Could not lock memory with error %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    // Locking faults in every mapped page on Linux, but not necessarily elsewhere, so the buffers are touched as well
+    rt_prefault(&recv_msg, sizeof(recv_msg));
+    rt_prefault(&inputs, sizeof(inputs));
+    rt_prefault(reorders, sizeof(reorders));
+    rt_prefault(&fanout, sizeof(fanout));
+    rt_prefault(&schema, sizeof(schema));
+    rt_prefault(&profile, sizeof(profile));
+    rt_prefault(block, sizeof(block));
+    rt_prefault(sources, sizeof(sources));
+    rt_prefault(&events, sizeof(events));
+    rt_prefault(&latency, sizeof(latency));
+    rt_prefault(arena.base, arena.used);
+    rt_prefault_stack();
+    log_print(stderr, LOG_INFO, "Real-time mode: SCHED_FIFO priority %d, memory locked, %d KiB of stack prefaulted\n",
+              rt_priority, RT_STACK_PREFAULT / 1024);
 }
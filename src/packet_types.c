@@ -166,13 +166,42 @@ void voltage_db_init(VoltageDB *b, const uint32_t mission_time, const uint16_t i
     b->voltage = voltage;
 }
 
+/**
+ * Initializes a vertical velocity data block with the provided information.
+ * @param b The velocity data block to be initialized.
+ * @param mission_time The mission time of the estimate.
+ * @param velocity The vertical velocity in millimetres per second, positive upwards.
+ */
+void velocity_db_init(VelocityDB *b, const uint32_t mission_time, const int32_t velocity) {
+    b->mission_time = mission_time;
+    b->velocity = velocity;
+}
+
+/**
+ * Initializes an event debug block with the provided information.
+ * @param b The event block to be initialized.
+ * @param mission_time The mission time at which the event happened.
+ * @param category The category of the event.
+ * @param string_id The ID of the interned string describing the event.
+ * @param arg The argument of the event.
+ */
+void event_db_init(EventDB *b, const uint32_t mission_time, const uint8_t category, const uint8_t string_id,
+                   const int32_t arg) {
+    b->mission_time = mission_time;
+    b->record = DBG_RECORD_EVENT;
+    b->category = category;
+    b->string_id = string_id;
+    b->_padding = 0;
+    b->arg = arg;
+}
+
 /**
  * Prints a packet to the output stream in hexadecimal representation.
  * @param stream The output stream to which the packet should be printed.
  * @param packet The packet to be printed.
  */
 void packet_print_hex(FILE *stream, uint8_t *packet) {
-    for (uint32_t i = 0; i < packet_header_get_length((PacketHeader *)(packet)); i++) {
+    for (uint32_t i = 0; i < packet_get_length(packet); i++) {
         fprintf(stream, "%02x", packet[i]);
     }
     fputc('\n', stream);
@@ -16,9 +16,12 @@
 #include <stdint.h>
 #include <stdio.h>
 
-/** The maximum size a packet can be in bytes. */
+/** The maximum size a packet can be in bytes, and the default size of packets sent over the radio. */
 #define PACKET_MAX_SIZE 256
 
+/** The largest packet size in bytes that the packet length field can describe, for links with larger framing. */
+#define PACKET_LIMIT_SIZE 1024
+
 /** The maximum size a block can be in bytes. */
 #define BLOCK_MAX_SIZE 128
 
@@ -41,9 +44,13 @@ typedef enum device_address {
 
 /** Possible types of radio packet blocks that could be sent. */
 typedef enum block_type {
-    TYPE_DATA = 0x0, /**< Data block */
+    TYPE_DATA = 0x0,        /**< Data block */
+    TYPE_DATA_PACKED = 0x1, /**< Data block bit-packed by a quantization profile (see quant.h) */
 } BlockType;
 
+/** Flag set in the type of a block resent from the history of a sink (see history.h), on top of its original type. */
+#define BLOCK_TYPE_RESENT 0x80
+
 /** Possible sub-types of data blocks that can be sent. */
 typedef enum data_block_type {
     DATA_DBG_MSG = 0x0,     /**< Debug message */
@@ -57,6 +64,8 @@ typedef enum data_block_type {
     DATA_HUMIDITY = 0x8,    /**< Humidity data */
     DATA_LAT_LONG = 0x9,    /**< Latitude and longitude coordinates */
     DATA_VOLTAGE = 0xA,     /**< Voltage in millivolts with a unique ID. */
+    DATA_VELOCITY = 0xB,    /**< Vertical velocity estimated by packager */
+    DATA_ALT_FUSED = 0xC,   /**< Altitude above launch level estimated by packager */
 } DataBlockType;
 
 /** Any block sub-type from DataBlockType, CtrlBlockType or CmdBlockType. */
@@ -79,6 +88,24 @@ typedef struct {
 void packet_header_init(PacketHeader *p, const char *callsign, const uint16_t length, const uint8_t version,
                         const DeviceAddress source, const uint32_t packet_number);
 
+/** The first byte of a compact packet header. A call sign can never start with a null character. */
+#define COMPACT_HEADER_MARKER 0x00
+
+/**
+ * A compact packet header sent in place of PacketHeader between call sign transmissions. The call sign and version are
+ * those of the last full header received from the same station.
+ */
+typedef struct {
+    /** Always COMPACT_HEADER_MARKER, to distinguish this header from a full packet header. */
+    uint8_t marker;
+    /** The packet length in multiples of 4 bytes. */
+    uint8_t len;
+    /** The station ID, which is the source address of the packet. */
+    uint8_t station_id;
+    /** The lowest 8 bits of the packet number. */
+    uint8_t packet_num;
+} CompactPacketHeader;
+
 /** Each block in the radio packet will have a header in this format. */
 typedef struct {
     /** The block header accessed as a bytes array. */
@@ -192,6 +219,60 @@ typedef struct {
 
 void voltage_db_init(VoltageDB *b, const uint32_t mission_time, const uint16_t id, const int16_t voltage);
 
+/** A data block containing vertical velocity. */
+typedef struct {
+    /** Mission time in milliseconds since launch. */
+    uint32_t mission_time;
+    /** Vertical velocity in millimetres per second, positive upwards. */
+    int32_t velocity;
+} VelocityDB;
+
+void velocity_db_init(VelocityDB *b, const uint32_t mission_time, const int32_t velocity);
+
+/**
+ * Binary records that can be sent in a debug message block instead of text. The first byte after the mission time
+ * tells them apart: text messages always start with a printable character.
+ */
+typedef enum debug_record_kind {
+    DBG_RECORD_EVENT = 0x01,      /**< An event referring to an interned string (EventDB) */
+    DBG_RECORD_DICTIONARY = 0x02, /**< Definitions of interned strings (DictionaryDB) */
+} DebugRecordKind;
+
+/** A debug block describing an event, with its text replaced by the ID of an interned string. */
+typedef struct {
+    /** Mission time in milliseconds since launch. */
+    uint32_t mission_time;
+    /** Always DBG_RECORD_EVENT. */
+    uint8_t record;
+    /** The category of the event. */
+    uint8_t category;
+    /** The ID of the interned string describing the event. */
+    uint8_t string_id;
+    /** 0 padding to fill the 4 byte multiple requirement of the packet spec. */
+    uint8_t _padding;
+    /** An argument to the event, such as an error number or new state. */
+    int32_t arg;
+} EventDB;
+
+void event_db_init(EventDB *b, const uint32_t mission_time, const uint8_t category, const uint8_t string_id,
+                   const int32_t arg);
+
+/**
+ * A debug block defining interned strings. It is followed by `count` entries, each made of a one byte string ID, a one
+ * byte string length and then the string characters without a null terminator. The block is padded with zeros to a
+ * multiple of 4 bytes.
+ */
+typedef struct {
+    /** Mission time in milliseconds since launch. */
+    uint32_t mission_time;
+    /** Always DBG_RECORD_DICTIONARY. */
+    uint8_t record;
+    /** The number of entries in the block. */
+    uint8_t count;
+    /** The dictionary entries. */
+    uint8_t entries[];
+} DictionaryDB;
+
 void packet_print_hex(FILE *stream, uint8_t *packet);
 
 /**
@@ -235,4 +316,57 @@ static inline void block_header_set_length(BlockHeader *b, const uint16_t length
  */
 static inline uint16_t block_header_get_length(const BlockHeader *b) { return (b->len + 1) * 4; }
 
+/**
+ * Gets the type of a block, whether or not it was resent.
+ * @param b The block header to read the type from.
+ * @return The type the block was first sent with.
+ */
+static inline BlockType block_header_get_type(const BlockHeader *b) { return b->type & ~BLOCK_TYPE_RESENT; }
+
+/**
+ * Checks whether a block is a resend of a block sent in an earlier packet.
+ * @param b The block header to check.
+ * @return True if the block was resent from the history of the sink, false if it is sent for the first time.
+ */
+static inline bool block_header_is_resent(const BlockHeader *b) { return b->type & BLOCK_TYPE_RESENT; }
+
+/**
+ * Checks whether a packet starts with a compact header.
+ * @param packet The packet to check.
+ * @return True if the packet has a CompactPacketHeader, false if it has a full PacketHeader.
+ */
+static inline bool packet_is_compact(const uint8_t *packet) { return packet[0] == COMPACT_HEADER_MARKER; }
+
+/**
+ * Gets the size of the header of a packet.
+ * @param packet The packet to read the header of.
+ * @return The size of the packet header in bytes.
+ */
+static inline uint16_t packet_header_size(const uint8_t *packet) {
+    return packet_is_compact(packet) ? sizeof(CompactPacketHeader) : sizeof(PacketHeader);
+}
+
+/**
+ * Gets the length of a packet with either a full or compact header.
+ * @param packet The packet to read the length from.
+ * @return The length of the packet in bytes, including its header.
+ */
+static inline uint16_t packet_get_length(const uint8_t *packet) {
+    if (packet_is_compact(packet)) return (((const CompactPacketHeader *)packet)->len + 1) * 4;
+    return packet_header_get_length((const PacketHeader *)packet);
+}
+
+/**
+ * Increments the length of a packet with either a full or compact header.
+ * @param packet The packet to change the length of.
+ * @param l The additional length (in bytes) to add to the packet length.
+ */
+static inline void packet_inc_length(uint8_t *packet, const uint16_t l) {
+    if (packet_is_compact(packet)) {
+        ((CompactPacketHeader *)packet)->len += l / 4;
+    } else {
+        packet_header_inc_length((PacketHeader *)packet, l);
+    }
+}
+
 #endif // _PACKET_TYPES_H
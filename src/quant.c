@@ -0,0 +1,320 @@
+/**
+ * @file quant.c
+ * @brief Contains the definitions for compiling quantization profiles and packing and unpacking data blocks.
+ */
+#include "quant.h"
+#include "encoder.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** A value of a standard data block. */
+typedef struct {
+    /** The offset of the value in the block payload. */
+    uint8_t offset;
+    /** The size of the value in bytes. */
+    uint8_t width;
+    /** Whether the value is signed. */
+    bool is_signed;
+} QuantField;
+
+/** The values of the standard blocks of a subtype. */
+typedef struct {
+    /** The size of the block payload in bytes. */
+    uint8_t payload;
+    /** The number of values, or 0 if blocks of the subtype cannot be packed. */
+    uint8_t n_fields;
+    /** The values, the mission time first. */
+    QuantField fields[QUANT_MAX_FIELDS];
+} QuantBlock;
+
+/** The mission time, which starts every data block. */
+#define TIME_FIELD {0, sizeof(uint32_t), false}
+
+/** A value of a standard data block, by block type and member. */
+#define FIELD(type, member, sign) {offsetof(type, member), sizeof(((type *)0)->member), sign}
+
+/** The values of the standard blocks of every subtype that can be packed, indexed by DataBlockType. */
+static const QuantBlock blocks[QUANT_SUBTYPES] = {
+    [DATA_ALT_SEA] = {sizeof(AltitudeDB), 2, {TIME_FIELD, FIELD(AltitudeDB, altitude, true)}},
+    [DATA_ALT_LAUNCH] = {sizeof(AltitudeDB), 2, {TIME_FIELD, FIELD(AltitudeDB, altitude, true)}},
+    [DATA_TEMP] = {sizeof(TemperatureDB), 2, {TIME_FIELD, FIELD(TemperatureDB, temperature, true)}},
+    // Pressures are encoded from signed fixed point values, so they are read back as signed like the decoder does
+    [DATA_PRESSURE] = {sizeof(PressureDB), 2, {TIME_FIELD, FIELD(PressureDB, pressure, true)}},
+    [DATA_ACCEL_REL] = {sizeof(AccelerationDB),
+                        4,
+                        {TIME_FIELD, FIELD(AccelerationDB, x, true), FIELD(AccelerationDB, y, true),
+                         FIELD(AccelerationDB, z, true)}},
+    [DATA_ACCEL_ABS] = {sizeof(AccelerationDB),
+                        4,
+                        {TIME_FIELD, FIELD(AccelerationDB, x, true), FIELD(AccelerationDB, y, true),
+                         FIELD(AccelerationDB, z, true)}},
+    [DATA_ANGULAR_VEL] = {sizeof(AngularVelocityDB),
+                          4,
+                          {TIME_FIELD, FIELD(AngularVelocityDB, x, true), FIELD(AngularVelocityDB, y, true),
+                           FIELD(AngularVelocityDB, z, true)}},
+    [DATA_HUMIDITY] = {sizeof(HumidityDB), 2, {TIME_FIELD, FIELD(HumidityDB, humidity, false)}},
+    [DATA_LAT_LONG] = {sizeof(CoordinateDB),
+                       3,
+                       {TIME_FIELD, FIELD(CoordinateDB, latitude, true), FIELD(CoordinateDB, longitude, true)}},
+    [DATA_VOLTAGE] = {sizeof(VoltageDB), 3, {TIME_FIELD, FIELD(VoltageDB, id, false), FIELD(VoltageDB, voltage, true)}},
+    [DATA_VELOCITY] = {sizeof(VelocityDB), 2, {TIME_FIELD, FIELD(VelocityDB, velocity, true)}},
+    [DATA_ALT_FUSED] = {sizeof(AltitudeDB), 2, {TIME_FIELD, FIELD(AltitudeDB, altitude, true)}},
+};
+
+/**
+ * Gets the limits of the values of a field.
+ * @param f The field.
+ * @param lo Where to store the smallest value.
+ * @param hi Where to store the largest value.
+ */
+static void field_limits(const QuantField *f, int64_t *lo, int64_t *hi) {
+    const unsigned bits = f->width * 8;
+    *lo = f->is_signed ? -((int64_t)1 << (bits - 1)) : 0;
+    *hi = f->is_signed ? ((int64_t)1 << (bits - 1)) - 1 : ((int64_t)1 << bits) - 1;
+}
+
+/**
+ * Compiles a range of the form `min:max[/resolution]` into an operation.
+ * @param op The operation to compile the range into.
+ * @param f The field the range is for.
+ * @param range The range, which is not null terminated.
+ * @param len The length of the range.
+ * @return True if the range is valid, within the limits of the field and has at most 2^32 steps, false otherwise.
+ */
+static bool range_parse(QuantOp *op, const QuantField *f, const char *range, const size_t len) {
+    char buf[64];
+    if (len >= sizeof(buf)) return false;
+    memcpy(buf, range, len);
+    buf[len] = '\0';
+
+    char *end;
+    const long long min = strtoll(buf, &end, 10);
+    if (end == buf || *end != ':') return false;
+    const char *p = end + 1;
+    const long long max = strtoll(p, &end, 10);
+    if (end == p) return false;
+    unsigned long long res = 1;
+    if (*end == '/') {
+        p = end + 1;
+        res = strtoull(p, &end, 10);
+        if (end == p || *p == '-') return false;
+    }
+    if (*end != '\0') return false;
+
+    int64_t lo, hi;
+    field_limits(f, &lo, &hi);
+    if (min < lo || max > hi || max <= min || res == 0 || res > UINT32_MAX) return false;
+    const uint64_t max_q = (uint64_t)(max - min) / res;
+    if (max_q == 0 || max_q > UINT32_MAX) return false;
+
+    *op = (QuantOp){.offset = f->offset,
+                    .width = f->width,
+                    .is_signed = f->is_signed,
+                    .bits = 32 - __builtin_clz(max_q),
+                    .shift = (res & (res - 1)) == 0 ? __builtin_ctzll(res) : -1,
+                    .min = min,
+                    .res = res,
+                    .max_q = max_q};
+    return true;
+}
+
+/**
+ * Initializes empty profiles, under which no block is packed.
+ * @param p The profiles to initialize.
+ */
+void quant_init(QuantProfile *p) { memset(p, 0, sizeof(*p)); }
+
+/**
+ * Compiles a line of a profile file into the profiles. Blank lines and comments starting with '#' are ignored.
+ * @param p The profiles.
+ * @param line The line, of the form `subtype time field...`.
+ * @return True if the line is valid, false if it is malformed, gives a subtype that is not a built-in sensor reading
+ * or already has a profile, or does not give exactly one valid range per value of the block.
+ */
+bool quant_parse(QuantProfile *p, const char *line) {
+    const char *s = line + strspn(line, " \t");
+    if (*s == '\0' || *s == '\n' || *s == '#') return true;
+
+    char *end;
+    const unsigned long subtype = strtoul(s, &end, 0);
+    if (end == s || subtype >= QUANT_SUBTYPES || blocks[subtype].n_fields == 0 || p->layouts[subtype].size != 0) {
+        return false;
+    }
+    s = end;
+    const QuantBlock *b = &blocks[subtype];
+
+    QuantLayout l = {0};
+    for (;;) {
+        s += strspn(s, " \t\r\n");
+        if (*s == '\0' || *s == '#') break;
+        const size_t len = strcspn(s, " \t\r\n#");
+        if (l.n_ops == b->n_fields || !range_parse(&l.ops[l.n_ops], &b->fields[l.n_ops], s, len)) return false;
+        l.bits += l.ops[l.n_ops++].bits;
+        s += len;
+    }
+    if (l.n_ops != b->n_fields) return false;
+
+    const uint16_t payload_size = (l.bits + 31) / 32 * 4;
+    block_header_init(&l.header, payload_size, TYPE_DATA_PACKED, subtype, GROUNDSTATION);
+    l.size = sizeof(BlockHeader) + payload_size;
+    l.standard_size = sizeof(BlockHeader) + b->payload;
+    p->layouts[subtype] = l;
+    return true;
+}
+
+/**
+ * Compiles a profile file into the profiles.
+ * @param p The profiles.
+ * @param path The path of the profile file.
+ * @param line Where to store the number of the first invalid line, or 0 if the file could not be read.
+ * @return True if every line of the file is valid, false otherwise.
+ */
+bool quant_load(QuantProfile *p, const char *path, unsigned int *line) {
+    *line = 0;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+
+    char buf[256];
+    bool valid = true;
+    unsigned int n = 0;
+    while (valid && fgets(buf, sizeof(buf), f) != NULL) {
+        n++;
+        // A line without a newline is only complete at the end of the file, otherwise it is too long
+        valid = (strchr(buf, '\n') != NULL || feof(f)) && quant_parse(p, buf);
+    }
+    if (ferror(f)) valid = false;
+    fclose(f);
+    if (!valid) *line = n;
+    return valid;
+}
+
+/**
+ * Reads a value from a standard block payload.
+ * @param op The operation of the value.
+ * @param payload The block payload.
+ * @return The value.
+ */
+static inline int64_t load(const QuantOp *op, const uint8_t *payload) {
+    if (op->width == sizeof(uint32_t)) {
+        uint32_t v;
+        memcpy(&v, payload + op->offset, sizeof(v));
+        return op->is_signed ? (int64_t)(int32_t)v : (int64_t)v;
+    }
+    uint16_t v;
+    memcpy(&v, payload + op->offset, sizeof(v));
+    return op->is_signed ? (int64_t)(int16_t)v : (int64_t)v;
+}
+
+/**
+ * Writes a value to a standard block payload.
+ * @param op The operation of the value.
+ * @param payload The block payload.
+ * @param value The value, within the limits of the field.
+ */
+static inline void store(const QuantOp *op, uint8_t *payload, const int64_t value) {
+    if (op->width == sizeof(uint32_t)) {
+        const uint32_t v = value;
+        memcpy(payload + op->offset, &v, sizeof(v));
+    } else {
+        const uint16_t v = value;
+        memcpy(payload + op->offset, &v, sizeof(v));
+    }
+}
+
+/**
+ * Rounds a value to the nearest step of its range, saturating at the ends of the range.
+ * @param op The operation of the value.
+ * @param value The value.
+ * @return The step.
+ */
+static inline uint32_t quantize(const QuantOp *op, const int64_t value) {
+    if (value <= op->min) return 0;
+    const uint64_t d = (uint64_t)(value - op->min) + op->res / 2;
+    const uint64_t q = op->shift >= 0 ? d >> op->shift : d / op->res;
+    return q > op->max_q ? op->max_q : q;
+}
+
+/**
+ * Packs a standard data block in place, if its subtype has a profile.
+ * @param p The profiles.
+ * @param block The block, including its header.
+ * @param size The size of the block in bytes including its header.
+ * @return The size of the packed block, or size if the block was left as is because it is not a data block or its
+ * subtype has no profile.
+ */
+uint16_t quant_pack(const QuantProfile *p, uint8_t *block, const uint16_t size) {
+    const BlockHeader *h = (const BlockHeader *)block;
+    if (h->type != TYPE_DATA) return size;
+    const QuantLayout *l = quant_layout(p, h->subtype);
+    if (l == NULL || size != l->standard_size) return size;
+
+    // Packs in place: every value takes up at most as many bits as in the standard block, so a word of the packed
+    // block is only ever written over values that have already been read
+    uint8_t *payload = block + sizeof(BlockHeader);
+    uint8_t *out = payload;
+    uint64_t acc = 0;
+    uint8_t used = 0;
+    for (const QuantOp *op = l->ops; op < l->ops + l->n_ops; op++) {
+        acc |= (uint64_t)quantize(op, load(op, payload)) << used;
+        used += op->bits;
+        if (used >= 32) {
+            const uint32_t w = acc;
+            memcpy(out, &w, sizeof(w));
+            out += sizeof(w);
+            acc >>= 32;
+            used -= 32;
+        }
+    }
+    if (used > 0) {
+        const uint32_t w = acc;
+        memcpy(out, &w, sizeof(w));
+    }
+    memcpy(block, &l->header, sizeof(BlockHeader));
+    return l->size;
+}
+
+/**
+ * Unpacks a packed data block into the standard block it was packed from. Values are restored at the resolution of the
+ * profile, so they may differ from the original by up to half a step, or more if they were outside the range.
+ * @param p The profiles the block was packed with.
+ * @param h The header of the packed block.
+ * @param payload The packed block contents following the header.
+ * @param buf The buffer to write the standard block to, which must not overlap the packed block. Must have room for
+ * at least ENCODED_BLOCK_MAX_SIZE bytes.
+ * @return The size of the standard block including its header, or 0 if the block is not packed, its subtype has no
+ * profile or its length does not match the profile.
+ */
+uint16_t quant_unpack(const QuantProfile *p, const BlockHeader *h, const uint8_t *payload, uint8_t *buf) {
+    if (block_header_get_type(h) != TYPE_DATA_PACKED) return 0;
+    const QuantLayout *l = quant_layout(p, h->subtype);
+    if (l == NULL || block_header_get_length(h) != l->size) return 0;
+
+    uint8_t *out = buf + sizeof(BlockHeader);
+    block_header_init((BlockHeader *)buf, l->standard_size - sizeof(BlockHeader), TYPE_DATA, h->subtype, h->dest_addr);
+    ((BlockHeader *)buf)->type |= h->type & BLOCK_TYPE_RESENT;
+    memset(out, 0, ENCODED_BLOCK_MAX_SIZE - sizeof(BlockHeader)); // Padding, cleared in one go whatever the block size
+
+    uint64_t acc = 0;
+    uint8_t avail = 0;
+    const uint8_t *in = payload;
+    for (const QuantOp *op = l->ops; op < l->ops + l->n_ops; op++) {
+        if (avail < op->bits) {
+            uint32_t w;
+            memcpy(&w, in, sizeof(w));
+            in += sizeof(w);
+            acc |= (uint64_t)w << avail;
+            avail += 32;
+        }
+        uint32_t q = acc & (((uint64_t)1 << op->bits) - 1);
+        acc >>= op->bits;
+        avail -= op->bits;
+        if (q > op->max_q) q = op->max_q; // Steps past the end of the range are never packed, only corrupted
+        store(op, out, op->min + (int64_t)q * op->res);
+    }
+    return l->standard_size;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file quant.h
+ * @brief Lossy quantization profiles that shrink data blocks to bit-packed layouts.
+ *
+ * The fixed point units of the data blocks are much finer than what the sensors deliver: a temperature is sent in
+ * millidegrees in 32 bits although the sensor resolves a tenth of a degree over a range of 125 degrees. A profile
+ * gives, for a data block subtype, the range and resolution of the mission time and of every field of the block:
+ *
+ *     # subtype  time          field...
+ *     0x03       0:3600000/10  -40000:85000/100
+ *     0x06       0:3600000/10  -16000:16000/10 -16000:16000/10 -16000:16000/10
+ *
+ * A range is `min:max[/resolution]`, in the fixed point units of the field (the resolution defaults to 1). Each value
+ * is rounded to the nearest multiple of the resolution above min, saturating at the range, and takes up just enough
+ * bits to count the steps of its range: the temperature above takes 11 bits and the mission time 19 bits, so the whole
+ * block fits in 4 bytes instead of 8.
+ *
+ * Each line is compiled into a layout with a ready-made block header and one operation per value. Packing and
+ * unpacking are a short loop of shifts and masks over a 64 bit accumulator, one 32 bit word at a time. Packed blocks
+ * have type TYPE_DATA_PACKED and keep the subtype of the block they were packed from; they are padded to a multiple of
+ * 4 bytes like every other block. The receiver unpacks them with the same profile back into the standard block,
+ * which decode_block understands.
+ */
+
+#ifndef _QUANT_H_
+#define _QUANT_H_
+
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Profiles can be given for the data block subtypes below this, which are the built-in sensor readings. */
+#define QUANT_SUBTYPES (DATA_ALT_FUSED + 1)
+
+/** The most values in a block, the mission time included. */
+#define QUANT_MAX_FIELDS 4
+
+/** The compiled operation that packs one value. */
+typedef struct {
+    /** The offset of the value in the standard block payload. */
+    uint8_t offset;
+    /** The size of the value in the standard block payload in bytes. */
+    uint8_t width;
+    /** Whether the value is signed in the standard block payload. */
+    bool is_signed;
+    /** The number of bits the value takes up in the packed block. */
+    uint8_t bits;
+    /** The shift that divides by the resolution when it is a power of 2, or -1 otherwise. */
+    int8_t shift;
+    /** The smallest value of the range. */
+    int64_t min;
+    /** The resolution, in fixed point units per step. */
+    uint32_t res;
+    /** The highest step of the range. */
+    uint32_t max_q;
+} QuantOp;
+
+/** The compiled layout of the packed blocks of one subtype. */
+typedef struct {
+    /** The header of the packed blocks, written as is. */
+    BlockHeader header;
+    /** The size of the packed blocks in bytes including their header, or 0 if the subtype has no profile. */
+    uint16_t size;
+    /** The size of the standard blocks in bytes including their header. */
+    uint16_t standard_size;
+    /** The number of bits of all values in the packed block, before padding. */
+    uint16_t bits;
+    /** The number of values, the mission time first. */
+    uint8_t n_ops;
+    /** One operation per value, in the order they are packed. */
+    QuantOp ops[QUANT_MAX_FIELDS];
+} QuantLayout;
+
+/** The compiled profiles, indexed by data block subtype. */
+typedef struct {
+    /** The layout of every subtype. */
+    QuantLayout layouts[QUANT_SUBTYPES];
+} QuantProfile;
+
+void quant_init(QuantProfile *p);
+bool quant_parse(QuantProfile *p, const char *line);
+bool quant_load(QuantProfile *p, const char *path, unsigned int *line);
+uint16_t quant_pack(const QuantProfile *p, uint8_t *block, const uint16_t size);
+uint16_t quant_unpack(const QuantProfile *p, const BlockHeader *h, const uint8_t *payload, uint8_t *buf);
+
+/**
+ * Gets the layout of the packed blocks of a subtype.
+ * @param p The profiles.
+ * @param subtype The data block subtype.
+ * @return The layout, or NULL if the subtype has no profile.
+ */
+static inline const QuantLayout *quant_layout(const QuantProfile *p, const uint8_t subtype) {
+    return subtype < QUANT_SUBTYPES && p->layouts[subtype].size != 0 ? &p->layouts[subtype] : NULL;
+}
+
+#endif // _QUANT_H_
@@ -0,0 +1,175 @@
+/**
+ * @file reorder.c
+ * @brief Contains the definitions for restoring the send order of input messages.
+ *
+ * Held messages are kept sorted by their distance from the next sequence number to release, which stays correct as
+ * sequence numbers wrap around. A message more than 64 sequence numbers behind is taken to come from a restarted
+ * source: everything held from before the restart is released first and numbering starts over from that message.
+ */
+#include "reorder.h"
+#include "intypes.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/** The number of released sequence numbers remembered for detecting duplicates. */
+#define HISTORY 64
+
+/**
+ * Initializes an empty reorder buffer, allocating room for its held messages from an arena.
+ * @param r The reorder buffer to initialize.
+ * @param window The most messages to hold, capped at REORDER_MAX. At least 1.
+ * @param latency_ms The most milliseconds to hold a message.
+ * @param arena The arena to allocate from.
+ * @return True if the reorder buffer was initialized, false if the arena had no room.
+ */
+bool reorder_init(ReorderBuffer *r, const uint8_t window, const uint32_t latency_ms, Arena *arena) {
+    memset(r, 0, sizeof(*r));
+    r->window = window == 0 ? 1 : window > REORDER_MAX ? REORDER_MAX : window;
+    r->latency = latency_ms;
+    r->entries = arena_alloc(arena, reorder_footprint(window), "reorder");
+    return r->entries != NULL;
+}
+
+/**
+ * Gets the distance of a sequence number from the next one to release.
+ * @param r The reorder buffer.
+ * @param seq The sequence number.
+ * @return The distance, negative for sequence numbers that were already released or given up on.
+ */
+static inline int32_t distance(const ReorderBuffer *r, const uint16_t seq) {
+    return (int16_t)(uint16_t)(seq - r->next);
+}
+
+/**
+ * Inserts a message into the held messages in send order.
+ * @param r The reorder buffer, which must not be full.
+ * @param e The message to insert.
+ * @return False if a message with the same sequence number is already held, true otherwise.
+ */
+static bool insert(ReorderBuffer *r, const ReorderEntry *e) {
+    const int32_t d = distance(r, e->msg.seq);
+    uint8_t i = r->count;
+    while (i > 0 && distance(r, r->entries[i - 1].msg.seq) > d) i--;
+    if (i > 0 && distance(r, r->entries[i - 1].msg.seq) == d) return false;
+
+    memmove(&r->entries[i + 1], &r->entries[i], (r->count - i) * sizeof(ReorderEntry));
+    r->entries[i] = *e;
+    r->count++;
+    if (r->count > r->max_count) r->max_count = r->count;
+    return true;
+}
+
+/**
+ * Adds a received message to the reorder buffer. Messages must be taken out with reorder_pop until it returns false
+ * before the next one is added.
+ * @param r The reorder buffer.
+ * @param msg The received message.
+ * @param priority The priority the message was received with.
+ * @param now_ms The current time in milliseconds.
+ * @return True if the message is held, false if it was dropped as a duplicate or as late.
+ */
+bool reorder_push(ReorderBuffer *r, const common_t *msg, const unsigned int priority, const uint32_t now_ms) {
+    const ReorderEntry e = {.msg = *msg, .priority = priority, .arrival = now_ms};
+
+    if (!r->started) {
+        r->next = msg->seq;
+        r->started = true;
+    }
+
+    const int32_t d = distance(r, msg->seq);
+    if (d < -HISTORY || r->restarting) {
+        if (r->restarting) {
+            // Only one message of the restarted source is kept until the old ones are released
+            r->late++;
+            return false;
+        }
+        r->restart = e;
+        r->restarting = true;
+        return true;
+    }
+    if (d < 0) {
+        if (r->released & (1ull << (-d - 1))) {
+            r->duplicates++;
+        } else {
+            r->late++;
+        }
+        return false;
+    }
+
+    if (!insert(r, &e)) {
+        r->duplicates++;
+        return false;
+    }
+    if (d > 0 && r->entries[0].msg.seq != r->next) r->reordered++;
+    return true;
+}
+
+/**
+ * Advances the next sequence number to release past a message.
+ * @param r The reorder buffer.
+ * @param seq The sequence number of the released message.
+ * @param released Whether the message was released, as opposed to given up on.
+ */
+static void advance(ReorderBuffer *r, const uint16_t seq, const bool released) {
+    const int32_t d = distance(r, seq);
+    r->skipped += d;
+    r->released = d + 1 >= HISTORY ? 0 : r->released << (d + 1);
+    if (released) r->released |= 1;
+    r->next = seq + 1;
+}
+
+/**
+ * Takes the next message out of the reorder buffer, if it may be released. A message may be released once every
+ * message sent before it has been released, or when the missing messages are given up on because the buffer is full,
+ * a message has been held for the latency limit or the buffer is being flushed.
+ * @param r The reorder buffer.
+ * @param msg Where to store the released message.
+ * @param priority Where to store the priority of the released message.
+ * @param now_ms The current time in milliseconds.
+ * @param flush True to release every held message regardless of missing messages, for when the input has ended.
+ * @return True if a message was released, false if there is none that may be released yet.
+ */
+bool reorder_pop(ReorderBuffer *r, common_t *msg, unsigned int *priority, const uint32_t now_ms, const bool flush) {
+    if (r->count == 0) {
+        if (!r->restarting) return false;
+
+        // Everything from before the restart has been released, so start over from the restarted source
+        r->restarting = false;
+        r->next = r->restart.msg.seq;
+        r->released = 0;
+        insert(r, &r->restart);
+    }
+
+    const ReorderEntry *head = &r->entries[0];
+    if (head->msg.seq != r->next && !flush && !r->restarting && r->count < r->window &&
+        reorder_wait_ms(r, now_ms) > 0) {
+        return false;
+    }
+
+    advance(r, head->msg.seq, true);
+    *msg = head->msg;
+    *priority = head->priority;
+    r->count--;
+    memmove(&r->entries[0], &r->entries[1], r->count * sizeof(ReorderEntry));
+    return true;
+}
+
+/**
+ * Gets how long to wait for the missing messages that held messages are waiting for.
+ * @param r The reorder buffer.
+ * @param now_ms The current time in milliseconds.
+ * @return The number of milliseconds until a held message reaches the latency limit, 0 if a message may be released
+ * now and -1 if no messages are held.
+ */
+int32_t reorder_wait_ms(const ReorderBuffer *r, const uint32_t now_ms) {
+    if (r->count == 0) return r->restarting ? 0 : -1;
+    if (r->entries[0].msg.seq == r->next) return 0;
+
+    uint32_t waited = 0;
+    for (uint8_t i = 0; i < r->count; i++) {
+        const uint32_t w = now_ms - r->entries[i].arrival;
+        if (w > waited) waited = w;
+    }
+    return waited >= r->latency ? 0 : (int32_t)(r->latency - waited);
+}
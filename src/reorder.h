@@ -0,0 +1,85 @@
+/**
+ * @file reorder.h
+ * @brief Bounded reorder buffer restoring the send order of input messages from their source sequence numbers.
+ *
+ * The input message queue delivers higher priority messages first, so a reading can overtake the time message it was
+ * sent after and be stamped with the wrong mission time. Messages are held until every message sent before them has
+ * been released, for at most a configurable number of messages and milliseconds, after which missing messages are
+ * given up on. Exact duplicates and messages that arrive after they were given up on are dropped.
+ *
+ * The sequence numbers must be stamped by the producer of the messages (see common_t.seq), which fetcher does not do
+ * yet, so the reorder buffer is only used when it is asked for.
+ */
+
+#ifndef _REORDER_H_
+#define _REORDER_H_
+
+#include "arena.h"
+#include "intypes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The largest number of messages the reorder buffer can hold. */
+#define REORDER_MAX 64
+
+/** The default number of milliseconds a message is held while waiting for a message sent before it. */
+#define REORDER_DEFAULT_LATENCY_MS 20
+
+/** A message held in the reorder buffer. */
+typedef struct {
+    /** The input message. */
+    common_t msg;
+    /** The priority the message was received with. */
+    unsigned int priority;
+    /** The time in milliseconds at which the message was received. */
+    uint32_t arrival;
+} ReorderEntry;
+
+/** State of the reorder buffer. */
+typedef struct {
+    /** The held messages, in send order, room for the window. */
+    ReorderEntry *entries;
+    /** The number of held messages. */
+    uint8_t count;
+    /** The most messages that are held before missing messages are given up on. */
+    uint8_t window;
+    /** The most milliseconds a message is held before missing messages are given up on. */
+    uint32_t latency;
+    /** The sequence number of the next message to release. */
+    uint16_t next;
+    /** Bit n is set if the message with sequence number next - 1 - n was released, for detecting duplicates. */
+    uint64_t released;
+    /** Whether the first message has been received, which sequence numbers start from. */
+    bool started;
+    /** A message from a restarted source, held until the messages from before the restart are released. */
+    ReorderEntry restart;
+    /** Whether a message from a restarted source is being held. */
+    bool restarting;
+    /** The number of messages that arrived before a message sent earlier. */
+    uint32_t reordered;
+    /** The number of exact duplicates dropped. */
+    uint32_t duplicates;
+    /** The number of messages dropped because they arrived after they were given up on. */
+    uint32_t late;
+    /** The number of missing messages given up on. */
+    uint32_t skipped;
+    /** The most messages held at once. */
+    uint8_t max_count;
+} ReorderBuffer;
+
+/**
+ * Gets the arena memory a reorder buffer needs.
+ * @param window The most messages to hold.
+ * @return The size of the reorder buffer's arena allocation in bytes.
+ */
+static inline size_t reorder_footprint(const uint8_t window) {
+    return arena_round((window == 0 ? 1 : window > REORDER_MAX ? REORDER_MAX : window) * sizeof(ReorderEntry));
+}
+
+bool reorder_init(ReorderBuffer *r, const uint8_t window, const uint32_t latency_ms, Arena *arena);
+bool reorder_push(ReorderBuffer *r, const common_t *msg, const unsigned int priority, const uint32_t now_ms);
+bool reorder_pop(ReorderBuffer *r, common_t *msg, unsigned int *priority, const uint32_t now_ms, const bool flush);
+int32_t reorder_wait_ms(const ReorderBuffer *r, const uint32_t now_ms);
+
+#endif // _REORDER_H_
@@ -0,0 +1,134 @@
+/**
+ * @file rt.c
+ * @brief Contains the definitions for entering real-time mode and recording latency statistics.
+ */
+#ifndef __QNX__
+#define _GNU_SOURCE // For setting the CPU affinity of a thread
+#endif
+#include "rt.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __QNX__
+#include <sys/neutrino.h>
+#endif
+
+/**
+ * Runs the calling thread at a fixed SCHED_FIFO priority, so that only higher priority threads can preempt it.
+ * @param priority The priority, within the SCHED_FIFO range of the system.
+ * @return True if the priority was set, false otherwise with errno set (EINVAL if it is out of range, EPERM if the
+ * process may not use real-time scheduling).
+ */
+bool rt_set_priority(const int priority) {
+    if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)) {
+        errno = EINVAL;
+        return false;
+    }
+    const struct sched_param param = {.sched_priority = priority};
+    const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) errno = err;
+    return err == 0;
+}
+
+/**
+ * Pins the calling thread to a CPU, so that it keeps its caches and can be given a CPU isolated from other processes.
+ * @param cpu The index of the CPU.
+ * @return True if the thread was pinned, false otherwise with errno set.
+ */
+bool rt_set_cpu(const int cpu) {
+    const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpu < 0 || (cpus > 0 && cpu >= cpus)) {
+        errno = EINVAL;
+        return false;
+    }
+#ifdef __QNX__
+    if (cpu >= 32) {
+        errno = EINVAL;
+        return false;
+    }
+    return ThreadCtl(_NTO_TCTL_RUNMASK, (void *)(uintptr_t)(1u << cpu)) != -1;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) errno = err;
+    return err == 0;
+#endif
+}
+
+/**
+ * Locks all current and future memory of the process in RAM, which also faults in every page that is mapped now.
+ * @return True if the memory was locked, false otherwise with errno set.
+ */
+bool rt_lock_memory(void) { return mlockall(MCL_CURRENT | MCL_FUTURE) == 0; }
+
+/**
+ * Faults in every page of a buffer by writing to it without changing its contents. Pages of zero initialized memory
+ * that have only been read are all mapped to the same zero page, so reading is not enough.
+ * @param buf The buffer, which no other thread may be using.
+ * @param size The size of the buffer in bytes.
+ */
+void rt_prefault(void *buf, const size_t size) {
+    volatile uint8_t *b = buf;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < size; i += page) b[i] = b[i];
+    if (size > 0) b[size - 1] = b[size - 1];
+}
+
+/**
+ * Faults in RT_STACK_PREFAULT bytes of stack below the caller, so that calls made later from the caller do not fault
+ * on them.
+ */
+__attribute__((noinline)) void rt_prefault_stack(void) {
+    uint8_t stack[RT_STACK_PREFAULT];
+    memset(stack, 0, sizeof(stack));
+    __asm__ volatile("" : : "r"(stack) : "memory"); // Keep the writes from being optimized away
+}
+
+/**
+ * Initializes empty latency statistics.
+ * @param s The statistics to initialize.
+ */
+void latency_init(LatencyStats *s) { memset(s, 0, sizeof(*s)); }
+
+/**
+ * Records a latency.
+ * @param s The statistics.
+ * @param ns The latency in nanoseconds.
+ */
+void latency_record(LatencyStats *s, const uint64_t ns) {
+    const uint64_t us = ns / 1000;
+    uint8_t bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    s->buckets[bucket]++;
+    s->count++;
+    s->sum_ns += ns;
+    if (ns > s->max_ns) s->max_ns = ns;
+}
+
+/**
+ * Gets a bound on a percentile of the latencies.
+ * @param s The statistics.
+ * @param permille The percentile in tenths of a percent, from 0 to 1000.
+ * @return The upper end of the bucket holding the percentile, in nanoseconds and at most the highest latency, or 0 if
+ * no latency was recorded.
+ */
+uint64_t latency_percentile_ns(const LatencyStats *s, const uint32_t permille) {
+    const uint64_t rank = ((uint64_t)s->count * permille + 999) / 1000; // Latencies at or below the percentile
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += s->buckets[i];
+        if (seen >= rank && seen > 0) {
+            const uint64_t bound = ((uint64_t)1 << i) * 1000;
+            return bound < s->max_ns ? bound : s->max_ns;
+        }
+    }
+    return s->max_ns;
+}
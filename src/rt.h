@@ -0,0 +1,62 @@
+/**
+ * @file rt.h
+ * @brief Real-time execution: fixed priority scheduling, CPU pinning, locked and prefaulted memory, and the latency
+ * statistics to compare it with default scheduling.
+ *
+ * Without it, the first touch of a buffer page faults and the scheduler preempts the main loop for other processes,
+ * and both show up as latency spikes in the packet output. In real-time mode the main loop runs at a SCHED_FIFO
+ * priority, optionally pinned to one CPU, with all of its memory locked so that it is never paged out and every
+ * buffer and enough stack for the deepest call chain faulted in at startup.
+ *
+ * The latency from receiving an input message to having encoded and fanned it out, including sending any packet it
+ * completed, is recorded in a histogram with power of 2 buckets so that the worst case of a run can be compared between
+ * modes without keeping every sample.
+ */
+
+#ifndef _RT_H_
+#define _RT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** The bytes of stack faulted in at startup in real-time mode, well beyond the deepest call chain of the main loop. */
+#define RT_STACK_PREFAULT (64 * 1024)
+
+/** The number of latency buckets. Bucket 0 counts latencies under 1 us, bucket n those from 2^(n-1) to 2^n us. */
+#define LATENCY_BUCKETS 24
+
+/** Statistics of the latencies of a run. */
+typedef struct {
+    /** The number of latencies recorded. */
+    uint32_t count;
+    /** The sum of the latencies in nanoseconds. */
+    uint64_t sum_ns;
+    /** The highest latency in nanoseconds. */
+    uint64_t max_ns;
+    /** The number of latencies in each bucket, the last one also counting everything above it. */
+    uint32_t buckets[LATENCY_BUCKETS];
+} LatencyStats;
+
+bool rt_set_priority(const int priority);
+bool rt_set_cpu(const int cpu);
+bool rt_lock_memory(void);
+void rt_prefault(void *buf, const size_t size);
+void rt_prefault_stack(void);
+
+void latency_init(LatencyStats *s);
+void latency_record(LatencyStats *s, const uint64_t ns);
+uint64_t latency_percentile_ns(const LatencyStats *s, const uint32_t permille);
+
+/**
+ * Gets the current time from the monotonic clock, for measuring latencies.
+ * @return The current monotonic time in nanoseconds.
+ */
+static inline uint64_t latency_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+#endif // _RT_H_
@@ -0,0 +1,267 @@
+/**
+ * @file schema.c
+ * @brief Contains the definitions for compiling schema files and encoding the readings of schema sensors.
+ */
+#include "schema.h"
+#include "encoder.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The names of the field types, indexed by SchemaType. */
+static const char *const type_names[] = {"f32", "i32", "u32", "i16", "u16", "i8", "u8", "id"};
+
+/** The number of bytes of the input message data that each field type takes up, indexed by SchemaType. */
+static const uint8_t type_sizes[] = {4, 4, 4, 2, 2, 1, 1, 0};
+
+/**
+ * Looks up a field type by name.
+ * @param name The name of the type.
+ * @param len The length of the name.
+ * @return The type, or -1 if there is no type with that name.
+ */
+static int type_parse(const char *name, const size_t len) {
+    for (size_t i = 0; i < sizeof(type_names) / sizeof(type_names[0]); i++) {
+        if (strlen(type_names[i]) == len && !strncmp(type_names[i], name, len)) return i;
+    }
+    return -1;
+}
+
+/**
+ * Sets the saturation limits of an operation from its output type.
+ * @param op The operation.
+ */
+static void op_limits(SchemaOp *op) {
+    switch (op->store) {
+    case SCHEMA_I32:
+        op->min = INT32_MIN, op->max = INT32_MAX, op->lo = -2147483648.0f, op->hi = 2147483648.0f;
+        break;
+    case SCHEMA_U32:
+        op->min = 0, op->max = UINT32_MAX, op->lo = 0.0f, op->hi = 4294967296.0f;
+        break;
+    case SCHEMA_I16:
+        op->min = INT16_MIN, op->max = INT16_MAX, op->lo = -32768.0f, op->hi = 32767.0f;
+        break;
+    case SCHEMA_U16:
+        op->min = 0, op->max = UINT16_MAX, op->lo = 0.0f, op->hi = 65535.0f;
+        break;
+    case SCHEMA_I8:
+        op->min = INT8_MIN, op->max = INT8_MAX, op->lo = -128.0f, op->hi = 127.0f;
+        break;
+    case SCHEMA_U8:
+        op->min = 0, op->max = UINT8_MAX, op->lo = 0.0f, op->hi = 255.0f;
+        break;
+    }
+}
+
+/**
+ * Compiles a field of the form `input:output[*scale]` into an operation.
+ * @param op The operation to compile the field into.
+ * @param field The field, which is not null terminated.
+ * @param len The length of the field.
+ * @param in The offset of the input in the input message data, advanced past the input.
+ * @param out The offset of the output in the fields of the block, advanced past the output.
+ * @return True if the field is valid and fits in the input message and the block, false otherwise.
+ */
+static bool field_parse(SchemaOp *op, const char *field, const size_t len, uint8_t *in, uint8_t *out) {
+    const char *colon = memchr(field, ':', len);
+    if (colon == NULL) return false;
+    const char *star = memchr(colon, '*', len - (colon - field));
+    const char *end = field + len;
+
+    const int load = type_parse(field, colon - field);
+    const int store = type_parse(colon + 1, (star != NULL ? star : end) - colon - 1);
+    if (load < 0 || store < 0 || store == SCHEMA_F32 || store == SCHEMA_ID) return false;
+
+    *op = (SchemaOp){.load = load,
+                     .store = store,
+                     .in = load == SCHEMA_ID ? 0 : *in,
+                     .out = sizeof(uint32_t) + *out,
+                     .scale = 1.0f,
+                     .int_scale = 1};
+    if (star != NULL) {
+        char scale[32];
+        if (end - star - 1 <= 0 || end - star - 1 >= (long)sizeof(scale)) return false;
+        memcpy(scale, star + 1, end - star - 1);
+        scale[end - star - 1] = '\0';
+
+        char *scale_end;
+        if (load == SCHEMA_F32) {
+            op->scale = strtof(scale, &scale_end);
+            if (!isfinite(op->scale)) return false;
+        } else {
+            // Integer inputs are scaled exactly, so only whole numbers are allowed
+            const long int_scale = strtol(scale, &scale_end, 10);
+            if (int_scale < -65536 || int_scale > 65536) return false;
+            op->int_scale = int_scale;
+        }
+        if (*scale_end != '\0') return false;
+    }
+    op_limits(op);
+
+    *in += type_sizes[load];
+    *out += type_sizes[store];
+    return *in <= sizeof(((common_t *)0)->data) && *out <= SCHEMA_MAX_FIELD_BYTES;
+}
+
+/**
+ * Initializes an empty schema, which describes no tags.
+ * @param s The schema to initialize.
+ */
+void schema_init(Schema *s) { memset(s, 0, sizeof(*s)); }
+
+/**
+ * Compiles a line of a schema file into the schema. Blank lines and comments starting with '#' are ignored.
+ * @param s The schema.
+ * @param line The line, of the form `tag subtype field...`.
+ * @return True if the line is valid, false if it is malformed, describes a tag that is built in or already described,
+ * uses the subtype of a built-in data block or its block would be larger than the largest built-in block.
+ */
+bool schema_parse(Schema *s, const char *line) {
+    const char *p = line + strspn(line, " \t");
+    if (*p == '\0' || *p == '\n' || *p == '#') return true;
+
+    char *end;
+    const unsigned long tag = strtoul(p, &end, 0);
+    if (end == p || tag >= SCHEMA_TAGS || encoded_block_size(tag) >= 0 || s->entries[tag].size != 0) return false;
+    p = end;
+    const unsigned long subtype = strtoul(p, &end, 0);
+    if (end == p || subtype > UINT8_MAX || subtype <= DATA_ALT_FUSED) return false;
+    p = end;
+
+    SchemaEntry e = {0};
+    uint8_t in = 0, out = 0;
+    for (;;) {
+        p += strspn(p, " \t\r\n");
+        if (*p == '\0' || *p == '#') break;
+        const size_t len = strcspn(p, " \t\r\n#");
+        if (e.n_ops == SCHEMA_MAX_FIELDS || !field_parse(&e.ops[e.n_ops++], p, len, &in, &out)) return false;
+        p += len;
+    }
+    if (e.n_ops == 0) return false;
+
+    const uint16_t payload_size = sizeof(uint32_t) + ((out + 3) & ~3u);
+    block_header_init(&e.header, payload_size, TYPE_DATA, subtype, GROUNDSTATION);
+    e.size = sizeof(BlockHeader) + payload_size;
+    s->entries[tag] = e;
+    return true;
+}
+
+/**
+ * Compiles a schema file into the schema.
+ * @param s The schema.
+ * @param path The path of the schema file.
+ * @param line Where to store the number of the first invalid line, or 0 if the file could not be read.
+ * @return True if every line of the file is valid, false otherwise.
+ */
+bool schema_load(Schema *s, const char *path, unsigned int *line) {
+    *line = 0;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+
+    char buf[256];
+    bool valid = true;
+    unsigned int n = 0;
+    while (valid && fgets(buf, sizeof(buf), f) != NULL) {
+        n++;
+        // A line without a newline is only complete at the end of the file, otherwise it is too long
+        valid = (strchr(buf, '\n') != NULL || feof(f)) && schema_parse(s, buf);
+    }
+    if (ferror(f)) valid = false;
+    fclose(f);
+    if (!valid) *line = n;
+    return valid;
+}
+
+/**
+ * Encodes an input message of a schema sensor as a data block, including its block header.
+ * @param s The schema.
+ * @param buf The buffer to write the block to. Must have room for at least ENCODED_BLOCK_MAX_SIZE bytes.
+ * @param msg The input message to encode.
+ * @param mission_time The mission time of the measurement in milliseconds.
+ * @return The number of bytes written, or 0 if the schema does not describe the tag of the message.
+ */
+uint16_t schema_encode(const Schema *s, uint8_t *buf, const common_t *msg, const uint32_t mission_time) {
+    const uint16_t size = schema_block_size(s, msg->type);
+    if (size == 0) return 0;
+    const SchemaEntry *e = &s->entries[msg->type];
+
+    uint8_t *payload = buf + sizeof(BlockHeader);
+    memcpy(buf, &e->header, sizeof(BlockHeader));
+    memcpy(payload, &mission_time, sizeof(uint32_t));
+    memset(buf + size - 4, 0, 4); // Padding after the last field
+
+    const uint8_t *data = (const uint8_t *)&msg->data;
+    for (const SchemaOp *op = e->ops; op < e->ops + e->n_ops; op++) {
+        int64_t v;
+        if (op->load == SCHEMA_F32) {
+            float f;
+            memcpy(&f, data + op->in, sizeof(f));
+            const float scaled = f * op->scale;
+            v = isnan(scaled) ? 0 : scaled >= op->hi ? op->max : scaled <= op->lo ? op->min : (int64_t)scaled;
+        } else {
+            switch (op->load) {
+            case SCHEMA_I32: {
+                int32_t x;
+                memcpy(&x, data + op->in, sizeof(x));
+                v = x;
+                break;
+            }
+            case SCHEMA_U32: {
+                uint32_t x;
+                memcpy(&x, data + op->in, sizeof(x));
+                v = x;
+                break;
+            }
+            case SCHEMA_I16: {
+                int16_t x;
+                memcpy(&x, data + op->in, sizeof(x));
+                v = x;
+                break;
+            }
+            case SCHEMA_U16: {
+                uint16_t x;
+                memcpy(&x, data + op->in, sizeof(x));
+                v = x;
+                break;
+            }
+            case SCHEMA_I8:
+                v = (int8_t)data[op->in];
+                break;
+            case SCHEMA_U8:
+                v = data[op->in];
+                break;
+            default:
+                v = msg->id;
+                break;
+            }
+            v *= op->int_scale;
+            v = v > op->max ? op->max : v < op->min ? op->min : v;
+        }
+
+        // Outputs are little endian like the rest of the packet, so the low bytes of the value are the output
+        switch (op->store) {
+        case SCHEMA_I32:
+        case SCHEMA_U32: {
+            const uint32_t x = (uint32_t)v;
+            memcpy(payload + op->out, &x, sizeof(x));
+            break;
+        }
+        case SCHEMA_I16:
+        case SCHEMA_U16: {
+            const uint16_t x = (uint16_t)v;
+            memcpy(payload + op->out, &x, sizeof(x));
+            break;
+        }
+        default:
+            payload[op->out] = (uint8_t)v;
+            break;
+        }
+    }
+    return size;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file schema.h
+ * @brief Sensors described by a schema file loaded at startup, for sensors that packager has no built-in encoding for.
+ *
+ * Every line of a schema file maps a sensor tag to a data block subtype and lists the fields of the block:
+ *
+ *     # tag  subtype  field...
+ *     0x11   0x20     f32:i32*1000
+ *     0x0e   0x21     id:u8 i16:i16 f32:u16*10
+ *
+ * A field is `input:output[*scale]`. Inputs are read one after the other from the data of the input message (f32,
+ * i32, u32, i16, u16, i8 or u8), except for `id`, which is the sensor ID. Outputs (i32, u32, i16, u16, i8 or u8) are
+ * written one after the other after the mission time and saturate at the limits of their type. Float inputs are
+ * multiplied by the scale and truncated like the built-in fixed point conversions, integer inputs are multiplied by
+ * the scale, which must then be a whole number. The block is zero padded to a multiple of 4 bytes.
+ *
+ * Each line is compiled into a table entry with a ready-made block header and one operation per field, so encoding is
+ * a table lookup and a short loop instead of parsing a description for every message.
+ */
+
+#ifndef _SCHEMA_H_
+#define _SCHEMA_H_
+
+#include "encoder.h"
+#include "intypes.h"
+#include "packet_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Schema sensors use tags below this. Tags with a built-in encoding cannot be redefined. */
+#define SCHEMA_TAGS 32
+
+/** The most fields a block can have. */
+#define SCHEMA_MAX_FIELDS 8
+
+/** The most bytes of fields a block can have, so that it is no larger than the largest built-in block. */
+#define SCHEMA_MAX_FIELD_BYTES (ENCODED_BLOCK_MAX_SIZE - sizeof(BlockHeader) - sizeof(uint32_t))
+
+/** The types that fields are read as and written as. */
+typedef enum {
+    SCHEMA_F32 = 0, /**< 32 bit float, input only */
+    SCHEMA_I32 = 1, /**< 32 bit signed integer */
+    SCHEMA_U32 = 2, /**< 32 bit unsigned integer */
+    SCHEMA_I16 = 3, /**< 16 bit signed integer */
+    SCHEMA_U16 = 4, /**< 16 bit unsigned integer */
+    SCHEMA_I8 = 5,  /**< 8 bit signed integer */
+    SCHEMA_U8 = 6,  /**< 8 bit unsigned integer */
+    SCHEMA_ID = 7,  /**< The sensor ID of the input message, input only */
+} SchemaType;
+
+/** The compiled operation that converts one field. */
+typedef struct {
+    /** The type the input is read as. */
+    uint8_t load;
+    /** The type the output is written as. */
+    uint8_t store;
+    /** The offset of the input in the data of the input message. */
+    uint8_t in;
+    /** The offset of the output in the block payload. */
+    uint8_t out;
+    /** The scale of float inputs. */
+    float scale;
+    /** The scale of integer inputs. */
+    int32_t int_scale;
+    /** Scaled float inputs at or below this saturate at min. */
+    float lo;
+    /** Scaled float inputs at or above this saturate at max. */
+    float hi;
+    /** The smallest value of the output type. */
+    int64_t min;
+    /** The largest value of the output type. */
+    int64_t max;
+} SchemaOp;
+
+/** The compiled description of the blocks of one sensor tag. */
+typedef struct {
+    /** The block header, written as is. */
+    BlockHeader header;
+    /** The size of the block in bytes including its header, or 0 if the tag is not described. */
+    uint16_t size;
+    /** The number of fields. */
+    uint8_t n_ops;
+    /** One operation per field, in order. */
+    SchemaOp ops[SCHEMA_MAX_FIELDS];
+} SchemaEntry;
+
+/** The compiled schema, indexed by sensor tag. */
+typedef struct {
+    /** The description of every tag. */
+    SchemaEntry entries[SCHEMA_TAGS];
+} Schema;
+
+void schema_init(Schema *s);
+bool schema_parse(Schema *s, const char *line);
+bool schema_load(Schema *s, const char *path, unsigned int *line);
+uint16_t schema_encode(const Schema *s, uint8_t *buf, const common_t *msg, const uint32_t mission_time);
+
+/**
+ * Gets the size of the blocks of a schema sensor.
+ * @param s The schema.
+ * @param tag The sensor tag.
+ * @return The size of the blocks in bytes including their header, or 0 if the schema does not describe the tag.
+ */
+static inline uint16_t schema_block_size(const Schema *s, const uint8_t tag) {
+    return tag < SCHEMA_TAGS ? s->entries[tag].size : 0;
+}
+
+#endif // _SCHEMA_H_
@@ -0,0 +1,80 @@
+/**
+ * @file seqstate.c
+ * @brief Contains the definitions for mapping, resuming and cleanly closing the sequence state file.
+ */
+#include "seqstate.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Opens the sequence state file, creating it if it does not exist. If the file holds the state of a previous
+ * instance, its counters are resumed and the outage is recorded in the sequence state. If the file cannot be mapped,
+ * the counters start from 0 in memory and are not persisted.
+ * @param s The sequence state to open.
+ * @param path The path of the state file.
+ * @param now_ms The current wall clock time in milliseconds.
+ * @return True if the state file was mapped, false if the state is only kept in memory.
+ */
+bool seqstate_open(SeqState *s, const char *path, const uint64_t now_ms) {
+    memset(s, 0, sizeof(*s));
+    s->data = &s->fallback;
+
+    int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd != -1) {
+        if (ftruncate(fd, sizeof(SeqStateData)) == 0) {
+            void *map = mmap(NULL, sizeof(SeqStateData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                s->data = map;
+                s->mapped = true;
+            }
+        }
+        close(fd); // The mapping stays valid after the descriptor is closed
+    }
+
+    SeqStateData *d = s->data;
+    if (d->magic == SEQSTATE_MAGIC && d->version == SEQSTATE_VERSION) {
+        s->resumed = true;
+        s->was_clean = d->clean;
+        s->downtime_ms = now_ms > d->last_alive_ms ? now_ms - d->last_alive_ms : 0;
+        d->restarts++;
+    } else {
+        memset(d, 0, sizeof(*d));
+        d->magic = SEQSTATE_MAGIC;
+        d->version = SEQSTATE_VERSION;
+    }
+    d->clean = 0;
+    d->last_alive_ms = now_ms;
+    return s->mapped;
+}
+
+/**
+ * Marks the sequence state as cleanly shut down and writes it back to the state file.
+ * @param s The sequence state.
+ * @param now_ms The current wall clock time in milliseconds.
+ */
+void seqstate_close(SeqState *s, const uint64_t now_ms) {
+    s->data->last_alive_ms = now_ms;
+    s->data->clean = 1;
+    if (s->mapped) {
+        msync(s->data, sizeof(SeqStateData), MS_SYNC);
+        munmap(s->data, sizeof(SeqStateData));
+        s->mapped = false;
+    }
+    s->data = &s->fallback;
+}
+
+/**
+ * Gets the current wall clock time, which unlike the monotonic clock keeps counting across restarts.
+ * @return The current wall clock time in milliseconds since the epoch.
+ */
+uint64_t seqstate_clock_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
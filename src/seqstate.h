@@ -0,0 +1,81 @@
+/**
+ * @file seqstate.h
+ * @brief Packet sequence numbers persisted in a memory mapped state file, so that a restarted packager continues
+ * numbering packets where the previous instance left off.
+ *
+ * Advancing a counter is a plain store into the mapped file, which the kernel keeps even if the process is killed. The
+ * file also records whether the previous instance shut down cleanly and when it was last alive, so the length of the
+ * outage can be reported after a restart.
+ */
+
+#ifndef _SEQSTATE_H_
+#define _SEQSTATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Identifies a valid sequence state file. */
+#define SEQSTATE_MAGIC 0x51455350 // "PSEQ"
+
+/** The version of the sequence state file layout. */
+#define SEQSTATE_VERSION 1
+
+/** The number of sequence counters kept in the state file, one per packet stream. */
+#define SEQSTATE_COUNTERS 8
+
+/** The layout of the sequence state file. */
+typedef struct {
+    /** Always SEQSTATE_MAGIC. */
+    uint32_t magic;
+    /** Always SEQSTATE_VERSION. */
+    uint16_t version;
+    /** 1 if the last instance shut down cleanly, 0 while running or after a crash. */
+    uint16_t clean;
+    /** The number of times the state has been resumed by a new instance. */
+    uint32_t restarts;
+    /** The last wall clock time in milliseconds at which the state was updated. */
+    uint64_t last_alive_ms;
+    /** The number of the next packet of each stream. */
+    uint32_t counters[SEQSTATE_COUNTERS];
+} SeqStateData;
+
+/** An open sequence state. */
+typedef struct {
+    /** The sequence state, either mapped from the state file or held in memory if it could not be mapped. */
+    SeqStateData *data;
+    /** In memory state used when the state file cannot be mapped. */
+    SeqStateData fallback;
+    /** Whether the state is mapped from a file. */
+    bool mapped;
+    /** Whether the state was resumed from a previous instance. */
+    bool resumed;
+    /** Whether the previous instance shut down cleanly. Only meaningful if the state was resumed. */
+    bool was_clean;
+    /** How long the state went without updates before it was resumed, in milliseconds. */
+    uint64_t downtime_ms;
+} SeqState;
+
+bool seqstate_open(SeqState *s, const char *path, const uint64_t now_ms);
+void seqstate_close(SeqState *s, const uint64_t now_ms);
+uint64_t seqstate_clock_ms(void);
+
+/**
+ * Gets a sequence counter.
+ * @param s The sequence state.
+ * @param stream The index of the packet stream, less than SEQSTATE_COUNTERS.
+ * @return A pointer to the number of the next packet of the stream.
+ */
+static inline uint32_t *seqstate_counter(SeqState *s, const unsigned stream) { return &s->data->counters[stream]; }
+
+/**
+ * Records that a packet of a stream has been numbered.
+ * @param s The sequence state.
+ * @param stream The index of the packet stream, less than SEQSTATE_COUNTERS.
+ * @param now_ms The current wall clock time in milliseconds.
+ */
+static inline void seqstate_advance(SeqState *s, const unsigned stream, const uint64_t now_ms) {
+    s->data->counters[stream]++;
+    s->data->last_alive_ms = now_ms;
+}
+
+#endif // _SEQSTATE_H_
@@ -0,0 +1,407 @@
+/**
+ * @file sink.c
+ * @brief Contains the definitions for parsing sink configurations, opening sinks and fanning blocks out to them.
+ */
+#include "sink.h"
+#include "encoder.h"
+#include "header.h"
+#include "inputs.h"
+#include "packet_types.h"
+#include "seqstate.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Parses a list of numbers separated by '+' into a bit mask.
+ * @param value The list of numbers.
+ * @param limit The numbers must be below this limit.
+ * @param mask Where to store the bit mask, bit n for number n.
+ * @return True if the list is valid, false otherwise.
+ */
+static bool parse_mask(const char *value, const unsigned long limit, uint32_t *mask) {
+    char *end;
+    *mask = 0;
+    for (const char *n = value; *n != '\0'; n = end + (*end == '+')) {
+        unsigned long bit = strtoul(n, &end, 0);
+        if (end == n || (*end != '+' && *end != '\0') || bit >= limit) return false;
+        if (*end == '+' && end[1] == '\0') return false;
+        *mask |= 1u << bit;
+    }
+    return true;
+}
+
+/**
+ * Parses a device address, as a number from 0 to 255.
+ * @param value The address.
+ * @param addr Where to store the address.
+ * @return True if the address is valid, false otherwise.
+ */
+static bool parse_address(const char *value, uint8_t *addr) {
+    char *end;
+    unsigned long a = strtoul(value, &end, 0);
+    if (end == value || *end != '\0' || a > UINT8_MAX) return false;
+    *addr = a;
+    return true;
+}
+
+/**
+ * Parses a sink specification of comma separated key=value options:
+ * - mq=NAME or file=PATH: where packets are written (one is required)
+ * - size=BYTES: maximum packet size, up to PACKET_LIMIT_SIZE, PACKET_MAX_SIZE by default
+ * - depth=N: number of packets the message queue can hold, SINK_DEFAULT_DEPTH by default
+ * - rate=BYTES: maximum bytes per second, unlimited by default
+ * - tags=T+T+...: sensor tags (as numbers) to send, all by default
+ * - events=0|1: whether event and dictionary blocks are sent, 1 by default
+ * - history=N: number of sent packets kept for resending, up to HISTORY_MAX_PACKETS, none by default
+ * - inputs=I+I+...: input queues (by index) to take sensor blocks from, all by default
+ * - src=ADDR: source address of the packets, that of the shared header template by default
+ * - dest=ADDR: destination address of the blocks, GROUNDSTATION by default
+ * - call=SIGN: call sign of the packets, that of the shared header template by default
+ * @param cfg The sink configuration to fill in.
+ * @param spec The sink specification.
+ * @return True if the specification is valid, false otherwise.
+ */
+bool sink_config_parse(SinkConfig *cfg, const char *spec) {
+    *cfg = (SinkConfig){
+        .max_size = PACKET_MAX_SIZE,
+        .depth = SINK_DEFAULT_DEPTH,
+        .tags = SINK_ALL_TAGS,
+        .events = true,
+        .inputs = SINK_ALL_INPUTS,
+        .src = SINK_SHARED_SOURCE,
+        .dest = GROUNDSTATION,
+    };
+
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) return false;
+    strcpy(buf, spec);
+
+    bool has_target = false;
+    char *save;
+    for (char *opt = strtok_r(buf, ",", &save); opt != NULL; opt = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(opt, '=');
+        if (value == NULL) return false;
+        *value++ = '\0';
+
+        char *end;
+        if (!strcmp(opt, "mq") || !strcmp(opt, "file")) {
+            if (has_target || *value == '\0' || strlen(value) > SINK_TARGET_MAX) return false;
+            cfg->kind = !strcmp(opt, "mq") ? SINK_QUEUE : SINK_FILE;
+            strcpy(cfg->target, value);
+            has_target = true;
+        } else if (!strcmp(opt, "size")) {
+            unsigned long size = strtoul(value, &end, 10);
+            if (*end != '\0' || size < SINK_MIN_SIZE || size > PACKET_LIMIT_SIZE) return false;
+            cfg->max_size = size & ~3ul;
+        } else if (!strcmp(opt, "depth")) {
+            cfg->depth = strtol(value, &end, 10);
+            if (*end != '\0' || cfg->depth <= 0) return false;
+        } else if (!strcmp(opt, "rate")) {
+            unsigned long rate = strtoul(value, &end, 10);
+            if (*end != '\0' || rate > UINT32_MAX / 2000) return false;
+            cfg->rate = rate;
+        } else if (!strcmp(opt, "tags")) {
+            if (!parse_mask(value, SINK_TAGS, &cfg->tags)) return false;
+        } else if (!strcmp(opt, "events")) {
+            if (strcmp(value, "0") && strcmp(value, "1")) return false;
+            cfg->events = value[0] == '1';
+        } else if (!strcmp(opt, "history")) {
+            unsigned long history = strtoul(value, &end, 10);
+            if (*end != '\0' || history > HISTORY_MAX_PACKETS) return false;
+            cfg->history = history;
+        } else if (!strcmp(opt, "inputs")) {
+            uint32_t inputs;
+            if (!parse_mask(value, INPUTS_MAX, &inputs)) return false;
+            cfg->inputs = inputs;
+        } else if (!strcmp(opt, "src")) {
+            uint8_t src;
+            if (!parse_address(value, &src)) return false;
+            cfg->src = src;
+        } else if (!strcmp(opt, "dest")) {
+            if (!parse_address(value, &cfg->dest)) return false;
+        } else if (!strcmp(opt, "call")) {
+            if (*value == '\0' || strlen(value) >= sizeof(cfg->call_sign)) return false;
+            strcpy(cfg->call_sign, value);
+        } else {
+            return false;
+        }
+    }
+    return has_target;
+}
+
+/**
+ * Initializes a fan-out with no sinks.
+ * @param f The fan-out to initialize.
+ * @param header The header template shared by the packets of all sinks.
+ * @param seq The sequence state holding the packet numbers of the sinks.
+ * @param arena The arena that the buffers of the sinks are allocated from.
+ */
+void fanout_init(Fanout *f, const PacketHeaderTemplate *header, SeqState *seq, Arena *arena) {
+    memset(f, 0, sizeof(*f));
+    f->header = header;
+    f->seq = seq;
+    f->arena = arena;
+}
+
+/**
+ * Opens a sink and adds it to the fan-out. Message queue sinks are opened without blocking.
+ * @param f The fan-out.
+ * @param cfg The configuration of the sink.
+ * @param every_packets Send the full header at least once every this many packets, or 0 to always send it.
+ * @param every_ms Send the full header at least once every this many milliseconds, or 0 for no time limit.
+ * @return True if the sink was added, false if there are too many sinks, the arena has no room for its buffers or its
+ * output could not be opened (with errno set).
+ */
+bool fanout_add(Fanout *f, const SinkConfig *cfg, const uint32_t every_packets, const uint32_t every_ms) {
+    if (f->count == SINKS_MAX) {
+        errno = ENOSPC;
+        return false;
+    }
+
+    Sink *s = &f->sinks[f->count];
+    memset(s, 0, sizeof(*s));
+    s->cfg = *cfg;
+    s->header = *f->header;
+    if (cfg->call_sign[0] != '\0') {
+        packet_header_template_init(&s->header, cfg->call_sign, f->header->version, f->header->src_addr);
+    }
+    if (cfg->src != SINK_SHARED_SOURCE) s->header.src_addr = cfg->src;
+    s->q = (mqd_t)-1;
+    s->fd = -1;
+
+    s->packet = arena_alloc(f->arena, cfg->max_size, "sinks");
+    if (s->packet == NULL || !history_init(&s->history, cfg->history, cfg->max_size, f->arena)) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (cfg->kind == SINK_QUEUE) {
+        struct mq_attr attr = {
+            .mq_flags = 0,
+            .mq_maxmsg = cfg->depth,
+            .mq_msgsize = cfg->max_size,
+        };
+        s->q = mq_open(cfg->target, O_CREAT | O_WRONLY | O_NONBLOCK, S_IWOTH, &attr);
+        if (s->q == (mqd_t)-1) return false;
+    } else {
+        s->fd = open(cfg->target, O_CREAT | O_WRONLY | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (s->fd == -1) return false;
+    }
+
+    packet_builder_init(&s->builder, s->packet, cfg->max_size);
+    header_schedule_init(&s->schedule, every_packets, every_ms);
+    s->tokens = cfg->rate * 1000u;
+    f->count++;
+    return true;
+}
+
+/**
+ * Refills the rate budget of a sink and checks that it has room for a block. Nothing is taken out of the budget until
+ * the block is accepted into a packet.
+ * @param s The sink.
+ * @param size The number of bytes the block adds to the sink's output.
+ * @param now_ms The current time in milliseconds.
+ * @return True if the block is within the budget, false if it must be dropped.
+ */
+static bool sink_admit(Sink *s, const uint16_t size, const uint32_t now_ms) {
+    if (s->cfg.rate == 0) return true;
+
+    // Allow at most one second's worth of bytes in a burst
+    uint32_t elapsed = now_ms - s->last_refill;
+    if (elapsed > 1000) elapsed = 1000;
+    s->last_refill = now_ms;
+    s->tokens += s->cfg.rate * elapsed;
+    if (s->tokens > s->cfg.rate * 1000u) s->tokens = s->cfg.rate * 1000u;
+
+    return s->tokens >= size * 1000u;
+}
+
+/**
+ * Takes bytes the sink sends out of its rate budget, which runs dry rather than below zero. Sinks without a rate limit
+ * have no budget to take from.
+ * @param s The sink.
+ * @param bytes The number of bytes sent.
+ */
+static void sink_charge(Sink *s, const uint16_t bytes) {
+    if (s->cfg.rate == 0) return;
+    s->tokens = s->tokens > bytes * 1000u ? s->tokens - bytes * 1000u : 0;
+}
+
+/**
+ * Appends blocks waiting to be resent to the packet being built by a sink, within its rate budget.
+ * @param s The sink.
+ * @param room The most bytes to give to resends.
+ */
+static void sink_resend(Sink *s, const uint16_t room) {
+    const uint32_t budget = s->cfg.rate == 0 ? UINT16_MAX : s->tokens / 1000u;
+    sink_charge(s, history_fill(&s->history, &s->builder, budget < room ? budget : room));
+}
+
+/**
+ * Sends the packet being built by a sink and advances its sequence number. Empty packets are not sent. Blocks waiting
+ * to be resent fill the room left in the packet, within the rate budget of the sink, and the sent packet is kept in the
+ * sink's history.
+ * @param f The fan-out.
+ * @param i The index of the sink.
+ * @param deadline How long to wait for room in a message queue, or NULL to not wait.
+ */
+static void sink_flush(Fanout *f, const uint8_t i, const struct timespec *deadline) {
+    Sink *s = &f->sinks[i];
+    if (!s->open || packet_builder_empty(&s->builder)) return;
+    s->open = false;
+
+    if (s->history.n_pending > 0) sink_resend(s, UINT16_MAX);
+    const uint32_t num = *seqstate_counter(f->seq, i);
+    seqstate_advance(f->seq, i, seqstate_clock_ms());
+
+    int result;
+    TRACE_START(send_start);
+    if (s->cfg.kind == SINK_FILE) {
+        result = write(s->fd, s->packet, s->builder.len) == s->builder.len ? 0 : -1;
+    } else if (deadline != NULL) {
+        result = mq_timedsend(s->q, (char *)s->packet, s->builder.len, s->priority, deadline);
+    } else {
+        result = mq_send(s->q, (char *)s->packet, s->builder.len, s->priority);
+    }
+    TRACE_SPAN(TRACE_SEND, send_start, i);
+
+    if (result == 0) {
+        s->sent++;
+        history_store(&s->history, num, s->packet, s->builder.len);
+        if (s->cfg.print) {
+            TRACE_START(print_start);
+            packet_print_hex(stdout, s->packet);
+            TRACE_SPAN(TRACE_PRINT, print_start, i);
+        }
+    } else if (errno == EAGAIN) {
+        s->dropped_full++; // Slow reader, the packet is only lost for this sink
+    } else {
+        s->errors++;
+        f->errors++;
+        f->last_errno = errno;
+        f->last_error_sink = i;
+    }
+}
+
+/**
+ * Offers an encoded block to every sink. Each sink that accepts the block's tag and input queue and has the budget for
+ * it copies the block into its packet, addressed to the sink's destination, first sending its packet if the block does
+ * not fit.
+ * @param f The fan-out.
+ * @param block The encoded block, including its header.
+ * @param size The size of the block in bytes. Sinks whose empty packets it does not fit in drop it.
+ * @param tag The sensor tag the block was encoded from, or SINK_TAG_EVENT for event and dictionary blocks.
+ * @param input The index of the input queue the block was encoded from. Ignored for event and dictionary blocks.
+ * @param priority The input priority of the block.
+ * @param now_ms The current time in milliseconds.
+ * @return True if a sink that sends events started a new packet, false otherwise.
+ */
+bool fanout_offer(Fanout *f, const uint8_t *block, const uint16_t size, const uint8_t tag, const uint8_t input,
+                  const unsigned int priority, const uint32_t now_ms) {
+    bool new_event_packet = false;
+    f->accepted = 0;
+
+    for (uint8_t i = 0; i < f->count; i++) {
+        Sink *s = &f->sinks[i];
+        if (tag == SINK_TAG_EVENT ? !s->cfg.events : tag >= SINK_TAGS || !(s->cfg.tags & (1u << tag))) continue;
+        if (tag != SINK_TAG_EVENT && (input >= INPUTS_MAX || !(s->cfg.inputs & (1u << input)))) continue;
+
+        if (s->open && !packet_builder_fits(&s->builder, size)) sink_flush(f, i, NULL);
+
+        // A block that starts a packet also pays for the header the packet is sent with. The schedule is only
+        // advanced once the packet is really started, so a dropped block does not use up a full header.
+        const bool starting = !s->open;
+        HeaderSchedule schedule = s->schedule;
+        const uint32_t num = *seqstate_counter(f->seq, i);
+        const bool full = starting && header_schedule_full(&schedule, num, now_ms);
+        const uint16_t cost = size + (!starting ? 0 : full ? sizeof(PacketHeader) : sizeof(CompactPacketHeader));
+        if (!sink_admit(s, cost, now_ms)) {
+            s->dropped_rate++;
+            continue;
+        }
+
+        if (starting) packet_builder_start(&s->builder, &s->header, !full, num);
+        if (!packet_builder_append_sized(&s->builder, block, size)) {
+            s->dropped_size++;
+            continue;
+        }
+        ((BlockHeader *)(packet_builder_tail(&s->builder) - size))->dest_addr = s->cfg.dest;
+        sink_charge(s, cost);
+        f->accepted++;
+
+        if (starting) {
+            s->schedule = schedule;
+            s->open = true;
+            s->priority = 0;
+            new_event_packet |= s->cfg.events;
+            // Reserve part of the new packet for resends, which fresh data would otherwise leave no room for
+            if (s->history.n_pending > 0) sink_resend(s, s->builder.max_size / HISTORY_RESERVE_SHARE);
+        }
+        if (priority > s->priority) s->priority = priority;
+    }
+
+    return new_event_packet;
+}
+
+/**
+ * Gets the largest event or dictionary block that fits in an empty packet of every sink that sends events.
+ * @param f The fan-out.
+ * @return The maximum size of an event block in bytes.
+ */
+uint16_t fanout_event_room(const Fanout *f) {
+    uint16_t room = BLOCK_MAX_SIZE;
+    for (uint8_t i = 0; i < f->count; i++) {
+        const Sink *s = &f->sinks[i];
+        if (s->cfg.events && s->builder.max_size - sizeof(PacketHeader) < room) {
+            room = s->builder.max_size - sizeof(PacketHeader);
+        }
+    }
+    return room;
+}
+
+/**
+ * Queues blocks from the history of a sink to be resent in its next packets.
+ * @param f The fan-out.
+ * @param r The resend request.
+ * @return The number of blocks queued, 0 if the request names no sink or none of its packets are in the history.
+ */
+uint16_t fanout_resend(Fanout *f, const ResendRequest *r) {
+    if (r->sink >= f->count) return 0;
+    return history_request(&f->sinks[r->sink].history, r);
+}
+
+/**
+ * Sends the packets being built by all sinks and closes their outputs.
+ * @param f The fan-out.
+ * @param timeout_s How long to wait for room in each message queue, in seconds.
+ */
+void fanout_close(Fanout *f, const unsigned int timeout_s) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_s;
+
+    for (uint8_t i = 0; i < f->count; i++) {
+        Sink *s = &f->sinks[i];
+        if (s->cfg.kind == SINK_QUEUE) {
+            // Wait for room for the last packet, but only until the deadline
+            struct mq_attr attr = {.mq_flags = 0};
+            mq_setattr(s->q, &attr, NULL);
+            sink_flush(f, i, &deadline);
+            mq_close(s->q);
+        } else {
+            sink_flush(f, i, NULL);
+            close(s->fd);
+        }
+    }
+    f->count = 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file sink.h
+ * @brief Fan-out of encoded blocks to several output sinks (radios, loggers), each building its own packets.
+ *
+ * Every block is encoded once and then copied into the packet of each sink that accepts it. A sink has its own output
+ * (a message queue or a file), maximum packet size, tag filter, rate budget in bytes per second and packet sequence
+ * number. Message queue sinks never block: when a queue is full the packet is dropped for that sink only, so a slow
+ * link cannot hold up the others.
+ *
+ * Each sink is an independent packet stream: it can override the source address and call sign of the shared header
+ * template, address its blocks to another destination and only take blocks from some of the input queues, so that the
+ * streams of several stations (rocket, payload, ground beacon) are built by one packager.
+ */
+
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include "arena.h"
+#include "encoder.h"
+#include "header.h"
+#include "history.h"
+#include "packet_types.h"
+#include "seqstate.h"
+#include <mqueue.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** The maximum number of sinks, one per sequence counter in the sequence state. */
+#define SINKS_MAX SEQSTATE_COUNTERS
+
+/** The maximum length of the queue name or file path of a sink. */
+#define SINK_TARGET_MAX 64
+
+/** The smallest allowed maximum packet size of a sink, which fits a full header and the largest sensor block. */
+#define SINK_MIN_SIZE (sizeof(PacketHeader) + ENCODED_BLOCK_MAX_SIZE)
+
+/** The default number of packets a message queue sink can hold. */
+#define SINK_DEFAULT_DEPTH 15
+
+/** The number of sensor tags that can be filtered, which covers the tags of schema sensors. */
+#define SINK_TAGS 32
+
+/** Tag filter value that accepts every sensor tag. */
+#define SINK_ALL_TAGS 0xFFFFFFFF
+
+/** Input filter value that accepts blocks from every input queue. */
+#define SINK_ALL_INPUTS 0xFF
+
+/** Source address value that keeps the source address of the shared header template. */
+#define SINK_SHARED_SOURCE -1
+
+/** The tag that event and dictionary blocks are offered with. */
+#define SINK_TAG_EVENT 0xFF
+
+/** Where a sink writes its packets. */
+typedef enum {
+    SINK_QUEUE = 0, /**< POSIX message queue, one packet per message */
+    SINK_FILE = 1,  /**< File, packets back to back */
+} SinkKind;
+
+/** The configuration of a sink. */
+typedef struct {
+    /** Where the sink writes its packets. */
+    SinkKind kind;
+    /** The name of the message queue or the path of the file. */
+    char target[SINK_TARGET_MAX + 1];
+    /** The maximum size of the packets of the sink in bytes. */
+    uint16_t max_size;
+    /** The number of packets the message queue can hold. */
+    long depth;
+    /** The maximum number of bytes per second, or 0 for no limit. */
+    uint32_t rate;
+    /** Bit mask of the sensor tags to send, bit n for tag n. */
+    uint32_t tags;
+    /** Whether event and dictionary blocks are sent. */
+    bool events;
+    /** Whether sent packets are printed to stdout in hex format. */
+    bool print;
+    /** The number of sent packets kept for resending, 0 for none. */
+    uint8_t history;
+    /** Bit mask of the input queues to take sensor blocks from, bit n for the queue at index n. */
+    uint8_t inputs;
+    /** The source address of the packets, or SINK_SHARED_SOURCE for that of the shared header template. */
+    int16_t src;
+    /** The destination address written into every block of the packets. */
+    uint8_t dest;
+    /** The call sign of the packets, or empty for that of the shared header template. */
+    char call_sign[sizeof(((PacketHeaderTemplate *)0)->call_sign) + 1];
+} SinkConfig;
+
+/** An output sink. */
+typedef struct {
+    /** The configuration of the sink. */
+    SinkConfig cfg;
+    /** The output message queue of a queue sink. */
+    mqd_t q;
+    /** The output file descriptor of a file sink. */
+    int fd;
+    /** The packet being built, the maximum packet size of the sink long. */
+    uint8_t *packet;
+    /** The header template of the packets, the shared one with the overrides of the configuration applied. */
+    PacketHeaderTemplate header;
+    /** Builds packets in the packet buffer. */
+    PacketBuilder builder;
+    /** Whether a packet has been started in the packet buffer. */
+    bool open;
+    /** The highest input priority of the blocks in the packet being built. */
+    unsigned int priority;
+    /** Decides which packets of the sink get the full header in compact header mode. */
+    HeaderSchedule schedule;
+    /** The rate budget in thousandths of a byte. */
+    uint32_t tokens;
+    /** The time in milliseconds at which the rate budget was last refilled. */
+    uint32_t last_refill;
+    /** The number of packets sent. */
+    uint32_t sent;
+    /** The number of packets dropped because the message queue was full. */
+    uint32_t dropped_full;
+    /** The number of blocks dropped because they exceeded the rate budget. */
+    uint32_t dropped_rate;
+    /** The number of blocks dropped because they did not fit in an empty packet. */
+    uint32_t dropped_size;
+    /** The number of packets that could not be sent because of an error. */
+    uint32_t errors;
+    /** The recently sent packets, which blocks are resent from on request. */
+    PacketHistory history;
+} Sink;
+
+/** A set of sinks that share one encode of every block. */
+typedef struct {
+    /** The sinks. */
+    Sink sinks[SINKS_MAX];
+    /** The number of sinks. */
+    uint8_t count;
+    /** The header template shared by all sinks, which each sink copies when it is added. */
+    const PacketHeaderTemplate *header;
+    /** The sequence state holding the packet number of each sink, indexed like the sinks. */
+    SeqState *seq;
+    /** The arena that the buffers of the sinks are allocated from. */
+    Arena *arena;
+    /** The number of sinks that accepted the last offered block. */
+    uint8_t accepted;
+    /** The total number of send errors over all sinks. */
+    uint32_t errors;
+    /** The error number of the last send error. */
+    int last_errno;
+    /** The index of the sink of the last send error. */
+    uint8_t last_error_sink;
+} Fanout;
+
+/**
+ * Gets the arena memory a sink needs.
+ * @param cfg The configuration of the sink.
+ * @return The size of the sink's arena allocations in bytes.
+ */
+static inline size_t sink_footprint(const SinkConfig *cfg) {
+    return arena_round(cfg->max_size) + history_footprint(cfg->history, cfg->max_size);
+}
+
+bool sink_config_parse(SinkConfig *cfg, const char *spec);
+
+void fanout_init(Fanout *f, const PacketHeaderTemplate *header, SeqState *seq, Arena *arena);
+bool fanout_add(Fanout *f, const SinkConfig *cfg, const uint32_t every_packets, const uint32_t every_ms);
+bool fanout_offer(Fanout *f, const uint8_t *block, const uint16_t size, const uint8_t tag, const uint8_t input,
+                  const unsigned int priority, const uint32_t now_ms);
+uint16_t fanout_event_room(const Fanout *f);
+uint16_t fanout_resend(Fanout *f, const ResendRequest *r);
+void fanout_close(Fanout *f, const unsigned int timeout_s);
+
+#endif // _SINK_H_
@@ -0,0 +1,145 @@
+/**
+ * @file snapshot.c
+ * @brief Contains the definitions for creating the shared memory snapshot table and for reading it from other
+ * processes.
+ */
+#include "snapshot.h"
+#include "intypes.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Creates or reopens the shared memory table and empties it for a new generation of readings.
+ * @param s The snapshot table to open.
+ * @param name The name of the shared memory object.
+ * @return True if the table was mapped, false if it could not be, in which case nothing is published.
+ */
+bool snapshot_open(Snapshot *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1) return false;
+    if (ftruncate(fd, sizeof(SnapshotTable)) == 0) {
+        void *map = mmap(NULL, sizeof(SnapshotTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) s->table = map;
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (s->table == NULL) return false;
+
+    SnapshotTable *t = s->table;
+    const uint32_t generation = t->magic == SNAPSHOT_MAGIC && t->version == SNAPSHOT_VERSION ? t->generation + 1 : 1;
+    t->live = 0;
+    atomic_store(&t->count, 0);
+    memset(t->entries, 0, sizeof(t->entries));
+    t->magic = SNAPSHOT_MAGIC;
+    t->version = SNAPSHOT_VERSION;
+    t->generation = generation;
+    t->live = 1;
+    return true;
+}
+
+/**
+ * Marks the table as no longer being published to and unmaps it. The shared memory object is left in place so that
+ * readers keep the last readings and a restarted packager publishes to the same table.
+ * @param s The snapshot table.
+ */
+void snapshot_close(Snapshot *s) {
+    if (s->table == NULL) return;
+    s->table->live = 0;
+    munmap(s->table, sizeof(SnapshotTable));
+    s->table = NULL;
+}
+
+/**
+ * Adds the entry of a sensor that has not been seen before.
+ * @param s The snapshot table.
+ * @param tag The tag of the sensor's readings.
+ * @param id The ID of the sensor.
+ * @return The new entry, or NULL if the table is full.
+ */
+SnapshotEntry *snapshot_add(Snapshot *s, const uint8_t tag, const uint8_t id) {
+    SnapshotTable *t = s->table;
+    const unsigned int n = atomic_load_explicit(&t->count, memory_order_relaxed);
+    if (n == SNAPSHOT_ENTRIES) {
+        s->dropped++;
+        return NULL;
+    }
+
+    // Readers look entries up by tag and ID, so set them before the entry becomes visible
+    SnapshotEntry *e = &t->entries[n];
+    e->msg.type = tag;
+    e->msg.id = id;
+    atomic_store_explicit(&t->count, n + 1, memory_order_release);
+    s->index[tag][id] = n + 1;
+    return e;
+}
+
+/**
+ * Maps a snapshot table for reading.
+ * @param name The name of the shared memory object.
+ * @return The table, or NULL if it does not exist or is not a valid snapshot table.
+ */
+const SnapshotTable *snapshot_attach(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SnapshotTable)) {
+        map = mmap(NULL, sizeof(SnapshotTable), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const SnapshotTable *t = map;
+    if (t->magic != SNAPSHOT_MAGIC || t->version != SNAPSHOT_VERSION) {
+        munmap(map, sizeof(SnapshotTable));
+        return NULL;
+    }
+    return t;
+}
+
+/**
+ * Unmaps a snapshot table mapped for reading.
+ * @param t The table.
+ */
+void snapshot_detach(const SnapshotTable *t) { munmap((void *)(uintptr_t)t, sizeof(SnapshotTable)); }
+
+/**
+ * Finds the entry of a sensor. Entries stay in place until packager restarts (the generation changes), so the entry can
+ * be kept and read repeatedly.
+ * @param t The table.
+ * @param tag The tag of the sensor's readings.
+ * @param id The ID of the sensor.
+ * @return The entry, or NULL if no reading of the sensor has been published.
+ */
+const SnapshotEntry *snapshot_find(const SnapshotTable *t, const uint8_t tag, const uint8_t id) {
+    const unsigned int n = atomic_load_explicit(&t->count, memory_order_acquire);
+    for (unsigned int i = 0; i < n && i < SNAPSHOT_ENTRIES; i++) {
+        if (t->entries[i].msg.type == tag && t->entries[i].msg.id == id) return &t->entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * Reads the latest reading of a sensor, retrying until the copy is not torn by a concurrent update.
+ * @param e The entry of the sensor.
+ * @param msg Where to store the reading.
+ * @param mission_time Where to store the mission time of the reading in milliseconds.
+ */
+void snapshot_read(const SnapshotEntry *e, common_t *msg, uint32_t *mission_time) {
+    unsigned int before, after;
+    do {
+        before = atomic_load_explicit(&e->seq, memory_order_acquire);
+        *mission_time = e->mission_time;
+        *msg = e->msg;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+}
@@ -0,0 +1,97 @@
+/**
+ * @file snapshot.h
+ * @brief Table of the latest reading of every sensor, published in shared memory for local consumers.
+ *
+ * Every input message is copied into the entry for its (tag, sensor ID) pair as it is received. Each entry is
+ * protected by its own sequence lock: the writer makes the sequence number odd, stores the reading and makes it even
+ * again, and readers retry until they copy an entry without the sequence number changing under them. Readers map the
+ * table read-only and never make a system call or take a lock to read it, and the writer never waits for readers.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "intypes.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Identifies a valid snapshot table. */
+#define SNAPSHOT_MAGIC 0x544F4E53 // "SNOT"
+
+/** The version of the snapshot table layout. */
+#define SNAPSHOT_VERSION 1
+
+/** The number of (tag, sensor ID) pairs the table can hold. */
+#define SNAPSHOT_ENTRIES 128
+
+/** Readings with tags at or above this are not published. */
+#define SNAPSHOT_TAGS 32
+
+/** The latest reading of one sensor. */
+typedef struct {
+    /** Sequence lock, odd while the entry is being written. */
+    atomic_uint seq;
+    /** Mission time of the reading in milliseconds. */
+    uint32_t mission_time;
+    /** The reading. */
+    common_t msg;
+} SnapshotEntry;
+
+/** The layout of the shared memory table. */
+typedef struct {
+    /** Always SNAPSHOT_MAGIC. */
+    uint32_t magic;
+    /** Always SNAPSHOT_VERSION. */
+    uint16_t version;
+    /** 1 while packager is publishing to the table, 0 after it has shut down. */
+    uint16_t live;
+    /** Incremented whenever a packager starts publishing, which empties the table. */
+    uint32_t generation;
+    /** The number of entries in use. Entries are never removed, so this only grows within a generation. */
+    atomic_uint count;
+    /** The entries, in the order their sensors were first seen. */
+    SnapshotEntry entries[SNAPSHOT_ENTRIES];
+} SnapshotTable;
+
+/** The publishing side of a snapshot table. */
+typedef struct {
+    /** The shared memory table, or NULL if it could not be mapped. */
+    SnapshotTable *table;
+    /** The entry of each (tag, sensor ID) pair plus one, or 0 if the pair has no entry yet. */
+    uint8_t index[SNAPSHOT_TAGS][256];
+    /** The number of readings not published because the table was full. */
+    uint32_t dropped;
+} Snapshot;
+
+bool snapshot_open(Snapshot *s, const char *name);
+void snapshot_close(Snapshot *s);
+SnapshotEntry *snapshot_add(Snapshot *s, const uint8_t tag, const uint8_t id);
+
+const SnapshotTable *snapshot_attach(const char *name);
+void snapshot_detach(const SnapshotTable *t);
+const SnapshotEntry *snapshot_find(const SnapshotTable *t, const uint8_t tag, const uint8_t id);
+void snapshot_read(const SnapshotEntry *e, common_t *msg, uint32_t *mission_time);
+
+/**
+ * Publishes a reading as the latest one of its sensor.
+ * @param s The snapshot table.
+ * @param msg The reading.
+ * @param mission_time The mission time of the reading in milliseconds.
+ */
+static inline void snapshot_publish(Snapshot *s, const common_t *msg, const uint32_t mission_time) {
+    if (s->table == NULL || msg->type >= SNAPSHOT_TAGS) return;
+    const uint8_t i = s->index[msg->type][msg->id];
+    SnapshotEntry *e = i != 0 ? &s->table->entries[i - 1] : snapshot_add(s, msg->type, msg->id);
+    if (e == NULL) return;
+
+    const unsigned int seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    e->mission_time = mission_time;
+    e->msg = *msg;
+    atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+#endif // _SNAPSHOT_H_
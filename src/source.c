@@ -0,0 +1,82 @@
+/**
+ * @file source.c
+ * @brief Contains the definitions for updating the state of an input queue with its messages.
+ */
+#include "source.h"
+#include "events.h"
+#include "flight_phase.h"
+#include "fusion.h"
+#include "intypes.h"
+#include "snapshot.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Initializes the state of an input queue: no mission time or GPS fix yet, on the pad, with full budgets and an
+ * estimator waiting for its first altitude reading. The latest readings table is left unopened.
+ * @param s The state to initialize.
+ * @param index The index of the input queue.
+ * @param fusion_rate The number of estimates per second to send instead of the relative altitude readings, or 0 to
+ * send the readings.
+ */
+void source_init(Source *s, const uint8_t index, const uint32_t fusion_rate) {
+    memset(s, 0, sizeof(*s));
+    s->index = index;
+    s->fix = -1;
+    flight_phase_init(&s->detector);
+    phase_budget_init(&s->budget, s->detector.phase, s->mission_time);
+    s->fusing = fusion_rate > 0;
+    fusion_init(&s->fusion, fusion_rate, FUSION_DEFAULT_TAU_MS);
+}
+
+/**
+ * Updates the state of an input queue with one of its messages: publishes it as the latest reading of its sensor,
+ * updates the flight phase, feeds the estimator, applies the bandwidth budget and keeps track of the mission time and
+ * GPS fix. Flight phase transitions and GPS fix changes are posted as events.
+ * @param s The state of the input queue the message came from.
+ * @param msg The message.
+ * @param events The event channel to post events to.
+ * @param adaptive Whether readings are limited by the bandwidth budget of the current flight phase.
+ * @return What to send for the message, stamped with the mission time of the input queue: the message, the estimates,
+ * both or nothing.
+ */
+SourceAction source_update(Source *s, const common_t *msg, EventChannel *events, const bool adaptive) {
+    snapshot_publish(&s->snapshot, msg, msg->type == TAG_TIME ? msg->data.U32 : s->mission_time);
+
+    if (flight_phase_update(&s->detector, msg, s->mission_time)) {
+        event_post(events, EVENT_PHASE, flight_phase_name(s->detector.phase), source_event_arg(s, s->detector.phase),
+                   s->mission_time);
+    }
+
+    // Relative altitude readings are replaced by the estimates, which are sent at their own rate, while acceleration
+    // readings are still sent as they are
+    SourceAction estimates = SOURCE_SKIP;
+    if (s->fusing && fusion_update(&s->fusion, msg, s->mission_time)) {
+        if (fusion_due(&s->fusion, s->mission_time)) estimates = SOURCE_ESTIMATES;
+        if (msg->type == TAG_ALTITUDE_REL) return estimates;
+    }
+
+    // Drop readings that exceed the bandwidth budget of the current flight phase
+    if (adaptive && !phase_budget_admit(&s->budget, s->detector.phase, msg->type, s->mission_time)) {
+        return estimates;
+    }
+
+    switch (msg->type) {
+    case TAG_TIME:
+        // Update with most recent time measurement to use as measurement time for other packets
+        s->mission_time = msg->data.U32;
+        return SOURCE_SKIP;
+
+    case TAG_FIX:
+        // Report changes of the fix type as events
+        if (msg->data.U8 != s->fix) {
+            s->fix = msg->data.U8;
+            event_post(events, EVENT_GPS_FIX, "gps fix", source_event_arg(s, s->fix), s->mission_time);
+        }
+        return SOURCE_SKIP;
+
+    default:
+        return estimates | SOURCE_ENCODE;
+    }
+}
@@ -0,0 +1,63 @@
+/**
+ * @file source.h
+ * @brief The state packager derives from the messages of one input queue: mission time, GPS fix, flight phase,
+ * bandwidth budget, estimator and latest readings.
+ *
+ * Each input queue belongs to one producer (avionics bay, payload, ground beacon), and the streams built from
+ * different producers must stay independent. A time message from one producer must not restamp the readings of
+ * another, and the altitude of the payload must not drive the flight phase or the estimator of the rocket. Every
+ * message therefore only updates the state of the input queue it came from. Its block is stamped with that queue's
+ * mission time, and events it causes carry the index of the queue.
+ */
+
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include "events.h"
+#include "flight_phase.h"
+#include "fusion.h"
+#include "intypes.h"
+#include "snapshot.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** What to send for a message once it has updated the state of its input, as flags that can be combined. */
+typedef enum {
+    SOURCE_SKIP = 0,      /**< Nothing: the message only updates state or exceeds the bandwidth budget */
+    SOURCE_ENCODE = 1,    /**< The message itself, encoded as a block */
+    SOURCE_ESTIMATES = 2, /**< The estimates of the estimator, which was fed the message and has estimates due */
+} SourceAction;
+
+/** The state derived from the messages of one input queue. */
+typedef struct {
+    /** The index of the input queue, which events caused by its messages carry. */
+    uint8_t index;
+    /** The most recent mission time of the input in milliseconds, the measurement time of its blocks. */
+    uint32_t mission_time;
+    /** The most recently received GPS fix type, or -1 if none has been received. */
+    int16_t fix;
+    /** Flight phase detector fed with every message of the input. */
+    FlightPhaseDetector detector;
+    /** Bandwidth budgets enforced on the messages of the input when adaptive composition is enabled. */
+    PhaseBudget budget;
+    /** Whether fusion is enabled, so that the estimator is fed and replaces relative altitude readings. */
+    bool fusing;
+    /** Estimator fed with relative altitude and absolute acceleration readings when fusion is enabled. */
+    Fusion fusion;
+    /** The latest reading of every sensor of the input, published if the table was opened. */
+    Snapshot snapshot;
+} Source;
+
+void source_init(Source *s, const uint8_t index, const uint32_t fusion_rate);
+SourceAction source_update(Source *s, const common_t *msg, EventChannel *events, const bool adaptive);
+
+/**
+ * Gets the argument of an event caused by a message of an input: the value in the low byte and the index of the input
+ * above it, so that the events of the first input keep the plain value.
+ * @param s The state of the input.
+ * @param value The value the event reports.
+ * @return The event argument.
+ */
+static inline int32_t source_event_arg(const Source *s, const uint8_t value) { return (int32_t)s->index << 8 | value; }
+
+#endif // _SOURCE_H_
@@ -0,0 +1,121 @@
+/**
+ * @file trace.c
+ * @brief Contains the definitions for claiming trace rings and exporting the recorded spans as a Chrome trace.
+ */
+#include "trace.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// The rings take up TRACE_MAX_THREADS * TRACE_RING_EVENTS * 24 bytes, so they only exist in traced builds
+#ifdef PACKAGER_TRACE
+
+/** The names of the tracepoints in the exported trace, indexed by TracePoint. */
+static const char *const point_names[TRACE_POINTS] = {"receive", "process", "encode", "fanout", "send", "print"};
+
+_Thread_local TraceRing *trace_ring = NULL;
+
+/** The rings of the threads that have recorded spans. */
+static TraceRing rings[TRACE_MAX_THREADS];
+
+/** The number of rings claimed. */
+static atomic_uint n_rings = 0;
+
+/** The cycle counter at the start of the trace, which exported timestamps are relative to. */
+static uint64_t epoch;
+
+/** The length of a cycle counter tick in nanoseconds, or 0 before the counter has been calibrated. */
+static double ns_per_tick = 0;
+
+/**
+ * Gets the time from the raw monotonic clock.
+ * @return The time in nanoseconds.
+ */
+static uint64_t clock_ns(void) {
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * Starts the trace and measures the rate of the cycle counter against the monotonic clock, which takes 10 ms. Spans
+ * recorded before are exported too, with timestamps before the start of the trace.
+ */
+void trace_init(void) {
+    const uint64_t ns = clock_ns();
+    epoch = trace_now();
+    const struct timespec wait = {.tv_nsec = 10000000};
+    nanosleep(&wait, NULL);
+    ns_per_tick = (double)(clock_ns() - ns) / (double)(trace_now() - epoch);
+}
+
+/**
+ * Claims a ring for the calling thread.
+ * @return The ring, or NULL if every ring has been claimed by other threads, in which case the thread's spans are not
+ * recorded.
+ */
+TraceRing *trace_ring_claim(void) {
+    unsigned int n = atomic_load_explicit(&n_rings, memory_order_relaxed);
+    do {
+        if (n == TRACE_MAX_THREADS) return NULL;
+    } while (!atomic_compare_exchange_weak(&n_rings, &n, n + 1));
+    trace_ring = &rings[n];
+    return trace_ring;
+}
+
+/**
+ * Writes the spans in every ring to a file in the Chrome trace event format, oldest first. Spans being recorded by
+ * other threads while exporting may be exported half written.
+ * @param path The path of the file.
+ * @return True if the file was written, false otherwise.
+ */
+bool trace_export(const char *path) {
+    if (ns_per_tick <= 0) trace_init();
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return false;
+
+    const int pid = getpid();
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"packager\"}}", pid);
+
+    const unsigned int n = atomic_load(&n_rings);
+    for (unsigned int i = 0; i < n; i++) {
+        const TraceRing *r = &rings[i];
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                pid, i + 1, i + 1);
+
+        const uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (uint64_t h = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0; h < head; h++) {
+            const TraceEvent *e = &r->events[h & (TRACE_RING_EVENTS - 1)];
+            const double ts = (double)(int64_t)(e->start - epoch) * ns_per_tick / 1000;
+            const double dur = (double)(e->end - e->start) * ns_per_tick / 1000;
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"cat\":\"packager\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%u}}",
+                    e->point < TRACE_POINTS ? point_names[e->point] : "unknown", pid, i + 1, ts, dur, e->arg);
+        }
+    }
+    fputs("\n]}\n", f);
+
+    const bool written = !ferror(f);
+    return fclose(f) == 0 && written;
+}
+
+/**
+ * Discards the spans recorded so far by every thread.
+ */
+void trace_reset(void) {
+    const unsigned int n = atomic_load(&n_rings);
+    for (unsigned int i = 0; i < n; i++) {
+        atomic_store(&rings[i].head, 0);
+    }
+}
+
+#endif // PACKAGER_TRACE
@@ -0,0 +1,128 @@
+/**
+ * @file trace.h
+ * @brief Tracepoints on the hot path, recorded in a per-thread ring buffer and exported as a Chrome trace.
+ *
+ * Tracepoints are compiled in only when PACKAGER_TRACE is defined. Otherwise TRACE_START and TRACE_SPAN expand to
+ * nothing and neither the rings nor the functions using them exist, so a build without tracing has no cost at all. When
+ * compiled in, a span is two cycle counter reads and a handful of stores into the ring of the calling thread, without
+ * locks or system calls. The ring keeps the most recent TRACE_RING_EVENTS spans of each thread and can be written out
+ * in the Chrome trace event format, which Perfetto and chrome://tracing open directly.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** The number of spans kept per thread. Must be a power of 2. */
+#define TRACE_RING_EVENTS 16384
+
+/** The most threads that can record spans. */
+#define TRACE_MAX_THREADS 4
+
+/** The boundaries of the hot path that are traced. */
+typedef enum {
+    TRACE_RECEIVE = 0, /**< Waiting for and receiving an input message */
+    TRACE_PROCESS = 1, /**< Processing an input message, argument is its tag */
+    TRACE_ENCODE = 2,  /**< Encoding an input message as a block, argument is its tag */
+    TRACE_FANOUT = 3,  /**< Copying a block into the packets of the sinks, argument is its size */
+    TRACE_SEND = 4,    /**< Sending a packet to a sink, argument is the index of the sink */
+    TRACE_PRINT = 5,   /**< Printing a packet in hex format, argument is the index of the sink */
+    TRACE_POINTS = 6,  /**< The number of tracepoints */
+} TracePoint;
+
+/** A traced span of time. */
+typedef struct {
+    /** The cycle counter when the span started. */
+    uint64_t start;
+    /** The cycle counter when the span ended. */
+    uint64_t end;
+    /** A value describing the span, depending on the tracepoint. */
+    uint32_t arg;
+    /** The tracepoint. */
+    uint16_t point;
+    /** Unused. */
+    uint16_t _padding;
+} TraceEvent;
+
+/** The spans recorded by one thread. */
+typedef struct {
+    /** The number of spans ever recorded, the next one goes at this index modulo TRACE_RING_EVENTS. */
+    atomic_uint_fast64_t head;
+    /** The spans. */
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+/**
+ * Reads the cycle counter, or the raw monotonic clock in nanoseconds on processors without one that is readable from
+ * user space.
+ * @return The current time in cycle counter ticks.
+ */
+static inline uint64_t trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+#ifdef PACKAGER_TRACE
+void trace_init(void);
+TraceRing *trace_ring_claim(void);
+bool trace_export(const char *path);
+void trace_reset(void);
+
+/** The ring of the calling thread, claimed on its first span. */
+extern _Thread_local TraceRing *trace_ring;
+
+/**
+ * Records a span in the ring of the calling thread, overwriting the oldest span once the ring is full.
+ * @param point The tracepoint.
+ * @param start The cycle counter when the span started.
+ * @param arg A value describing the span.
+ */
+static inline void trace_record(const TracePoint point, const uint64_t start, const uint32_t arg) {
+    TraceRing *r = trace_ring;
+    if (r == NULL && (r = trace_ring_claim()) == NULL) return;
+    const uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    TraceEvent *e = &r->events[h & (TRACE_RING_EVENTS - 1)];
+    e->start = start;
+    e->end = trace_now();
+    e->arg = arg;
+    e->point = point;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+/** Whether tracepoints are compiled in. */
+#define TRACE_ENABLED 1
+/** Starts a span, storing its start time in a new variable with the given name. */
+#define TRACE_START(var) const uint64_t var = trace_now()
+/** Ends the span started with TRACE_START(var) and records it for the tracepoint, with an argument. */
+#define TRACE_SPAN(point, var, arg) trace_record((point), (var), (arg))
+#else
+/** Whether tracepoints are compiled in. */
+#define TRACE_ENABLED 0
+/** Starts a span, storing its start time in a new variable with the given name. */
+#define TRACE_START(var)
+/** Ends the span started with TRACE_START(var) and records it for the tracepoint, with an argument. */
+#define TRACE_SPAN(point, var, arg) ((void)0)
+#endif
+
+#endif // _TRACE_H_
@@ -22,15 +22,54 @@ TESTDIR += $(PROJECT_ROOT)/tests
 TESTFILES += $(wildcard $(TESTDIR)/*.c)
 TESTBINS = $(patsubst %.c,%,$(TESTFILES))
 
-.PHONY: $(TESTBINS)
+FUZZDIR = $(TESTDIR)/fuzz
+FUZZSRC = $(FUZZDIR)/fuzz_packager.c
+FUZZBIN = $(FUZZDIR)/fuzz_packager
+STRESS_ITERATIONS ?= 20000
+
+BENCHDIR = $(TESTDIR)/bench
+BENCHFILES = $(wildcard $(BENCHDIR)/*.c)
+BENCHBINS = $(patsubst %.c,%,$(BENCHFILES))
+
+LOADSRC = $(TESTDIR)/load/loadgen.c
+LOADBIN = $(TESTDIR)/load/loadgen
+
+.PHONY: $(TESTBINS) $(BENCHBINS) fuzz fuzz-afl stress bench load
 
 test: WARNINGS = 
 
 test: $(TESTBINS)
 
+# Tracepoints and their rings only exist in traced builds
+$(TESTDIR)/test_trace $(BENCHDIR)/bench_trace: CFLAGS += -DPACKAGER_TRACE
+
 $(TESTBINS):
 	@gcc $(CFLAGS) $(WARNINGS) $(SRCFILES) $@.c -o $@
 	$@
 
+# libFuzzer target, run with `./tests/fuzz/fuzz_packager <corpus dir>`
+fuzz:
+	clang $(CFLAGS) -g -O1 -DFUZZ_LIBFUZZER -fsanitize=fuzzer,address,undefined $(SRCFILES) $(FUZZSRC) -o $(FUZZBIN)
+
+# AFL target, reads each input from stdin
+fuzz-afl:
+	afl-clang-fast $(CFLAGS) -g -O1 $(SRCFILES) $(FUZZSRC) -o $(FUZZBIN)-afl
+
+# Property-based stress run of the fuzz harness on random inputs, with sanitizers
+stress:
+	@gcc $(CFLAGS) -g -O2 -fsanitize=address,undefined -fno-sanitize-recover=all $(SRCFILES) $(FUZZSRC) -o $(FUZZBIN)-stress
+	$(FUZZBIN)-stress -s $(STRESS_ITERATIONS)
+
+# Benchmarks, built with the optimization level of the optimized packager binary
+bench: $(BENCHBINS)
+
+$(BENCHBINS):
+	@gcc $(CFLAGS) -O3 $(SRCFILES) $@.c -o $@ -lm
+	$@
+
+# Synthetic fetcher load generator, run against a packager reading from its queues (see tests/load/loadgen.c)
+load:
+	@gcc $(CFLAGS) -O2 $(SRCFILES) $(LOADSRC) -o $(LOADBIN) -pthread
+
 clean:
-	@rm $(TESTBINS)
+	@rm -f $(TESTBINS) $(BENCHBINS) $(FUZZBIN) $(FUZZBIN)-afl $(FUZZBIN)-stress $(LOADBIN)
@@ -0,0 +1,137 @@
+/**
+ * @file bench_builder.c
+ * @brief Benchmarks appending encoded blocks to packets with the generic runtime sized packet builder, the builders
+ * specialized at compile time, the dispatch on the packet size that sinks use and a baseline with the packet size hard
+ * coded like it used to be.
+ *
+ * Run with `make -f test.mk bench`.
+ */
+#include "../../src/encoder.h"
+#include "../../src/header.h"
+#include "../../src/packet_types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** The number of blocks appended per measurement. */
+#define BENCH_BLOCKS 20000000
+
+/** The number of distinct pre-encoded blocks cycled through. */
+#define BENCH_MIX 8
+
+/** Pre-encoded blocks of mixed sizes, as the sinks receive them from the shared encode. */
+static uint8_t blocks[BENCH_MIX][ENCODED_BLOCK_MAX_SIZE];
+
+/** The sizes of the pre-encoded blocks. */
+static uint16_t sizes[BENCH_MIX];
+
+/** The packet buffer. */
+static uint8_t packet[PACKET_LIMIT_SIZE];
+
+/** Keeps the compiler from optimizing away the packets. */
+static volatile uint32_t sink;
+
+/** The header template of the benchmarked packets. */
+static PacketHeaderTemplate header;
+
+/**
+ * The baseline: appending with the packet size fixed at compile time to PACKET_MAX_SIZE, the way packets were built
+ * before the size was configurable. Blocks are copied the same way as in the specialized builders, so that only the
+ * size checks differ.
+ */
+static inline bool fixed_append(PacketBuilder *b, const uint8_t *block, const uint16_t n) {
+    if (b->len + n > PACKET_MAX_SIZE) return false;
+    for (uint16_t i = 0; i < n; i += 4) memcpy(packet + b->len + i, block + i, 4);
+    b->len += n;
+    b->blocks++;
+    packet_inc_length(packet, n);
+    return true;
+}
+
+/**
+ * Defines a benchmark loop that fills packets with the pre-encoded blocks using the given append expression, starting
+ * a new packet whenever a block does not fit.
+ */
+#define BENCH_LOOP(name, append)                                                                                       \
+    static double name(PacketBuilder *b) {                                                                             \
+        struct timespec start, end;                                                                                    \
+        uint32_t packets = 0;                                                                                          \
+        clock_gettime(CLOCK_MONOTONIC, &start);                                                                        \
+        packet_builder_start(b, &header, false, 0);                                                                    \
+        for (uint32_t i = 0; i < BENCH_BLOCKS; i++) {                                                                  \
+            const uint8_t *block = blocks[i % BENCH_MIX];                                                              \
+            const uint16_t n = sizes[i % BENCH_MIX];                                                                   \
+            if (!append) {                                                                                             \
+                packets += b->len;                                                                                     \
+                packet_builder_start(b, &header, false, packets);                                                      \
+                append;                                                                                                \
+            }                                                                                                          \
+        }                                                                                                              \
+        clock_gettime(CLOCK_MONOTONIC, &end);                                                                          \
+        sink = packets + b->len;                                                                                       \
+        return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / BENCH_BLOCKS;                     \
+    }
+
+BENCH_LOOP(bench_fixed, fixed_append(b, block, n))
+BENCH_LOOP(bench_generic, packet_builder_append(b, block, n))
+BENCH_LOOP(bench_specialized64, packet_builder64_append(b, block, n))
+BENCH_LOOP(bench_specialized128, packet_builder128_append(b, block, n))
+BENCH_LOOP(bench_specialized256, packet_builder256_append(b, block, n))
+BENCH_LOOP(bench_specialized1024, packet_builder1024_append(b, block, n))
+
+BENCH_LOOP(bench_sized, packet_builder_append_sized(b, block, n))
+
+/**
+ * Runs a benchmark with a packet builder of the given size and prints the result.
+ * @param label The name of the benchmark.
+ * @param max_size The maximum packet size.
+ * @param bench The benchmark loop.
+ */
+static void run(const char *label, const uint16_t max_size, double (*bench)(PacketBuilder *)) {
+    PacketBuilder b;
+    packet_builder_init(&b, packet, max_size);
+    // Report the best of a few runs, after a warm up run
+    bench(&b);
+    double ns = bench(&b);
+    for (int i = 0; i < 4; i++) {
+        const double run_ns = bench(&b);
+        if (run_ns < ns) ns = run_ns;
+    }
+    printf("%-28s %5u B  %6.2f ns/block  %7.1f Mblocks/s\n", label, max_size, ns, 1e3 / ns);
+}
+
+int main(void) {
+
+    packet_header_template_init(&header, "VA3ZZZ", 1, ROCKET);
+
+    // A mix of the block sizes produced from sensor readings
+    const common_t msgs[BENCH_MIX] = {
+        {.type = TAG_ALTITUDE_REL, .data.FLOAT = 120.5f},
+        {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {0.1f, 0.2f, 9.8f}},
+        {.type = TAG_TEMPERATURE, .data.FLOAT = 21.0f},
+        {.type = TAG_COORDS, .data.VEC2D_I32 = {453838000, -756954000}},
+        {.type = TAG_PRESSURE, .data.FLOAT = 101.3f},
+        {.type = TAG_ANGULAR_VEL, .data.VEC3D = {1.0f, 2.0f, 3.0f}},
+        {.type = TAG_ALTITUDE_SEA, .data.FLOAT = 180.0f},
+        {.type = TAG_VOLTAGE, .id = 1, .data.I16 = 3700},
+    };
+    for (int i = 0; i < BENCH_MIX; i++) {
+        sizes[i] = encode_block(blocks[i], &msgs[i], i);
+    }
+
+    printf("Appending %d pre-encoded blocks of mixed sizes\n", BENCH_BLOCKS);
+    run("fixed size (baseline)", PACKET_MAX_SIZE, bench_fixed);
+    run("generic, runtime size", PACKET_MAX_SIZE, bench_generic);
+    run("specialized", PACKET_MAX_SIZE, bench_specialized256);
+    run("dispatched by size (sinks)", PACKET_MAX_SIZE, bench_sized);
+    run("generic, runtime size", 64, bench_generic);
+    run("specialized", 64, bench_specialized64);
+    run("generic, runtime size", 128, bench_generic);
+    run("specialized", 128, bench_specialized128);
+    run("generic, runtime size", 1024, bench_generic);
+    run("specialized", 1024, bench_specialized1024);
+    run("dispatched by size (sinks)", 1024, bench_sized);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file bench_fusion.c
+ * @brief Benchmarks feeding readings to the altitude and vertical velocity estimator, compared to encoding every raw
+ * reading as a block.
+ *
+ * Run with `make -f test.mk bench`.
+ */
+#include "../../src/encoder.h"
+#include "../../src/fusion.h"
+#include "../../src/intypes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** The number of readings per measurement. */
+#define BENCH_SAMPLES 20000000
+
+/** The number of distinct readings cycled through: four acceleration readings for every altitude reading. */
+#define BENCH_MIX 5
+
+/** The readings, as fetcher sends them. */
+static common_t msgs[BENCH_MIX];
+
+/** Keeps the compiler from optimizing away the results. */
+static volatile uint32_t sink;
+
+/**
+ * Gets the time elapsed since a start time.
+ * @param start The start time.
+ * @return The elapsed time in nanoseconds.
+ */
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Feeds the readings to the estimator every 2 ms of mission time, sending estimates at the given rate.
+ * @param rate The number of estimates per second.
+ * @return The time per reading in nanoseconds.
+ */
+static double bench_fusion(const uint32_t rate) {
+    Fusion f;
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint32_t bytes = 0;
+    fusion_init(&f, rate, FUSION_DEFAULT_TAU_MS);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+        const uint32_t t = i * 2;
+        fusion_update(&f, &msgs[i % BENCH_MIX], t);
+        if (fusion_due(&f, t)) {
+            bytes += fusion_encode(&f, block, TAG_ALTITUDE_FUSED, t);
+            bytes += fusion_encode(&f, block, TAG_VERTICAL_VEL, t);
+        }
+    }
+    const double ns = elapsed_ns(&start) / BENCH_SAMPLES;
+    sink = bytes + block[4];
+    return ns;
+}
+
+/**
+ * Encodes every reading as a block, which is what is done without the estimator.
+ * @return The time per reading in nanoseconds.
+ */
+static double bench_raw(void) {
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint32_t bytes = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+        bytes += encode_block(block, &msgs[i % BENCH_MIX], i * 2);
+    }
+    const double ns = elapsed_ns(&start) / BENCH_SAMPLES;
+    sink = bytes + block[4];
+    return ns;
+}
+
+/**
+ * Runs a benchmark a few times and prints the best result.
+ * @param label The name of the benchmark.
+ * @param rate The number of estimates per second, or 0 to encode every raw reading.
+ */
+static void run(const char *label, const uint32_t rate) {
+    double ns = 1e9;
+    for (int i = 0; i < 5; i++) {
+        const double run_ns = rate == 0 ? bench_raw() : bench_fusion(rate);
+        if (run_ns < ns) ns = run_ns;
+    }
+    printf("%-32s %4u Hz  %6.2f ns/reading  %7.1f Mreadings/s\n", label, rate, ns, 1e3 / ns);
+}
+
+int main(void) {
+
+    for (int i = 0; i < BENCH_MIX - 1; i++) {
+        msgs[i] = (common_t){.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.1f, -0.2f, 60.0f + i}};
+    }
+    msgs[BENCH_MIX - 1] = (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = 1234.5f};
+
+    printf("Processing %d altitude and acceleration readings, 2 ms apart\n", BENCH_SAMPLES);
+    run("raw, every reading encoded", 0);
+    run("fusion, estimates encoded", 10);
+    run("fusion, estimates encoded", 100);
+
+    return EXIT_SUCCESS;
+}
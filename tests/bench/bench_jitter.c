@@ -0,0 +1,135 @@
+/**
+ * @file bench_jitter.c
+ * @brief Benchmarks the latency jitter of the main loop with default scheduling and in real-time mode.
+ *
+ * Run with `make -f test.mk bench`. Like cyclictest, a loop wakes up every millisecond, as if an input message had
+ * arrived, encodes a reading and fans it out to a sink, while a CPU bound thread with default scheduling competes for
+ * the same CPU. The latency from the intended wake up time to the block having been fanned out is reported for each
+ * mode, worst case included. Real-time mode needs permission to use SCHED_FIFO and to lock memory (root or
+ * CAP_SYS_NICE and CAP_IPC_LOCK on Linux); without it, only default scheduling is measured.
+ */
+#include "../../src/arena.h"
+#include "../../src/encoder.h"
+#include "../../src/intypes.h"
+#include "../../src/rt.h"
+#include "../../src/sink.h"
+#include "../fixtures.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+/** The number of wake ups per mode. */
+#define BENCH_CYCLES 2000
+
+/** The time between wake ups in nanoseconds. */
+#define BENCH_PERIOD_NS 1000000
+
+/** The real-time priority of the loop, below the kernel's own threads. */
+#define BENCH_PRIORITY 80
+
+/** Arena of the fan-out. */
+static Arena arena;
+
+/** Tells the competing thread to stop. */
+static atomic_bool stop;
+
+/**
+ * Competes for the CPU with the loop until told to stop.
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *compete(void *arg) {
+    (void)arg;
+    volatile uint64_t spins = 0;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) spins++;
+    return NULL;
+}
+
+/**
+ * Adds nanoseconds to a time.
+ * @param t The time.
+ * @param ns The nanoseconds to add, less than a second.
+ */
+static void add_ns(struct timespec *t, const long ns) {
+    t->tv_nsec += ns;
+    if (t->tv_nsec >= 1000000000) {
+        t->tv_nsec -= 1000000000;
+        t->tv_sec++;
+    }
+}
+
+/**
+ * Runs the loop and measures its latencies.
+ * @param s Where to record the latency from each intended wake up to the block having been fanned out.
+ */
+static void run_loop(LatencyStats *s) {
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    struct timespec next;
+    latency_init(s);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t i = 0; i < BENCH_CYCLES; i++) {
+        add_ns(&next, BENCH_PERIOD_NS);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+
+        const common_t msg = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.1f * i, -0.2f, 9.81f}};
+        const uint16_t size = encode_block(block, &msg, i);
+        fanout_offer(&f, block, size, msg.type, 0, 0, i);
+
+        const uint64_t due_ns = (uint64_t)next.tv_sec * 1000000000u + next.tv_nsec;
+        latency_record(s, latency_now_ns() - due_ns);
+    }
+}
+
+/**
+ * Prints the latencies of a mode.
+ * @param label The name of the mode.
+ * @param s The latencies.
+ */
+static void report(const char *label, const LatencyStats *s) {
+    printf("%-20s %8.1f us average %8.1f us 99%% %8.1f us 99.9%% %8.1f us worst\n", label,
+           s->sum_ns / 1e3 / s->count, latency_percentile_ns(s, 990) / 1e3, latency_percentile_ns(s, 999) / 1e3,
+           s->max_ns / 1e3);
+}
+
+int main(void) {
+
+    SinkConfig cfg;
+    sink_config_parse(&cfg, "file=/dev/null,size=256");
+    if (!arena_open(&arena, sink_footprint(&cfg))) return EXIT_FAILURE;
+    fixture_fanout(&arena);
+    if (!fanout_add(&f, &cfg, 0, 0)) return EXIT_FAILURE;
+    arena_seal(&arena);
+
+    // Both threads share one CPU, so that the loop has to be scheduled in over the competing thread
+    rt_set_cpu(0);
+    pthread_t competitor;
+    if (pthread_create(&competitor, NULL, compete, NULL) != 0) return EXIT_FAILURE;
+
+    printf("Waking up every %d us %d times, competing with a CPU bound thread\n", BENCH_PERIOD_NS / 1000, BENCH_CYCLES);
+    LatencyStats s;
+    run_loop(&s);
+    report("default scheduling", &s);
+
+    if (!rt_set_priority(BENCH_PRIORITY) || !rt_lock_memory()) {
+        printf("%-20s not available: %s\n", "real-time", strerror(errno));
+    } else {
+        rt_prefault(&f, sizeof(f));
+        rt_prefault_stack();
+        run_loop(&s);
+        report("real-time", &s);
+        munlockall();
+    }
+
+    atomic_store(&stop, true);
+    pthread_join(competitor, NULL);
+    fanout_close(&f, 0);
+    arena_close(&arena);
+    return EXIT_SUCCESS;
+}
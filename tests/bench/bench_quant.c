@@ -0,0 +1,267 @@
+/**
+ * @file bench_quant.c
+ * @brief Benchmarks packing and unpacking blocks by quantization profiles, and reports the bits they save per packet
+ * on a replayed flight.
+ *
+ * Run with `make -f test.mk bench`, or directly as `bench_quant [replay file [profile file]]` to replay recorded input
+ * messages (the same files as `packager -i`) and pack them by a profile file. Without a recording, a 10 minute flight
+ * is synthesized; without a profile file, the profiles below are used.
+ */
+#include "../../src/encoder.h"
+#include "../../src/header.h"
+#include "../../src/intypes.h"
+#include "../../src/quant.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** The number of blocks packed and unpacked per measurement. */
+#define BENCH_BLOCKS 20000000
+
+/** The size of the packets of the report, the default sink packet size. */
+#define BENCH_PACKET_SIZE 256
+
+/** The most input messages of a flight. */
+#define BENCH_MAX_MSGS 1000000
+
+/** Profiles at the resolution of the flight sensors, for flights of up to 20 minutes. */
+static const char *const profile_lines[] = {
+    "0x02 0:1200000/10 -1000000:30000000/32",           // Altitude, 20 bits of 32 mm steps
+    "0x03 0:1200000/10 -40000:85000/50",                // Temperature, 12 bits of 0.05 degree steps
+    "0x04 0:1200000/10 0:110000/4",                     // Pressure, 15 bits of 4 Pa steps
+    "0x06 0:1200000/10 -16000:16000/8 -16000:16000/8 -16000:16000/8", // Acceleration, 12 bits of 8 cm/s^2
+    "0x07 0:1200000/10 -20000:20000/10 -20000:20000/10 -20000:20000/10", // Angular velocity, 12 bits of 1 degree/s
+    "0x09 0:1200000/10 450000000:455000000/10 -760000000:-755000000/10", // Coordinates, 19 bits of 1 microdegree
+    "0x0a 0:1200000/10 0:7 0:16000/4",                  // Voltage, 12 bits of 4 mV
+};
+
+/** The input messages of the flight, with the mission time of each. */
+static common_t msgs[BENCH_MAX_MSGS];
+
+/** The number of input messages of the flight. */
+static uint32_t n_msgs;
+
+/** The profiles. */
+static QuantProfile profile;
+
+/** Keeps the compiler from optimizing away the results. */
+static volatile uint32_t sink;
+
+/**
+ * Gets the time elapsed since a start time.
+ * @param start The start time.
+ * @return The elapsed time in nanoseconds.
+ */
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Adds an input message to the flight.
+ * @param msg The input message.
+ */
+static void add(const common_t msg) {
+    if (n_msgs < BENCH_MAX_MSGS) msgs[n_msgs++] = msg;
+}
+
+/**
+ * Synthesizes a 10 minute flight: a 3 second boost to 300 m/s, coast to apogee and descent under a parachute at
+ * 8 m/s. Time, acceleration and angular velocity are read every 10 ms, altitude, pressure and temperature every 50 ms
+ * and coordinates and voltages every second, with some sensor noise.
+ */
+static void synthesize_flight(void) {
+    float altitude = 0.0f, velocity = 0.0f;
+    srand(42);
+    for (uint32_t t = 0; t < 600000; t += 10) {
+        const float noise = (rand() % 1000 - 500) / 1000.0f;
+        const float accel = t < 3000 ? 100.0f : velocity > -8.0f ? -9.81f : 0.0f;
+        velocity += accel * 0.01f;
+        altitude += velocity * 0.01f;
+        if (altitude < 0.0f) altitude = velocity = 0.0f;
+
+        add((common_t){.type = TAG_TIME, .data.U32 = t});
+        add((common_t){.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {noise, -noise, accel + 9.81f + noise}});
+        add((common_t){.type = TAG_ANGULAR_VEL, .data.VEC3D = {noise * 20.0f, 5.0f, -noise * 10.0f}});
+        if (t % 50 == 0) {
+            add((common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = altitude + noise});
+            add((common_t){.type = TAG_PRESSURE, .data.FLOAT = 101.325f * expf(-altitude / 8434.0f) + noise * 0.01f});
+            add((common_t){.type = TAG_TEMPERATURE, .data.FLOAT = 15.0f - altitude * 0.0065f + noise});
+        }
+        if (t % 1000 == 0) {
+            add((common_t){.type = TAG_COORDS, .data.VEC2D_I32 = {452500000 + (int32_t)t, -757500000 - (int32_t)t}});
+            add((common_t){.type = TAG_VOLTAGE, .id = 1, .data.I16 = 7400 - t / 1000});
+            add((common_t){.type = TAG_VOLTAGE, .id = 2, .data.I16 = 3700});
+        }
+    }
+}
+
+/**
+ * Reads a recorded flight.
+ * @param path The replay file of raw input messages, back to back.
+ * @return True if the file was read.
+ */
+static bool read_flight(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    n_msgs = fread(msgs, sizeof(common_t), BENCH_MAX_MSGS, f);
+    fclose(f);
+    return true;
+}
+
+/** The totals of packing a flight into packets. */
+typedef struct {
+    /** The number of packets sent. */
+    uint32_t packets;
+    /** The number of blocks sent. */
+    uint32_t blocks;
+    /** The number of bytes of blocks sent, headers included. */
+    uint64_t block_bytes;
+    /** The number of bits of block values, without headers and padding. */
+    uint64_t value_bits;
+} FlightTotals;
+
+/**
+ * Packs the flight into packets like a sink does, sending a packet when the next block does not fit.
+ * @param packed Whether to pack the blocks by the profiles.
+ * @return The totals.
+ */
+static FlightTotals pack_flight(const bool packed) {
+    static uint8_t packet[BENCH_PACKET_SIZE];
+    PacketHeaderTemplate t;
+    PacketBuilder b;
+    FlightTotals totals = {0};
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint32_t mission_time = 0;
+
+    packet_header_template_init(&t, "VA3ZZZ", 1, ROCKET);
+    packet_builder_init(&b, packet, sizeof(packet));
+    packet_builder_start(&b, &t, false, 0);
+    for (uint32_t i = 0; i < n_msgs; i++) {
+        if (msgs[i].type == TAG_TIME) mission_time = msgs[i].data.U32;
+        uint16_t size = encode_block(block, &msgs[i], mission_time);
+        if (size == 0) continue;
+        const uint16_t standard_size = size;
+        if (packed) size = quant_pack(&profile, block, size);
+
+        const BlockHeader *h = (const BlockHeader *)block;
+        const QuantLayout *l = quant_layout(&profile, h->subtype);
+        totals.value_bits += h->type == TYPE_DATA_PACKED ? l->bits : (standard_size - sizeof(BlockHeader)) * 8u;
+        totals.blocks++;
+        totals.block_bytes += size;
+        if (!packet_builder_append(&b, block, size)) {
+            totals.packets++;
+            packet_builder_start(&b, &t, false, totals.packets);
+            packet_builder_append(&b, block, size);
+        }
+    }
+    if (!packet_builder_empty(&b)) totals.packets++;
+    return totals;
+}
+
+/**
+ * Reports the bits saved by the profiles on the flight, overall and for each subtype.
+ */
+static void report_flight(void) {
+    const FlightTotals std = pack_flight(false);
+    const FlightTotals pk = pack_flight(true);
+    printf("%u input messages, %u blocks in %d byte packets\n", n_msgs, std.blocks, BENCH_PACKET_SIZE);
+    printf("  %-10s %8s %12s %14s %12s\n", "", "packets", "block bytes", "value bits", "blocks/packet");
+    printf("  %-10s %8u %12lu %14lu %12.1f\n", "standard", std.packets, (unsigned long)std.block_bytes,
+           (unsigned long)std.value_bits, (double)std.blocks / std.packets);
+    printf("  %-10s %8u %12lu %14lu %12.1f\n", "packed", pk.packets, (unsigned long)pk.block_bytes,
+           (unsigned long)pk.value_bits, (double)pk.blocks / pk.packets);
+    printf("  %.0f bits saved per packet on the wire (%.1f%% fewer packets), %.0f bits of values saved per packet\n",
+           (std.block_bytes - pk.block_bytes) * 8.0 / std.packets, 100.0 * (std.packets - pk.packets) / std.packets,
+           (std.value_bits - pk.value_bits) * 1.0 / std.packets);
+
+    for (uint8_t s = 0; s < QUANT_SUBTYPES; s++) {
+        const QuantLayout *l = quant_layout(&profile, s);
+        if (l == NULL) continue;
+        printf("  subtype 0x%02x: %2u of %3zu value bits, %2u of %2u bytes per block\n", s, l->bits,
+               (l->standard_size - sizeof(BlockHeader)) * 8, l->size, l->standard_size);
+    }
+}
+
+/**
+ * Packs and unpacks the blocks of the flight in turn.
+ * @param unpack Whether to also unpack each packed block.
+ * @return The time per block in nanoseconds.
+ */
+static double bench_pack(const bool unpack) {
+    static uint8_t blocks[64][ENCODED_BLOCK_MAX_SIZE];
+    static uint16_t sizes[64];
+    uint8_t n = 0;
+    uint32_t mission_time = 0;
+    for (uint32_t i = 0; i < n_msgs && n < 64; i++) {
+        if (msgs[i].type == TAG_TIME) mission_time = msgs[i].data.U32;
+        sizes[n] = encode_block(blocks[n], &msgs[i], mission_time);
+        if (sizes[n] != 0) n++;
+    }
+    if (n == 0) return 0.0;
+
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t out[ENCODED_BLOCK_MAX_SIZE];
+    uint32_t bytes = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0, j = 0; i < BENCH_BLOCKS; i++, j = j + 1 == n ? 0 : j + 1) {
+        memcpy(block, blocks[j], sizes[j]);
+        const uint16_t size = quant_pack(&profile, block, sizes[j]);
+        bytes += size;
+        if (unpack) bytes += quant_unpack(&profile, (const BlockHeader *)block, block + sizeof(BlockHeader), out);
+    }
+    const double ns = elapsed_ns(&start) / BENCH_BLOCKS;
+    sink = bytes + out[4];
+    return ns;
+}
+
+/**
+ * Runs a benchmark a few times and prints the best result.
+ * @param label The name of the benchmark.
+ * @param unpack Whether to also unpack each packed block.
+ */
+static void run(const char *label, const bool unpack) {
+    double ns = 1e9;
+    for (int i = 0; i < 5; i++) {
+        const double run_ns = bench_pack(unpack);
+        if (run_ns < ns) ns = run_ns;
+    }
+    printf("%-32s %6.2f ns/block  %7.1f Mblocks/s\n", label, ns, 1e3 / ns);
+}
+
+int main(int argc, char **argv) {
+
+    quant_init(&profile);
+    if (argc > 2) {
+        unsigned int line;
+        if (!quant_load(&profile, argv[2], &line)) {
+            fprintf(stderr, "Invalid quantization profiles '%s' at line %u\n", argv[2], line);
+            return EXIT_FAILURE;
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(profile_lines) / sizeof(profile_lines[0]); i++) {
+            if (!quant_parse(&profile, profile_lines[i])) return EXIT_FAILURE;
+        }
+    }
+
+    if (argc > 1) {
+        if (!read_flight(argv[1])) {
+            fprintf(stderr, "Could not read replay file '%s'\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        printf("Replaying %s\n", argv[1]);
+    } else {
+        synthesize_flight();
+        printf("Replaying a synthesized 10 minute flight\n");
+    }
+
+    report_flight();
+    run("pack", false);
+    run("pack and unpack", true);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file bench_schema.c
+ * @brief Benchmarks encoding readings of schema sensors compared to the same readings of the built-in sensors that
+ * they are described like.
+ *
+ * Run with `make -f test.mk bench`.
+ */
+#include "../../src/encoder.h"
+#include "../../src/intypes.h"
+#include "../../src/schema.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** The number of readings encoded per measurement. */
+#define BENCH_SAMPLES 20000000
+
+/** The number of distinct readings cycled through. */
+#define BENCH_MIX 4
+
+/** Schema descriptions of the built-in sensors, with the tag of each schema sensor being 0x10 more. */
+static const char *const lines[BENCH_MIX] = {
+    "0x10 0x20 f32:i32*1000",                        // Temperature
+    "0x18 0x21 f32:i16*100 f32:i16*100 f32:i16*100", // Absolute linear acceleration
+    "0x19 0x22 i32:i32 i32:i32",                     // Coordinates
+    "0x1a 0x23 id:u16 i16:i16",                      // Voltage
+};
+
+/** Readings of the built-in sensors. */
+static common_t builtin[BENCH_MIX];
+
+/** The same readings as schema sensors. */
+static common_t described[BENCH_MIX];
+
+/** The compiled schema. */
+static Schema schema;
+
+/** Keeps the compiler from optimizing away the results. */
+static volatile uint32_t sink;
+
+/**
+ * Gets the time elapsed since a start time.
+ * @param start The start time.
+ * @return The elapsed time in nanoseconds.
+ */
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Encodes the readings with the built-in encodings or the schema.
+ * @param interpreted True to encode the schema sensors, false to encode the built-in ones.
+ * @return The time per reading in nanoseconds.
+ */
+static double bench(const bool interpreted) {
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint32_t bytes = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (interpreted) {
+        for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+            bytes += schema_encode(&schema, block, &described[i % BENCH_MIX], i);
+        }
+    } else {
+        for (uint32_t i = 0; i < BENCH_SAMPLES; i++) {
+            bytes += encode_block(block, &builtin[i % BENCH_MIX], i);
+        }
+    }
+    const double ns = elapsed_ns(&start) / BENCH_SAMPLES;
+    sink = bytes + block[4];
+    return ns;
+}
+
+/**
+ * Runs a benchmark a few times and prints the best result.
+ * @param label The name of the benchmark.
+ * @param interpreted True to encode the schema sensors, false to encode the built-in ones.
+ * @return The best time per reading in nanoseconds.
+ */
+static double run(const char *label, const bool interpreted) {
+    double ns = 1e9;
+    for (int i = 0; i < 5; i++) {
+        const double run_ns = bench(interpreted);
+        if (run_ns < ns) ns = run_ns;
+    }
+    printf("%-24s %6.2f ns/reading  %7.1f Mreadings/s\n", label, ns, 1e3 / ns);
+    return ns;
+}
+
+int main(void) {
+
+    builtin[0] = (common_t){.type = TAG_TEMPERATURE, .data.FLOAT = 21.5f};
+    builtin[1] = (common_t){.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.1f, -0.2f, 9.81f}};
+    builtin[2] = (common_t){.type = TAG_COORDS, .data.VEC2D_I32 = {453841234, -756941234}};
+    builtin[3] = (common_t){.type = TAG_VOLTAGE, .id = 2, .data.I16 = 3300};
+
+    schema_init(&schema);
+    for (int i = 0; i < BENCH_MIX; i++) {
+        if (!schema_parse(&schema, lines[i])) {
+            fprintf(stderr, "Invalid schema line '%s'\n", lines[i]);
+            return EXIT_FAILURE;
+        }
+        described[i] = builtin[i];
+        described[i].type += 0x10;
+    }
+
+    printf("Encoding %d temperature, acceleration, coordinate and voltage readings\n", BENCH_SAMPLES);
+    const double builtin_ns = run("built-in", false);
+    const double schema_ns = run("schema", true);
+    printf("schema encoding takes %.2fx the time of the built-in encoding\n", schema_ns / builtin_ns);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file bench_trace.c
+ * @brief Benchmarks the cost of a traced span, compared to the same loop without the tracepoint.
+ *
+ * Run with `make -f test.mk bench`.
+ */
+#include "../../src/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** The number of spans per measurement. */
+#define BENCH_SPANS 20000000
+
+/** Keeps the compiler from optimizing away the work being traced. */
+static volatile uint32_t sink;
+
+/**
+ * Gets the time elapsed since a start time.
+ * @param start The start time.
+ * @return The elapsed time in nanoseconds.
+ */
+static double elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Runs a loop of a small amount of work, with or without a span around each iteration.
+ * @param traced True to record a span per iteration.
+ * @return The time per iteration in nanoseconds.
+ */
+static double bench(const bool traced) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (traced) {
+        for (uint32_t i = 0; i < BENCH_SPANS; i++) {
+            TRACE_START(t);
+            sink = sink + i;
+            TRACE_SPAN(TRACE_ENCODE, t, i);
+        }
+    } else {
+        for (uint32_t i = 0; i < BENCH_SPANS; i++) {
+            sink = sink + i;
+        }
+    }
+    return elapsed_ns(&start) / BENCH_SPANS;
+}
+
+/**
+ * Runs a benchmark a few times and prints the best result.
+ * @param label The name of the benchmark.
+ * @param traced True to record a span per iteration.
+ * @return The best time per iteration in nanoseconds.
+ */
+static double run(const char *label, const bool traced) {
+    double ns = 1e9;
+    for (int i = 0; i < 5; i++) {
+        const double run_ns = bench(traced);
+        if (run_ns < ns) ns = run_ns;
+    }
+    printf("%-24s %6.2f ns/iteration\n", label, ns);
+    return ns;
+}
+
+int main(void) {
+
+    trace_init();
+    printf("Running %d iterations\n", BENCH_SPANS);
+    const double untraced_ns = run("without tracepoint", false);
+    const double traced_ns = run("with tracepoint", true);
+    printf("a span costs %.2f ns\n", traced_ns - untraced_ns);
+
+    return EXIT_SUCCESS;
+}
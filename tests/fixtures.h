@@ -0,0 +1,33 @@
+/**
+ * @file fixtures.h
+ * @brief The fan-out shared by the tests and benchmarks that send blocks through sinks, with its sequence state and
+ * header template. Include it once per test program.
+ */
+#ifndef _FIXTURES_H_
+#define _FIXTURES_H_
+
+#include "../src/arena.h"
+#include "../src/header.h"
+#include "../src/seqstate.h"
+#include "../src/sink.h"
+
+/** Fan-out used by the tests, large enough not to belong on the stack. */
+static Fanout f;
+
+/** Sequence state of the fan-out, kept in memory. */
+static SeqState seq;
+
+/** Header template of the fan-out. */
+static PacketHeaderTemplate header;
+
+/**
+ * Empties the fan-out, restarting its packet numbers from 0.
+ * @param arena The arena to allocate the buffers of the sinks from.
+ */
+static inline void fixture_fanout(Arena *arena) {
+    packet_header_template_init(&header, "VA3ZZZ", 1, ROCKET);
+    seqstate_open(&seq, "/nonexistent/directory/packager.seq", 0);
+    fanout_init(&f, &header, &seq, arena);
+}
+
+#endif // _FIXTURES_H_
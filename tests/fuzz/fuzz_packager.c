@@ -0,0 +1,726 @@
+/**
+ * @file fuzz_packager.c
+ * @brief Fuzzing and property-based stress harness for the packet encoder, length arithmetic and decoder.
+ *
+ * The fuzz input is laid out as:
+ *
+ * - Two configuration bytes: the packet size of the first sink, its compact header interval, adaptive composition and
+ *   the fusion rate.
+ * - A length byte and that many bytes of configuration text, one line per option: `sink SPEC` adds a sink like -o
+ *   does, writing to a file whatever target the specification names, and `quant LINE` and `schema LINE` are parsed
+ *   like the lines of the -q and -s files. Invalid lines are left out like packager refuses them.
+ * - A stream of raw input messages (common_t). Messages with tag FUZZ_TAG_RESEND carry a resend request instead of a
+ *   reading: the sink in their ID and the first packet, packet count and subtype mask in their data.
+ *
+ * The messages are run through the same path as packager: source_update, encode_block, schema_encode and quant_pack
+ * for every message, and fanout_offer into the sinks, which send their packets when they are full and when the fan-out
+ * is closed. Every offered block and every packet the sinks sent is checked against the following invariants, and the
+ * harness aborts if any of them is broken:
+ *
+ * - Nothing is written past the memory the sinks were given.
+ * - The length in the packet header matches the bytes sent, and the block lengths add up to it.
+ * - Packet numbers follow each other and full packet headers are reconstructed correctly from compact ones.
+ * - The sensor blocks of the packets are the offered blocks that pass the tag filter of the sink, in order, and
+ *   decode(encode(x)) == x at the resolution of the block. Resent blocks are blocks offered before.
+ * - Packed blocks unpack with the profile and pack back into the same bits.
+ * - Packets still in the history of a sink are the packets it sent.
+ *
+ * Build with libFuzzer (`make fuzz -f test.mk`), with AFL (`make fuzz-afl -f test.mk`) or as a standalone binary which
+ * runs the files given as arguments, or a randomized stress run with `-s <iterations>` (`make stress -f test.mk`).
+ */
+#include "../../src/arena.h"
+#include "../../src/decoder.h"
+#include "../../src/encoder.h"
+#include "../../src/events.h"
+#include "../../src/header.h"
+#include "../../src/intypes.h"
+#include "../../src/packet_types.h"
+#include "../../src/quant.h"
+#include "../../src/schema.h"
+#include "../../src/seqstate.h"
+#include "../../src/sink.h"
+#include "../../src/source.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Number of guard bytes after the memory of the sinks which must never be written. */
+#define GUARD_SIZE 64
+
+/** Value of the guard bytes. */
+#define GUARD_BYTE 0xA5
+
+/** The tag of messages that carry a resend request. */
+#define FUZZ_TAG_RESEND 0xFE
+
+/** The size of the arena the sinks are allocated from. Sinks that do not fit in it are left out. */
+#define FUZZ_ARENA_SIZE (SINKS_MAX * 16 * PACKET_LIMIT_SIZE)
+
+/** The most input messages run per fuzz input, so that every offered block can be kept for checking. */
+#define MAX_MESSAGES 4096
+
+/** The most blocks offered per fuzz input: one per message and the two estimates a message can complete. */
+#define MAX_OFFERED (MAX_MESSAGES * 3)
+
+/** Aborts with a message if an invariant does not hold. */
+#define FUZZ_CHECK(exp)                                                                                                \
+    do {                                                                                                               \
+        if (!(exp)) {                                                                                                  \
+            fprintf(stderr, "%s:%d: invariant broken: %s\n", __FILE__, __LINE__, #exp);                                \
+            abort();                                                                                                   \
+        }                                                                                                              \
+    } while (0)
+
+/** Memory the sinks are allocated from, followed by guard bytes. */
+static _Alignas(ARENA_ALIGN) uint8_t memory[FUZZ_ARENA_SIZE + GUARD_SIZE];
+
+/** Arena over the memory, without the guard bytes. */
+static Arena arena;
+
+/** Fan-out that the blocks are offered to. */
+static Fanout fanout;
+
+/** Sequence state of the fan-out, kept in memory. */
+static SeqState seq;
+
+/** Header template of the fan-out. */
+static PacketHeaderTemplate header;
+
+/** The files the sinks write their packets to, created on the first run. */
+static char paths[SINKS_MAX][32];
+
+/** State of the input, like that of an input queue of packager. */
+static Source source;
+
+/** Schema sensors, none unless the fuzz input defines some. */
+static Schema schema;
+
+/** Quantization profiles, none unless the fuzz input defines some. */
+static QuantProfile profile;
+
+/** The block being encoded, large enough for event and dictionary blocks. */
+static uint8_t block[BLOCK_MAX_SIZE];
+
+/** Every block offered to the fan-out, in order, with the tag it was offered with. */
+static struct {
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint16_t size;
+    uint8_t tag;
+} offered[MAX_OFFERED];
+
+/** Number of entries in offered. */
+static size_t n_offered;
+
+/** Decoder state which persists between the packets of one sink. */
+static HeaderDecoder header_decoder;
+
+/** Event channel exercised by GPS fix messages, flight phase changes and unknown tags. */
+static EventChannel events;
+
+/** Statistics for the stress run. */
+static size_t total_packets, total_messages;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/**
+ * Checks whether two fixed point values are equal within one unit plus the precision lost by a float round trip.
+ * @param a The first value.
+ * @param b The second value.
+ * @return True if the values are close enough.
+ */
+static bool close_enough(const int64_t a, const int64_t b) {
+    const int64_t diff = a > b ? a - b : b - a;
+    const int64_t mag = a > 0 ? a : -a;
+    return diff <= 1 + (mag >> 22);
+}
+
+/**
+ * Checks that a re-encoded block matches the original block at the resolution of the block.
+ * @param original The original encoded block, including its header.
+ * @param again The block encoded from the decoded message, including its header.
+ * @param size The size of the blocks.
+ */
+static void check_blocks_match(const uint8_t *original, const uint8_t *again, const uint16_t size) {
+    const BlockHeader *h = (const BlockHeader *)original;
+    FUZZ_CHECK(!memcmp(original, again, sizeof(BlockHeader) + sizeof(uint32_t)));
+
+    const uint8_t *a = original + sizeof(BlockHeader) + sizeof(uint32_t);
+    const uint8_t *b = again + sizeof(BlockHeader) + sizeof(uint32_t);
+    const uint16_t n = size - sizeof(BlockHeader) - sizeof(uint32_t);
+
+    switch (h->subtype) {
+    case DATA_LAT_LONG:
+    case DATA_VOLTAGE:
+        // Integer readings must survive exactly
+        FUZZ_CHECK(!memcmp(a, b, n));
+        break;
+    case DATA_ACCEL_REL:
+    case DATA_ACCEL_ABS:
+    case DATA_ANGULAR_VEL:
+        for (uint16_t i = 0; i < n; i += sizeof(int16_t)) {
+            FUZZ_CHECK(close_enough(*(const int16_t *)(a + i), *(const int16_t *)(b + i)));
+        }
+        break;
+    case DATA_HUMIDITY:
+        FUZZ_CHECK(close_enough(*(const uint32_t *)a, *(const uint32_t *)b));
+        break;
+    default:
+        FUZZ_CHECK(close_enough(*(const int32_t *)a, *(const int32_t *)b));
+        break;
+    }
+}
+
+/**
+ * Checks that a debug block is well formed.
+ * @param h The block header.
+ * @param payload The block contents.
+ */
+static void check_debug_block(const BlockHeader *h, const uint8_t *payload) {
+    const uint16_t n = block_header_get_length(h) - sizeof(BlockHeader);
+    FUZZ_CHECK(n >= sizeof(uint32_t) + 1);
+    FUZZ_CHECK(block_header_get_length(h) <= BLOCK_MAX_SIZE);
+
+    if (payload[sizeof(uint32_t)] == DBG_RECORD_EVENT) {
+        FUZZ_CHECK(n == sizeof(EventDB));
+        const EventDB *e = (const EventDB *)payload;
+        FUZZ_CHECK(e->string_id == EVENT_STRING_NONE || event_string(&events, e->string_id) != NULL);
+    } else if (payload[sizeof(uint32_t)] == DBG_RECORD_DICTIONARY) {
+        const DictionaryDB *d = (const DictionaryDB *)payload;
+        uint16_t offset = 0;
+        for (uint8_t i = 0; i < d->count; i++) {
+            FUZZ_CHECK(offsetof(DictionaryDB, entries) + offset + 2 <= n);
+            const char *s = event_string(&events, d->entries[offset]);
+            FUZZ_CHECK(s != NULL);
+            FUZZ_CHECK(strlen(s) == d->entries[offset + 1]);
+            FUZZ_CHECK(offsetof(DictionaryDB, entries) + offset + 2 + d->entries[offset + 1] <= n);
+            FUZZ_CHECK(!memcmp(&d->entries[offset + 2], s, d->entries[offset + 1]));
+            offset += 2 + d->entries[offset + 1];
+        }
+    } else {
+        FUZZ_CHECK(false);
+    }
+}
+
+/**
+ * Checks that a block about to be offered is well formed: packed blocks unpack with the profile and pack back into
+ * the same bits, and built-in sensor blocks survive decode(encode(x)) at the resolution of the block.
+ * @param b The block, including its header.
+ * @param size The size of the block in bytes.
+ */
+static void check_block(const uint8_t *b, const uint16_t size) {
+    const BlockHeader *h = (const BlockHeader *)b;
+    FUZZ_CHECK(size % 4 == 0 && size <= ENCODED_BLOCK_MAX_SIZE);
+    FUZZ_CHECK(block_header_get_length(h) == size);
+
+    uint8_t standard[ENCODED_BLOCK_MAX_SIZE];
+    uint16_t standard_size = size;
+    memcpy(standard, b, size);
+    if (block_header_get_type(h) == TYPE_DATA_PACKED) {
+        standard_size = quant_unpack(&profile, h, b + sizeof(BlockHeader), standard);
+        FUZZ_CHECK(standard_size != 0);
+        uint8_t again[ENCODED_BLOCK_MAX_SIZE];
+        memcpy(again, standard, standard_size);
+        again[offsetof(BlockHeader, type)] &= ~BLOCK_TYPE_RESENT;
+        FUZZ_CHECK(quant_pack(&profile, again, standard_size) == size);
+        FUZZ_CHECK(!memcmp(again + sizeof(BlockHeader), b + sizeof(BlockHeader), size - sizeof(BlockHeader)));
+    }
+
+    common_t decoded;
+    uint32_t decoded_time;
+    const BlockHeader *sh = (const BlockHeader *)standard;
+    if (!decode_block(sh, standard + sizeof(BlockHeader), &decoded, &decoded_time)) {
+        // Only schema sensors have no built-in decoding
+        FUZZ_CHECK(sh->subtype > DATA_ALT_FUSED);
+        return;
+    }
+    uint8_t again[ENCODED_BLOCK_MAX_SIZE];
+    FUZZ_CHECK(encode_block(again, &decoded, decoded_time) == standard_size);
+    again[offsetof(BlockHeader, type)] = sh->type;
+    again[offsetof(BlockHeader, dest_addr)] = sh->dest_addr;
+    check_blocks_match(standard, again, standard_size);
+}
+
+/**
+ * Checks whether a block sent by a sink is an offered block, which the sink only addressed to its destination and
+ * marked if it was resent.
+ * @param sent The header of the sent block.
+ * @param i The index of the offered block.
+ * @return True if the blocks match.
+ */
+static bool is_offered(const BlockHeader *sent, const size_t i) {
+    const BlockHeader *o = (const BlockHeader *)offered[i].block;
+    return block_header_get_length(sent) == offered[i].size && block_header_get_type(sent) == o->type &&
+           sent->subtype == o->subtype &&
+           !memcmp(sent + 1, offered[i].block + sizeof(BlockHeader), offered[i].size - sizeof(BlockHeader));
+}
+
+/**
+ * Checks every invariant of a packet sent by a sink.
+ * @param s The sink.
+ * @param packet The packet.
+ * @param len The length of the packet in bytes.
+ * @param packet_number The number the packet should have.
+ * @param next The index of the first offered block the packet may hold, advanced past the blocks it holds.
+ */
+static void check_packet(const Sink *s, const uint8_t *packet, const uint16_t len, const uint32_t packet_number,
+                         size_t *next) {
+
+    // Header length matches the bytes sent
+    FUZZ_CHECK(len % 4 == 0 && len <= s->cfg.max_size);
+
+    PacketHeader h;
+    FUZZ_CHECK(header_decode(&header_decoder, packet, &h) == packet_header_size(packet));
+    FUZZ_CHECK(h.packet_num == packet_number);
+    FUZZ_CHECK(!memcmp(h.call_sign, s->header.call_sign, sizeof(h.call_sign)));
+    FUZZ_CHECK(h.src_addr == s->header.src_addr);
+    FUZZ_CHECK(packet_header_get_length(&h) == len - packet_header_size(packet) + sizeof(PacketHeader));
+
+    // Block lengths add up to the packet length, and the sensor blocks are offered blocks in the order offered
+    BlockIterator it;
+    FUZZ_CHECK(block_iter_init(&it, packet, len));
+    const BlockHeader *bh;
+    const uint8_t *payload;
+    int status;
+    size_t blocks = 0;
+    while ((status = block_iter_next(&it, &bh, &payload)) == 1) {
+        blocks++;
+        FUZZ_CHECK(bh->dest_addr == s->cfg.dest);
+        if (bh->subtype == DATA_DBG_MSG) {
+            FUZZ_CHECK(s->cfg.events);
+            check_debug_block(bh, payload);
+            continue;
+        }
+        if (block_header_is_resent(bh)) {
+            check_block((const uint8_t *)bh, block_header_get_length(bh));
+            size_t i = *next;
+            while (i > 0 && !is_offered(bh, i - 1)) i--;
+            FUZZ_CHECK(i > 0);
+            continue;
+        }
+
+        while (*next < n_offered && !is_offered(bh, *next)) (*next)++;
+        FUZZ_CHECK(*next < n_offered);
+        FUZZ_CHECK(offered[*next].tag < SINK_TAGS && (s->cfg.tags & (1u << offered[*next].tag)));
+        (*next)++;
+    }
+    FUZZ_CHECK(status == 0);
+    FUZZ_CHECK(blocks > 0);
+
+    total_packets++;
+}
+
+/**
+ * Checks every packet a sink sent to its file.
+ * @param i The index of the sink.
+ */
+static void check_sink(const uint8_t i) {
+    const Sink *s = &fanout.sinks[i];
+    const int fd = open(paths[i], O_RDONLY);
+    FUZZ_CHECK(fd != -1);
+    struct stat st;
+    FUZZ_CHECK(fstat(fd, &st) == 0);
+    if (st.st_size == 0) {
+        FUZZ_CHECK(s->sent == 0);
+        close(fd);
+        return;
+    }
+    uint8_t *out = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    FUZZ_CHECK(out != MAP_FAILED);
+
+    header_decoder_init(&header_decoder);
+    size_t next = 0;
+    uint32_t packet_number = 0;
+    for (off_t pos = 0; pos < st.st_size; packet_number++) {
+        FUZZ_CHECK(st.st_size - pos >= (off_t)sizeof(CompactPacketHeader));
+        const uint16_t len = packet_get_length(out + pos);
+        FUZZ_CHECK(len <= st.st_size - pos);
+        check_packet(s, out + pos, len, packet_number, &next);
+
+        uint16_t kept_len;
+        const uint8_t *kept = history_find(&s->history, packet_number, &kept_len);
+        FUZZ_CHECK(kept == NULL || (kept_len == len && !memcmp(kept, out + pos, len)));
+        pos += len;
+    }
+    FUZZ_CHECK(packet_number == s->sent);
+
+    munmap(out, st.st_size);
+    close(fd);
+}
+
+/**
+ * Offers the block being encoded to the fan-out like packager does, keeping a copy to check the packets against.
+ * @param size The size of the block in bytes.
+ * @param tag The sensor tag the block was encoded from.
+ */
+static void offer(const uint16_t size, const uint8_t tag) {
+    check_block(block, size);
+    FUZZ_CHECK(n_offered < MAX_OFFERED);
+    memcpy(offered[n_offered].block, block, size);
+    offered[n_offered].size = size;
+    offered[n_offered++].tag = tag;
+    if (fanout_offer(&fanout, block, size, tag, 0, 0, source.mission_time)) event_channel_new_packet(&events);
+}
+
+/**
+ * Processes an input message like packager does: updates the state of the input and encodes the message, the
+ * estimates it completes or both, once for every sink.
+ * @param msg The input message.
+ * @param adaptive Whether adaptive composition is enabled.
+ */
+static void process_message(const common_t *msg, const bool adaptive) {
+    const SourceAction action = source_update(&source, msg, &events, adaptive);
+
+    if (action & SOURCE_ENCODE) {
+        uint16_t size = encode_block(block, msg, source.mission_time);
+        if (size == 0) size = schema_encode(&schema, block, msg, source.mission_time);
+        size = quant_pack(&profile, block, size);
+        if (size == 0) {
+            event_post(&events, EVENT_ERROR, "Unknown input data type", msg->type, source.mission_time);
+        } else {
+            offer(size, msg->type);
+        }
+    }
+
+    if (action & SOURCE_ESTIMATES) {
+        static const uint8_t estimates[] = {TAG_ALTITUDE_FUSED, TAG_VERTICAL_VEL};
+        for (size_t i = 0; i < sizeof(estimates); i++) {
+            const uint16_t encoded = fusion_encode(&source.fusion, block, estimates[i], source.mission_time);
+            offer(quant_pack(&profile, block, encoded), estimates[i]);
+        }
+    }
+}
+
+/**
+ * Fans out the due event and dictionary blocks like packager does.
+ */
+static void emit_events(void) {
+    uint16_t written;
+    while ((written = event_channel_emit(&events, block, fanout_event_room(&fanout), source.mission_time,
+                                         source.mission_time)) != 0) {
+        if (fanout_offer(&fanout, block, written, SINK_TAG_EVENT, 0, 0, source.mission_time)) {
+            event_channel_new_packet(&events);
+        }
+        if (fanout.accepted == 0) event_channel_unsent(&events, block);
+    }
+}
+
+/**
+ * Applies one line of the configuration text of a fuzz input.
+ * @param line The line, without its line break.
+ * @param every The compact header interval of the sinks.
+ */
+static void configure(const char *line, const uint32_t every) {
+    if (!strncmp(line, "quant ", 6)) {
+        quant_parse(&profile, line + 6);
+    } else if (!strncmp(line, "schema ", 7)) {
+        schema_parse(&schema, line + 7);
+    } else if (!strncmp(line, "sink ", 5) && fanout.count < SINKS_MAX) {
+        // The file is named first so that a specification without a target is valid, and whatever target it names
+        // is replaced by the file
+        char spec[sizeof(paths[0]) + 256];
+        snprintf(spec, sizeof(spec), "file=%s,%s", paths[fanout.count], line + 5);
+        SinkConfig cfg;
+        if (!sink_config_parse(&cfg, spec)) return;
+        cfg.kind = SINK_FILE;
+        snprintf(cfg.target, sizeof(cfg.target), "%s", paths[fanout.count]);
+        cfg.print = false;
+        FUZZ_CHECK(truncate(cfg.target, 0) == 0);
+        fanout_add(&fanout, &cfg, every, 0);
+    }
+}
+
+/**
+ * Removes the files of the sinks.
+ */
+static void remove_outputs(void) {
+    for (uint8_t i = 0; i < SINKS_MAX; i++) {
+        if (paths[i][0] != '\0') unlink(paths[i]);
+    }
+}
+
+/**
+ * Creates the files of the sinks on the first run, to be removed on exit.
+ */
+static void create_outputs(void) {
+    if (paths[0][0] != '\0') return;
+    for (uint8_t i = 0; i < SINKS_MAX; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "/tmp/fuzz_packager_XXXXXX");
+        const int fd = mkstemp(paths[i]);
+        FUZZ_CHECK(fd != -1);
+        close(fd);
+    }
+    atexit(remove_outputs);
+}
+
+/**
+ * Runs the decoder over arbitrary bytes as if they were a received packet. The bytes are copied into a buffer of the
+ * exact size, so that the address sanitizer catches any read past the end of the packet.
+ * @param data The received bytes.
+ * @param size The number of received bytes.
+ */
+static void decode_arbitrary(const uint8_t *data, size_t size) {
+    if (size > PACKET_LIMIT_SIZE) size = PACKET_LIMIT_SIZE;
+    if (size == 0) return;
+    uint8_t *packet = malloc(size);
+    FUZZ_CHECK(packet != NULL);
+    memcpy(packet, data, size);
+
+    BlockIterator it;
+    if (block_iter_init(&it, packet, size)) {
+        PacketHeader h;
+        header_decode(&header_decoder, packet, &h);
+
+        const BlockHeader *bh;
+        const uint8_t *payload;
+        uint16_t total = packet_header_size(packet);
+        while (block_iter_next(&it, &bh, &payload) == 1) {
+            total += block_header_get_length(bh);
+            common_t msg;
+            uint32_t mission_time;
+            if (decode_block(bh, payload, &msg, &mission_time)) {
+                FUZZ_CHECK((int16_t)block_header_get_length(bh) == encoded_block_size(msg.type));
+            }
+        }
+        FUZZ_CHECK(total <= size);
+    }
+    free(packet);
+}
+
+/**
+ * Runs one fuzz input through the encode and fan-out path of packager.
+ * @param data The fuzz input: two configuration bytes, the configuration text and its length, then raw input messages.
+ * @param size The size of the input in bytes.
+ * @return Always 0.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size < 2) return 0;
+
+    header_decoder_init(&header_decoder);
+    decode_arbitrary(data, size);
+    create_outputs();
+
+    // The configuration bytes select the packet size of the sink, either any size or one with a specialized builder,
+    // the compact header interval, adaptive composition and the fusion rate
+    static const uint16_t specialized[] = {64, 128, 256, 1024};
+    uint16_t max_size = sizeof(PacketHeader) + ENCODED_BLOCK_MAX_SIZE +
+                        (data[0] % ((PACKET_LIMIT_SIZE - sizeof(PacketHeader) - ENCODED_BLOCK_MAX_SIZE) / 4 + 1)) * 4;
+    if (data[1] & 0x80) max_size = specialized[data[0] % 4];
+    const uint32_t every = data[1] % 8;
+    const bool adaptive = data[1] & 0x08;
+    const uint32_t fusion_rate = (data[1] >> 4) & 0x07;
+    data += 2;
+    size -= 2;
+
+    FUZZ_CHECK(packet_header_template_init(&header, "VA3INI", 1, ROCKET));
+    seqstate_open(&seq, "/nonexistent/directory/packager.seq", 0);
+    arena_init(&arena, memory, sizeof(memory) - GUARD_SIZE);
+    fanout_init(&fanout, &header, &seq, &arena);
+    SinkConfig cfg;
+    char spec[64];
+    snprintf(spec, sizeof(spec), "file=%s,size=%u", paths[0], max_size);
+    FUZZ_CHECK(sink_config_parse(&cfg, spec));
+    FUZZ_CHECK(truncate(paths[0], 0) == 0);
+    FUZZ_CHECK(fanout_add(&fanout, &cfg, every, 0));
+    schema_init(&schema);
+    quant_init(&profile);
+
+    // The configuration text adds sinks, profiles and schema sensors, one per line
+    const size_t text_len = size == 0 ? 0 : data[0] < size - 1 ? data[0] : size - 1;
+    for (size_t pos = 1; pos <= text_len;) {
+        char line[256];
+        size_t n = 0;
+        while (pos <= text_len && data[pos] != '\n') line[n++] = (char)data[pos++];
+        line[n] = '\0';
+        pos++;
+        configure(line, every);
+    }
+    if (size > 0) {
+        data += 1 + text_len;
+        size -= 1 + text_len;
+    }
+    memset(memory + arena.used, GUARD_BYTE, GUARD_SIZE);
+
+    source_init(&source, 0, fusion_rate);
+    event_channel_init(&events, 50, 2, 500);
+    n_offered = 0;
+
+    size_t n_msgs = size / sizeof(common_t);
+    if (n_msgs > MAX_MESSAGES) n_msgs = MAX_MESSAGES;
+    for (size_t i = 0; i < n_msgs; i++) {
+        common_t msg;
+        memcpy(&msg, data + i * sizeof(common_t), sizeof(common_t));
+        total_messages++;
+        if (msg.type == FUZZ_TAG_RESEND) {
+            uint32_t words[3];
+            memcpy(words, &msg.data, sizeof(words));
+            const ResendRequest r = {.sink = msg.id, .first = words[0], .count = words[1], .subtypes = words[2]};
+            fanout_resend(&fanout, &r);
+            continue;
+        }
+        process_message(&msg, adaptive);
+        emit_events();
+    }
+
+    // Closing the fan-out sends the packets still being built
+    const uint8_t sinks = fanout.count;
+    const size_t used = arena.used;
+    fanout_close(&fanout, 0);
+    for (uint8_t i = 0; i < sinks; i++) {
+        check_sink(i);
+    }
+
+    // Nothing written past the memory of the sinks
+    for (size_t i = used; i < used + GUARD_SIZE; i++) {
+        FUZZ_CHECK(memory[i] == GUARD_BYTE);
+    }
+
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+/**
+ * Generates the next pseudo random number.
+ * @param state The generator state, which must not be 0.
+ * @return A pseudo random 32 bit number.
+ */
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * Generates a random reading, occasionally an extreme or non-finite one.
+ * @param state The random generator state.
+ * @return The random reading.
+ */
+static float random_reading(uint32_t *state) {
+    const uint32_t r = xorshift32(state);
+    switch (r % 16) {
+    case 0:
+        return NAN;
+    case 1:
+        return (r & 0x10) ? INFINITY : -INFINITY;
+    case 2:
+        return (r & 0x10) ? 3.0e38f : -3.0e38f;
+    default:
+        return ((int32_t)xorshift32(state) % 2000000) / 100.0f;
+    }
+}
+
+/** Configuration lines the stress run picks from, a few of them invalid. */
+static const char *const stress_config[] = {
+    "sink size=64,rate=2000,history=8",
+    "sink tags=1+4+5+13+17,events=0,dest=255",
+    "sink size=1024,history=16,call=VA3XYZ,src=7,rate=20000",
+    "sink size=16",
+    "quant 0x03 0:3600000/10 -40000:85000/100",
+    "quant 0x06 0:3600000/10 -16000:16000/10 -16000:16000/10 -16000:16000/10",
+    "quant 0x0c 0:3600000/10 -100000:100000/10",
+    "quant 0x04 0:1000 0:100/101",
+    "schema 0x11 0x20 f32:i32*1000",
+    "schema 0x0e 0x21 id:u8 i16:i16 f32:u16*10",
+    "schema 0x05 0x22 f32:i32",
+};
+
+/**
+ * Runs randomly generated inputs through the harness and reports the throughput.
+ * @param iterations The number of random inputs to run.
+ */
+static void stress(const unsigned long iterations) {
+    static uint8_t input[3 + UINT8_MAX + 512 * sizeof(common_t)];
+    uint32_t state = 0x12345678;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (unsigned long i = 0; i < iterations; i++) {
+        const size_t n = xorshift32(&state) % 512;
+        input[0] = xorshift32(&state);
+        input[1] = xorshift32(&state);
+
+        // Each configuration line is picked half of the time, as long as the text fits its length byte
+        size_t text_len = 0;
+        for (size_t c = 0; c < sizeof(stress_config) / sizeof(stress_config[0]); c++) {
+            const size_t len = strlen(stress_config[c]);
+            if (xorshift32(&state) % 2 || text_len + len + 1 > UINT8_MAX) continue;
+            memcpy(input + 3 + text_len, stress_config[c], len);
+            input[3 + text_len + len] = '\n';
+            text_len += len + 1;
+        }
+        input[2] = text_len;
+        uint8_t *msgs = input + 3 + text_len;
+
+        for (size_t m = 0; m < n; m++) {
+            common_t msg = {0};
+            // Mostly valid and schema tags, sometimes unknown ones and resend requests
+            msg.type = xorshift32(&state) % 32 == 0 ? FUZZ_TAG_RESEND : xorshift32(&state) % (SCHEMA_TAGS / 2 + 2);
+            msg.id = xorshift32(&state);
+            if (msg.type == TAG_TIME || msg.type == TAG_COORDS || msg.type == TAG_VOLTAGE || msg.type == TAG_FIX) {
+                msg.data.VEC2D_I32.x = xorshift32(&state);
+                msg.data.VEC2D_I32.y = xorshift32(&state);
+                if (msg.type == TAG_FIX) msg.data.U8 %= 4;
+            } else if (msg.type == FUZZ_TAG_RESEND) {
+                msg.id %= 4;
+                msg.data.VEC2D_I32.x = xorshift32(&state) % 64;
+                msg.data.VEC2D_I32.y = xorshift32(&state) % 4;
+                const uint32_t subtypes = xorshift32(&state) % 2 ? RESEND_ALL_SUBTYPES : 1u << DATA_DBG_MSG;
+                memcpy(&msg.data.VEC3D.z, &subtypes, sizeof(subtypes));
+            } else {
+                msg.data.VEC3D = (vec3d_t){random_reading(&state), random_reading(&state), random_reading(&state)};
+            }
+            memcpy(msgs + m * sizeof(common_t), &msg, sizeof(msg));
+        }
+        LLVMFuzzerTestOneInput(input, 3 + text_len + n * sizeof(common_t));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%lu inputs, %zu messages, %zu packets in %.3f s: %.0f messages/s, %.0f packets/s (checks included)\n",
+           iterations, total_messages, total_packets, secs, total_messages / secs, total_packets / secs);
+}
+
+/**
+ * Runs the harness on each file given as an argument, on standard input if there are none (for AFL), or a stress run
+ * with `-s <iterations>`.
+ */
+int main(int argc, char **argv) {
+    static uint8_t input[1 << 20];
+
+    if (argc == 3 && !strcmp(argv[1], "-s")) {
+        stress(strtoul(argv[2], NULL, 10));
+        return EXIT_SUCCESS;
+    }
+
+    if (argc < 2) {
+        size_t n = fread(input, 1, sizeof(input), stdin);
+        LLVMFuzzerTestOneInput(input, n);
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            fprintf(stderr, "Could not open '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        size_t n = fread(input, 1, sizeof(input), f);
+        fclose(f);
+        LLVMFuzzerTestOneInput(input, n);
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif // FUZZ_LIBFUZZER
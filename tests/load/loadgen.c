@@ -0,0 +1,478 @@
+/**
+ * @file loadgen.c
+ * @brief Synthetic fetcher: pushes input messages into packager's input queue at a controlled rate and tag mix, and
+ * reads the packets from packager's output queue to measure end-to-end latency, drop rate and the highest sustainable
+ * input rate.
+ *
+ * Runs on any Linux box with POSIX message queues (the input queue depth needs /proc/sys/fs/mqueue/msg_max to be at
+ * least 30). Build with `make -f test.mk load` and start packager reading from the queues that loadgen creates within
+ * its start up delay, for example:
+ *
+ *     ./tests/load/loadgen -q /fetcher-sensors -o /packager-out -P imu -S &
+ *     ./packager -Q /fetcher-sensors -o mq=/packager-out VA3ZZZ
+ *
+ * Every PROBE_EVERY messages one is a latency probe: a coordinate reading carrying its send time, which is outside the
+ * range of real coordinates. After each run, filler readings are sent to push the last partly filled packets out.
+ */
+#include "../../src/decoder.h"
+#include "../../src/intypes.h"
+#include "../../src/packet_types.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/** The depth of the input queue, as fetcher creates it. */
+#define INPUT_DEPTH 30
+
+/** One in this many messages is a latency probe. */
+#define PROBE_EVERY 16
+
+/** One in this many messages is a time message. */
+#define TIME_EVERY 10
+
+/** The high byte of the latitude of a latency probe, which no real latitude has. */
+#define PROBE_MARKER 0x7F
+
+/** The sensor ID of filler readings, which are not counted. */
+#define FILLER_ID 0xEE
+
+/** The depth of the output queue, as packager creates it by default. */
+#define OUTPUT_DEPTH 15
+
+/** How long filler readings are sent after each run, in milliseconds. */
+#define FLUSH_MS 500
+
+/** The most latency samples kept per run. */
+#define MAX_SAMPLES (1 << 20)
+
+/** The most messages loaded from a recorded profile. */
+#define MAX_RECORDED 100000
+
+/** Runs with more than this fraction of blocks lost are not sustainable. */
+#define SUSTAINABLE_LOSS 0.001
+
+/** A tag mix to generate. */
+typedef struct {
+    /** The name of the profile. */
+    const char *name;
+    /** The tags to send, in a repeating pattern. */
+    const uint8_t *pattern;
+    /** The length of the pattern. */
+    size_t len;
+    /** For bursty loads, how long each burst lasts in milliseconds, or 0 for a steady load. */
+    uint32_t burst_ms;
+    /** For bursty loads, how long the pause after each burst lasts in milliseconds. */
+    uint32_t pause_ms;
+} Profile;
+
+/** Accelerometer and gyroscope readings at high rates, with some barometer readings. */
+static const uint8_t imu_pattern[] = {
+    TAG_LINEAR_ACCEL_REL, TAG_ANGULAR_VEL,  TAG_LINEAR_ACCEL_REL, TAG_ANGULAR_VEL, TAG_LINEAR_ACCEL_ABS,
+    TAG_LINEAR_ACCEL_REL, TAG_ANGULAR_VEL,  TAG_ALTITUDE_REL,     TAG_PRESSURE,    TAG_TEMPERATURE,
+};
+
+/** Position readings, with fix changes and housekeeping. */
+static const uint8_t gps_pattern[] = {
+    TAG_COORDS, TAG_ALTITUDE_SEA, TAG_COORDS, TAG_FIX, TAG_VOLTAGE, TAG_COORDS, TAG_ALTITUDE_SEA, TAG_HUMIDITY,
+};
+
+/** The built in profiles. The bursty profile sends the IMU mix at five times the rate for a fifth of the time. */
+static const Profile profiles[] = {
+    {"imu", imu_pattern, sizeof(imu_pattern), 0, 0},
+    {"gps", gps_pattern, sizeof(gps_pattern), 0, 0},
+    {"bursty", imu_pattern, sizeof(imu_pattern), 50, 200},
+};
+
+/** Messages of a recorded profile, replayed in a loop. */
+static common_t recorded[MAX_RECORDED];
+
+/** The number of messages of the recorded profile. */
+static size_t n_recorded;
+
+/** Results of one run. */
+typedef struct {
+    /** The number of messages sent. */
+    uint64_t sent;
+    /** The number of messages rejected because the input queue was full. */
+    uint64_t full;
+    /** The number of blocks the sent messages should become. */
+    uint64_t blocks_sent;
+    /** The number of blocks lost because the input queue was full. */
+    uint64_t blocks_full;
+    /** The number of blocks received, not counting fillers. */
+    uint64_t blocks_received;
+    /** The number of packets received. */
+    uint64_t packets;
+    /** The time the messages were sent over, in seconds. */
+    double elapsed;
+    /** Latencies of the received probes, in microseconds. */
+    uint32_t *latencies;
+    /** The number of received probes. */
+    size_t n_latencies;
+} RunResult;
+
+/** The input queue. */
+static mqd_t in_q;
+
+/** The output queue. */
+static mqd_t out_q;
+
+/** Tells the receiver thread to stop. */
+static atomic_bool stop_receiving;
+
+/** Sequence number of the next input message. */
+static uint16_t next_seq;
+
+/**
+ * Gets the current time from the monotonic clock.
+ * @return The time in microseconds.
+ */
+static uint64_t now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+/**
+ * Sleeps until the given monotonic time.
+ * @param us The time to wake up at, in microseconds.
+ */
+static void sleep_until(const uint64_t us) {
+    const struct timespec t = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+        ;
+}
+
+/**
+ * Generates a plausible reading for a tag.
+ * @param msg The message to fill in.
+ * @param tag The tag of the reading.
+ * @param i The index of the message, which the reading varies with.
+ */
+static void make_reading(common_t *msg, const uint8_t tag, const uint64_t i) {
+    const float x = (float)(i % 1000) / 10.0f;
+    memset(msg, 0, sizeof(*msg));
+    msg->type = tag;
+    switch (tag) {
+    case TAG_LINEAR_ACCEL_REL:
+    case TAG_LINEAR_ACCEL_ABS:
+    case TAG_ANGULAR_VEL:
+        msg->data.VEC3D = (vec3d_t){x, -x, 9.81f + x};
+        break;
+    case TAG_COORDS:
+        msg->data.VEC2D_I32 = (vec2d_i32_t){453838000 + (int32_t)(i % 1000), -756954000};
+        break;
+    case TAG_VOLTAGE:
+        msg->id = 1;
+        msg->data.I16 = 3700 + (int16_t)(i % 100);
+        break;
+    case TAG_FIX:
+        msg->data.U8 = 3;
+        break;
+    default:
+        msg->data.FLOAT = 100.0f + x;
+        break;
+    }
+}
+
+/**
+ * Sends a message to the input queue without blocking, stamping it with the next sequence number.
+ * @param msg The message.
+ * @param r The results of the run, or NULL if the message is not counted.
+ */
+static void send_msg(common_t *msg, RunResult *r) {
+    msg->seq = next_seq++;
+    const bool sent = mq_send(in_q, (const char *)msg, sizeof(*msg), 0) == 0;
+    if (r == NULL || (!sent && errno != EAGAIN)) return;
+
+    const bool block = msg->type != TAG_TIME && msg->type != TAG_FIX;
+    if (sent) {
+        r->sent++;
+        r->blocks_sent += block;
+    } else {
+        r->full++;
+        r->blocks_full += block;
+    }
+}
+
+/**
+ * Receives packets from the output queue until told to stop, counting the blocks and recording probe latencies.
+ * @param arg The results of the run.
+ * @return NULL.
+ */
+static void *receive(void *arg) {
+    RunResult *r = arg;
+    uint8_t packet[PACKET_LIMIT_SIZE];
+
+    while (!atomic_load(&stop_receiving)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 50000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        const ssize_t n = mq_timedreceive(out_q, (char *)packet, sizeof(packet), NULL, &deadline);
+        if (n <= 0) continue;
+        const uint32_t received = (uint32_t)now_us();
+
+        BlockIterator it;
+        if (!block_iter_init(&it, packet, n)) continue;
+        r->packets++;
+        const BlockHeader *h;
+        const uint8_t *payload;
+        while (block_iter_next(&it, &h, &payload) == 1) {
+            common_t msg;
+            uint32_t mission_time;
+            if (!decode_block(h, payload, &msg, &mission_time)) continue; // Events
+            if (msg.type == TAG_VOLTAGE && msg.id == FILLER_ID) continue;
+            r->blocks_received++;
+            if (msg.type == TAG_COORDS && (uint32_t)msg.data.VEC2D_I32.x >> 24 == PROBE_MARKER &&
+                r->n_latencies < MAX_SAMPLES) {
+                r->latencies[r->n_latencies++] = received - (uint32_t)msg.data.VEC2D_I32.y;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Sends messages of a profile at a rate for a while, then filler readings to flush packager's packets.
+ * @param p The profile, or NULL for the recorded profile.
+ * @param rate The average number of messages per second.
+ * @param duration_s How long to send for, in seconds.
+ * @param r Where to store the results.
+ */
+static void run(const Profile *p, const double rate, const double duration_s, RunResult *r) {
+    uint32_t *latencies = r->latencies;
+    memset(r, 0, sizeof(*r));
+    r->latencies = latencies;
+
+    // Discard packets left over from a previous run
+    uint8_t packet[PACKET_LIMIT_SIZE];
+    struct mq_attr attr = {.mq_flags = O_NONBLOCK}, old;
+    mq_setattr(out_q, &attr, &old);
+    while (mq_receive(out_q, (char *)packet, sizeof(packet), NULL) >= 0)
+        ;
+    mq_setattr(out_q, &old, NULL);
+
+    pthread_t receiver;
+    atomic_store(&stop_receiving, false);
+    pthread_create(&receiver, NULL, receive, r);
+
+    // Bursts send at a higher rate so that the average rate is as requested
+    const uint32_t cycle_us = p != NULL ? (p->burst_ms + p->pause_ms) * 1000 : 0;
+    const double burst_rate = cycle_us != 0 ? rate * (p->burst_ms + p->pause_ms) / p->burst_ms : rate;
+    const double period_us = 1e6 / burst_rate;
+
+    const uint64_t start = now_us();
+    const uint64_t end = start + (uint64_t)(duration_s * 1e6);
+    double next = start;
+    common_t msg;
+    for (uint64_t i = 0;; i++) {
+        // Skip over the pause at the end of each burst
+        if (cycle_us != 0 && ((uint64_t)next - start) % cycle_us >= p->burst_ms * 1000u) {
+            next += cycle_us - ((uint64_t)next - start) % cycle_us;
+        }
+        if ((uint64_t)next >= end) break;
+        if ((uint64_t)next > now_us() + 100) sleep_until((uint64_t)next);
+        next += period_us;
+
+        const uint64_t t = now_us();
+        if (i % TIME_EVERY == 0) {
+            msg = (common_t){.type = TAG_TIME, .data.U32 = (t - start) / 1000};
+            send_msg(&msg, r);
+        } else if (i % PROBE_EVERY == 1) {
+            msg = (common_t){.type = TAG_COORDS};
+            msg.data.VEC2D_I32 = (vec2d_i32_t){(int32_t)((PROBE_MARKER << 24) | (i & 0xFFFFFF)), (int32_t)(uint32_t)t};
+            send_msg(&msg, r);
+        } else if (p == NULL) {
+            msg = recorded[i % n_recorded];
+            send_msg(&msg, r);
+        } else {
+            make_reading(&msg, p->pattern[i % p->len], i);
+            send_msg(&msg, r);
+        }
+    }
+    r->elapsed = (now_us() - start) / 1e6;
+
+    // Push out the packets still being built without counting the filler
+    const uint64_t flush_end = now_us() + FLUSH_MS * 1000;
+    while (now_us() < flush_end) {
+        msg = (common_t){.type = TAG_VOLTAGE, .id = FILLER_ID};
+        send_msg(&msg, NULL);
+        sleep_until(now_us() + 1000);
+    }
+
+    atomic_store(&stop_receiving, true);
+    pthread_join(receiver, NULL);
+}
+
+/**
+ * Compares two latencies for sorting.
+ * @param a The first latency.
+ * @param b The second latency.
+ * @return The order of the latencies.
+ */
+static int compare_latency(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Gets the fraction of the blocks sent that were not received.
+ * @param r The results of a run.
+ * @return The fraction of blocks lost, including messages rejected by a full input queue.
+ */
+static double loss(const RunResult *r) {
+    const uint64_t offered = r->blocks_sent + r->blocks_full;
+    if (offered == 0) return 0.0;
+    return r->blocks_received >= offered ? 0.0 : 1.0 - (double)r->blocks_received / offered;
+}
+
+/**
+ * Prints the results of a run.
+ * @param rate The requested rate in messages per second.
+ * @param r The results of the run.
+ */
+static void report(const double rate, RunResult *r) {
+    printf("%9.0f msg/s requested, %9.0f sent: %8llu messages, %6llu input queue full, %8llu/%8llu blocks received "
+           "(%.3f%% lost), %6llu packets\n",
+           rate, r->sent / r->elapsed, (unsigned long long)r->sent, (unsigned long long)r->full,
+           (unsigned long long)r->blocks_received, (unsigned long long)r->blocks_sent, loss(r) * 100.0,
+           (unsigned long long)r->packets);
+    if (r->n_latencies == 0) {
+        puts("          no latency probes received");
+        return;
+    }
+    qsort(r->latencies, r->n_latencies, sizeof(uint32_t), compare_latency);
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    printf("          latency us:");
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        printf(" p%g %u", percentiles[i] * 100.0, r->latencies[(size_t)(percentiles[i] * (r->n_latencies - 1))]);
+    }
+    printf(" max %u (%zu probes)\n", r->latencies[r->n_latencies - 1], r->n_latencies);
+}
+
+/**
+ * Loads a recorded profile: input messages back to back, as packager replays them with -i.
+ * @param path The file of recorded messages.
+ * @return True if at least one message was loaded.
+ */
+static bool load_recorded(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    n_recorded = fread(recorded, sizeof(common_t), MAX_RECORDED, f);
+    fclose(f);
+    return n_recorded > 0;
+}
+
+/**
+ * Prints the usage of the tool.
+ * @param name The name the tool was run as.
+ */
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-q input queue] [-o output queue] [-P imu|gps|bursty|FILE] [-r messages/s] [-d seconds]\n"
+            "          [-w seconds] [-S]\n"
+            "  -w  wait this long for packager to start before the first run (default 1)\n"
+            "  -S  sweep the rate up from -r until the load is no longer sustained\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    const char *in_name = "/fetcher-sensors";
+    const char *out_name = "/packager-out";
+    const Profile *profile = &profiles[0];
+    double rate = 1000.0;
+    double duration = 5.0;
+    double wait = 1.0;
+    bool sweep = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "q:o:P:r:d:w:S")) != -1) {
+        switch (c) {
+        case 'q':
+            in_name = optarg;
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        case 'P':
+            profile = NULL;
+            for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+                if (!strcmp(optarg, profiles[i].name)) profile = &profiles[i];
+            }
+            if (profile == NULL && !load_recorded(optarg)) {
+                fprintf(stderr, "Unknown profile or unreadable recording '%s'.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            rate = strtod(optarg, NULL);
+            break;
+        case 'd':
+            duration = strtod(optarg, NULL);
+            break;
+        case 'w':
+            wait = strtod(optarg, NULL);
+            break;
+        case 'S':
+            sweep = true;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (rate <= 0.0 || duration <= 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Create the queues like fetcher and packager do, so that either side can start first
+    struct mq_attr in_attr = {.mq_maxmsg = INPUT_DEPTH, .mq_msgsize = sizeof(common_t)};
+    struct mq_attr out_attr = {.mq_maxmsg = OUTPUT_DEPTH, .mq_msgsize = PACKET_LIMIT_SIZE};
+    in_q = mq_open(in_name, O_CREAT | O_WRONLY | O_NONBLOCK, S_IRUSR | S_IWUSR, &in_attr);
+    out_q = mq_open(out_name, O_CREAT | O_RDONLY, S_IRUSR | S_IWUSR | S_IWOTH, &out_attr);
+    if (in_q == (mqd_t)-1 || out_q == (mqd_t)-1) {
+        fprintf(stderr, "Could not open %s: %s\n", in_q == (mqd_t)-1 ? in_name : out_name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    sleep_until(now_us() + (uint64_t)(wait * 1e6));
+
+    RunResult r = {.latencies = malloc(MAX_SAMPLES * sizeof(uint32_t))};
+    if (r.latencies == NULL) return EXIT_FAILURE;
+    printf("Profile %s, %g s per run, input queue depth %d\n", profile != NULL ? profile->name : "recorded", duration,
+           INPUT_DEPTH);
+
+    if (!sweep) {
+        run(profile, rate, duration, &r);
+        report(rate, &r);
+    } else {
+        // Raise the rate by half each run until messages are lost or the sender cannot keep up
+        double sustained = 0.0;
+        for (;; rate *= 1.5) {
+            run(profile, rate, duration, &r);
+            report(rate, &r);
+            if (loss(&r) > SUSTAINABLE_LOSS || r.sent / r.elapsed < rate * 0.95) break;
+            sustained = r.sent / r.elapsed;
+        }
+        printf("Max sustainable input rate: %.0f msg/s\n", sustained);
+    }
+
+    free(r.latencies);
+    mq_close(in_q);
+    mq_close(out_q);
+    return EXIT_SUCCESS;
+}
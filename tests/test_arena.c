@@ -0,0 +1,165 @@
+/**
+ * @file test_arena.c
+ * @brief Tests allocating subsystem buffers from the startup arena, and that steady-state operation never allocates.
+ */
+#include "../src/arena.h"
+#include "../src/encoder.h"
+#include "../src/reorder.h"
+#include "../src/sink.h"
+#include <errno.h>
+#include <string.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+#endif
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+#include "fixtures.h"
+
+/** Reorder buffer used by the tests. */
+static ReorderBuffer r;
+
+/** Arena used by the tests. */
+static Arena arena;
+
+/** Memory for arenas over caller owned memory. */
+static _Alignas(ARENA_ALIGN) uint8_t memory[256];
+
+/**
+ * Gets the number of bytes allocated from the heap.
+ * @return The bytes in use, or 0 where the C library does not report it.
+ */
+static size_t heap_in_use(void) {
+#ifdef HAVE_MALLINFO2
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Test that allocations are aligned, zeroed, counted per subsystem and refused once the arena is full or sealed.
+ */
+bool test_alloc(void) {
+
+    memset(memory, 0xFF, sizeof(memory));
+    arena_init(&arena, memory, sizeof(memory));
+
+    uint8_t *a = arena_alloc(&arena, 1, "sinks");
+    uint8_t *b = arena_alloc(&arena, 20, "history");
+    uint8_t *c = arena_alloc(&arena, 16, "sinks");
+    LOG_ASSERT(a == memory && b == memory + 16 && c == memory + 48);
+    LOG_ASSERT(b[0] == 0 && b[31] == 0);
+    LOG_ASSERT(arena.used == 64);
+
+    LOG_ASSERT(arena.n_owners == 2);
+    LOG_ASSERT(!strcmp(arena.owners[0].name, "sinks"));
+    LOG_ASSERT(arena.owners[0].bytes == 32 && arena.owners[0].allocations == 2);
+    LOG_ASSERT(arena.owners[1].bytes == 32 && arena.owners[1].allocations == 1);
+
+    LOG_ASSERT(arena_alloc(&arena, sizeof(memory) - 64 + 1, "reorder") == NULL);
+    LOG_ASSERT(arena_alloc(&arena, sizeof(memory) - 64, "reorder") != NULL);
+    LOG_ASSERT(arena.used == sizeof(memory));
+    LOG_ASSERT(arena.refused == 1);
+
+    arena_init(&arena, memory, sizeof(memory));
+    arena_seal(&arena);
+    LOG_ASSERT(arena_alloc(&arena, 1, "sinks") == NULL);
+    LOG_ASSERT(arena.refused == 1 && arena.used == 0);
+
+    return true;
+}
+
+/**
+ * Test that an arena sized from the footprints of the configuration fits exactly the buffers of the subsystems, and
+ * that a sink that does not fit is not added.
+ */
+bool test_footprint(void) {
+
+    SinkConfig cfgs[2];
+    LOG_ASSERT(sink_config_parse(&cfgs[0], "file=/dev/null,size=250,history=16"));
+    LOG_ASSERT(sink_config_parse(&cfgs[1], "file=/dev/null,size=64"));
+    const size_t footprint = reorder_footprint(12) + sink_footprint(&cfgs[0]) + sink_footprint(&cfgs[1]);
+    LOG_ASSERT(footprint == arena_round(12 * sizeof(ReorderEntry)) + 256 + 16 * 248 + 64);
+
+    LOG_ASSERT(arena_open(&arena, footprint));
+    fixture_fanout(&arena);
+    LOG_ASSERT(fanout_add(&f, &cfgs[0], 0, 0));
+    LOG_ASSERT(fanout_add(&f, &cfgs[1], 0, 0));
+    LOG_ASSERT(reorder_init(&r, 12, 20, &arena));
+    LOG_ASSERT(arena.used == arena.size);
+
+    errno = 0;
+    LOG_ASSERT(!fanout_add(&f, &cfgs[1], 0, 0));
+    LOG_ASSERT(errno == ENOMEM);
+    LOG_ASSERT(f.count == 2);
+
+    fanout_close(&f, 0);
+    arena_close(&arena);
+    LOG_ASSERT(arena.base == NULL && arena.size == 0);
+
+    return true;
+}
+
+/**
+ * Test that reordering, encoding, fanning out, sending and resending input messages once startup is over neither
+ * allocates from the arena nor from the heap.
+ */
+bool test_steady_state_does_not_allocate(void) {
+
+    SinkConfig cfgs[2];
+    LOG_ASSERT(sink_config_parse(&cfgs[0], "file=/dev/null,size=128,history=32"));
+    LOG_ASSERT(sink_config_parse(&cfgs[1], "file=/dev/null,size=1024,rate=2000,tags=1+4"));
+    LOG_ASSERT(arena_open(&arena, reorder_footprint(16) + sink_footprint(&cfgs[0]) + sink_footprint(&cfgs[1])));
+    fixture_fanout(&arena);
+    LOG_ASSERT(fanout_add(&f, &cfgs[0], 4, 0));
+    LOG_ASSERT(fanout_add(&f, &cfgs[1], 0, 0));
+    LOG_ASSERT(reorder_init(&r, 16, 20, &arena));
+    arena_seal(&arena);
+    const size_t used = arena.used;
+
+    static const uint8_t tags[] = {TAG_TIME, TAG_ALTITUDE_REL, TAG_TEMPERATURE, TAG_PRESSURE, TAG_ALTITUDE_SEA};
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    size_t heap = 0;
+    for (uint32_t i = 0; i < 20000; i++) {
+        if (i == 1000) heap = heap_in_use(); // Only measure once every path has been taken at least once
+
+        // Swap neighbouring messages so that the reorder buffer has to hold some
+        const common_t in = {.type = tags[i % sizeof(tags)], .seq = i ^ 1, .data.FLOAT = i * 0.5f};
+        reorder_push(&r, &in, 0, i);
+        common_t msg;
+        unsigned int priority;
+        while (reorder_pop(&r, &msg, &priority, i, false)) {
+            const uint16_t n = encode_block(block, &msg, i);
+            if (n != 0) fanout_offer(&f, block, n, msg.type, 0, priority, i);
+        }
+        if (i % 64 == 0) fanout_resend(&f, &(ResendRequest){.sink = 0, .count = 0, .subtypes = RESEND_ALL_SUBTYPES});
+    }
+
+    LOG_ASSERT(f.sinks[0].sent > 1000 && f.sinks[1].sent > 0 && f.sinks[0].history.dropped > 0);
+    LOG_ASSERT(arena.used == used && arena.refused == 0);
+    LOG_ASSERT(heap_in_use() == heap);
+
+    fanout_close(&f, 0);
+    arena_close(&arena);
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_alloc);
+    RUN_TEST(test_footprint);
+    RUN_TEST(test_steady_state_does_not_allocate);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file test_encoder.c
+ * @brief Tests encoding input messages as blocks, the packet builder and decoding received packets.
+ */
+#include "../src/decoder.h"
+#include "../src/encoder.h"
+#include "../src/header.h"
+#include "../src/packet_types.h"
+#include <math.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/**
+ * Test that readings outside the range of the fixed point fields saturate instead of wrapping, and NaN becomes 0.
+ */
+bool test_saturation(void) {
+
+    uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+    common_t msg = {.type = TAG_ALTITUDE_SEA, .data.FLOAT = 1e12f};
+    LOG_ASSERT(encode_block(buf, &msg, 0) == sizeof(BlockHeader) + sizeof(AltitudeDB));
+    LOG_ASSERT(((AltitudeDB *)(buf + sizeof(BlockHeader)))->altitude == INT32_MAX);
+
+    msg.data.FLOAT = -1e12f;
+    encode_block(buf, &msg, 0);
+    LOG_ASSERT(((AltitudeDB *)(buf + sizeof(BlockHeader)))->altitude == INT32_MIN);
+
+    msg.data.FLOAT = NAN;
+    encode_block(buf, &msg, 0);
+    LOG_ASSERT(((AltitudeDB *)(buf + sizeof(BlockHeader)))->altitude == 0);
+
+    msg = (common_t){.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {.x = 1000.0f, .y = -1000.0f, .z = NAN}};
+    encode_block(buf, &msg, 0);
+    AccelerationDB *a = (AccelerationDB *)(buf + sizeof(BlockHeader));
+    LOG_ASSERT(a->x == INT16_MAX);
+    LOG_ASSERT(a->y == INT16_MIN);
+    LOG_ASSERT(a->z == 0);
+
+    // Humidity is unsigned
+    msg = (common_t){.type = TAG_HUMIDITY, .data.FLOAT = -5.0f};
+    encode_block(buf, &msg, 0);
+    LOG_ASSERT(((HumidityDB *)(buf + sizeof(BlockHeader)))->humidity == 0);
+
+    return true;
+}
+
+/**
+ * Test that every kind of block decodes back to the message it was encoded from.
+ */
+bool test_round_trip(void) {
+
+    const common_t msgs[] = {
+        {.type = TAG_TEMPERATURE, .data.FLOAT = 21.5f},
+        {.type = TAG_PRESSURE, .data.FLOAT = 101.325f},
+        {.type = TAG_HUMIDITY, .data.FLOAT = 45.25f},
+        {.type = TAG_ALTITUDE_SEA, .data.FLOAT = 1234.5f},
+        {.type = TAG_ALTITUDE_REL, .data.FLOAT = -3.25f},
+        {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {.x = 1.5f, .y = -9.75f, .z = 0.25f}},
+        {.type = TAG_ANGULAR_VEL, .data.VEC3D = {.x = 12.5f, .y = -0.5f, .z = 300.0f}},
+        {.type = TAG_COORDS, .data.VEC2D_I32 = {.x = 453838000, .y = -756954000}},
+        {.type = TAG_VOLTAGE, .id = 3, .data.I16 = 3700},
+    };
+
+    for (size_t i = 0; i < sizeof(msgs) / sizeof(msgs[0]); i++) {
+        uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+        const uint16_t n = encode_block(buf, &msgs[i], 1000 + i);
+        LOG_ASSERT(n == encoded_block_size(msgs[i].type));
+        LOG_ASSERT(n == block_header_get_length((BlockHeader *)buf));
+
+        common_t out;
+        uint32_t mission_time;
+        LOG_ASSERT(decode_block((BlockHeader *)buf, buf + sizeof(BlockHeader), &out, &mission_time));
+        LOG_ASSERT(out.type == msgs[i].type);
+        LOG_ASSERT(mission_time == 1000 + i);
+        LOG_ASSERT(!memcmp(&out.data, &msgs[i].data, sizeof(out.data)));
+        LOG_ASSERT(out.id == msgs[i].id);
+    }
+
+    // Time and fix messages do not produce blocks
+    uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+    common_t msg = {.type = TAG_TIME};
+    LOG_ASSERT(encode_block(buf, &msg, 0) == 0);
+    LOG_ASSERT(encoded_block_size(0xEE) == -1);
+
+    return true;
+}
+
+/**
+ * Test that the packet builder fills a packet exactly to its maximum size without writing past it, and keeps the
+ * length in the packet header in sync.
+ */
+bool test_builder_exact_fit(void) {
+
+    // One guard word after the maximum packet size
+    uint8_t buf[64 + 4];
+    memset(buf, 0xA5, sizeof(buf));
+
+    PacketHeaderTemplate t;
+    LOG_ASSERT(packet_header_template_init(&t, "VA3ZZZ", 1, 0));
+    PacketBuilder b;
+    packet_builder_init(&b, buf, 66);
+    LOG_ASSERT(b.max_size == 64);
+
+    packet_builder_start(&b, &t, false, 0);
+    LOG_ASSERT(packet_builder_empty(&b));
+    LOG_ASSERT(b.len == sizeof(PacketHeader));
+
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 1.0f};
+    const common_t coords = {.type = TAG_COORDS};
+    while (packet_builder_add(&b, &alt, 0))
+        ;
+    LOG_ASSERT(b.len <= b.max_size);
+    LOG_ASSERT(packet_builder_room(&b) < encoded_block_size(TAG_ALTITUDE_REL));
+    LOG_ASSERT(!packet_builder_add(&b, &coords, 0));
+    LOG_ASSERT(packet_get_length(buf) == b.len);
+
+    for (size_t i = 64; i < sizeof(buf); i++) {
+        LOG_ASSERT(buf[i] == 0xA5);
+    }
+
+    // Messages without blocks are always accepted
+    const common_t time = {.type = TAG_TIME};
+    LOG_ASSERT(packet_builder_add(&b, &time, 0));
+
+    return true;
+}
+
+/**
+ * Test that built packets can be iterated and that malformed packets are rejected without reading past their end.
+ */
+bool test_iterate_and_reject(void) {
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    PacketHeaderTemplate t;
+    LOG_ASSERT(packet_header_template_init(&t, "VA3ZZZ", 1, 0));
+    PacketBuilder b;
+    packet_builder_init(&b, buf, sizeof(buf));
+    packet_builder_start(&b, &t, true, 7);
+
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 20.0f};
+    const common_t volt = {.type = TAG_VOLTAGE, .id = 1, .data.I16 = 5000};
+    LOG_ASSERT(packet_builder_add(&b, &temp, 10));
+    LOG_ASSERT(packet_builder_add(&b, &volt, 20));
+
+    BlockIterator it;
+    const BlockHeader *h;
+    const uint8_t *payload;
+    LOG_ASSERT(block_iter_init(&it, buf, b.len));
+    LOG_ASSERT(block_iter_next(&it, &h, &payload) == 1);
+    LOG_ASSERT(h->subtype == DATA_TEMP);
+    LOG_ASSERT(block_iter_next(&it, &h, &payload) == 1);
+    LOG_ASSERT(h->subtype == DATA_VOLTAGE);
+    LOG_ASSERT(block_iter_next(&it, &h, &payload) == 0);
+
+    // Received length does not match the header, or is not a multiple of 4
+    LOG_ASSERT(!block_iter_init(&it, buf, b.len - 4));
+    LOG_ASSERT(!block_iter_init(&it, buf, b.len + 2));
+    LOG_ASSERT(!block_iter_init(&it, buf, 2));
+
+    // Block claims to be longer than what is left of the packet
+    BlockHeader *last = (BlockHeader *)(buf + b.len - encoded_block_size(TAG_VOLTAGE));
+    last->len += 1;
+    LOG_ASSERT(block_iter_init(&it, buf, b.len));
+    LOG_ASSERT(block_iter_next(&it, &h, &payload) == 1);
+    LOG_ASSERT(block_iter_next(&it, &h, &payload) == -1);
+
+    // Sensor block with the wrong length for its sub-type is not decoded
+    common_t out;
+    uint32_t mission_time;
+    LOG_ASSERT(!decode_block(last, (uint8_t *)(last + 1), &out, &mission_time));
+
+    return true;
+}
+
+/**
+ * Test that the builders specialized for the common sizes fill packets exactly like the generic one, including the
+ * smaller limit of the largest compact packets.
+ */
+bool test_specialized_builders(void) {
+
+    static uint8_t generic_buf[PACKET_LIMIT_SIZE];
+    static uint8_t specialized_buf[PACKET_LIMIT_SIZE];
+    PacketHeaderTemplate t;
+    LOG_ASSERT(packet_header_template_init(&t, "VA3ZZZ", 1, 0));
+
+    const uint16_t sizes[] = {64, 100, 128, 256, 1024};
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t coords = {.type = TAG_COORDS};
+    const uint16_t n = encode_block(block, &coords, 0);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int compact = 0; compact < 2; compact++) {
+            PacketBuilder generic, specialized;
+            packet_builder_init(&generic, generic_buf, sizes[i]);
+            packet_builder_init(&specialized, specialized_buf, sizes[i]);
+            packet_builder_start(&generic, &t, compact, 0);
+            packet_builder_start(&specialized, &t, compact, 0);
+
+            while (packet_builder_append(&generic, block, n)) {
+                LOG_ASSERT(packet_builder_append_sized(&specialized, block, n));
+            }
+            LOG_ASSERT(!packet_builder_append_sized(&specialized, block, n));
+            LOG_ASSERT(specialized.len == generic.len);
+            LOG_ASSERT(!memcmp(specialized_buf, generic_buf, generic.len));
+            LOG_ASSERT(generic.len <= (compact ? COMPACT_PACKET_LIMIT_SIZE : PACKET_LIMIT_SIZE));
+        }
+    }
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_builder_exact_fit);
+    RUN_TEST(test_iterate_and_reject);
+    RUN_TEST(test_specialized_builders);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file test_events.c
+ * @brief Tests the event channel: string interning, dictionary blocks and rate limiting.
+ */
+#include "../src/events.h"
+#include "../src/packet_types.h"
+#include <stddef.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Event channel used by the tests. */
+static EventChannel c;
+
+/**
+ * Test that repeated strings are interned into the same ID and that the dictionary block defining them is sent before
+ * the events that use them.
+ */
+bool test_interning_and_dictionary(void) {
+
+    event_channel_init(&c, 100, 10, 0);
+    LOG_ASSERT(event_post(&c, EVENT_ERROR, "Could not read message", 4, 10));
+    LOG_ASSERT(event_post(&c, EVENT_ERROR, "Could not read message", 11, 20));
+    LOG_ASSERT(event_post(&c, EVENT_GPS_FIX, "gps fix", 3, 30));
+    LOG_ASSERT(c.n_strings == 2);
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    uint16_t n = event_channel_emit(&c, buf, sizeof(buf), 40, 0);
+
+    // First block defines both strings
+    BlockHeader *h = (BlockHeader *)buf;
+    LOG_ASSERT(n == block_header_get_length(h));
+    LOG_ASSERT(n % 4 == 0);
+    LOG_ASSERT(h->subtype == DATA_DBG_MSG);
+    DictionaryDB *d = (DictionaryDB *)(buf + sizeof(BlockHeader));
+    LOG_ASSERT(d->record == DBG_RECORD_DICTIONARY);
+    LOG_ASSERT(d->count == 2);
+    LOG_ASSERT(d->entries[0] == 0);
+    LOG_ASSERT(d->entries[1] == strlen("Could not read message"));
+    LOG_ASSERT(!memcmp(&d->entries[2], "Could not read message", d->entries[1]));
+    uint8_t *second = &d->entries[2 + d->entries[1]];
+    LOG_ASSERT(second[0] == 1);
+    LOG_ASSERT(second[1] == strlen("gps fix"));
+    LOG_ASSERT(!memcmp(&second[2], "gps fix", second[1]));
+
+    // Then the events in order, each a fixed 16 bytes
+    int32_t args[] = {4, 11, 3};
+    uint8_t ids[] = {0, 0, 1};
+    for (int i = 0; i < 3; i++) {
+        n = event_channel_emit(&c, buf, sizeof(buf), 40, 0);
+        LOG_ASSERT(n == sizeof(BlockHeader) + sizeof(EventDB));
+        LOG_ASSERT(n == 16);
+        EventDB *e = (EventDB *)(buf + sizeof(BlockHeader));
+        LOG_ASSERT(e->record == DBG_RECORD_EVENT);
+        LOG_ASSERT(e->arg == args[i]);
+        LOG_ASSERT(e->string_id == ids[i]);
+    }
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 40, 0) == 0);
+
+    return true;
+}
+
+/**
+ * Test that a dictionary block is exactly as long as its entries padded to a multiple of 4, and that the padding is
+ * zeroed rather than left over from whatever was in the buffer before.
+ */
+bool test_dictionary_padding(void) {
+
+    event_channel_init(&c, 100, 10, 0);
+    LOG_ASSERT(event_post(&c, EVENT_GPS_FIX, "gps fix", 3, 30));
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    memset(buf, 0xFF, sizeof(buf));
+    uint16_t n = event_channel_emit(&c, buf, sizeof(buf), 40, 0);
+
+    // 6 bytes before the entries and a 9 byte entry, padded to 16
+    const size_t end = sizeof(BlockHeader) + offsetof(DictionaryDB, entries) + 2 + strlen("gps fix");
+    LOG_ASSERT(n == sizeof(BlockHeader) + 16);
+    LOG_ASSERT(n == block_header_get_length((BlockHeader *)buf));
+    for (size_t i = end; i < n; i++) LOG_ASSERT(buf[i] == 0);
+
+    return true;
+}
+
+/**
+ * Test that the string table is bounded and that strings past the limit get the reserved ID.
+ */
+bool test_intern_overflow(void) {
+
+    event_channel_init(&c, 100, 10, 0);
+    char str[8];
+    for (int i = 0; i < EVENT_STRINGS_MAX + 5; i++) {
+        snprintf(str, sizeof(str), "e%d", i);
+        event_post(&c, EVENT_ERROR, str, 0, 0);
+        c.queued = 0; // Discard the event, only the interning matters
+    }
+    LOG_ASSERT(c.n_strings == EVENT_STRINGS_MAX);
+    LOG_ASSERT(c.intern_overflows == 5);
+    LOG_ASSERT(!strcmp(event_string(&c, 0), "e0"));
+    LOG_ASSERT(event_string(&c, EVENT_STRING_NONE) == NULL);
+
+    return true;
+}
+
+/**
+ * Test that the number of event blocks per packet and per second are limited and the queue is bounded.
+ */
+bool test_rate_limits(void) {
+
+    event_channel_init(&c, 2, 1, 0);
+    for (int i = 0; i < EVENT_QUEUE_LEN + 3; i++) {
+        event_post(&c, EVENT_PHASE, "phase", i, 0);
+    }
+    LOG_ASSERT(c.queued == EVENT_QUEUE_LEN);
+    LOG_ASSERT(c.dropped == 3);
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    uint32_t now = 0;
+
+    // Dictionary uses up the only slot of the first packet
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) != 0);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) == 0);
+
+    // Two events are allowed in a burst, then the rate limit kicks in
+    event_channel_new_packet(&c);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) != 0);
+    event_channel_new_packet(&c);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) != 0);
+    event_channel_new_packet(&c);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) == 0);
+
+    now += 500;
+    event_channel_new_packet(&c);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, now) != 0);
+
+    // Not enough room in the packet for an event
+    now += 500;
+    event_channel_new_packet(&c);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(BlockHeader) + sizeof(EventDB) - 4, 0, now) == 0);
+
+    return true;
+}
+
+/**
+ * Test that the whole dictionary is sent again after the refresh period.
+ */
+bool test_dictionary_refresh(void) {
+
+    event_channel_init(&c, 100, 10, 1000);
+    event_post(&c, EVENT_PHASE, "BOOST", 1, 0);
+    c.queued = 0;
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 1) != 0);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 500) == 0);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 1001) != 0);
+    LOG_ASSERT(((DictionaryDB *)(buf + sizeof(BlockHeader)))->record == DBG_RECORD_DICTIONARY);
+
+    return true;
+}
+
+/**
+ * Test that the strings of a dictionary block that no sink accepted are sent again, while those of a sent one are not.
+ */
+bool test_dictionary_unsent(void) {
+
+    event_channel_init(&c, 100, 10, 0);
+    event_post(&c, EVENT_PHASE, "BOOST", 1, 0);
+    event_post(&c, EVENT_GPS_FIX, "gps fix", 3, 0);
+    c.queued = 0;
+
+    uint8_t buf[PACKET_MAX_SIZE];
+    const uint16_t n = event_channel_emit(&c, buf, sizeof(buf), 0, 0);
+    LOG_ASSERT(n != 0);
+    LOG_ASSERT(event_channel_emit(&c, buf + n, sizeof(buf) - n, 0, 0) == 0);
+
+    // The same dictionary is written again once it is reported unsent
+    event_channel_unsent(&c, buf);
+    LOG_ASSERT(event_channel_emit(&c, buf + n, sizeof(buf) - n, 0, 0) == n);
+    LOG_ASSERT(!memcmp(buf, buf + n, n));
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 0) == 0);
+
+    // Event blocks are not resent
+    event_post(&c, EVENT_PHASE, "BOOST", 1, 0);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 0) == sizeof(BlockHeader) + sizeof(EventDB));
+    event_channel_unsent(&c, buf);
+    LOG_ASSERT(event_channel_emit(&c, buf, sizeof(buf), 0, 0) == 0);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_interning_and_dictionary);
+    RUN_TEST(test_dictionary_padding);
+    RUN_TEST(test_intern_overflow);
+    RUN_TEST(test_rate_limits);
+    RUN_TEST(test_dictionary_refresh);
+    RUN_TEST(test_dictionary_unsent);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
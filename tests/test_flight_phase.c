@@ -0,0 +1,248 @@
+/**
+ * @file test_flight_phase.c
+ * @brief Tests flight phase detection by replaying a simulated flight, and the per-phase bandwidth budgets.
+ */
+#include "../src/flight_phase.h"
+#include "../src/intypes.h"
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Time between samples of the simulated flight in milliseconds. */
+#define SAMPLE_PERIOD 10
+
+/** Mission time at which the simulated motor ignites. */
+#define IGNITION_TIME 5000
+
+/** Mission time at which the simulated motor burns out. */
+#define BURNOUT_TIME 8000
+
+/** Descent rate under parachute of the simulated flight in m/s. */
+#define DESCENT_RATE 20.0f
+
+/** Mission times at which each phase was entered while replaying a flight, 0 if never entered. */
+static uint32_t phase_times[PHASE_COUNT];
+
+/** Order in which phases were entered while replaying a flight. */
+static FlightPhase phase_order[PHASE_COUNT * 2];
+
+/** Number of phase transitions while replaying a flight. */
+static size_t transitions;
+
+/**
+ * Feeds a single message to the detector and records any transition.
+ * @param d The flight phase detector.
+ * @param msg The message to feed.
+ * @param mission_time The current mission time.
+ */
+static void feed(FlightPhaseDetector *d, const common_t *msg, uint32_t mission_time) {
+    if (flight_phase_update(d, msg, mission_time)) {
+        phase_times[d->phase] = mission_time;
+        if (transitions < sizeof(phase_order) / sizeof(phase_order[0])) phase_order[transitions] = d->phase;
+        transitions++;
+    }
+}
+
+/**
+ * Replays a simulated flight (pad, boost, ballistic coast, parachute descent and landing) into the detector, the same
+ * way fetcher would produce it: a time message followed by altitude, acceleration and pressure readings.
+ * @param d The flight phase detector.
+ * @param with_altitude Whether to include relative altitude readings.
+ * @param with_accel Whether to include acceleration readings.
+ * @return The mission time of apogee.
+ */
+static uint32_t replay_flight(FlightPhaseDetector *d, bool with_altitude, bool with_accel) {
+    memset(phase_times, 0, sizeof(phase_times));
+    transitions = 0;
+
+    float altitude = 0.0f;
+    float velocity = 0.0f;
+    uint32_t apogee = 0;
+    uint32_t landed = 0;
+    const float dt = SAMPLE_PERIOD / 1000.0f;
+
+    for (uint32_t t = 0; landed == 0 || t < landed + 20000; t += SAMPLE_PERIOD) {
+
+        // Specific force felt by the accelerometer
+        float thrust = 0.0f;
+        if (t >= IGNITION_TIME && t < BURNOUT_TIME) {
+            thrust = 80.0f;
+            velocity += (thrust - 9.81f) * dt;
+        } else if (t >= BURNOUT_TIME && velocity > -DESCENT_RATE && landed == 0) {
+            velocity -= 9.81f * dt;
+            if (velocity < 0.0f && apogee == 0) apogee = t;
+            // Parachute caps the descent rate
+            if (velocity < -DESCENT_RATE) velocity = -DESCENT_RATE;
+        }
+        altitude += velocity * dt;
+        if (t > BURNOUT_TIME && altitude <= 0.0f && landed == 0) {
+            altitude = 0.0f;
+            velocity = 0.0f;
+            landed = t;
+        }
+        float felt = (t < IGNITION_TIME || landed != 0 || velocity <= -DESCENT_RATE) ? 9.81f : thrust;
+
+        // Approximately 12 Pa per metre near sea level
+        float pressure = 101.325f - altitude * 0.012f;
+
+        common_t msg = {.type = TAG_TIME, .data.U32 = t};
+        feed(d, &msg, t);
+        if (with_altitude) {
+            msg = (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = altitude};
+            feed(d, &msg, t);
+        }
+        if (with_accel) {
+            msg = (common_t){.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {.x = 0.1f, .y = -0.2f, .z = felt}};
+            feed(d, &msg, t);
+        }
+        msg = (common_t){.type = TAG_PRESSURE, .data.FLOAT = pressure};
+        feed(d, &msg, t);
+    }
+
+    return apogee;
+}
+
+/**
+ * Test that a full flight is detected as pad, boost, coast, descent and then landed at the right times.
+ */
+bool test_replay_full_flight(void) {
+
+    FlightPhaseDetector d;
+    flight_phase_init(&d);
+    LOG_ASSERT(d.phase == PHASE_PAD);
+
+    uint32_t apogee = replay_flight(&d, true, true);
+
+    LOG_ASSERT(transitions == 4);
+    LOG_ASSERT(phase_order[0] == PHASE_BOOST);
+    LOG_ASSERT(phase_order[1] == PHASE_COAST);
+    LOG_ASSERT(phase_order[2] == PHASE_DESCENT);
+    LOG_ASSERT(phase_order[3] == PHASE_LANDED);
+
+    LOG_ASSERT(phase_times[PHASE_BOOST] >= IGNITION_TIME && phase_times[PHASE_BOOST] <= IGNITION_TIME + 100);
+    LOG_ASSERT(phase_times[PHASE_COAST] >= BURNOUT_TIME && phase_times[PHASE_COAST] <= BURNOUT_TIME + 100);
+    LOG_ASSERT(phase_times[PHASE_DESCENT] >= apogee && phase_times[PHASE_DESCENT] <= apogee + 2000);
+    LOG_ASSERT(phase_times[PHASE_LANDED] > phase_times[PHASE_DESCENT]);
+
+    return true;
+}
+
+/**
+ * Test that a flight is still detected from altitude alone when there is no accelerometer, skipping the coast phase.
+ */
+bool test_replay_altitude_only(void) {
+
+    FlightPhaseDetector d;
+    flight_phase_init(&d);
+    replay_flight(&d, true, false);
+
+    LOG_ASSERT(transitions == 3);
+    LOG_ASSERT(phase_order[0] == PHASE_BOOST);
+    LOG_ASSERT(phase_order[1] == PHASE_DESCENT);
+    LOG_ASSERT(phase_order[2] == PHASE_LANDED);
+
+    return true;
+}
+
+/**
+ * Test that apogee is detected from pressure when there is no altitude source.
+ */
+bool test_replay_pressure_apogee(void) {
+
+    FlightPhaseDetector d;
+    flight_phase_init(&d);
+    uint32_t apogee = replay_flight(&d, false, true);
+
+    LOG_ASSERT(phase_order[0] == PHASE_BOOST);
+    LOG_ASSERT(phase_order[1] == PHASE_COAST);
+    LOG_ASSERT(phase_order[2] == PHASE_DESCENT);
+    LOG_ASSERT(phase_times[PHASE_DESCENT] >= apogee && phase_times[PHASE_DESCENT] <= apogee + 3000);
+
+    return true;
+}
+
+/**
+ * Test that a single spike in acceleration does not trigger the boost phase.
+ */
+bool test_spike_rejected(void) {
+
+    FlightPhaseDetector d;
+    flight_phase_init(&d);
+
+    common_t spike = {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {.x = 0.0f, .y = 0.0f, .z = 100.0f}};
+    common_t rest = {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {.x = 0.0f, .y = 0.0f, .z = 0.0f}};
+    for (int i = 0; i < 10; i++) {
+        LOG_ASSERT(!flight_phase_update(&d, &spike, i * 20));
+        LOG_ASSERT(!flight_phase_update(&d, &rest, i * 20 + 10));
+    }
+    LOG_ASSERT(d.phase == PHASE_PAD);
+
+    return true;
+}
+
+/**
+ * Test that budgets limit the number of blocks per second of a tag and refill over time.
+ */
+bool test_budget_rate(void) {
+
+    PhaseBudget b;
+    phase_budget_init(&b, PHASE_PAD, 0);
+
+    // Voltage is allowed 10 blocks per second on the pad
+    uint16_t rate = flight_phase_budget(PHASE_PAD, TAG_VOLTAGE);
+    LOG_ASSERT(rate == 10);
+
+    size_t admitted = 0;
+    for (uint32_t t = 0; t < 10000; t++) {
+        if (phase_budget_admit(&b, PHASE_PAD, TAG_VOLTAGE, t)) admitted++;
+    }
+
+    // One second of initial burst plus ten seconds of refill
+    LOG_ASSERT(admitted >= 10 * rate && admitted <= 11 * rate);
+
+    return true;
+}
+
+/**
+ * Test that tags with a zero budget are dropped and unlimited tags are always admitted.
+ */
+bool test_budget_zero_and_unlimited(void) {
+
+    PhaseBudget b;
+    phase_budget_init(&b, PHASE_PAD, 0);
+
+    // Coordinates are not sent during boost, even with tokens left over from the pad
+    LOG_ASSERT(flight_phase_budget(PHASE_BOOST, TAG_COORDS) == 0);
+    LOG_ASSERT(!phase_budget_admit(&b, PHASE_BOOST, TAG_COORDS, 1));
+
+    for (uint32_t t = 0; t < 1000; t++) {
+        LOG_ASSERT(phase_budget_admit(&b, PHASE_BOOST, TAG_TIME, t));
+    }
+
+    // Unknown tags are never limited
+    LOG_ASSERT(phase_budget_admit(&b, PHASE_BOOST, 0xEE, 1000));
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_replay_full_flight);
+    RUN_TEST(test_replay_altitude_only);
+    RUN_TEST(test_replay_pressure_apogee);
+    RUN_TEST(test_spike_rejected);
+    RUN_TEST(test_budget_rate);
+    RUN_TEST(test_budget_zero_and_unlimited);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file test_fusion.c
+ * @brief Tests the altitude and vertical velocity estimator by replaying a simulated flight with noisy sensors, and the
+ * encoding of its estimates.
+ */
+#include "../src/decoder.h"
+#include "../src/encoder.h"
+#include "../src/fusion.h"
+#include "../src/intypes.h"
+#include <math.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Time between acceleration samples of the simulated flight in milliseconds. */
+#define SAMPLE_PERIOD 10
+
+/** Number of acceleration samples per altitude sample, like a barometer that is slower than the accelerometer. */
+#define ALTITUDE_DIVIDER 5
+
+/** Mission time at which the simulated motor ignites. */
+#define IGNITION_TIME 5000
+
+/** Mission time at which the simulated motor burns out. */
+#define BURNOUT_TIME 8000
+
+/** Mission time at which the simulated flight ends. */
+#define END_TIME 60000
+
+/** Descent rate under parachute of the simulated flight in m/s. */
+#define DESCENT_RATE 20.0f
+
+/** Amplitude of the uniform noise on the altitude readings in metres. */
+#define ALTITUDE_NOISE 3.0f
+
+/** Constant bias of the acceleration readings in m/s^2. */
+#define ACCEL_BIAS 0.2f
+
+/** Estimates per second sent during the replay. */
+#define OUTPUT_RATE 10
+
+/** Results of replaying a flight into the estimator. */
+typedef struct {
+    /** The number of estimates sent. */
+    uint32_t estimates;
+    /** Mean square error of the sent altitude estimates in m^2. */
+    float altitude_mse;
+    /** Mean square error of the raw altitude readings in m^2. */
+    float raw_mse;
+    /** Mean square error of the sent velocity estimates in (m/s)^2. */
+    float velocity_mse;
+    /** Largest error of the sent velocity estimates in m/s. */
+    float velocity_max;
+} ReplayResult;
+
+/**
+ * Generates the next pseudo random number.
+ * @param state The generator state, which must not be 0.
+ * @return A pseudo random number between -1 and 1.
+ */
+static float noise(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)(int32_t)x / 2147483648.0f;
+}
+
+/**
+ * Decodes the value of a block encoded from the estimate.
+ * @param f The estimator.
+ * @param tag The estimate to encode.
+ * @param mission_time The mission time of the estimate.
+ * @return The decoded value.
+ */
+static float encoded_estimate(const Fusion *f, const uint8_t tag, const uint32_t mission_time) {
+    uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+    common_t msg;
+    uint32_t time;
+    fusion_encode(f, buf, tag, mission_time);
+    if (!decode_block((const BlockHeader *)buf, buf + sizeof(BlockHeader), &msg, &time)) return NAN;
+    if (msg.type != tag || time != mission_time) return NAN;
+    return msg.data.FLOAT;
+}
+
+/**
+ * Replays a simulated flight (pad, boost, ballistic coast and parachute descent) into the estimator the way fetcher
+ * would produce it, with noisy altitude readings and biased acceleration readings, and compares the sent estimates to
+ * the true altitude and velocity.
+ * @param f The estimator.
+ * @param r Where to store the results.
+ */
+static void replay_flight(Fusion *f, ReplayResult *r) {
+    memset(r, 0, sizeof(*r));
+    uint32_t state = 0x2545F491;
+    float altitude = 0.0f;
+    float velocity = 0.0f;
+    float altitude_sq = 0.0f, raw_sq = 0.0f, velocity_sq = 0.0f;
+    uint32_t raw_count = 0;
+    const float dt = SAMPLE_PERIOD / 1000.0f;
+
+    for (uint32_t t = 0, i = 0; t < END_TIME; t += SAMPLE_PERIOD, i++) {
+        const float previous = velocity;
+        if (t >= IGNITION_TIME && t < BURNOUT_TIME) {
+            velocity += (80.0f - 9.81f) * dt;
+        } else if (t >= BURNOUT_TIME && altitude > 0.0f) {
+            velocity -= 9.81f * dt;
+            if (velocity < -DESCENT_RATE) velocity = -DESCENT_RATE; // Parachute caps the descent rate
+        }
+        altitude += velocity * dt;
+        const float accel = (velocity - previous) / dt;
+
+        const common_t a = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.0f, 0.0f, accel + ACCEL_BIAS}};
+        fusion_update(f, &a, t);
+        if (i % ALTITUDE_DIVIDER == 0) {
+            const common_t h = {.type = TAG_ALTITUDE_REL, .data.FLOAT = altitude + ALTITUDE_NOISE * noise(&state)};
+            fusion_update(f, &h, t);
+            raw_sq += (h.data.FLOAT - altitude) * (h.data.FLOAT - altitude);
+            raw_count++;
+        }
+
+        if (fusion_due(f, t)) {
+            const float altitude_error = encoded_estimate(f, TAG_ALTITUDE_FUSED, t) - altitude;
+            const float velocity_error = fabsf(encoded_estimate(f, TAG_VERTICAL_VEL, t) - velocity);
+            altitude_sq += altitude_error * altitude_error;
+            velocity_sq += velocity_error * velocity_error;
+            if (!(velocity_error <= r->velocity_max)) r->velocity_max = velocity_error;
+            r->estimates++;
+        }
+    }
+
+    r->altitude_mse = altitude_sq / r->estimates;
+    r->raw_mse = raw_sq / raw_count;
+    r->velocity_mse = velocity_sq / r->estimates;
+}
+
+/**
+ * Test that the estimates of a replayed flight are sent at the configured rate, that the filtered altitude is closer
+ * to the truth than the raw readings and that the velocity, which is never measured directly, is tracked through
+ * boost, coast and parachute deployment.
+ */
+bool test_replay_accuracy(void) {
+
+    Fusion f;
+    ReplayResult r;
+    fusion_init(&f, OUTPUT_RATE, FUSION_DEFAULT_TAU_MS);
+    replay_flight(&f, &r);
+
+    printf("altitude mse %.2f m^2 (raw %.2f m^2), velocity mse %.2f (m/s)^2, max error %.2f m/s\n",
+           (double)r.altitude_mse, (double)r.raw_mse, (double)r.velocity_mse, (double)r.velocity_max);
+    LOG_ASSERT(r.estimates == END_TIME / 1000 * OUTPUT_RATE);
+    LOG_ASSERT(r.altitude_mse < r.raw_mse / 4.0f);
+    LOG_ASSERT(r.velocity_mse < 1.0f);
+    LOG_ASSERT(r.velocity_max < 5.0f);
+
+    return true;
+}
+
+/**
+ * Test that a longer time constant smooths the altitude more.
+ */
+bool test_time_constant(void) {
+
+    Fusion f;
+    ReplayResult fast, slow;
+    fusion_init(&f, OUTPUT_RATE, 100);
+    replay_flight(&f, &fast);
+    fusion_init(&f, OUTPUT_RATE, 1000);
+    replay_flight(&f, &slow);
+
+    LOG_ASSERT(slow.altitude_mse < fast.altitude_mse);
+    LOG_ASSERT(fast.altitude_mse < fast.raw_mse);
+
+    return true;
+}
+
+/**
+ * Test that only the inputs of the estimator are consumed, that nothing is due before the first altitude reading and
+ * that NaN readings are ignored.
+ */
+bool test_inputs(void) {
+
+    Fusion f;
+    fusion_init(&f, OUTPUT_RATE, FUSION_DEFAULT_TAU_MS);
+
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 20.0f};
+    const common_t accel = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.0f, 0.0f, 1.0f}};
+    const common_t rel_accel = {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {0.0f, 0.0f, 1.0f}};
+    const common_t nan_alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = NAN};
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 100.0f};
+
+    LOG_ASSERT(!fusion_update(&f, &temp, 0));
+    LOG_ASSERT(!fusion_update(&f, &rel_accel, 0));
+    LOG_ASSERT(fusion_update(&f, &accel, 0));
+    LOG_ASSERT(fusion_update(&f, &nan_alt, 0));
+    LOG_ASSERT(!f.ready);
+    LOG_ASSERT(!fusion_due(&f, 0));
+
+    LOG_ASSERT(fusion_update(&f, &alt, 1000));
+    LOG_ASSERT(f.ready);
+    LOG_ASSERT(fusion_due(&f, 1000));
+    LOG_ASSERT(!fusion_due(&f, 1050));
+    LOG_ASSERT(fusion_due(&f, 1100));
+
+    // Missed estimates are skipped rather than sent in a burst
+    LOG_ASSERT(fusion_due(&f, 5000));
+    LOG_ASSERT(!fusion_due(&f, 5050));
+
+    // The filtered altitude has a tag of its own, apart from that of the raw readings
+    uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+    LOG_ASSERT(fusion_encode(&f, buf, TAG_ALTITUDE_REL, 5000) == 0);
+    LOG_ASSERT(fusion_encode(&f, buf, TAG_ALTITUDE_FUSED, 5000) != 0);
+    LOG_ASSERT(((const BlockHeader *)buf)->subtype == DATA_ALT_FUSED);
+
+    return true;
+}
+
+/**
+ * Test that the estimate starts at rest at the first reading and starts over at the next reading after a long gap,
+ * instead of being integrated over the gap.
+ */
+bool test_gap(void) {
+
+    Fusion f;
+    fusion_init(&f, OUTPUT_RATE, FUSION_DEFAULT_TAU_MS);
+
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 100.0f};
+    const common_t accel = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.0f, 0.0f, 10.0f}};
+    fusion_update(&f, &alt, 0);
+    LOG_ASSERT(encoded_estimate(&f, TAG_ALTITUDE_FUSED, 0) == 100.0f);
+    LOG_ASSERT(encoded_estimate(&f, TAG_VERTICAL_VEL, 0) == 0.0f);
+
+    fusion_update(&f, &accel, 0);
+    const common_t later = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 250.0f};
+    fusion_update(&f, &later, 60000);
+    LOG_ASSERT(encoded_estimate(&f, TAG_ALTITUDE_FUSED, 60000) == 250.0f);
+    LOG_ASSERT(fabsf(encoded_estimate(&f, TAG_VERTICAL_VEL, 60000)) < 1.0f);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_replay_accuracy);
+    RUN_TEST(test_time_constant);
+    RUN_TEST(test_inputs);
+    RUN_TEST(test_gap);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
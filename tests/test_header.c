@@ -0,0 +1,161 @@
+/**
+ * @file test_header.c
+ * @brief Tests packet header templates, the compact header schedule and full header reconstruction.
+ */
+#include "../src/header.h"
+#include "../src/packet_types.h"
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/**
+ * Test that a header written from a template is identical to one created with packet_header_init.
+ */
+bool test_template_matches_init(void) {
+
+    PacketHeaderTemplate t;
+    LOG_ASSERT(packet_header_template_init(&t, "VA3INI", 1, ROCKET));
+
+    PacketHeader expected;
+    packet_header_init(&expected, "VA3INI", 0, 1, ROCKET, 1234);
+
+    uint8_t packet[PACKET_MAX_SIZE];
+    memset(packet, 0xAA, sizeof(packet));
+    LOG_ASSERT(packet_header_write(packet, &t, false, 1234) == sizeof(PacketHeader));
+    LOG_ASSERT(!memcmp(packet, &expected, sizeof(PacketHeader)));
+    LOG_ASSERT(!packet_is_compact(packet));
+
+    return true;
+}
+
+/**
+ * Test that call signs which do not fit in the header are rejected.
+ */
+bool test_template_rejects_bad_callsign(void) {
+
+    PacketHeaderTemplate t;
+    LOG_ASSERT(!packet_header_template_init(&t, "", 1, ROCKET));
+    LOG_ASSERT(!packet_header_template_init(&t, "VA3INIVA3I", 1, ROCKET));
+    LOG_ASSERT(packet_header_template_init(&t, "VA3INIVA3", 1, ROCKET));
+
+    return true;
+}
+
+/**
+ * Test that compact headers have the correct size and that the generic length helpers work on them.
+ */
+bool test_compact_header_length(void) {
+
+    PacketHeaderTemplate t;
+    packet_header_template_init(&t, "VA3INI", 1, ROCKET);
+
+    uint8_t packet[PACKET_MAX_SIZE];
+    LOG_ASSERT(packet_header_write(packet, &t, true, 0x1234) == sizeof(CompactPacketHeader));
+    LOG_ASSERT(sizeof(CompactPacketHeader) == 4);
+    LOG_ASSERT(packet_is_compact(packet));
+    LOG_ASSERT(packet_header_size(packet) == sizeof(CompactPacketHeader));
+    LOG_ASSERT(packet_get_length(packet) == sizeof(CompactPacketHeader));
+
+    packet_inc_length(packet, 12);
+    LOG_ASSERT(packet_get_length(packet) == sizeof(CompactPacketHeader) + 12);
+
+    CompactPacketHeader *c = (CompactPacketHeader *)packet;
+    LOG_ASSERT(c->station_id == ROCKET);
+    LOG_ASSERT(c->packet_num == 0x34);
+
+    return true;
+}
+
+/**
+ * Test that the schedule sends full headers every N packets and at least every so many milliseconds.
+ */
+bool test_schedule(void) {
+
+    HeaderSchedule s;
+
+    // Disabled compact mode always sends full headers
+    header_schedule_init(&s, 0, 0);
+    for (uint32_t i = 0; i < 10; i++) {
+        LOG_ASSERT(header_schedule_full(&s, i, 0));
+    }
+
+    header_schedule_init(&s, 4, 0);
+    for (uint32_t i = 0; i < 12; i++) {
+        LOG_ASSERT(header_schedule_full(&s, i, 0) == (i % 4 == 0));
+    }
+
+    header_schedule_init(&s, 100, 1000);
+    LOG_ASSERT(header_schedule_full(&s, 0, 0));
+    LOG_ASSERT(!header_schedule_full(&s, 1, 500));
+    LOG_ASSERT(header_schedule_full(&s, 2, 1000));
+    LOG_ASSERT(!header_schedule_full(&s, 3, 1500));
+
+    // Full headers are forced before the 8 bit compact packet number becomes ambiguous
+    header_schedule_init(&s, 10000, 0);
+    LOG_ASSERT(header_schedule_full(&s, 0, 0));
+    LOG_ASSERT(!header_schedule_full(&s, 255, 0));
+    LOG_ASSERT(header_schedule_full(&s, 256, 0));
+
+    return true;
+}
+
+/**
+ * Test that the decoder reconstructs full headers from compact ones, including across packet number wrap around.
+ */
+bool test_decoder_reconstructs(void) {
+
+    static HeaderDecoder d;
+    header_decoder_init(&d);
+
+    PacketHeaderTemplate t;
+    packet_header_template_init(&t, "VA3INI", 1, ROCKET);
+    HeaderSchedule s;
+    header_schedule_init(&s, 50, 0);
+
+    uint8_t packet[PACKET_MAX_SIZE];
+    PacketHeader out;
+
+    // A compact header from an unknown station cannot be decoded
+    packet_header_write(packet, &t, true, 3);
+    LOG_ASSERT(header_decode(&d, packet, &out) == 0);
+
+    for (uint32_t num = 250; num < 1000; num++) {
+        // Drop some packets to simulate radio loss
+        bool full = header_schedule_full(&s, num, 0);
+        if (num % 7 == 0) continue;
+
+        packet_header_write(packet, &t, !full, num);
+        packet_inc_length(packet, 8);
+        LOG_ASSERT(header_decode(&d, packet, &out) == (full ? sizeof(PacketHeader) : sizeof(CompactPacketHeader)));
+
+        // The first packet must be full for the decoder to learn the station
+        LOG_ASSERT(out.packet_num == num);
+        LOG_ASSERT(!strcmp(out.call_sign, "VA3INI"));
+        LOG_ASSERT(out.version == 1);
+        LOG_ASSERT(out.src_addr == ROCKET);
+        LOG_ASSERT(packet_header_get_length(&out) == sizeof(PacketHeader) + 8);
+    }
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_template_matches_init);
+    RUN_TEST(test_template_rejects_bad_callsign);
+    RUN_TEST(test_compact_header_length);
+    RUN_TEST(test_schedule);
+    RUN_TEST(test_decoder_reconstructs);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+/**
+ * @file test_history.c
+ * @brief Tests keeping the history of sent packets and resending requested blocks in the room left in later packets.
+ */
+#include "../src/decoder.h"
+#include "../src/encoder.h"
+#include "../src/history.h"
+#include "../src/sink.h"
+#include <fcntl.h>
+#include <mqueue.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+#include "fixtures.h"
+
+/** History used by the tests. */
+static PacketHistory h;
+
+/** Memory the packets of the history and the sink are allocated from. */
+static _Alignas(ARENA_ALIGN) uint8_t memory[8192];
+
+/** Arena over the memory, emptied by each test. */
+static Arena arena;
+
+/** Mask of the subtype of debug message blocks, which the tests treat as critical. */
+#define CRITICAL (1u << DATA_DBG_MSG)
+
+/**
+ * Empties the history and its arena.
+ * @param depth The number of packets to keep.
+ * @param slot_size The maximum size of the packets in bytes.
+ */
+static void init(const uint8_t depth, const uint16_t slot_size) {
+    arena_init(&arena, memory, sizeof(memory));
+    history_init(&h, depth, slot_size, &arena);
+}
+
+/**
+ * Writes a 16 byte debug message block whose payload is filled with a marker byte.
+ * @param block Where to write the block.
+ * @param marker The byte the payload is filled with.
+ * @return The size of the block in bytes.
+ */
+static uint16_t debug_block(uint8_t *block, const uint8_t marker) {
+    block_header_init((BlockHeader *)block, 12, TYPE_DATA, DATA_DBG_MSG, GROUNDSTATION);
+    memset(block + sizeof(BlockHeader), marker, 12);
+    return 16;
+}
+
+/**
+ * Builds a packet with an altitude block and a debug message block and stores it in the history.
+ * @param b The packet builder to build the packet with.
+ * @param num The number of the packet, which is also the marker of its debug message block.
+ */
+static void store_packet(PacketBuilder *b, const uint32_t num) {
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 10.0f};
+    packet_builder_start(b, &header, false, num);
+    packet_builder_add(b, &alt, num);
+    packet_builder_append(b, block, debug_block(block, num));
+    history_store(&h, num, b->buf, b->len);
+}
+
+/**
+ * Test that the most recent packets are found by number, and older ones are replaced.
+ */
+bool test_store_and_find(void) {
+
+    arena_init(&arena, memory, sizeof(memory));
+    LOG_ASSERT(history_init(&h, 200, 32, &arena));
+    LOG_ASSERT(h.depth == HISTORY_MAX_PACKETS);
+    LOG_ASSERT(arena.used == history_footprint(200, 32));
+    LOG_ASSERT(!history_init(&h, 16, 1024, &arena));
+    LOG_ASSERT(h.depth == 0);
+
+    uint8_t buf[64];
+    PacketBuilder b;
+    packet_builder_init(&b, buf, sizeof(buf));
+    init(4, sizeof(buf));
+    uint16_t len;
+    LOG_ASSERT(history_find(&h, 0, &len) == NULL);
+
+    for (uint32_t num = 0; num < 6; num++) {
+        store_packet(&b, num);
+    }
+    LOG_ASSERT(history_find(&h, 0, &len) == NULL);
+    LOG_ASSERT(history_find(&h, 1, &len) == NULL);
+    for (uint32_t num = 2; num < 6; num++) {
+        const uint8_t *packet = history_find(&h, num, &len);
+        LOG_ASSERT(packet != NULL);
+        LOG_ASSERT(len == packet_get_length(packet));
+        LOG_ASSERT(packet[len - 1] == num);
+    }
+    LOG_ASSERT(history_find(&h, 6, &len) == NULL);
+
+    init(0, sizeof(buf));
+    history_store(&h, 0, buf, b.len);
+    LOG_ASSERT(history_find(&h, 0, &len) == NULL);
+
+    return true;
+}
+
+/**
+ * Test that requests queue only the blocks of the requested subtypes from packets still in the history, and count the
+ * requested packets that are not.
+ */
+bool test_request(void) {
+
+    uint8_t buf[64];
+    PacketBuilder b;
+    packet_builder_init(&b, buf, sizeof(buf));
+    init(4, sizeof(buf));
+
+    ResendRequest r = {.sink = 0, .first = 0, .count = 2, .subtypes = CRITICAL};
+    LOG_ASSERT(history_request(&h, &r) == 0);
+    LOG_ASSERT(h.missing == 2);
+
+    init(4, sizeof(buf));
+    for (uint32_t num = 0; num < 6; num++) {
+        store_packet(&b, num);
+    }
+
+    r = (ResendRequest){.first = 3, .count = 2, .subtypes = CRITICAL};
+    LOG_ASSERT(history_request(&h, &r) == 2);
+    LOG_ASSERT(h.pending[0].packet_num == 3 && h.pending[1].packet_num == 4);
+    LOG_ASSERT(h.pending[0].size == 16);
+    LOG_ASSERT(h.missing == 0);
+
+    r = (ResendRequest){.first = 0, .count = 10, .subtypes = RESEND_ALL_SUBTYPES};
+    LOG_ASSERT(history_request(&h, &r) == 8);
+    LOG_ASSERT(h.missing == 6);
+    LOG_ASSERT(h.n_pending == 10);
+
+    r = (ResendRequest){.first = 0, .count = 0, .subtypes = CRITICAL};
+    LOG_ASSERT(history_request(&h, &r) == 4);
+    LOG_ASSERT(h.missing == 6);
+
+    r = (ResendRequest){.first = 0, .count = 0, .subtypes = 1u << DATA_TEMP};
+    LOG_ASSERT(history_request(&h, &r) == 0);
+
+    // Requests beyond the pending limit are dropped
+    for (int i = 0; i < HISTORY_MAX_PENDING; i++) {
+        history_request(&h, &(ResendRequest){.first = 5, .count = 1, .subtypes = CRITICAL});
+    }
+    LOG_ASSERT(h.n_pending == HISTORY_MAX_PENDING);
+    LOG_ASSERT(h.dropped == 14);
+
+    return true;
+}
+
+/**
+ * Test that queued blocks are appended in request order within the room and budget given, marked as resent, and the
+ * rest stay queued.
+ */
+bool test_fill(void) {
+
+    uint8_t buf[64];
+    PacketBuilder b;
+    packet_builder_init(&b, buf, sizeof(buf));
+    init(4, sizeof(buf));
+    for (uint32_t num = 0; num < 4; num++) {
+        store_packet(&b, num);
+    }
+    LOG_ASSERT(history_request(&h, &(ResendRequest){.first = 0, .count = 4, .subtypes = CRITICAL}) == 4);
+
+    // A full header leaves room for 3 blocks of 16 bytes, but the budget only allows 1
+    uint8_t out[64];
+    PacketBuilder o;
+    packet_builder_init(&o, out, sizeof(out));
+    packet_builder_start(&o, &header, false, 100);
+    LOG_ASSERT(history_fill(&h, &o, 31) == 16);
+    LOG_ASSERT(out[o.len - 1] == 0);
+    LOG_ASSERT(h.n_pending == 3 && h.resent == 1);
+    const BlockHeader *resent = (const BlockHeader *)(out + o.len - 16);
+    LOG_ASSERT(block_header_is_resent(resent) && block_header_get_type(resent) == TYPE_DATA);
+    LOG_ASSERT(resent->subtype == DATA_DBG_MSG);
+
+    LOG_ASSERT(history_fill(&h, &o, UINT16_MAX) == 32);
+    LOG_ASSERT(out[o.len - 17] == 1 && out[o.len - 1] == 2);
+    LOG_ASSERT(packet_get_length(out) == o.len);
+    LOG_ASSERT(h.n_pending == 1 && h.pending[0].packet_num == 3);
+
+    // Blocks of packets that have left the history are dropped instead of resent
+    store_packet(&b, 7);
+    packet_builder_start(&o, &header, false, 101);
+    LOG_ASSERT(history_fill(&h, &o, UINT16_MAX) == 0);
+    LOG_ASSERT(h.n_pending == 0 && h.dropped == 1);
+
+    return true;
+}
+
+/**
+ * Test that a request received over a local stand-in for the uplink queue makes a sink resend the critical blocks of
+ * earlier packets in its next packets, even while fresh data would fill them.
+ */
+bool test_uplink_resend(void) {
+
+    char path[] = "/tmp/test_history_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1) close(fd);
+    unlink(path);
+
+    const char *uplink = "/test_history_uplink";
+    struct mq_attr attr = {.mq_flags = 0, .mq_maxmsg = 4, .mq_msgsize = sizeof(ResendRequest)};
+    mq_unlink(uplink);
+    mqd_t up = mq_open(uplink, O_CREAT | O_RDWR | O_NONBLOCK, S_IRUSR | S_IWUSR, &attr);
+    if (up == (mqd_t)-1) {
+        puts("Message queues are not available, skipping");
+        return true;
+    }
+
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+    SinkConfig cfg;
+    char spec[64];
+    snprintf(spec, sizeof(spec), "file=%s,size=64,history=8", path);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(cfg.history == 8);
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    // Each packet holds a debug block and a 32 byte block of padding, which the next block does not fit after
+    uint8_t block[32] = {0};
+    for (uint8_t i = 0; i < 3; i++) {
+        fanout_offer(&f, block, debug_block(block, 0xA0 + i), SINK_TAG_EVENT, 0, 0, 0);
+        block_header_init((BlockHeader *)block, 28, TYPE_DATA, DATA_TEMP, GROUNDSTATION);
+        fanout_offer(&f, block, 32, SINK_TAG_EVENT, 0, 0, 0);
+    }
+    LOG_ASSERT(f.sinks[0].sent == 2);
+
+    // The ground station lost packets 0 and 1 and wants their debug blocks back
+    const ResendRequest sent = {.sink = 0, .first = 0, .count = 2, .subtypes = CRITICAL};
+    LOG_ASSERT(mq_send(up, (const char *)&sent, sizeof(sent), 0) == 0);
+    ResendRequest r;
+    LOG_ASSERT(mq_receive(up, (char *)&r, sizeof(r), NULL) == sizeof(r));
+    LOG_ASSERT(fanout_resend(&f, &r) == 2);
+    LOG_ASSERT(fanout_resend(&f, &(ResendRequest){.sink = 1, .count = 0, .subtypes = CRITICAL}) == 0);
+
+    // Packet 2 has no room left for them, and fresh data fills every later packet, but each new packet reserves a
+    // quarter of its 64 bytes for one of them
+    for (uint8_t i = 3; i < 5; i++) {
+        fanout_offer(&f, block, debug_block(block, 0xA0 + i), SINK_TAG_EVENT, 0, 0, 0);
+        LOG_ASSERT(f.sinks[0].history.resent == i - 2u);
+        block_header_init((BlockHeader *)block, 12, TYPE_DATA, DATA_TEMP, GROUNDSTATION);
+        fanout_offer(&f, block, 16, SINK_TAG_EVENT, 0, 0, 0);
+    }
+    fanout_close(&f, 0);
+    LOG_ASSERT(f.sinks[0].sent == 5);
+    LOG_ASSERT(f.sinks[0].history.resent == 2);
+
+    uint8_t out[512];
+    fd = open(path, O_RDONLY);
+    const ssize_t n = read(fd, out, sizeof(out));
+    close(fd);
+    unlink(path);
+
+    uint8_t markers[8];
+    bool resent[8];
+    int found = 0;
+    for (ssize_t pos = 0; pos < n; pos += packet_get_length(out + pos)) {
+        BlockIterator it;
+        LOG_ASSERT(block_iter_init(&it, out + pos, packet_get_length(out + pos)));
+        const BlockHeader *bh;
+        const uint8_t *payload;
+        while (block_iter_next(&it, &bh, &payload) == 1) {
+            if (bh->subtype != DATA_DBG_MSG || found == 8) continue;
+            resent[found] = block_header_is_resent(bh);
+            markers[found++] = payload[0];
+        }
+    }
+    LOG_ASSERT(found == 7);
+    LOG_ASSERT(markers[0] == 0xA0 && markers[1] == 0xA1 && markers[2] == 0xA2 && markers[3] == 0xA3);
+    LOG_ASSERT(markers[4] == 0xA0 && markers[5] == 0xA4 && markers[6] == 0xA1);
+    LOG_ASSERT(!resent[0] && !resent[3] && resent[4] && !resent[5] && resent[6]);
+
+    mq_close(up);
+    mq_unlink(uplink);
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    // The packets stored directly in the history share the header of the fan-out
+    packet_header_template_init(&header, "VA3ZZZ", 1, ROCKET);
+
+    RUN_TEST(test_store_and_find);
+    RUN_TEST(test_request);
+    RUN_TEST(test_fill);
+    RUN_TEST(test_uplink_resend);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file test_inputs.c
+ * @brief Tests draining several input queues in weighted turns from one poll loop.
+ */
+#include "../src/inputs.h"
+#include "../src/intypes.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** The names of the input queues used by the tests. */
+static const char *names[] = {"/test_inputs_a", "/test_inputs_b", "/test_inputs_c"};
+
+/** The queues, opened for sending. */
+static mqd_t senders[3];
+
+/** The input set used by the tests. */
+static InputSet set;
+
+/**
+ * Creates the input queues used by the tests, empty.
+ * @return True if the queues were created, false if message queues are not available.
+ */
+static bool create_queues(void) {
+    struct mq_attr attr = {.mq_flags = 0, .mq_maxmsg = 10, .mq_msgsize = sizeof(common_t)};
+    for (int i = 0; i < 3; i++) {
+        mq_unlink(names[i]);
+        senders[i] = mq_open(names[i], O_CREAT | O_WRONLY | O_NONBLOCK, S_IRUSR | S_IWUSR, &attr);
+        if (senders[i] == (mqd_t)-1) return false;
+    }
+    return true;
+}
+
+/**
+ * Closes and removes the input queues used by the tests.
+ */
+static void remove_queues(void) {
+    input_set_close(&set);
+    for (int i = 0; i < 3; i++) {
+        mq_close(senders[i]);
+        mq_unlink(names[i]);
+    }
+}
+
+/**
+ * Sends a message identified by a sequence number to an input queue.
+ * @param queue The index of the queue.
+ * @param seq The sequence number of the message.
+ * @param priority The priority of the message.
+ * @return True if the message was sent.
+ */
+static bool send(const int queue, const uint16_t seq, const unsigned int priority) {
+    const common_t msg = {.type = TAG_TEMPERATURE, .seq = seq};
+    return mq_send(senders[queue], (const char *)&msg, sizeof(msg), priority) == 0;
+}
+
+/**
+ * Receives the next message from the input set without waiting.
+ * @param source Where to store the index of the queue the message came from.
+ * @return The sequence number of the message, or -1 if there was none.
+ */
+static int receive(uint8_t *source) {
+    common_t msg;
+    unsigned int priority;
+    if (input_set_receive(&set, (char *)&msg, sizeof(msg), &priority, source, 0) != sizeof(msg)) return -1;
+    return msg.seq;
+}
+
+/**
+ * Test that queue specifications are parsed and that invalid ones and missing queues are rejected.
+ */
+bool test_add(void) {
+
+    input_set_init(&set);
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_a:3"));
+    LOG_ASSERT(!strcmp(set.queues[0].name, names[0]) && set.queues[0].weight == 3);
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_b"));
+    LOG_ASSERT(set.queues[1].weight == 1);
+
+    LOG_ASSERT(!input_set_add(&set, "/test_inputs_c:0") && errno == EINVAL);
+    LOG_ASSERT(!input_set_add(&set, "/test_inputs_c:65") && errno == EINVAL);
+    LOG_ASSERT(!input_set_add(&set, ":2") && errno == EINVAL);
+    LOG_ASSERT(!input_set_add(&set, "/test_inputs_missing") && errno == ENOENT);
+    LOG_ASSERT(set.count == 2);
+
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_c"));
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_c"));
+    LOG_ASSERT(!input_set_add(&set, "/test_inputs_c") && errno == ENOSPC);
+
+    input_set_close(&set);
+    LOG_ASSERT(set.count == 0);
+    return true;
+}
+
+/**
+ * Test that each round takes up to the weight of every queue in messages, so a full queue cannot starve the others,
+ * and that the rounds each queue gave its whole weight in are counted.
+ */
+bool test_weighted_rounds(void) {
+
+    input_set_init(&set);
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_a"));
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_b:2"));
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_c:2"));
+
+    for (uint16_t i = 0; i < 6; i++) {
+        LOG_ASSERT(send(0, 100 + i, 0));
+        LOG_ASSERT(send(1, 200 + i, 0));
+    }
+    LOG_ASSERT(send(2, 300, 0));
+
+    static const int expected[] = {100, 200, 201, 300, 101, 202, 203, 102, 204, 205, 103, 104, 105};
+    uint8_t source;
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        LOG_ASSERT(receive(&source) == expected[i]);
+        LOG_ASSERT(source == expected[i] / 100 - 1);
+    }
+    LOG_ASSERT(receive(&source) == -1 && errno == EAGAIN);
+
+    LOG_ASSERT(set.queues[0].received == 6 && set.queues[1].received == 6 && set.queues[2].received == 1);
+    LOG_ASSERT(set.queues[0].busy_rounds == 6 && set.queues[0].full_turns == 6);
+    LOG_ASSERT(set.queues[1].busy_rounds == 3 && set.queues[1].full_turns == 3);
+    LOG_ASSERT(set.queues[2].busy_rounds == 1 && set.queues[2].full_turns == 0);
+
+    input_set_close(&set);
+    return true;
+}
+
+/**
+ * Test that messages within a queue are received by priority, and that a single queue is read without rounds.
+ */
+bool test_priority(void) {
+
+    input_set_init(&set);
+    LOG_ASSERT(input_set_add(&set, "/test_inputs_a:4"));
+    LOG_ASSERT(send(0, 1, 0));
+    LOG_ASSERT(send(0, 2, 5));
+    LOG_ASSERT(send(0, 3, 1));
+
+    uint8_t source;
+    LOG_ASSERT(receive(&source) == 2);
+    LOG_ASSERT(receive(&source) == 3);
+    LOG_ASSERT(receive(&source) == 1);
+    LOG_ASSERT(receive(&source) == -1 && errno == EAGAIN);
+    LOG_ASSERT(set.queues[0].received == 3 && set.queues[0].busy_rounds == 0);
+
+    input_set_close(&set);
+    return true;
+}
+
+/**
+ * Sends a message to the last input queue after a short delay.
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *send_later(void *arg) {
+    (void)arg;
+    const struct timespec delay = {.tv_nsec = 20000000};
+    nanosleep(&delay, NULL);
+    send(2, 42, 0);
+    return NULL;
+}
+
+/**
+ * Test that waiting times out when no queue receives a message, and wakes up as soon as any of them does.
+ */
+bool test_wait(void) {
+
+    input_set_init(&set);
+    for (int i = 0; i < 3; i++) {
+        LOG_ASSERT(input_set_add(&set, names[i]));
+    }
+
+    common_t msg;
+    unsigned int priority;
+    uint8_t source;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    LOG_ASSERT(input_set_receive(&set, (char *)&msg, sizeof(msg), &priority, &source, 10) == -1);
+    LOG_ASSERT(errno == ETIMEDOUT);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LOG_ASSERT((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000 >= 9);
+
+    pthread_t thread;
+    LOG_ASSERT(pthread_create(&thread, NULL, send_later, NULL) == 0);
+    LOG_ASSERT(input_set_receive(&set, (char *)&msg, sizeof(msg), &priority, &source, -1) == sizeof(msg));
+    pthread_join(thread, NULL);
+    LOG_ASSERT(msg.seq == 42 && source == 2);
+
+    input_set_close(&set);
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    if (!create_queues()) {
+        puts("Message queues are not available, skipping");
+        return EXIT_SUCCESS;
+    }
+
+    RUN_TEST(test_add);
+    RUN_TEST(test_weighted_rounds);
+    RUN_TEST(test_priority);
+    RUN_TEST(test_wait);
+
+    remove_queues();
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
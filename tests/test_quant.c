@@ -0,0 +1,239 @@
+/**
+ * @file test_quant.c
+ * @brief Tests compiling quantization profiles and packing and unpacking data blocks.
+ */
+#include "../src/decoder.h"
+#include "../src/encoder.h"
+#include "../src/intypes.h"
+#include "../src/packet_types.h"
+#include "../src/quant.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Profiles used by the tests, reinitialized by each test. */
+static QuantProfile p;
+
+/**
+ * Encodes a reading, packs it and unpacks it again.
+ * @param msg The reading.
+ * @param mission_time The mission time of the reading.
+ * @param standard Where to store the standard block encoded from the reading.
+ * @param unpacked Where to store the block unpacked from the packed block.
+ * @return The size of the packed block, or 0 if unpacking failed or did not give back a block of the standard size.
+ */
+static uint16_t roundtrip(const common_t *msg, const uint32_t mission_time, uint8_t *standard, uint8_t *unpacked) {
+    uint8_t packed[ENCODED_BLOCK_MAX_SIZE];
+    const uint16_t size = encode_block(standard, msg, mission_time);
+    memcpy(packed, standard, size);
+    const uint16_t packed_size = quant_pack(&p, packed, size);
+    if (quant_unpack(&p, (const BlockHeader *)packed, packed + sizeof(BlockHeader), unpacked) != size) return 0;
+    return packed_size;
+}
+
+/**
+ * Test that profiles are compiled into layouts with the right number of bits and block sizes, and that invalid
+ * profiles are rejected.
+ */
+bool test_parse(void) {
+
+    quant_init(&p);
+    LOG_ASSERT(quant_parse(&p, "0x03 0:3600000/10 -40000:85000/100   # Temperature"));
+    LOG_ASSERT(quant_parse(&p, "  6\t0:3600000/10 -16000:16000/10 -16000:16000/10 -16000:16000/10\n"));
+    LOG_ASSERT(quant_parse(&p, "0x09 0:4000000000 -900000000:900000000/10 -1800000000:1800000000/16"));
+    LOG_ASSERT(quant_parse(&p, "# Comment"));
+    LOG_ASSERT(quant_parse(&p, ""));
+
+    const QuantLayout *temp = quant_layout(&p, DATA_TEMP);
+    LOG_ASSERT(temp != NULL && temp->n_ops == 2);
+    LOG_ASSERT(temp->ops[0].bits == 19 && temp->ops[1].bits == 11 && temp->bits == 30);
+    LOG_ASSERT(temp->size == sizeof(BlockHeader) + 4 && temp->standard_size == sizeof(BlockHeader) + 8);
+    LOG_ASSERT(temp->header.type == TYPE_DATA_PACKED && temp->header.subtype == DATA_TEMP);
+    LOG_ASSERT(block_header_get_length(&temp->header) == temp->size);
+
+    const QuantLayout *accel = quant_layout(&p, DATA_ACCEL_ABS);
+    LOG_ASSERT(accel != NULL && accel->bits == 19 + 3 * 12 && accel->size == sizeof(BlockHeader) + 8);
+    const QuantLayout *coords = quant_layout(&p, DATA_LAT_LONG);
+    LOG_ASSERT(coords != NULL && coords->bits == 32 + 28 + 28 && coords->size == sizeof(BlockHeader) + 12);
+    LOG_ASSERT(coords->ops[1].shift == -1 && coords->ops[2].shift == 4);
+    LOG_ASSERT(quant_layout(&p, DATA_PRESSURE) == NULL);
+
+    LOG_ASSERT(!quant_parse(&p, "0x03 0:1000 0:100"));                 // Already has a profile
+    LOG_ASSERT(!quant_parse(&p, "0x00 0:1000"));                       // Debug messages
+    LOG_ASSERT(!quant_parse(&p, "0x0d 0:1000 0:100"));                 // Not a built-in reading
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000"));                       // Too few ranges
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0:100 0:100"));           // Too many ranges
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 100:100"));               // Empty range
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0:100/101"));             // Coarser than the range
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0:100/0"));               // No resolution
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0:100/-1"));              // Negative resolution
+    LOG_ASSERT(!quant_parse(&p, "0x04 -1:1000 0:100"));                // Negative mission time
+    LOG_ASSERT(!quant_parse(&p, "0x05 0:1000 0:40000 0:1 0:1"));       // Beyond a 16 bit field
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0-100"));                 // Malformed
+    LOG_ASSERT(!quant_parse(&p, "0x04 0:1000 0:100/5x"));              // Trailing characters
+    LOG_ASSERT(quant_layout(&p, DATA_PRESSURE) == NULL);
+
+    return true;
+}
+
+/**
+ * Test that readings within the range are restored to within half a step, and that blocks decode as before.
+ */
+bool test_roundtrip(void) {
+
+    quant_init(&p);
+    LOG_ASSERT(quant_parse(&p, "0x03 0:3600000/10 -40000:85000/100"));
+    LOG_ASSERT(quant_parse(&p, "0x06 0:3600000/8 -16000:16000/10 -16000:16000/10 -16000:16000/10"));
+    LOG_ASSERT(quant_parse(&p, "0x0a 0:3600000/10 0:15 0:20000/5"));
+
+    uint8_t standard[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t unpacked[ENCODED_BLOCK_MAX_SIZE];
+    for (int32_t i = 0; i < 1000; i++) {
+        const uint32_t t = i * 3599;
+        const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = -40.0f + i * 0.12345f};
+        LOG_ASSERT(roundtrip(&temp, t, standard, unpacked) == sizeof(BlockHeader) + 4);
+        const TemperatureDB *a = (const TemperatureDB *)(standard + sizeof(BlockHeader));
+        const TemperatureDB *b = (const TemperatureDB *)(unpacked + sizeof(BlockHeader));
+        LOG_ASSERT(abs(a->temperature - b->temperature) <= 50);
+        LOG_ASSERT(abs((int32_t)(a->mission_time - b->mission_time)) <= 5);
+        LOG_ASSERT(b->temperature % 100 == 0 && b->mission_time % 10 == 0);
+
+        const common_t accel = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {i * 0.3f - 150.0f, 9.81f, -i * 0.1f}};
+        LOG_ASSERT(roundtrip(&accel, t, standard, unpacked) == sizeof(BlockHeader) + 8);
+        const AccelerationDB *c = (const AccelerationDB *)(standard + sizeof(BlockHeader));
+        const AccelerationDB *d = (const AccelerationDB *)(unpacked + sizeof(BlockHeader));
+        LOG_ASSERT(abs(c->x - d->x) <= 5 && abs(c->y - d->y) <= 5 && abs(c->z - d->z) <= 5);
+        LOG_ASSERT(abs((int32_t)(c->mission_time - d->mission_time)) <= 4 && d->_padding == 0);
+
+        const common_t volts = {.type = TAG_VOLTAGE, .id = i % 16, .data.I16 = i * 17};
+        LOG_ASSERT(roundtrip(&volts, t, standard, unpacked) == sizeof(BlockHeader) + 8);
+        const VoltageDB *e = (const VoltageDB *)(unpacked + sizeof(BlockHeader));
+        LOG_ASSERT(e->id == i % 16 && abs(e->voltage - i * 17) <= 2);
+    }
+
+    // The unpacked block is a standard block
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 21.5f};
+    LOG_ASSERT(roundtrip(&temp, 123450, standard, unpacked) != 0);
+    LOG_ASSERT(!memcmp(standard, unpacked, sizeof(BlockHeader) + sizeof(TemperatureDB)));
+    common_t decoded;
+    uint32_t mission_time;
+    LOG_ASSERT(decode_block((const BlockHeader *)unpacked, unpacked + sizeof(BlockHeader), &decoded, &mission_time));
+    LOG_ASSERT(decoded.type == TAG_TEMPERATURE && decoded.data.FLOAT > 21.49f && decoded.data.FLOAT < 21.51f);
+    LOG_ASSERT(mission_time == 123450);
+
+    return true;
+}
+
+/**
+ * Test that readings outside the range saturate at its ends, and that corrupted steps do not leave the range.
+ */
+bool test_saturation(void) {
+
+    quant_init(&p);
+    LOG_ASSERT(quant_parse(&p, "0x03 0:3600000/10 -40000:85000/100"));
+
+    uint8_t standard[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t unpacked[ENCODED_BLOCK_MAX_SIZE];
+    const TemperatureDB *b = (const TemperatureDB *)(unpacked + sizeof(BlockHeader));
+    const common_t cold = {.type = TAG_TEMPERATURE, .data.FLOAT = -273.0f};
+    LOG_ASSERT(roundtrip(&cold, 0, standard, unpacked) != 0);
+    LOG_ASSERT(b->temperature == -40000 && b->mission_time == 0);
+    const common_t hot = {.type = TAG_TEMPERATURE, .data.FLOAT = 1000.0f};
+    LOG_ASSERT(roundtrip(&hot, 4000000, standard, unpacked) != 0);
+    LOG_ASSERT(b->temperature == 85000 && b->mission_time == 3600000);
+
+    // Steps past the end of the range can only come from a corrupted block
+    uint8_t packed[sizeof(BlockHeader) + 4];
+    memcpy(packed, &quant_layout(&p, DATA_TEMP)->header, sizeof(BlockHeader));
+    memset(packed + sizeof(BlockHeader), 0xFF, 4);
+    LOG_ASSERT(quant_unpack(&p, (const BlockHeader *)packed, packed + sizeof(BlockHeader), unpacked) != 0);
+    LOG_ASSERT(b->temperature == 85000 && b->mission_time == 3600000);
+
+    return true;
+}
+
+/**
+ * Test that blocks without a profile are left as is and that blocks that do not match their layout are not unpacked.
+ */
+bool test_unpacked_blocks(void) {
+
+    quant_init(&p);
+    LOG_ASSERT(quant_parse(&p, "0x03 0:3600000/10 -40000:85000/100"));
+
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t copy[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t unpacked[ENCODED_BLOCK_MAX_SIZE];
+    const common_t pressure = {.type = TAG_PRESSURE, .data.FLOAT = 101.3f};
+    const uint16_t size = encode_block(block, &pressure, 1000);
+    memcpy(copy, block, size);
+    LOG_ASSERT(quant_pack(&p, block, size) == size && !memcmp(block, copy, size));
+    LOG_ASSERT(quant_unpack(&p, (const BlockHeader *)block, block + sizeof(BlockHeader), unpacked) == 0);
+
+    // A packed block is not packed again
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 21.5f};
+    const uint16_t packed_size = quant_pack(&p, block, encode_block(block, &temp, 1000));
+    LOG_ASSERT(packed_size == sizeof(BlockHeader) + 4);
+    LOG_ASSERT(quant_pack(&p, block, packed_size) == packed_size);
+
+    // Nor is a packed block with the wrong length unpacked
+    block_header_init((BlockHeader *)block, 8, TYPE_DATA_PACKED, DATA_TEMP, GROUNDSTATION);
+    LOG_ASSERT(quant_unpack(&p, (const BlockHeader *)block, block + sizeof(BlockHeader), unpacked) == 0);
+
+    // Without the profile, the decoder does not mistake a packed block for a standard one
+    common_t decoded;
+    uint32_t mission_time;
+    LOG_ASSERT(!decode_block((const BlockHeader *)block, block + sizeof(BlockHeader), &decoded, &mission_time));
+
+    return true;
+}
+
+/**
+ * Test that profile files are loaded and the first invalid line is reported.
+ */
+bool test_load(void) {
+
+    char path[] = "/tmp/test_quant_XXXXXX";
+    const int fd = mkstemp(path);
+    LOG_ASSERT(fd >= 0);
+    FILE *f = fdopen(fd, "w");
+    fputs("# subtype time field...\n0x03 0:3600000/10 -40000:85000/100\n\n0x0b 0:3600000/10 -500000:500000/10", f);
+    fclose(f);
+
+    unsigned int line;
+    quant_init(&p);
+    LOG_ASSERT(quant_load(&p, path, &line) && line == 0);
+    LOG_ASSERT(quant_layout(&p, DATA_TEMP) != NULL && quant_layout(&p, DATA_VELOCITY) != NULL);
+
+    f = fopen(path, "w");
+    fputs("0x03 0:3600000/10 -40000:85000/100\n0x03 0:3600000/10 -40000:85000/100\n", f);
+    fclose(f);
+    quant_init(&p);
+    LOG_ASSERT(!quant_load(&p, path, &line) && line == 2);
+
+    remove(path);
+    LOG_ASSERT(!quant_load(&p, path, &line) && line == 0);
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_parse);
+    RUN_TEST(test_roundtrip);
+    RUN_TEST(test_saturation);
+    RUN_TEST(test_unpacked_blocks);
+    RUN_TEST(test_load);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file test_reorder.c
+ * @brief Tests restoring the send order of input messages with the reorder buffer.
+ */
+#include "../src/intypes.h"
+#include "../src/reorder.h"
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Reorder buffer used by the tests, reinitialized by each test. */
+static ReorderBuffer r;
+
+/** Memory the held messages of the reorder buffer are allocated from. */
+static _Alignas(ARENA_ALIGN) uint8_t memory[REORDER_MAX * sizeof(ReorderEntry)];
+
+/** Arena over the memory, emptied by each test. */
+static Arena arena;
+
+/** Sequence numbers of the released messages. */
+static uint16_t released[256];
+
+/** Number of released messages. */
+static size_t n_released;
+
+/**
+ * Empties the reorder buffer and its arena.
+ * @param window The most messages to hold.
+ * @param latency_ms The most milliseconds to hold a message.
+ */
+static void init(const uint8_t window, const uint32_t latency_ms) {
+    arena_init(&arena, memory, sizeof(memory));
+    reorder_init(&r, window, latency_ms, &arena);
+}
+
+/**
+ * Adds a message with the given sequence number and releases whatever may be released.
+ * @param seq The sequence number of the message.
+ * @param now_ms The current time in milliseconds.
+ * @return Whether the message was held.
+ */
+static bool push(const uint16_t seq, const uint32_t now_ms) {
+    const common_t msg = {.type = TAG_TEMPERATURE, .seq = seq, .data.FLOAT = seq};
+    const bool held = reorder_push(&r, &msg, seq % 3, now_ms);
+
+    common_t out;
+    unsigned int priority;
+    while (reorder_pop(&r, &out, &priority, now_ms, false)) {
+        if (priority != out.seq % 3u || out.data.FLOAT != out.seq) return false; // Message mixed up with another one
+        released[n_released++] = out.seq;
+    }
+    return held;
+}
+
+/**
+ * Checks that the released messages have the given sequence numbers, in order.
+ * @param expected The expected sequence numbers.
+ * @param n The number of expected sequence numbers.
+ * @return True if they match.
+ */
+static bool released_are(const uint16_t *expected, const size_t n) {
+    return n_released == n && !memcmp(released, expected, n * sizeof(uint16_t));
+}
+
+/**
+ * Test that messages received in order pass straight through, including across the wrap of the sequence numbers.
+ */
+bool test_in_order(void) {
+
+    init(8, 20);
+    n_released = 0;
+    for (uint16_t seq = 65530; seq != 6; seq++) {
+        LOG_ASSERT(push(seq, 0));
+        LOG_ASSERT(r.count == 0);
+    }
+    LOG_ASSERT(n_released == 12);
+    LOG_ASSERT(r.reordered == 0 && r.skipped == 0);
+
+    return true;
+}
+
+/**
+ * Test that messages which overtook earlier ones are held until the earlier ones arrive.
+ */
+bool test_restores_order(void) {
+
+    init(8, 20);
+    n_released = 0;
+    const uint16_t arrivals[] = {10, 12, 13, 11, 14, 16, 15};
+    for (size_t i = 0; i < sizeof(arrivals) / sizeof(arrivals[0]); i++) {
+        LOG_ASSERT(push(arrivals[i], 0));
+    }
+
+    const uint16_t expected[] = {10, 11, 12, 13, 14, 15, 16};
+    LOG_ASSERT(released_are(expected, 7));
+    LOG_ASSERT(r.reordered == 3);
+    LOG_ASSERT(r.max_count == 3);
+
+    return true;
+}
+
+/**
+ * Test that exact duplicates are dropped whether they are still held or already released.
+ */
+bool test_duplicates(void) {
+
+    init(8, 20);
+    n_released = 0;
+    LOG_ASSERT(push(1, 0));
+    LOG_ASSERT(push(3, 0));
+    LOG_ASSERT(!push(3, 0)); // Held
+    LOG_ASSERT(!push(1, 0)); // Released
+    LOG_ASSERT(push(2, 0));
+
+    const uint16_t expected[] = {1, 2, 3};
+    LOG_ASSERT(released_are(expected, 3));
+    LOG_ASSERT(r.duplicates == 2);
+
+    return true;
+}
+
+/**
+ * Test that a missing message is given up on after the latency limit or when the window is full, and dropped as late
+ * if it arrives afterwards.
+ */
+bool test_missing(void) {
+
+    init(4, 20);
+    n_released = 0;
+    LOG_ASSERT(push(1, 0));
+    LOG_ASSERT(push(3, 0));
+    LOG_ASSERT(reorder_wait_ms(&r, 5) == 15);
+    LOG_ASSERT(push(4, 10));
+    LOG_ASSERT(n_released == 1);
+
+    // Message 2 is given up on once message 3 has waited 20 ms
+    common_t out;
+    unsigned int priority;
+    LOG_ASSERT(!reorder_pop(&r, &out, &priority, 19, false));
+    LOG_ASSERT(reorder_wait_ms(&r, 20) == 0);
+    LOG_ASSERT(reorder_pop(&r, &out, &priority, 20, false) && out.seq == 3);
+    LOG_ASSERT(reorder_pop(&r, &out, &priority, 20, false) && out.seq == 4);
+    LOG_ASSERT(reorder_wait_ms(&r, 20) == -1);
+    LOG_ASSERT(r.skipped == 1);
+    LOG_ASSERT(!push(2, 30));
+    LOG_ASSERT(r.late == 1);
+
+    // A full window gives up on message 5
+    n_released = 0;
+    for (uint16_t seq = 6; seq < 10; seq++) {
+        push(seq, 40);
+    }
+    const uint16_t expected[] = {6, 7, 8, 9};
+    LOG_ASSERT(released_are(expected, 4));
+    LOG_ASSERT(r.skipped == 2);
+
+    return true;
+}
+
+/**
+ * Test that flushing releases everything held regardless of missing messages.
+ */
+bool test_flush(void) {
+
+    init(8, 1000);
+    n_released = 0;
+    push(10, 0);
+    push(12, 0);
+    push(13, 0);
+    LOG_ASSERT(n_released == 1);
+
+    common_t out;
+    unsigned int priority;
+    while (reorder_pop(&r, &out, &priority, 0, true)) {
+        released[n_released++] = out.seq;
+    }
+    const uint16_t expected[] = {10, 12, 13};
+    LOG_ASSERT(released_are(expected, 3));
+    LOG_ASSERT(r.count == 0);
+
+    return true;
+}
+
+/**
+ * Test that a restarted source is followed once the messages from before the restart are released.
+ */
+bool test_restart(void) {
+
+    init(8, 1000);
+    n_released = 0;
+    push(500, 0);
+    push(502, 0);
+    push(503, 0);
+    LOG_ASSERT(push(0, 0));
+    LOG_ASSERT(push(1, 0));
+    LOG_ASSERT(!r.restarting);
+
+    const uint16_t expected[] = {500, 502, 503, 0, 1};
+    LOG_ASSERT(released_are(expected, 5));
+    LOG_ASSERT(r.skipped == 1);
+    LOG_ASSERT(r.late == 0);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_restores_order);
+    RUN_TEST(test_duplicates);
+    RUN_TEST(test_missing);
+    RUN_TEST(test_flush);
+    RUN_TEST(test_restart);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file test_rt.c
+ * @brief Tests entering real-time mode and recording latency statistics.
+ */
+#include "../src/rt.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Latency statistics used by the tests. */
+static LatencyStats s;
+
+/**
+ * Test that latencies are counted in power of 2 buckets of microseconds and that the worst case is kept exactly.
+ */
+bool test_latency_buckets(void) {
+
+    latency_init(&s);
+    latency_record(&s, 999);
+    latency_record(&s, 1000);
+    latency_record(&s, 1999);
+    latency_record(&s, 2000);
+    latency_record(&s, 1000000);
+    latency_record(&s, 3600000000000u);
+    LOG_ASSERT(s.buckets[0] == 1 && s.buckets[1] == 2 && s.buckets[2] == 1);
+    LOG_ASSERT(s.buckets[10] == 1 && s.buckets[LATENCY_BUCKETS - 1] == 1);
+    LOG_ASSERT(s.count == 6 && s.max_ns == 3600000000000u);
+    LOG_ASSERT(s.sum_ns == 999 + 1000 + 1999 + 2000 + 1000000 + 3600000000000u);
+
+    return true;
+}
+
+/**
+ * Test that percentiles are bounded by the upper end of their bucket and by the worst case.
+ */
+bool test_latency_percentiles(void) {
+
+    latency_init(&s);
+    LOG_ASSERT(latency_percentile_ns(&s, 990) == 0);
+
+    for (int i = 0; i < 990; i++) latency_record(&s, 3000);
+    for (int i = 0; i < 9; i++) latency_record(&s, 100000);
+    latency_record(&s, 700000);
+    LOG_ASSERT(latency_percentile_ns(&s, 500) == 4000);
+    LOG_ASSERT(latency_percentile_ns(&s, 990) == 4000);
+    LOG_ASSERT(latency_percentile_ns(&s, 999) == 128000);
+    LOG_ASSERT(latency_percentile_ns(&s, 1000) == 700000);
+
+    latency_init(&s);
+    latency_record(&s, 5500);
+    LOG_ASSERT(latency_percentile_ns(&s, 990) == 5500);
+
+    return true;
+}
+
+/**
+ * Test that invalid priorities and CPUs are rejected, and that valid ones take effect where the process is allowed to
+ * use real-time scheduling.
+ */
+bool test_scheduling(void) {
+
+    LOG_ASSERT(!rt_set_priority(0) && errno == EINVAL);
+    LOG_ASSERT(!rt_set_priority(sched_get_priority_max(SCHED_FIFO) + 1) && errno == EINVAL);
+    LOG_ASSERT(!rt_set_cpu(-1) && errno == EINVAL);
+    LOG_ASSERT(!rt_set_cpu(1 << 20) && errno == EINVAL);
+    LOG_ASSERT(rt_set_cpu(0));
+
+    if (rt_set_priority(sched_get_priority_min(SCHED_FIFO))) {
+        int policy;
+        struct sched_param param;
+        LOG_ASSERT(pthread_getschedparam(pthread_self(), &policy, &param) == 0);
+        LOG_ASSERT(policy == SCHED_FIFO && param.sched_priority == sched_get_priority_min(SCHED_FIFO));
+        param.sched_priority = 0;
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    } else {
+        LOG_ASSERT(errno == EPERM);
+    }
+
+    return true;
+}
+
+/**
+ * Test that prefaulting leaves buffers as they were and that memory can be locked where the process is allowed to.
+ */
+bool test_prefault(void) {
+
+    static uint8_t buf[3 * 4096 + 100];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = i * 7;
+    rt_prefault(buf, sizeof(buf));
+    for (size_t i = 0; i < sizeof(buf); i++) LOG_ASSERT(buf[i] == (uint8_t)(i * 7));
+    rt_prefault(buf, 0);
+    rt_prefault_stack();
+
+    if (rt_lock_memory()) {
+        munlockall();
+    } else {
+        LOG_ASSERT(errno == EPERM || errno == ENOMEM);
+    }
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_latency_buckets);
+    RUN_TEST(test_latency_percentiles);
+    RUN_TEST(test_scheduling);
+    RUN_TEST(test_prefault);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+/**
+ * @file test_schema.c
+ * @brief Tests compiling schema files and encoding the readings of schema sensors.
+ */
+#include "../src/encoder.h"
+#include "../src/intypes.h"
+#include "../src/packet_types.h"
+#include "../src/schema.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Schema used by the tests, reinitialized by each test. */
+static Schema s;
+
+/**
+ * Encodes a reading with a built-in encoding and the same reading as a schema sensor described like the built-in one,
+ * and compares the blocks.
+ * @param builtin The reading of the built-in sensor.
+ * @param tag The tag of the schema sensor.
+ * @return True if the blocks only differ in their subtype.
+ */
+static bool same_as_builtin(const common_t *builtin, const uint8_t tag) {
+    uint8_t expected[ENCODED_BLOCK_MAX_SIZE];
+    uint8_t actual[ENCODED_BLOCK_MAX_SIZE];
+    common_t msg = *builtin;
+    msg.type = tag;
+
+    const uint16_t size = encode_block(expected, builtin, 123456);
+    if (schema_encode(&s, actual, &msg, 123456) != size) return false;
+    ((BlockHeader *)expected)->subtype = ((BlockHeader *)actual)->subtype;
+    return !memcmp(expected, actual, size);
+}
+
+/**
+ * Test that schema sensors described like built-in ones are encoded exactly like them, including saturation.
+ */
+bool test_matches_builtin(void) {
+
+    schema_init(&s);
+    LOG_ASSERT(schema_parse(&s, "0x11 0x20 f32:i32*1000   # Like temperature"));
+    LOG_ASSERT(schema_parse(&s, "0x0e 0x21 f32:i16*100 f32:i16*100 f32:i16*100"));
+    LOG_ASSERT(schema_parse(&s, "  15\t0x22 i32:i32 i32:i32\n"));
+    LOG_ASSERT(schema_parse(&s, "16 0x23 id:u16 i16:i16"));
+    LOG_ASSERT(schema_block_size(&s, 0x11) == sizeof(BlockHeader) + sizeof(TemperatureDB));
+    LOG_ASSERT(schema_block_size(&s, 0x0e) == sizeof(BlockHeader) + sizeof(AccelerationDB));
+
+    const float floats[] = {0.0f, 21.5f, -40.125f, 1e12f, -1e12f, NAN};
+    for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++) {
+        const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = floats[i]};
+        LOG_ASSERT(same_as_builtin(&temp, 0x11));
+        const common_t accel = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {floats[i], -floats[i], 9.81f}};
+        LOG_ASSERT(same_as_builtin(&accel, 0x0e));
+    }
+
+    const common_t coords = {.type = TAG_COORDS, .data.VEC2D_I32 = {453841234, -756941234}};
+    LOG_ASSERT(same_as_builtin(&coords, 15));
+    const common_t voltage = {.type = TAG_VOLTAGE, .id = 7, .data.I16 = -3300};
+    LOG_ASSERT(same_as_builtin(&voltage, 16));
+
+    return true;
+}
+
+/**
+ * Test the conversions of every field type, padding and the block header.
+ */
+bool test_fields(void) {
+
+    schema_init(&s);
+    LOG_ASSERT(schema_parse(&s, "20 0x30 id:u8 u8:i8 i8:u8 u16:u8*2 f32:u16*10"));
+    const common_t msg = {.type = 20, .id = 9, .data.U32 = 0x7F02FFC8u};
+
+    // Inputs are read in order: u8 0xC8 (200), i8 0xFF (-1), u16 0x7F02 and f32 from the next 4 bytes (0)
+    uint8_t buf[ENCODED_BLOCK_MAX_SIZE];
+    LOG_ASSERT(schema_encode(&s, buf, &msg, 42) == sizeof(BlockHeader) + 4 + 8);
+    const BlockHeader *h = (BlockHeader *)buf;
+    LOG_ASSERT(h->type == TYPE_DATA && h->subtype == 0x30 && h->dest_addr == GROUNDSTATION);
+    LOG_ASSERT(block_header_get_length(h) == sizeof(BlockHeader) + 4 + 8);
+
+    const uint8_t *p = buf + sizeof(BlockHeader);
+    uint32_t time;
+    memcpy(&time, p, sizeof(time));
+    LOG_ASSERT(time == 42);
+    LOG_ASSERT(p[4] == 9);           // Sensor ID
+    LOG_ASSERT((int8_t)p[5] == 127); // 200 saturates at the i8 maximum
+    LOG_ASSERT(p[6] == 0);           // -1 saturates at the u8 minimum
+    LOG_ASSERT(p[7] == 255);         // 0x7F02 * 2 saturates at the u8 maximum
+    LOG_ASSERT(p[8] == 0 && p[9] == 0);
+    LOG_ASSERT(p[10] == 0 && p[11] == 0); // Padding
+
+    // Negative float readings saturate at 0 for unsigned outputs
+    common_t neg = {.type = 20, .data.FLOAT = 0.0f};
+    memcpy((uint8_t *)&neg.data + 4, &(float){-5.0f}, sizeof(float));
+    schema_encode(&s, buf, &neg, 0);
+    LOG_ASSERT(p[8] == 0 && p[9] == 0);
+    memcpy((uint8_t *)&neg.data + 4, &(float){12.34f}, sizeof(float));
+    schema_encode(&s, buf, &neg, 0);
+    LOG_ASSERT(p[8] == 123 && p[9] == 0);
+
+    // Tags that are not described are not encoded
+    const common_t unknown = {.type = 21};
+    LOG_ASSERT(schema_encode(&s, buf, &unknown, 0) == 0);
+    const common_t builtin = {.type = TAG_TEMPERATURE};
+    LOG_ASSERT(schema_encode(&s, buf, &builtin, 0) == 0);
+
+    return true;
+}
+
+/**
+ * Test that invalid lines are rejected and ignored lines are accepted.
+ */
+bool test_invalid(void) {
+
+    schema_init(&s);
+    LOG_ASSERT(schema_parse(&s, ""));
+    LOG_ASSERT(schema_parse(&s, "   \n"));
+    LOG_ASSERT(schema_parse(&s, "# 0x11 0x20 f32:i32"));
+    LOG_ASSERT(schema_parse(&s, "0x11 0x20 f32:i32"));
+
+    LOG_ASSERT(!schema_parse(&s, "0x11 0x21 f32:i32"));                 // Already described
+    LOG_ASSERT(!schema_parse(&s, "0x00 0x21 f32:i32"));                 // Built in
+    LOG_ASSERT(!schema_parse(&s, "0x0b 0x21 u8:u8"));                   // Built in without a block
+    LOG_ASSERT(!schema_parse(&s, "0x0d 0x21 f32:i32"));                 // Estimated by packager
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x0c f32:i32"));                 // Subtype of an estimate
+    LOG_ASSERT(!schema_parse(&s, "32 0x21 f32:i32"));                   // Tag too large
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x03 f32:i32"));                 // Built-in subtype
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x110 f32:i32"));                // Subtype too large
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21"));                         // No fields
+    LOG_ASSERT(!schema_parse(&s, "0x0e"));                              // No subtype
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32:f32"));                 // Float output
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32:id"));                  // ID output
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f64:i32"));                 // Unknown type
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32"));                     // No output type
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32:i32*"));                // No scale
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32:i32*1e99"));            // Infinite scale
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 i16:i32*1.5"));             // Fractional integer scale
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 i32:i32 i32:i32 i32:i32")); // Block too large
+
+    // Past the end of the message data, and too many fields
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 f32:u8 f32:u8 f32:u8 u32:u8"));
+    LOG_ASSERT(!schema_parse(&s, "0x0e 0x21 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8"));
+    LOG_ASSERT(schema_block_size(&s, 0x0e) == 0);
+
+    LOG_ASSERT(schema_parse(&s, "0x0e 0x21 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8 u8:u8"));
+    LOG_ASSERT(schema_parse(&s, "0x0f 0x21 f32:i32*-0.5 i16:i16*-2"));
+
+    return true;
+}
+
+/**
+ * Test loading a schema file and reporting the line of the first invalid line.
+ */
+bool test_load(void) {
+
+    const char *path = "/tmp/test_schema.txt";
+    FILE *f = fopen(path, "w");
+    LOG_ASSERT(f != NULL);
+    fputs("# Sensors added after the flight computer was built\n\n0x11 0x20 f32:i32*1000\n0x0e 0x21 u16:u16", f);
+    fclose(f);
+
+    unsigned int line;
+    schema_init(&s);
+    LOG_ASSERT(schema_load(&s, path, &line));
+    LOG_ASSERT(schema_block_size(&s, 0x11) == sizeof(BlockHeader) + 8);
+    LOG_ASSERT(schema_block_size(&s, 0x0e) == sizeof(BlockHeader) + 8);
+
+    f = fopen(path, "w");
+    LOG_ASSERT(f != NULL);
+    fputs("0x11 0x20 f32:i32*1000\n# Comment\n0x11 0x21 u16:u16\n", f);
+    fclose(f);
+    schema_init(&s);
+    LOG_ASSERT(!schema_load(&s, path, &line));
+    LOG_ASSERT(line == 3);
+    remove(path);
+
+    LOG_ASSERT(!schema_load(&s, path, &line));
+    LOG_ASSERT(line == 0);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_matches_builtin);
+    RUN_TEST(test_fields);
+    RUN_TEST(test_invalid);
+    RUN_TEST(test_load);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
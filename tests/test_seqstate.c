@@ -0,0 +1,115 @@
+/**
+ * @file test_seqstate.c
+ * @brief Tests persisting packet sequence numbers across restarts in the sequence state file.
+ */
+#include "../src/seqstate.h"
+#include <stdio.h>
+#include <unistd.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** The state file used by the tests. */
+static char path[] = "/tmp/test_seqstate_XXXXXX";
+
+/**
+ * Test that a new state file starts numbering from 0 and that a clean restart resumes numbering and reports the
+ * outage.
+ */
+bool test_clean_restart(void) {
+
+    unlink(path);
+    SeqState s;
+    LOG_ASSERT(seqstate_open(&s, path, 1000));
+    LOG_ASSERT(!s.resumed);
+    LOG_ASSERT(*seqstate_counter(&s, 0) == 0);
+
+    for (int i = 0; i < 300; i++) {
+        seqstate_advance(&s, 0, 1000 + i);
+    }
+    seqstate_advance(&s, 1, 1400);
+    seqstate_close(&s, 1500);
+
+    LOG_ASSERT(seqstate_open(&s, path, 4500));
+    LOG_ASSERT(s.resumed);
+    LOG_ASSERT(s.was_clean);
+    LOG_ASSERT(s.downtime_ms == 3000);
+    LOG_ASSERT(s.data->restarts == 1);
+    LOG_ASSERT(*seqstate_counter(&s, 0) == 300);
+    LOG_ASSERT(*seqstate_counter(&s, 1) == 1);
+    seqstate_close(&s, 5000);
+
+    return true;
+}
+
+/**
+ * Test that counters advanced before a crash are kept, since they are stored straight into the mapped file, and that
+ * the restart is reported as unclean.
+ */
+bool test_crash_restart(void) {
+
+    unlink(path);
+    SeqState crashed;
+    LOG_ASSERT(seqstate_open(&crashed, path, 0));
+    seqstate_advance(&crashed, 0, 10);
+    seqstate_advance(&crashed, 0, 20);
+
+    // The crashed instance never closes its state
+    SeqState s;
+    LOG_ASSERT(seqstate_open(&s, path, 520));
+    LOG_ASSERT(s.resumed);
+    LOG_ASSERT(!s.was_clean);
+    LOG_ASSERT(s.downtime_ms == 500);
+    LOG_ASSERT(*seqstate_counter(&s, 0) == 2);
+    seqstate_close(&s, 600);
+
+    return true;
+}
+
+/**
+ * Test that a state file which does not hold a valid state is reset, and that an unusable path falls back to counting
+ * in memory.
+ */
+bool test_invalid_state(void) {
+
+    FILE *f = fopen(path, "wb");
+    LOG_ASSERT(f != NULL);
+    fputs("not a sequence state file, but long enough to look like one", f);
+    fclose(f);
+
+    SeqState s;
+    LOG_ASSERT(seqstate_open(&s, path, 0));
+    LOG_ASSERT(!s.resumed);
+    LOG_ASSERT(*seqstate_counter(&s, 0) == 0);
+    seqstate_close(&s, 0);
+
+    LOG_ASSERT(!seqstate_open(&s, "/nonexistent/directory/packager.seq", 0));
+    LOG_ASSERT(!s.resumed);
+    seqstate_advance(&s, 0, 0);
+    LOG_ASSERT(*seqstate_counter(&s, 0) == 1);
+    seqstate_close(&s, 0);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    int fd = mkstemp(path);
+    if (fd != -1) close(fd);
+
+    RUN_TEST(test_clean_restart);
+    RUN_TEST(test_crash_restart);
+    RUN_TEST(test_invalid_state);
+
+    unlink(path);
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
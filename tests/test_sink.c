@@ -0,0 +1,400 @@
+/**
+ * @file test_sink.c
+ * @brief Tests parsing sink specifications and fanning blocks out to sinks with different packet policies.
+ */
+#include "../src/decoder.h"
+#include "../src/encoder.h"
+#include "../src/sink.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+#include "fixtures.h"
+
+/** Memory the buffers of the sinks are allocated from. */
+static _Alignas(ARENA_ALIGN) uint8_t memory[4 * PACKET_LIMIT_SIZE];
+
+/** Arena over the memory, emptied by each test. */
+static Arena arena;
+
+/** Output files used by the tests. */
+static char paths[2][32] = {"/tmp/test_sink_a_XXXXXX", "/tmp/test_sink_b_XXXXXX"};
+
+/**
+ * Reads back the packets written to a file sink and counts them and the blocks they contain.
+ * @param path The output file of the sink.
+ * @param max_size The maximum packet size of the sink.
+ * @param packets Where to store the number of packets.
+ * @return The number of blocks, or -1 if a packet is invalid or too large.
+ */
+static int read_back(const char *path, const uint16_t max_size, int *packets) {
+    uint8_t buf[4096];
+    int fd = open(path, O_RDONLY);
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+
+    int blocks = 0;
+    *packets = 0;
+    for (ssize_t pos = 0; pos < n;) {
+        uint16_t len = packet_get_length(buf + pos);
+        BlockIterator it;
+        if (len > max_size || !block_iter_init(&it, buf + pos, len)) return -1;
+        const BlockHeader *h;
+        const uint8_t *payload;
+        while (block_iter_next(&it, &h, &payload) == 1) {
+            blocks++;
+        }
+        pos += len;
+        (*packets)++;
+    }
+    return blocks;
+}
+
+/**
+ * Test that valid sink specifications are parsed and invalid ones are rejected.
+ */
+bool test_parse(void) {
+
+    SinkConfig cfg;
+    LOG_ASSERT(sink_config_parse(&cfg, "mq=radio"));
+    LOG_ASSERT(cfg.kind == SINK_QUEUE);
+    LOG_ASSERT(!strcmp(cfg.target, "radio"));
+    LOG_ASSERT(cfg.max_size == PACKET_MAX_SIZE);
+    LOG_ASSERT(cfg.tags == SINK_ALL_TAGS);
+    LOG_ASSERT(cfg.events);
+    LOG_ASSERT(cfg.rate == 0);
+
+    LOG_ASSERT(sink_config_parse(&cfg, "file=/tmp/log,size=66,rate=100,tags=4+5+0x9,events=0,depth=3"));
+    LOG_ASSERT(cfg.kind == SINK_FILE);
+    LOG_ASSERT(cfg.max_size == 64);
+    LOG_ASSERT(cfg.rate == 100);
+    LOG_ASSERT(cfg.tags == ((1 << 4) | (1 << 5) | (1 << 9)));
+    LOG_ASSERT(!cfg.events);
+    LOG_ASSERT(cfg.depth == 3);
+    LOG_ASSERT(cfg.inputs == SINK_ALL_INPUTS && cfg.src == SINK_SHARED_SOURCE && cfg.dest == GROUNDSTATION);
+    LOG_ASSERT(cfg.call_sign[0] == '\0');
+
+    LOG_ASSERT(sink_config_parse(&cfg, "mq=payload,inputs=1+3,src=2,dest=0xff,call=VA3PLDPLD"));
+    LOG_ASSERT(cfg.inputs == ((1 << 1) | (1 << 3)));
+    LOG_ASSERT(cfg.src == 2 && cfg.dest == MULTICAST);
+    LOG_ASSERT(!strcmp(cfg.call_sign, "VA3PLDPLD"));
+
+    LOG_ASSERT(!sink_config_parse(&cfg, "size=64"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,file=b"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,size=8"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,tags=4+"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,tags=32"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,colour=red"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,depth"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,history=129"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,inputs=4"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,src=256"));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,dest="));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,call="));
+    LOG_ASSERT(!sink_config_parse(&cfg, "mq=a,call=VA3PLDPLDP"));
+
+    return true;
+}
+
+/**
+ * Test that each sink gets the blocks its tag filter accepts, in packets no larger than its maximum size, numbered by
+ * its own sequence counter.
+ */
+bool test_filter_and_size(void) {
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    char spec[64];
+    snprintf(spec, sizeof(spec), "file=%s", paths[0]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+    snprintf(spec, sizeof(spec), "file=%s,size=40,tags=5,events=0", paths[1]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 10.0f};
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 20.0f};
+    for (int i = 0; i < 50; i++) {
+        uint16_t n = encode_block(block, i % 2 ? &alt : &temp, i);
+        fanout_offer(&f, block, n, i % 2 ? TAG_ALTITUDE_REL : TAG_TEMPERATURE, 0, 0, i);
+    }
+    LOG_ASSERT(fanout_event_room(&f) == BLOCK_MAX_SIZE);
+    fanout_close(&f, 0);
+
+    // Everything for the first sink, only altitude for the second, at most 2 blocks per 40 byte packet
+    int packets;
+    LOG_ASSERT(read_back(paths[0], PACKET_MAX_SIZE, &packets) == 50);
+    LOG_ASSERT(packets == (int)*seqstate_counter(&seq, 0));
+    LOG_ASSERT(read_back(paths[1], 40, &packets) == 25);
+    LOG_ASSERT(packets == 13);
+    LOG_ASSERT(*seqstate_counter(&seq, 1) == 13);
+    LOG_ASSERT(f.sinks[1].sent == 13);
+
+    return true;
+}
+
+/**
+ * Test that a sink's rate budget drops blocks for that sink only.
+ */
+bool test_rate_budget(void) {
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    char spec[64];
+    snprintf(spec, sizeof(spec), "file=%s", paths[0]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+    snprintf(spec, sizeof(spec), "file=%s,rate=100", paths[1]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    // 12 byte blocks every 10 ms for 2 seconds: 1200 bytes per second offered, 100 per second allowed
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 10.0f};
+    for (uint32_t t = 0; t < 2000; t += 10) {
+        uint16_t n = encode_block(block, &alt, t);
+        fanout_offer(&f, block, n, TAG_ALTITUDE_REL, 0, 0, 5000 + t);
+    }
+    fanout_close(&f, 0);
+
+    int packets;
+    LOG_ASSERT(read_back(paths[0], PACKET_MAX_SIZE, &packets) == 200);
+    LOG_ASSERT(f.sinks[0].dropped_rate == 0);
+
+    // One second burst and then two seconds worth of refill, including the packet headers
+    int blocks = read_back(paths[1], PACKET_MAX_SIZE, &packets);
+    LOG_ASSERT(blocks > 0);
+    LOG_ASSERT(blocks * 12 + packets * (int)sizeof(PacketHeader) <= 300);
+    LOG_ASSERT(blocks + (int)f.sinks[1].dropped_rate == 200);
+
+    return true;
+}
+
+/**
+ * Test that a sink's rate budget is charged for the header each packet is actually sent with, and only for blocks that
+ * make it into a packet, and that a sink without a rate limit never runs its budget down.
+ */
+bool test_rate_accounting(void) {
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    char spec[96];
+    snprintf(spec, sizeof(spec), "file=%s,size=%zu,rate=10000,history=4", paths[0], SINK_MIN_SIZE);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 1000, 0));
+    snprintf(spec, sizeof(spec), "file=%s,history=4", paths[1]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    // Only the first packet has a full header, the others are compact
+    uint8_t block[BLOCK_MAX_SIZE];
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 10.0f};
+    const uint16_t n = encode_block(block, &alt, 0);
+    for (int i = 0; i < 40; i++) {
+        fanout_offer(&f, block, n, TAG_ALTITUDE_REL, 0, 0, 5000);
+    }
+    const Sink *s = &f.sinks[0];
+    LOG_ASSERT(s->sent > 1);
+    const uint32_t bytes = 40 * n + sizeof(PacketHeader) + s->sent * sizeof(CompactPacketHeader);
+    LOG_ASSERT(s->tokens == (10000 - bytes) * 1000);
+
+    // A block dropped for not fitting in a packet takes nothing out of the budget
+    memset(block, 0, sizeof(block));
+    block_header_init((BlockHeader *)block, BLOCK_MAX_SIZE - sizeof(BlockHeader), TYPE_DATA, DATA_DBG_MSG,
+                      GROUNDSTATION);
+    fanout_offer(&f, block, BLOCK_MAX_SIZE, SINK_TAG_EVENT, 0, 0, 5000);
+    LOG_ASSERT(s->dropped_size == 1);
+    LOG_ASSERT(s->tokens == (10000 - bytes) * 1000);
+
+    // Resending from the history of a sink without a rate limit leaves its budget alone
+    LOG_ASSERT(fanout_resend(&f, &(ResendRequest){.sink = 1, .count = 0, .subtypes = RESEND_ALL_SUBTYPES}) > 0);
+    fanout_close(&f, 0);
+    LOG_ASSERT(f.sinks[1].history.resent > 0);
+    LOG_ASSERT(f.sinks[1].tokens == 0);
+
+    return true;
+}
+
+/**
+ * Test that each sink builds its own stream: packets with its own source address and call sign, blocks addressed to its
+ * destination and sensor blocks only from its input queues, while event blocks go to every stream.
+ */
+bool test_streams(void) {
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    char spec[96];
+    snprintf(spec, sizeof(spec), "file=%s,inputs=0", paths[0]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+    snprintf(spec, sizeof(spec), "file=%s,inputs=1+2,src=2,dest=255,call=VA3PLD", paths[1]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t temp = {.type = TAG_TEMPERATURE, .data.FLOAT = 20.0f};
+    for (uint8_t input = 0; input < 4; input++) {
+        uint16_t n = encode_block(block, &temp, input);
+        fanout_offer(&f, block, n, TAG_TEMPERATURE, input, 0, input);
+    }
+    uint16_t n = encode_block(block, &temp, 9);
+    fanout_offer(&f, block, n, SINK_TAG_EVENT, 3, 0, 9);
+    fanout_close(&f, 0);
+
+    static const struct {
+        const char *call_sign;
+        uint8_t src;
+        uint8_t dest;
+        uint32_t times[3];
+    } expected[] = {
+        {"VA3ZZZ", ROCKET, GROUNDSTATION, {0, 9}},
+        {"VA3PLD", 2, MULTICAST, {1, 2, 9}},
+    };
+    for (int i = 0; i < 2; i++) {
+        uint8_t buf[PACKET_MAX_SIZE];
+        int fd = open(paths[i], O_RDONLY);
+        ssize_t len = read(fd, buf, sizeof(buf));
+        close(fd);
+        LOG_ASSERT(len > 0 && len == packet_get_length(buf));
+
+        const PacketHeader *p = (const PacketHeader *)buf;
+        LOG_ASSERT(!strncmp(p->call_sign, expected[i].call_sign, sizeof(p->call_sign)));
+        LOG_ASSERT(p->src_addr == expected[i].src && p->packet_num == 0);
+
+        BlockIterator it;
+        const BlockHeader *h;
+        const uint8_t *payload;
+        int blocks = 0;
+        LOG_ASSERT(block_iter_init(&it, buf, len));
+        while (block_iter_next(&it, &h, &payload) == 1) {
+            LOG_ASSERT(h->dest_addr == expected[i].dest);
+            LOG_ASSERT(((const TemperatureDB *)payload)->mission_time == expected[i].times[blocks]);
+            blocks++;
+        }
+        LOG_ASSERT(blocks == 3 - (i == 0));
+    }
+
+    return true;
+}
+
+/**
+ * Test that a block too large for an empty packet of a sink is dropped and counted by that sink, without writing
+ * outside its packet, while sinks with room for it still send it.
+ */
+bool test_oversized_block(void) {
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    char spec[64];
+    snprintf(spec, sizeof(spec), "file=%s,size=%zu", paths[0], SINK_MIN_SIZE);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+    snprintf(spec, sizeof(spec), "file=%s", paths[1]);
+    LOG_ASSERT(sink_config_parse(&cfg, spec));
+    LOG_ASSERT(fanout_add(&f, &cfg, 0, 0));
+
+    uint8_t block[BLOCK_MAX_SIZE];
+    memset(block, 0, sizeof(block));
+    block_header_init((BlockHeader *)block, BLOCK_MAX_SIZE - sizeof(BlockHeader), TYPE_DATA, DATA_DBG_MSG,
+                      GROUNDSTATION);
+    fanout_offer(&f, block, BLOCK_MAX_SIZE, SINK_TAG_EVENT, 0, 0, 0);
+    LOG_ASSERT(f.sinks[0].dropped_size == 1 && f.sinks[1].dropped_size == 0);
+    LOG_ASSERT(f.accepted == 1);
+    LOG_ASSERT(f.sinks[0].builder.len == sizeof(PacketHeader));
+    fanout_close(&f, 0);
+
+    int packets;
+    LOG_ASSERT(read_back(paths[0], SINK_MIN_SIZE, &packets) == 0 && packets == 0);
+    LOG_ASSERT(read_back(paths[1], PACKET_MAX_SIZE, &packets) == 1 && packets == 1);
+
+    return true;
+}
+
+/**
+ * Test that a message queue sink whose queue is full drops packets instead of blocking.
+ */
+bool test_full_queue_does_not_block(void) {
+
+    arena_init(&arena, memory, sizeof(memory));
+    fixture_fanout(&arena);
+
+    SinkConfig cfg;
+    LOG_ASSERT(sink_config_parse(&cfg, "mq=/test_sink_queue,depth=1,size=32"));
+    mq_unlink(cfg.target);
+    if (!fanout_add(&f, &cfg, 0, 0)) {
+        puts("Message queues are not available, skipping");
+        return true;
+    }
+
+    uint8_t block[ENCODED_BLOCK_MAX_SIZE];
+    const common_t alt = {.type = TAG_ALTITUDE_REL, .data.FLOAT = 10.0f};
+    for (int i = 0; i < 10; i++) {
+        uint16_t n = encode_block(block, &alt, i);
+        fanout_offer(&f, block, n, TAG_ALTITUDE_REL, 0, 0, i);
+    }
+    LOG_ASSERT(f.sinks[0].sent == 1);
+    LOG_ASSERT(f.sinks[0].dropped_full == 8);
+    LOG_ASSERT(f.errors == 0);
+
+    fanout_close(&f, 0);
+    mq_unlink(cfg.target);
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    for (int i = 0; i < 2; i++) {
+        int fd = mkstemp(paths[i]);
+        if (fd != -1) close(fd);
+    }
+
+    RUN_TEST(test_parse);
+    RUN_TEST(test_filter_and_size);
+    RUN_TEST(test_rate_budget);
+    RUN_TEST(test_rate_accounting);
+    RUN_TEST(test_streams);
+    RUN_TEST(test_oversized_block);
+    RUN_TEST(test_full_queue_does_not_block);
+
+    for (int i = 0; i < 2; i++) {
+        unlink(paths[i]);
+    }
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file test_snapshot.c
+ * @brief Tests publishing the latest readings in the shared memory table and reading them back from another process.
+ */
+#include "../src/intypes.h"
+#include "../src/snapshot.h"
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Name of the shared memory object used by the tests. */
+#define SNAPSHOT_NAME "/test_snapshot"
+
+/** Publishing side of the table, reopened by each test. */
+static Snapshot s;
+
+/**
+ * Test that published readings can be found and read by tag and sensor ID, with the latest reading replacing earlier
+ * ones.
+ */
+bool test_publish_read(void) {
+
+    LOG_ASSERT(snapshot_open(&s, SNAPSHOT_NAME));
+    const SnapshotTable *t = snapshot_attach(SNAPSHOT_NAME);
+    LOG_ASSERT(t != NULL);
+    LOG_ASSERT(t->live == 1);
+    LOG_ASSERT(snapshot_find(t, TAG_TEMPERATURE, 0) == NULL);
+
+    const common_t first = {.type = TAG_TEMPERATURE, .id = 0, .data.FLOAT = 21.5f};
+    const common_t second = {.type = TAG_TEMPERATURE, .id = 0, .data.FLOAT = 22.0f};
+    const common_t other = {.type = TAG_TEMPERATURE, .id = 1, .data.FLOAT = -3.0f};
+    snapshot_publish(&s, &first, 100);
+    snapshot_publish(&s, &other, 110);
+    snapshot_publish(&s, &second, 120);
+
+    common_t msg;
+    uint32_t time;
+    const SnapshotEntry *e = snapshot_find(t, TAG_TEMPERATURE, 0);
+    LOG_ASSERT(e != NULL);
+    snapshot_read(e, &msg, &time);
+    LOG_ASSERT(!memcmp(&msg, &second, sizeof(msg)));
+    LOG_ASSERT(time == 120);
+
+    e = snapshot_find(t, TAG_TEMPERATURE, 1);
+    LOG_ASSERT(e != NULL);
+    snapshot_read(e, &msg, &time);
+    LOG_ASSERT(!memcmp(&msg, &other, sizeof(msg)));
+    LOG_ASSERT(time == 110);
+    LOG_ASSERT(atomic_load(&t->count) == 2);
+
+    snapshot_close(&s);
+    LOG_ASSERT(t->live == 0);
+    snapshot_detach(t);
+
+    return true;
+}
+
+/**
+ * Test that reopening the table starts a new generation with no entries.
+ */
+bool test_generation(void) {
+
+    LOG_ASSERT(snapshot_open(&s, SNAPSHOT_NAME));
+    const common_t msg = {.type = TAG_PRESSURE, .data.FLOAT = 101.3f};
+    snapshot_publish(&s, &msg, 0);
+    const SnapshotTable *t = snapshot_attach(SNAPSHOT_NAME);
+    LOG_ASSERT(t != NULL);
+    const uint32_t generation = t->generation;
+    snapshot_close(&s);
+
+    // The last readings stay readable after the packager shuts down
+    LOG_ASSERT(snapshot_find(t, TAG_PRESSURE, 0) != NULL);
+
+    LOG_ASSERT(snapshot_open(&s, SNAPSHOT_NAME));
+    LOG_ASSERT(t->generation == generation + 1);
+    LOG_ASSERT(snapshot_find(t, TAG_PRESSURE, 0) == NULL);
+    snapshot_close(&s);
+    snapshot_detach(t);
+
+    return true;
+}
+
+/**
+ * Test that readings of new sensors are dropped once the table is full, while known sensors keep updating, and that
+ * readings with unknown tags are not published.
+ */
+bool test_full(void) {
+
+    LOG_ASSERT(snapshot_open(&s, SNAPSHOT_NAME));
+    const SnapshotTable *t = snapshot_attach(SNAPSHOT_NAME);
+    LOG_ASSERT(t != NULL);
+
+    for (unsigned int i = 0; i <= SNAPSHOT_ENTRIES; i++) {
+        const common_t msg = {.type = TAG_VOLTAGE + i / 256, .id = i % 256, .data.I16 = i};
+        snapshot_publish(&s, &msg, i);
+    }
+    LOG_ASSERT(atomic_load(&t->count) == SNAPSHOT_ENTRIES);
+    LOG_ASSERT(s.dropped == 1);
+
+    const common_t update = {.type = TAG_VOLTAGE, .id = 5, .data.I16 = 1234};
+    snapshot_publish(&s, &update, 999);
+    common_t msg;
+    uint32_t time;
+    snapshot_read(snapshot_find(t, TAG_VOLTAGE, 5), &msg, &time);
+    LOG_ASSERT(msg.data.I16 == 1234 && time == 999);
+
+    const common_t unknown = {.type = SNAPSHOT_TAGS, .id = 0};
+    snapshot_publish(&s, &unknown, 0);
+    LOG_ASSERT(s.dropped == 1);
+    LOG_ASSERT(snapshot_find(t, SNAPSHOT_TAGS, 0) == NULL);
+
+    snapshot_close(&s);
+    snapshot_detach(t);
+
+    return true;
+}
+
+/**
+ * Test that a reader in another process never sees a torn reading while the writer updates it as fast as it can.
+ */
+bool test_concurrent(void) {
+
+    LOG_ASSERT(snapshot_open(&s, SNAPSHOT_NAME));
+    const common_t start = {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {0, 0, 0}};
+    snapshot_publish(&s, &start, 0);
+
+    pid_t writer = fork();
+    LOG_ASSERT(writer != -1);
+    if (writer == 0) {
+        for (uint32_t n = 1;; n++) {
+            const common_t msg = {.type = TAG_LINEAR_ACCEL_REL, .data.VEC3D = {n, n, n}};
+            snapshot_publish(&s, &msg, n);
+        }
+    }
+
+    const SnapshotTable *t = snapshot_attach(SNAPSHOT_NAME);
+    LOG_ASSERT(t != NULL);
+    const SnapshotEntry *e = snapshot_find(t, TAG_LINEAR_ACCEL_REL, 0);
+    LOG_ASSERT(e != NULL);
+
+    bool consistent = true;
+    uint32_t last = 0;
+    for (unsigned int i = 0; i < 1000000 && consistent; i++) {
+        common_t msg;
+        uint32_t time;
+        snapshot_read(e, &msg, &time);
+        const float n = (float)time;
+        consistent = msg.data.VEC3D.x == n && msg.data.VEC3D.y == n && msg.data.VEC3D.z == n && time >= last;
+        last = time;
+    }
+
+    kill(writer, SIGKILL);
+    waitpid(writer, NULL, 0);
+    snapshot_close(&s);
+    snapshot_detach(t);
+    LOG_ASSERT(consistent);
+    LOG_ASSERT(last > 0); // The writer made progress while being read
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_publish_read);
+    RUN_TEST(test_generation);
+    RUN_TEST(test_full);
+    RUN_TEST(test_concurrent);
+
+    shm_unlink(SNAPSHOT_NAME);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
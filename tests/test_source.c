@@ -0,0 +1,155 @@
+/**
+ * @file test_source.c
+ * @brief Tests that the messages of each input queue only update the mission time, GPS fix, flight phase and estimator
+ * of that queue.
+ */
+#include "../src/events.h"
+#include "../src/flight_phase.h"
+#include "../src/intypes.h"
+#include "../src/source.h"
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** Event channel used by the tests. */
+static EventChannel c;
+
+/** The states of the two inputs of the tests, the avionics bay and the payload. */
+static Source sources[2];
+
+/**
+ * Sets up two inputs with an empty event channel.
+ * @param fusion_rate The number of estimates per second, or 0 to disable fusion.
+ */
+static void setup(const uint32_t fusion_rate) {
+    event_channel_init(&c, 100, 10, 0);
+    source_init(&sources[0], 0, fusion_rate);
+    source_init(&sources[1], 1, fusion_rate);
+}
+
+/**
+ * Feeds a message to an input.
+ * @param i The index of the input.
+ * @param msg The message.
+ * @return What to send for the message.
+ */
+static SourceAction feed(const uint8_t i, const common_t msg) { return source_update(&sources[i], &msg, &c, false); }
+
+/**
+ * Test that two inputs with unrelated clocks that interleave time messages each stamp their readings with their own
+ * mission time.
+ */
+bool test_interleaved_time(void) {
+
+    setup(0);
+    LOG_ASSERT(sources[0].mission_time == 0 && sources[1].mission_time == 0);
+
+    for (uint32_t t = 0; t < 100; t++) {
+        LOG_ASSERT(feed(0, (common_t){.type = TAG_TIME, .data.U32 = 600000 + t * 10}) == SOURCE_SKIP);
+        LOG_ASSERT(feed(1, (common_t){.type = TAG_TIME, .data.U32 = t * 50}) == SOURCE_SKIP);
+        LOG_ASSERT(feed(0, (common_t){.type = TAG_PRESSURE, .data.FLOAT = 101.3f}) == SOURCE_ENCODE);
+        LOG_ASSERT(sources[0].mission_time == 600000 + t * 10);
+        LOG_ASSERT(feed(1, (common_t){.type = TAG_PRESSURE, .data.FLOAT = 101.3f}) == SOURCE_ENCODE);
+        LOG_ASSERT(sources[1].mission_time == t * 50);
+    }
+    LOG_ASSERT(c.queued == 0);
+
+    return true;
+}
+
+/**
+ * Test that the altitude of one input moves only its own flight phase, and that the transition event carries the index
+ * of the input and its mission time.
+ */
+bool test_phase_per_source(void) {
+
+    setup(0);
+    feed(0, (common_t){.type = TAG_TIME, .data.U32 = 600000});
+    for (uint32_t t = 1000; t < 1100; t += 10) {
+        feed(1, (common_t){.type = TAG_TIME, .data.U32 = t});
+        feed(1, (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = 100.0f});
+        feed(0, (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = 0.0f});
+    }
+
+    LOG_ASSERT(sources[0].detector.phase == PHASE_PAD);
+    LOG_ASSERT(sources[1].detector.phase == PHASE_BOOST);
+    LOG_ASSERT(c.queued == 1);
+    const Event *e = &c.queue[c.head];
+    LOG_ASSERT(e->category == EVENT_PHASE);
+    LOG_ASSERT(e->arg == (1 << 8 | PHASE_BOOST));
+    LOG_ASSERT(e->mission_time >= 1000 && e->mission_time < 1100);
+    LOG_ASSERT(!strcmp(event_string(&c, e->string_id), "BOOST"));
+
+    return true;
+}
+
+/**
+ * Test that GPS fix changes are tracked per input, so that both receivers report their first fix and a repeated fix
+ * reports nothing.
+ */
+bool test_fix_per_source(void) {
+
+    setup(0);
+    LOG_ASSERT(feed(0, (common_t){.type = TAG_FIX, .data.U8 = 3}) == SOURCE_SKIP);
+    LOG_ASSERT(feed(1, (common_t){.type = TAG_FIX, .data.U8 = 3}) == SOURCE_SKIP);
+    LOG_ASSERT(feed(0, (common_t){.type = TAG_FIX, .data.U8 = 3}) == SOURCE_SKIP);
+    LOG_ASSERT(c.queued == 2);
+    LOG_ASSERT(c.queue[c.head].arg == 3);
+    LOG_ASSERT(c.queue[(c.head + 1) % EVENT_QUEUE_LEN].arg == (1 << 8 | 3));
+
+    return true;
+}
+
+/**
+ * Test that the altitude of one input only feeds its own estimator.
+ */
+bool test_fusion_per_source(void) {
+
+    setup(10);
+    Fusion untouched;
+    memcpy(&untouched, &sources[0].fusion, sizeof(untouched));
+
+    SourceAction action = SOURCE_SKIP;
+    for (uint32_t t = 0; t < 1000; t += 10) {
+        feed(1, (common_t){.type = TAG_TIME, .data.U32 = t});
+        const SourceAction a = feed(1, (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = 1.0f});
+        LOG_ASSERT(a != SOURCE_ENCODE);
+        if (a == SOURCE_ESTIMATES) action = a;
+    }
+
+    LOG_ASSERT(action == SOURCE_ESTIMATES);
+    LOG_ASSERT(sources[1].fusion.ready);
+    LOG_ASSERT(!memcmp(&untouched, &sources[0].fusion, sizeof(untouched)));
+
+    // Acceleration readings feed the estimator and are still sent as they are
+    const common_t accel = {.type = TAG_LINEAR_ACCEL_ABS, .data.VEC3D = {0.0f, 0.0f, 1.0f}};
+    const uint32_t samples = sources[1].fusion.samples;
+    LOG_ASSERT(feed(1, accel) & SOURCE_ENCODE);
+    LOG_ASSERT(sources[1].fusion.samples == samples + 1);
+
+    // Without fusion the same readings are sent as they are
+    setup(0);
+    LOG_ASSERT(feed(1, (common_t){.type = TAG_ALTITUDE_REL, .data.FLOAT = 1.0f}) == SOURCE_ENCODE);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_interleaved_time);
+    RUN_TEST(test_phase_per_source);
+    RUN_TEST(test_fix_per_source);
+    RUN_TEST(test_fusion_per_source);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file test_trace.c
+ * @brief Tests recording spans at tracepoints and exporting them as a Chrome trace.
+ */
+#include "../src/trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+// Define appropriate variables for tracking test statistics within macros
+#define TOTAL_COUNT total
+#define FAIL_COUNT failed
+// Include harness
+#include "harness.h"
+
+/** The file the tests export traces to. */
+#define TRACE_PATH "/tmp/test_trace.json"
+
+/**
+ * Counts the occurrences of a string in the exported trace.
+ * @param needle The string to count.
+ * @return The number of occurrences, or -1 if the trace could not be read.
+ */
+static int count_in_trace(const char *needle) {
+    static char buf[4 * 1024 * 1024];
+    FILE *f = fopen(TRACE_PATH, "r");
+    if (f == NULL) return -1;
+    const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    int count = 0;
+    for (const char *p = buf; (p = strstr(p, needle)) != NULL; p++) count++;
+    return count;
+}
+
+/**
+ * Test that spans are recorded with their tracepoint, argument and an end after their start.
+ */
+bool test_record(void) {
+
+    trace_reset();
+    TRACE_START(outer);
+    TRACE_START(inner);
+    TRACE_SPAN(TRACE_ENCODE, inner, 7);
+    TRACE_SPAN(TRACE_PROCESS, outer, 9);
+
+    LOG_ASSERT(trace_ring != NULL);
+    LOG_ASSERT(atomic_load(&trace_ring->head) == 2);
+    const TraceEvent *e = &trace_ring->events[0];
+    LOG_ASSERT(e->point == TRACE_ENCODE && e->arg == 7 && e->end >= e->start);
+    e = &trace_ring->events[1];
+    LOG_ASSERT(e->point == TRACE_PROCESS && e->arg == 9 && e->start <= trace_ring->events[0].start);
+    LOG_ASSERT(e->end >= trace_ring->events[0].end);
+
+    return true;
+}
+
+/**
+ * Test that the export is a Chrome trace with one complete event per span, and only the newest spans once the ring
+ * has wrapped around.
+ */
+bool test_export(void) {
+
+    trace_init();
+    trace_reset();
+    for (uint32_t i = 0; i < 3; i++) {
+        TRACE_START(t);
+        TRACE_SPAN(TRACE_SEND, t, i);
+    }
+    LOG_ASSERT(trace_export(TRACE_PATH));
+    LOG_ASSERT(count_in_trace("\"traceEvents\":[") == 1);
+    LOG_ASSERT(count_in_trace("\"ph\":\"X\"") == 3);
+    LOG_ASSERT(count_in_trace("\"name\":\"send\"") == 3);
+    LOG_ASSERT(count_in_trace("\"args\":{\"arg\":2}}") == 1);
+    LOG_ASSERT(count_in_trace("\n]}\n") == 1);
+
+    for (uint32_t i = 0; i < TRACE_RING_EVENTS + 10; i++) {
+        TRACE_START(t);
+        TRACE_SPAN(TRACE_RECEIVE, t, i);
+    }
+    LOG_ASSERT(trace_export(TRACE_PATH));
+    LOG_ASSERT(count_in_trace("\"ph\":\"X\"") == TRACE_RING_EVENTS);
+    LOG_ASSERT(count_in_trace("\"name\":\"send\"") == 0);
+    LOG_ASSERT(count_in_trace("\"args\":{\"arg\":9}}") == 0);
+    LOG_ASSERT(count_in_trace("\"args\":{\"arg\":10}}") == 1);
+    remove(TRACE_PATH);
+
+    LOG_ASSERT(!trace_export("/nonexistent/trace.json"));
+
+    return true;
+}
+
+/**
+ * Records spans from another thread.
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *record_thread(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < 100; i++) {
+        TRACE_START(t);
+        TRACE_SPAN(TRACE_FANOUT, t, i);
+    }
+    return NULL;
+}
+
+/**
+ * Test that every thread records into its own ring, which is exported as its own thread.
+ */
+bool test_threads(void) {
+
+    trace_reset();
+    TRACE_START(t);
+    TRACE_SPAN(TRACE_PRINT, t, 0);
+
+    pthread_t thread;
+    LOG_ASSERT(pthread_create(&thread, NULL, record_thread, NULL) == 0);
+    pthread_join(thread, NULL);
+    LOG_ASSERT(atomic_load(&trace_ring->head) == 1);
+
+    LOG_ASSERT(trace_export(TRACE_PATH));
+    LOG_ASSERT(count_in_trace("\"name\":\"thread_name\"") == 2);
+    LOG_ASSERT(count_in_trace("\"name\":\"fanout\",\"cat\":\"packager\",\"ph\":\"X\"") == 100);
+    LOG_ASSERT(count_in_trace("\"tid\":2,\"ts\"") == 100);
+    remove(TRACE_PATH);
+
+    return true;
+}
+
+int main(void) {
+
+    // Track test statistics
+    size_t total = 0;
+    size_t failed = 0;
+
+    RUN_TEST(test_record);
+    RUN_TEST(test_export);
+    RUN_TEST(test_threads);
+
+    HARNESS_RESULTS();
+
+    return EXIT_SUCCESS;
+}